@@ -0,0 +1,52 @@
+// Copyright (c) 2024 Aniket Ray
+//
+// Licensed under the MIT License; see LICENSE.txt.
+
+#include "arena.h"
+
+#include <stdlib.h>
+
+#include "util.h"
+
+using namespace std;
+
+namespace {
+
+/// Small enough not to matter for a tiny State, large enough that a
+/// million nodes take a few hundred blocks.
+const size_t kBlockSize = 256 * 1024;
+
+}  // anonymous namespace
+
+Arena::~Arena() {
+  for (vector<char*>::iterator i = blocks_.begin(); i != blocks_.end(); ++i)
+    free(*i);
+}
+
+void* Arena::AllocateSlow(size_t size, size_t align) {
+  // Oversized requests get a block of their own, leaving the current one
+  // to be filled.
+  size_t block_size = size + align > kBlockSize / 4 ? size + align : kBlockSize;
+  char* block = static_cast<char*>(malloc(block_size));
+  if (!block)
+    Fatal("out of memory");
+  blocks_.push_back(block);
+  reserved_ += block_size;
+
+  char* p = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(block) + align - 1) & ~(align - 1));
+  if (block_size == kBlockSize) {
+    ptr_ = p + size;
+    end_ = block + block_size;
+  }
+  used_ += size;
+  return p;
+}
+
+void Arena::Adopt(Arena* other) {
+  blocks_.insert(blocks_.end(), other->blocks_.begin(), other->blocks_.end());
+  used_ += other->used_;
+  reserved_ += other->reserved_;
+  other->blocks_.clear();
+  other->ptr_ = other->end_ = nullptr;
+  other->used_ = other->reserved_ = 0;
+}
@@ -0,0 +1,109 @@
+// Copyright (c) 2024 Aniket Ray
+//
+// Licensed under the MIT License; see LICENSE.txt.
+
+#ifndef NINJA_ARENA_H_
+#define NINJA_ARENA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/// A bump allocator for objects that all die together, such as the nodes
+/// and edges of a State.  Memory comes from large blocks that are only
+/// released when the Arena is destroyed; it never runs destructors, so its
+/// owner must destroy what it put there.
+struct Arena {
+  Arena() {}
+  ~Arena();
+
+  /// Return \a size bytes aligned to \a align, which must be a power of two.
+  void* Allocate(size_t size, size_t align) {
+    char* p = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(ptr_) + align - 1) & ~(align - 1));
+    if (p + size > end_)
+      return AllocateSlow(size, align);
+    ptr_ = p + size;
+    used_ += size;
+    return p;
+  }
+
+  /// Construct a T in the arena.
+  template <typename T, typename... Args>
+  T* New(Args&&... args) {
+    return new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+  }
+
+  /// Take over the blocks of \a other, leaving it empty, so that what was
+  /// allocated from it lives as long as this arena.
+  void Adopt(Arena* other);
+
+  /// Bytes handed out, and bytes held in blocks.
+  size_t used() const { return used_; }
+  size_t reserved() const { return reserved_; }
+  size_t blocks() const { return blocks_.size(); }
+
+ private:
+  void* AllocateSlow(size_t size, size_t align);
+
+  std::vector<char*> blocks_;
+  char* ptr_ = nullptr;
+  char* end_ = nullptr;
+  size_t used_ = 0;
+  size_t reserved_ = 0;
+
+  Arena(const Arena&);
+  void operator=(const Arena&);
+};
+
+/// An allocator that takes memory from an Arena, for containers owned by
+/// objects in that arena, or from the heap if it has no arena.  Memory
+/// freed into an arena is only reclaimed with the arena, so it suits
+/// containers that mostly grow, like the edge lists of the graph.
+template <typename T>
+struct ArenaAllocator {
+  typedef T value_type;
+  /// Moving or swapping a container moves its memory, so its allocator
+  /// must come along.
+  typedef std::true_type propagate_on_container_move_assignment;
+  typedef std::true_type propagate_on_container_swap;
+
+  ArenaAllocator() {}
+  explicit ArenaAllocator(Arena* arena) : arena_(arena) {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.arena()) {}
+
+  T* allocate(size_t n) {
+    if (arena_)
+      return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T)));
+    return std::allocator<T>().allocate(n);
+  }
+
+  void deallocate(T* p, size_t n) {
+    if (!arena_)
+      std::allocator<T>().deallocate(p, n);
+  }
+
+  Arena* arena() const { return arena_; }
+
+  template <typename U>
+  bool operator==(const ArenaAllocator<U>& other) const {
+    return arena_ == other.arena();
+  }
+  template <typename U>
+  bool operator!=(const ArenaAllocator<U>& other) const {
+    return arena_ != other.arena();
+  }
+
+ private:
+  Arena* arena_ = nullptr;
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+#endif  // NINJA_ARENA_H_
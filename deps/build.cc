@@ -33,6 +33,7 @@
 #include "deps_log.h"
 #include "disk_interface.h"
 #include "graph.h"
+#include "jobserver.h"
 #include "metrics.h"
 #include "state.h"
 #include "status.h"
@@ -48,7 +49,7 @@ struct DryRunCommandRunner : public CommandRunner {
   virtual ~DryRunCommandRunner() {}
 
   // Overridden from CommandRunner:
-  virtual size_t CanRunMore() const;
+  virtual size_t CanRunMore();
   virtual bool StartCommand(Edge* edge);
   virtual bool WaitForCommand(Result* result);
 
@@ -56,7 +57,7 @@ struct DryRunCommandRunner : public CommandRunner {
   queue<Edge*> finished_;
 };
 
-size_t DryRunCommandRunner::CanRunMore() const {
+size_t DryRunCommandRunner::CanRunMore() {
   return SIZE_MAX;
 }
 
@@ -77,13 +78,21 @@ bool DryRunCommandRunner::WaitForCommand(Result* result) {
 
 }  // namespace
 
-Plan::Plan(Builder* builder) : builder_(builder), command_edges_(0), wanted_edges_(0) {}
+Plan::Plan(Builder* builder)
+    : memory_budget_kb_(0), admitted_memory_kb_(0), builder_(builder), command_edges_(0), wanted_edges_(0) {}
 
 void Plan::Reset() {
   command_edges_ = 0;
   wanted_edges_ = 0;
   ready_.clear();
+  deferred_.clear();
   want_.clear();
+  pending_inputs_.clear();
+  plan_edges_.clear();
+  admitted_memory_kb_ = 0;
+  admitted_kb_.clear();
+  estimate_kb_.clear();
+  rule_peak_kb_.clear();
 }
 
 bool Plan::AddTarget(const Node* target, string* err) {
@@ -102,8 +111,8 @@ bool Plan::AddSubTarget(const Node* node, const Node* dependent, string* err, se
     if (node->dirty() && !node->generated_by_dep_loader()) {
       string referenced;
       if (dependent)
-        referenced = ", needed by '" + dependent->path() + "',";
-      *err = "'" + node->path() + "'" + referenced + " missing and no known rule to make it";
+        referenced = ", needed by '" + dependent->path().AsString() + "',";
+      *err = "'" + node->path().AsString() + "'" + referenced + " missing and no known rule to make it";
     }
     return false;
   }
@@ -113,8 +122,18 @@ bool Plan::AddSubTarget(const Node* node, const Node* dependent, string* err, se
 
   // If an entry in want_ does not already exist for edge, create an entry which
   // maps to kWantNothing, indicating that we do not want to build this entry itself.
-  pair<map<Edge*, Want>::iterator, bool> want_ins = want_.insert(make_pair(edge, kWantNothing));
-  Want& want = want_ins.first->second;
+  if (edge->id_ >= want_.size()) {
+    want_.resize(edge->id_ + 1, kNotInPlan);
+    pending_inputs_.resize(edge->id_ + 1);
+    admitted_kb_.resize(edge->id_ + 1);
+    estimate_kb_.resize(edge->id_ + 1, -1);
+  }
+  Want& want = want_[edge->id_];
+  bool inserted = want == kNotInPlan;
+  if (inserted) {
+    want = kWantNothing;
+    plan_edges_.push_back(edge);
+  }
 
   if (dyndep_walk && want == kWantToFinish)
     return false;  // Don't need to do anything with already-scheduled edge.
@@ -129,17 +148,28 @@ bool Plan::AddSubTarget(const Node* node, const Node* dependent, string* err, se
   if (dyndep_walk)
     dyndep_walk->insert(edge);
 
-  if (!want_ins.second)
+  if (!inserted)
     return true;  // We've already processed the inputs.
 
-  for (vector<Node*>::iterator i = edge->inputs_.begin(); i != edge->inputs_.end(); ++i) {
+  for (ArenaVector<Node*>::iterator i = edge->inputs_.begin(); i != edge->inputs_.end(); ++i) {
     if (!AddSubTarget(*i, node, err, dyndep_walk) && !err->empty())
       return false;
   }
+  // Every producer of an input is now either in the plan or ready.
+  pending_inputs_[edge->id_] = CountPendingInputs(edge);
 
   return true;
 }
 
+int Plan::CountPendingInputs(const Edge* edge) const {
+  int pending = 0;
+  for (ArenaVector<Node*>::const_iterator i = edge->inputs_.begin(); i != edge->inputs_.end(); ++i) {
+    if ((*i)->in_edge() && InPlan((*i)->in_edge()))
+      ++pending;
+  }
+  return pending;
+}
+
 void Plan::EdgeWanted(const Edge* edge) {
   ++wanted_edges_;
   if (!edge->is_phony()) {
@@ -153,23 +183,67 @@ Edge* Plan::FindWork() {
   if (ready_.empty())
     return NULL;
 
-  Edge* work = ready_.top();
-  ready_.pop();
-  return work;
+  if (memory_budget_kb_ <= 0) {
+    Edge* work = ready_.top();
+    ready_.pop();
+    return work;
+  }
+
+  // Take the most urgent edge that fits in what the running commands leave
+  // of the budget.  Any edge fits when none is running, so that one larger
+  // than the whole budget still runs, alone.  Those that do not fit wait in
+  // deferred_ until a running command frees some memory.
+  while (!ready_.empty()) {
+    Edge* edge = ready_.top();
+    ready_.pop();
+    int64_t estimate = estimate_kb_[edge->id_];
+    if (estimate < 0)
+      estimate = estimate_kb_[edge->id_] = EstimateMemory(edge);
+    if (admitted_memory_kb_ == 0 || admitted_memory_kb_ + estimate <= memory_budget_kb_) {
+      admitted_kb_[edge->id_] = estimate;
+      admitted_memory_kb_ += estimate;
+      return edge;
+    }
+    deferred_.push_back(edge);
+  }
+  return NULL;
 }
 
-void Plan::ScheduleWork(map<Edge*, Want>::iterator want_e) {
-  if (want_e->second == kWantToFinish) {
+void Plan::RequeueDeferred() {
+  vector<Edge*>::iterator kept = deferred_.begin();
+  for (vector<Edge*>::iterator e = deferred_.begin(); e != deferred_.end(); ++e) {
+    if (admitted_memory_kb_ == 0 || admitted_memory_kb_ + estimate_kb_[(*e)->id_] <= memory_budget_kb_)
+      ready_.push(*e);
+    else
+      *kept++ = *e;
+  }
+  deferred_.erase(kept, deferred_.end());
+}
+
+int64_t Plan::EstimateMemory(const Edge* edge) const {
+  if (edge->is_phony())
+    return 0;
+  if (edge->prev_peak_rss_kb > 0)
+    return edge->prev_peak_rss_kb;
+  int64_t kb;
+  if (ParseMemorySize(edge->GetBinding("memory"), &kb))
+    return kb;
+  map<const Rule*, int64_t>::const_iterator i = rule_peak_kb_.find(&edge->rule());
+  return i == rule_peak_kb_.end() ? 0 : i->second;
+}
+
+void Plan::ScheduleWork(Edge* edge) {
+  Want& want = want_[edge->id_];
+  if (want == kWantToFinish) {
     // This edge has already been scheduled.  We can get here again if an edge
     // and one of its dependencies share an order-only input, or if a node
     // duplicates an out edge (see https://github.com/ninja-build/ninja/pull/519).
     // Avoid scheduling the work again.
     return;
   }
-  assert(want_e->second == kWantToStart);
-  want_e->second = kWantToFinish;
+  assert(want == kWantToStart);
+  want = kWantToFinish;
 
-  Edge* edge = want_e->first;
   Pool* pool = edge->pool();
   if (pool->ShouldDelayEdge()) {
     pool->DelayEdge(edge);
@@ -181,9 +255,15 @@ void Plan::ScheduleWork(map<Edge*, Want>::iterator want_e) {
 }
 
 bool Plan::EdgeFinished(Edge* edge, EdgeResult result, string* err) {
-  map<Edge*, Want>::iterator e = want_.find(edge);
-  assert(e != want_.end());
-  bool directly_wanted = e->second != kWantNothing;
+  assert(InPlan(edge));
+  bool directly_wanted = want_[edge->id_] != kWantNothing;
+
+  // Whatever the result, the edge's memory is free again.
+  if (edge->id_ < admitted_kb_.size() && admitted_kb_[edge->id_] > 0) {
+    admitted_memory_kb_ -= admitted_kb_[edge->id_];
+    admitted_kb_[edge->id_] = 0;
+    RequeueDeferred();
+  }
 
   // See if this job frees up any delayed jobs.
   if (directly_wanted)
@@ -196,11 +276,20 @@ bool Plan::EdgeFinished(Edge* edge, EdgeResult result, string* err) {
 
   if (directly_wanted)
     --wanted_edges_;
-  want_.erase(e);
+  want_[edge->id_] = kNotInPlan;
   edge->outputs_ready_ = true;
 
+  // Count the outputs off the edges waiting for them, all before any of
+  // them loads dyndep info and recounts.
+  for (ArenaVector<Node*>::iterator o = edge->outputs_.begin(); o != edge->outputs_.end(); ++o) {
+    for (ArenaVector<Edge*>::const_iterator oe = (*o)->out_edges().begin(); oe != (*o)->out_edges().end(); ++oe) {
+      if (InPlan(*oe))
+        --pending_inputs_[(*oe)->id_];
+    }
+  }
+
   // Check off any nodes we were waiting for with this edge.
-  for (vector<Node*>::iterator o = edge->outputs_.begin(); o != edge->outputs_.end(); ++o) {
+  for (ArenaVector<Node*>::iterator o = edge->outputs_.begin(); o != edge->outputs_.end(); ++o) {
     if (!NodeFinished(*o, err))
       return false;
   }
@@ -217,23 +306,22 @@ bool Plan::NodeFinished(Node* node, string* err) {
   }
 
   // See if we we want any edges from this node.
-  for (vector<Edge*>::const_iterator oe = node->out_edges().begin(); oe != node->out_edges().end(); ++oe) {
-    map<Edge*, Want>::iterator want_e = want_.find(*oe);
-    if (want_e == want_.end())
+  for (ArenaVector<Edge*>::const_iterator oe = node->out_edges().begin(); oe != node->out_edges().end(); ++oe) {
+    if (!InPlan(*oe))
       continue;
 
     // See if the edge is now ready.
-    if (!EdgeMaybeReady(want_e, err))
+    if (!EdgeMaybeReady(*oe, err))
       return false;
   }
   return true;
 }
 
-bool Plan::EdgeMaybeReady(map<Edge*, Want>::iterator want_e, string* err) {
-  Edge* edge = want_e->first;
-  if (edge->AllInputsReady()) {
-    if (want_e->second != kWantNothing) {
-      ScheduleWork(want_e);
+bool Plan::EdgeMaybeReady(Edge* edge, string* err) {
+  assert(pending_inputs_[edge->id_] >= 0);
+  if (pending_inputs_[edge->id_] == 0) {
+    if (want_[edge->id_] != kWantNothing) {
+      ScheduleWork(edge);
     } else {
       // We do not need to build this edge, but we might need to build one of
       // its dependents.
@@ -247,10 +335,9 @@ bool Plan::EdgeMaybeReady(map<Edge*, Want>::iterator want_e, string* err) {
 bool Plan::CleanNode(DependencyScan* scan, Node* node, string* err) {
   node->set_dirty(false);
 
-  for (vector<Edge*>::const_iterator oe = node->out_edges().begin(); oe != node->out_edges().end(); ++oe) {
+  for (ArenaVector<Edge*>::const_iterator oe = node->out_edges().begin(); oe != node->out_edges().end(); ++oe) {
     // Don't process edges that we don't actually want.
-    map<Edge*, Want>::iterator want_e = want_.find(*oe);
-    if (want_e == want_.end() || want_e->second == kWantNothing)
+    if (!InPlan(*oe) || want_[(*oe)->id_] == kWantNothing)
       continue;
 
     // Don't attempt to clean an edge if it failed to load deps.
@@ -259,7 +346,7 @@ bool Plan::CleanNode(DependencyScan* scan, Node* node, string* err) {
 
     // If all non-order-only inputs for this edge are now clean,
     // we might have changed the dirty state of the outputs.
-    vector<Node*>::iterator begin = (*oe)->inputs_.begin(), end = (*oe)->inputs_.end() - (*oe)->order_only_deps_;
+    ArenaVector<Node*>::iterator begin = (*oe)->inputs_.begin(), end = (*oe)->inputs_.end() - (*oe)->order_only_deps_;
 #if __cplusplus < 201703L
 #define MEM_FN mem_fun
 #else
@@ -268,7 +355,7 @@ bool Plan::CleanNode(DependencyScan* scan, Node* node, string* err) {
     if (find_if(begin, end, MEM_FN(&Node::dirty)) == end) {
       // Recompute most_recent_input.
       Node* most_recent_input = NULL;
-      for (vector<Node*>::iterator i = begin; i != end; ++i) {
+      for (ArenaVector<Node*>::iterator i = begin; i != end; ++i) {
         if (!most_recent_input || (*i)->mtime() > most_recent_input->mtime())
           most_recent_input = *i;
       }
@@ -281,12 +368,12 @@ bool Plan::CleanNode(DependencyScan* scan, Node* node, string* err) {
         return false;
       }
       if (!outputs_dirty) {
-        for (vector<Node*>::iterator o = (*oe)->outputs_.begin(); o != (*oe)->outputs_.end(); ++o) {
+        for (ArenaVector<Node*>::iterator o = (*oe)->outputs_.begin(); o != (*oe)->outputs_.end(); ++o) {
           if (!CleanNode(scan, *o, err))
             return false;
         }
 
-        want_e->second = kWantNothing;
+        want_[(*oe)->id_] = kWantNothing;
         --wanted_edges_;
         if (!(*oe)->is_phony()) {
           --command_edges_;
@@ -319,11 +406,9 @@ bool Plan::DyndepsLoaded(DependencyScan* scan, const Node* node, const DyndepFil
     if (edge->outputs_ready())
       continue;
 
-    map<Edge*, Want>::iterator want_e = want_.find(edge);
-
     // If the edge has not been encountered before then nothing already in the
     // plan depends on it so we do not need to consider the edge yet either.
-    if (want_e == want_.end())
+    if (!InPlan(edge))
       continue;
 
     // This edge is already in the plan so queue it for the walk.
@@ -341,21 +426,33 @@ bool Plan::DyndepsLoaded(DependencyScan* scan, const Node* node, const DyndepFil
     }
   }
 
+  // The edges with new dyndep info have new inputs to wait for, and the
+  // users of their new outputs now wait for them.
+  for (std::vector<DyndepFile::const_iterator>::iterator oei = dyndep_roots.begin(); oei != dyndep_roots.end(); ++oei) {
+    DyndepFile::const_iterator oe = *oei;
+    pending_inputs_[oe->first->id_] = CountPendingInputs(oe->first);
+    for (vector<Node*>::const_iterator o = oe->second.implicit_outputs_.begin(); o != oe->second.implicit_outputs_.end();
+         ++o) {
+      for (ArenaVector<Edge*>::const_iterator user = (*o)->out_edges().begin(); user != (*o)->out_edges().end();
+           ++user) {
+        if (InPlan(*user))
+          pending_inputs_[(*user)->id_] = CountPendingInputs(*user);
+      }
+    }
+  }
+
   // Add out edges from this node that are in the plan (just as
   // Plan::NodeFinished would have without taking the dyndep code path).
-  for (vector<Edge*>::const_iterator oe = node->out_edges().begin(); oe != node->out_edges().end(); ++oe) {
-    map<Edge*, Want>::iterator want_e = want_.find(*oe);
-    if (want_e == want_.end())
-      continue;
-    dyndep_walk.insert(want_e->first);
+  for (ArenaVector<Edge*>::const_iterator oe = node->out_edges().begin(); oe != node->out_edges().end(); ++oe) {
+    if (InPlan(*oe))
+      dyndep_walk.insert(*oe);
   }
 
   // See if any encountered edges are now ready.
   for (set<Edge*>::iterator wi = dyndep_walk.begin(); wi != dyndep_walk.end(); ++wi) {
-    map<Edge*, Want>::iterator want_e = want_.find(*wi);
-    if (want_e == want_.end())
+    if (!InPlan(*wi))
       continue;
-    if (!EdgeMaybeReady(want_e, err))
+    if (!EdgeMaybeReady(*wi, err))
       return false;
   }
 
@@ -395,10 +492,9 @@ bool Plan::RefreshDyndepDependents(DependencyScan* scan, const Node* node, strin
     // information an output is now known to be dirty, so we want the edge.
     Edge* edge = n->in_edge();
     assert(edge && !edge->outputs_ready());
-    map<Edge*, Want>::iterator want_e = want_.find(edge);
-    assert(want_e != want_.end());
-    if (want_e->second == kWantNothing) {
-      want_e->second = kWantToStart;
+    assert(InPlan(edge));
+    if (want_[edge->id_] == kWantNothing) {
+      want_[edge->id_] = kWantToStart;
       EdgeWanted(edge);
     }
   }
@@ -406,16 +502,15 @@ bool Plan::RefreshDyndepDependents(DependencyScan* scan, const Node* node, strin
 }
 
 void Plan::UnmarkDependents(const Node* node, set<Node*>* dependents) {
-  for (vector<Edge*>::const_iterator oe = node->out_edges().begin(); oe != node->out_edges().end(); ++oe) {
+  for (ArenaVector<Edge*>::const_iterator oe = node->out_edges().begin(); oe != node->out_edges().end(); ++oe) {
     Edge* edge = *oe;
 
-    map<Edge*, Want>::iterator want_e = want_.find(edge);
-    if (want_e == want_.end())
+    if (!InPlan(edge))
       continue;
 
     if (edge->mark_ != Edge::VisitNone) {
       edge->mark_ = Edge::VisitNone;
-      for (vector<Node*>::iterator o = edge->outputs_.begin(); o != edge->outputs_.end(); ++o) {
+      for (ArenaVector<Node*>::iterator o = edge->outputs_.begin(); o != edge->outputs_.end(); ++o) {
         if (dependents->insert(*o).second)
           UnmarkDependents(*o, dependents);
       }
@@ -437,11 +532,77 @@ struct SeenBefore {
   }
 };
 
-// Heuristic for edge priority weighting.
-// Phony edges are free (0 cost), all other edges are weighted equally.
-int64_t EdgeWeightHeuristic(Edge* edge) {
-  return edge->is_phony() ? 0 : 1;
-}
+/// Edge weights for critical path scheduling, in milliseconds.
+///
+/// Phony edges are free.  Other edges weigh what they took the last time
+/// they ran, according to the build log.  Edges that never ran weigh the
+/// mean of their rule's recorded times, or failing that of all recorded
+/// times, or 1 when nothing was recorded, which makes the critical path
+/// the graph depth.
+///
+/// A pool of depth d with more than d edges to run lines them up, so each
+/// also weighs its expected wait: half of the rest of the pool's work,
+/// spread over d slots.  That starts the work feeding a busy pool early.
+struct EdgeWeights {
+  EdgeWeights(const vector<Edge*>& edges, const vector<Plan::Want>& want) {
+    int64_t total = 0;
+    int count = 0;
+    for (vector<Edge*>::const_iterator i = edges.begin(); i != edges.end(); ++i) {
+      const Edge* edge = *i;
+      if (want[edge->id_] == Plan::kNotInPlan || edge->is_phony() || edge->prev_elapsed_time_millis < 0)
+        continue;
+      Mean& rule = rule_means_[&edge->rule()];
+      rule.total += Recorded(edge);
+      ++rule.count;
+      total += Recorded(edge);
+      ++count;
+    }
+    default_ = count ? total / count : 1;
+
+    for (vector<Edge*>::const_iterator i = edges.begin(); i != edges.end(); ++i) {
+      const Edge* edge = *i;
+      Plan::Want edge_want = want[edge->id_];
+      if (edge_want == Plan::kNotInPlan || edge_want == Plan::kWantNothing || edge->is_phony() ||
+          edge->pool()->depth() <= 0)
+        continue;
+      Mean& pool = pool_loads_[edge->pool()];
+      pool.total += Estimate(edge);
+      ++pool.count;
+    }
+  }
+
+  int64_t operator()(const Edge* edge) const {
+    if (edge->is_phony())
+      return 0;
+    int64_t weight = Estimate(edge);
+    map<const Pool*, Mean>::const_iterator pool = pool_loads_.find(edge->pool());
+    if (pool != pool_loads_.end() && pool->second.count > edge->pool()->depth())
+      weight += max<int64_t>(pool->second.total - weight, 0) / (2 * edge->pool()->depth());
+    return weight;
+  }
+
+ private:
+  struct Mean {
+    int64_t total = 0;
+    int count = 0;
+  };
+
+  /// Zero-length runs still cost something.
+  static int64_t Recorded(const Edge* edge) { return max<int64_t>(edge->prev_elapsed_time_millis, 1); }
+
+  int64_t Estimate(const Edge* edge) const {
+    if (edge->prev_elapsed_time_millis >= 0)
+      return Recorded(edge);
+    map<const Rule*, Mean>::const_iterator rule = rule_means_.find(&edge->rule());
+    if (rule != rule_means_.end())
+      return rule->second.total / rule->second.count;
+    return default_;
+  }
+
+  map<const Rule*, Mean> rule_means_;
+  map<const Pool*, Mean> pool_loads_;
+  int64_t default_;
+};
 
 }  // namespace
 
@@ -454,46 +615,56 @@ void Plan::ComputeCriticalPath() {
     targets_.erase(std::remove_if(targets_.begin(), targets_.end(), seen_before), targets_.end());
   }
 
-  // Use backflow algorithm to compute the critical path for all
-  // nodes, starting from the destination nodes.
-  // XXX: ignores pools
-  std::queue<Edge*> work_queue;  // Queue, for breadth-first traversal
-  // The set of edges currently in work_queue, to avoid duplicates.
-  std::set<const Edge*> active_edges;
-  SeenBefore<Edge> seen_edge(&active_edges);
+  const EdgeWeights edge_weight_of(plan_edges_, want_);
 
+  // Use backflow algorithm to compute the critical path for all
+  // nodes, starting from the destination nodes.  A depth-first walk orders
+  // the edges so that each comes after the edges producing its inputs;
+  // walking that order backwards visits every consumer before its
+  // producers, so one pass settles each edge's weight.
+  vector<Edge*> order;
+  vector<bool> visited;
+  vector<pair<Edge*, size_t> > stack;
   for (size_t i = 0; i < targets_.size(); ++i) {
-    const Node* target = targets_[i];
-    if (Edge* in = target->in_edge()) {
-      int64_t edge_weight = EdgeWeightHeuristic(in);
-      in->set_critical_path_weight(std::max<int64_t>(edge_weight, in->critical_path_weight()));
-      if (!seen_edge(in)) {
-        work_queue.push(in);
+    Edge* in = targets_[i]->in_edge();
+    if (!in)
+      continue;
+    in->set_critical_path_weight(std::max<int64_t>(edge_weight_of(in), in->critical_path_weight()));
+    if (in->id_ >= visited.size())
+      visited.resize(in->id_ + 1);
+    if (visited[in->id_])
+      continue;
+    visited[in->id_] = true;
+    stack.push_back(make_pair(in, 0));
+    while (!stack.empty()) {
+      Edge* e = stack.back().first;
+      size_t& next_input = stack.back().second;
+      if (next_input == e->inputs_.size()) {
+        order.push_back(e);
+        stack.pop_back();
+        continue;
+      }
+      Edge* producer = e->inputs_[next_input++]->in_edge();
+      if (!producer)
+        continue;
+      if (producer->id_ >= visited.size())
+        visited.resize(producer->id_ + 1);
+      if (!visited[producer->id_]) {
+        visited[producer->id_] = true;
+        stack.push_back(make_pair(producer, 0));
       }
     }
   }
 
-  while (!work_queue.empty()) {
-    Edge* e = work_queue.front();
-    work_queue.pop();
-    // If the critical path of any dependent edges is updated, this
-    // edge may need to be processed again. So re-allow insertion.
-    active_edges.erase(e);
-
-    for (std::vector<Node*>::iterator it = e->inputs_.begin(), end = e->inputs_.end(); it != end; ++it) {
+  for (vector<Edge*>::reverse_iterator e = order.rbegin(); e != order.rend(); ++e) {
+    for (ArenaVector<Node*>::iterator it = (*e)->inputs_.begin(), end = (*e)->inputs_.end(); it != end; ++it) {
       Edge* in = (*it)->in_edge();
       if (!in) {
         continue;
       }
-      // Only process edge if this node offers a higher weighted path
-      const int64_t edge_weight = EdgeWeightHeuristic(in);
-      const int64_t proposed_weight = e->critical_path_weight() + edge_weight;
-      if (proposed_weight > in->critical_path_weight()) {
+      const int64_t proposed_weight = (*e)->critical_path_weight() + edge_weight_of(in);
+      if (proposed_weight > in->critical_path_weight())
         in->set_critical_path_weight(proposed_weight);
-        if (!seen_edge(in)) {
-          work_queue.push(in);
-        }
-      }
     }
   }
 }
@@ -503,10 +674,9 @@ void Plan::ScheduleInitialEdges() {
   assert(ready_.empty());
   std::set<Pool*> pools;
 
-  for (std::map<Edge*, Plan::Want>::iterator it = want_.begin(), end = want_.end(); it != end; ++it) {
-    Edge* edge = it->first;
-    Plan::Want want = it->second;
-    if (!(want == kWantToStart && edge->AllInputsReady())) {
+  for (std::vector<Edge*>::iterator it = plan_edges_.begin(), end = plan_edges_.end(); it != end; ++it) {
+    Edge* edge = *it;
+    if (!(want_[edge->id_] == kWantToStart && pending_inputs_[edge->id_] == 0)) {
       continue;
     }
 
@@ -515,39 +685,50 @@ void Plan::ScheduleInitialEdges() {
       pool->DelayEdge(edge);
       pools.insert(pool);
     } else {
-      ScheduleWork(it);
+      ScheduleWork(edge);
     }
   }
 
   // Call RetrieveReadyEdges only once at the end so higher priority
   // edges are retrieved first, not the ones that happen to be first
-  // in the want_ map.
+  // in plan_edges_.
   for (std::set<Pool*>::iterator it = pools.begin(), end = pools.end(); it != end; ++it) {
     (*it)->RetrieveReadyEdges(&ready_);
   }
 }
 
 void Plan::PrepareQueue() {
+  if (memory_budget_kb_ > 0) {
+    for (vector<Edge*>::const_iterator e = plan_edges_.begin(); e != plan_edges_.end(); ++e) {
+      int64_t& peak = rule_peak_kb_[&(*e)->rule()];
+      peak = max(peak, (*e)->prev_peak_rss_kb);
+    }
+  }
   ComputeCriticalPath();
   ScheduleInitialEdges();
 }
 
 void Plan::Dump() const {
-  printf("pending: %d\n", (int)want_.size());
-  for (map<Edge*, Want>::const_iterator e = want_.begin(); e != want_.end(); ++e) {
-    if (e->second != kWantNothing)
+  int pending = 0;
+  for (vector<Edge*>::const_iterator e = plan_edges_.begin(); e != plan_edges_.end(); ++e)
+    pending += InPlan(*e);
+  printf("pending: %d\n", pending);
+  for (vector<Edge*>::const_iterator e = plan_edges_.begin(); e != plan_edges_.end(); ++e) {
+    if (!InPlan(*e))
+      continue;
+    if (want_[(*e)->id_] != kWantNothing)
       printf("want ");
-    e->first->Dump();
+    (*e)->Dump();
   }
   printf("ready: %d\n", (int)ready_.size());
 }
 
 struct RealCommandRunner : public CommandRunner {
-  explicit RealCommandRunner(const BuildConfig& config) : config_(config) {}
+  explicit RealCommandRunner(const BuildConfig& config);
 
-  virtual ~RealCommandRunner() {}
+  virtual ~RealCommandRunner();
 
-  virtual size_t CanRunMore() const;
+  virtual size_t CanRunMore();
   virtual bool StartCommand(Edge* edge);
   virtual bool WaitForCommand(Result* result);
   virtual vector<Edge*> GetActiveEdges();
@@ -556,8 +737,60 @@ struct RealCommandRunner : public CommandRunner {
   const BuildConfig& config_;
   SubprocessSet subprocs_;
   map<const Subprocess*, Edge*> subproc_to_edge_;
+
+  /// Where job slots beyond the first come from, if anywhere.  Tokens are
+  /// taken as CanRunMore() offers slots, and those no running command uses
+  /// go back as WaitForCommand() starts, before it waits.
+  unique_ptr<Jobserver> jobserver_;
+  /// MAKEFLAGS before a jobserver we started replaced it, or NULL.
+  unique_ptr<string> saved_makeflags_;
 };
 
+RealCommandRunner::RealCommandRunner(const BuildConfig& config) : config_(config) {
+  subprocs_.output_limit_ = (size_t)config_.output_limit_kb * 1024;
+  if (!config_.jobserver_client && !config_.jobserver_server)
+    return;
+  const char* makeflags = getenv("MAKEFLAGS");
+  string err;
+  if (config_.jobserver_client && makeflags)
+    jobserver_.reset(Jobserver::Connect(makeflags, &err));
+  if (!err.empty()) {
+    Warning("jobserver: %s; running up to -j jobs", err.c_str());
+    return;
+  }
+  if (jobserver_ || !config_.jobserver_server || config_.parallelism == INT_MAX)
+    return;
+
+  jobserver_.reset(Jobserver::Create(config_.parallelism, &err));
+  if (!jobserver_) {
+    Warning("jobserver: %s", err.c_str());
+    return;
+  }
+  saved_makeflags_.reset(new string(makeflags ? makeflags : ""));
+  string flags = jobserver_->makeflags();
+  if (makeflags && *makeflags)
+    flags = string(makeflags) + " " + flags;
+#ifdef _WIN32
+  _putenv_s("MAKEFLAGS", flags.c_str());
+#else
+  setenv("MAKEFLAGS", flags.c_str(), 1);
+#endif
+}
+
+RealCommandRunner::~RealCommandRunner() {
+  jobserver_.reset();
+  if (saved_makeflags_) {
+#ifdef _WIN32
+    _putenv_s("MAKEFLAGS", saved_makeflags_->c_str());
+#else
+    if (saved_makeflags_->empty())
+      unsetenv("MAKEFLAGS");
+    else
+      setenv("MAKEFLAGS", saved_makeflags_->c_str(), 1);
+#endif
+  }
+}
+
 vector<Edge*> RealCommandRunner::GetActiveEdges() {
   vector<Edge*> edges;
   for (map<const Subprocess*, Edge*>::iterator e = subproc_to_edge_.begin(); e != subproc_to_edge_.end(); ++e)
@@ -567,9 +800,11 @@ vector<Edge*> RealCommandRunner::GetActiveEdges() {
 
 void RealCommandRunner::Abort() {
   subprocs_.Clear();
+  if (jobserver_)
+    jobserver_->Release(0);
 }
 
-size_t RealCommandRunner::CanRunMore() const {
+size_t RealCommandRunner::CanRunMore() {
   size_t subproc_number = subprocs_.running_.size() + subprocs_.finished_.size();
 
   int64_t capacity = config_.parallelism - subproc_number;
@@ -587,6 +822,12 @@ size_t RealCommandRunner::CanRunMore() const {
     // Ensure that we make progress.
     capacity = 1;
 
+  if (jobserver_ && capacity > 0) {
+    // Every command past the first needs a token.
+    int64_t tokens = jobserver_->Acquire(subproc_number + capacity - 1);
+    capacity = max<int64_t>(tokens + 1 - subproc_number, 0);
+  }
+
   return capacity;
 }
 
@@ -601,6 +842,12 @@ bool RealCommandRunner::StartCommand(Edge* edge) {
 }
 
 bool RealCommandRunner::WaitForCommand(Result* result) {
+  // Don't sit on tokens that no command uses while waiting.
+  if (jobserver_) {
+    size_t subproc_number = subprocs_.running_.size() + subprocs_.finished_.size();
+    jobserver_->Release(max<int>((int)subproc_number - 1, 0));
+  }
+
   Subprocess* subproc;
   while ((subproc = subprocs_.NextFinished()) == NULL) {
     bool interrupted = subprocs_.DoWork();
@@ -609,7 +856,8 @@ bool RealCommandRunner::WaitForCommand(Result* result) {
   }
 
   result->status = subproc->Finish();
-  result->output = subproc->GetOutput();
+  subproc->TakeOutput(&result->output);
+  result->usage = subproc->GetResourceUsage();
 
   map<const Subprocess*, Edge*>::iterator e = subproc_to_edge_.find(subproc);
   result->edge = e->second;
@@ -619,6 +867,75 @@ bool RealCommandRunner::WaitForCommand(Result* result) {
   return true;
 }
 
+/// A RealCommandRunner that sends the edges of rules with a "worker"
+/// binding to persistent worker processes started with that command, one
+/// request at a time each.  Workers start as they are first needed and
+/// last the build; one that breaks is replaced.
+struct WorkerCommandRunner : public RealCommandRunner {
+  explicit WorkerCommandRunner(const BuildConfig& config) : RealCommandRunner(config) {}
+  virtual ~WorkerCommandRunner();
+
+  virtual bool StartCommand(Edge* edge);
+  virtual bool WaitForCommand(Result* result);
+  virtual void Abort();
+
+  /// Stop workers that broke, or all of them.
+  void StopWorkers(bool all);
+
+  vector<Worker*> workers_;
+};
+
+WorkerCommandRunner::~WorkerCommandRunner() {
+  // Requests in flight refer to their workers.
+  subprocs_.Clear();
+  StopWorkers(true);
+}
+
+bool WorkerCommandRunner::StartCommand(Edge* edge) {
+  string command = edge->GetBinding("worker");
+  if (command.empty() || edge->use_console())
+    return RealCommandRunner::StartCommand(edge);
+
+  Worker* worker = NULL;
+  for (vector<Worker*>::iterator w = workers_.begin(); w != workers_.end() && !worker; ++w) {
+    if (!(*w)->busy() && !(*w)->broken() && (*w)->command() == command)
+      worker = *w;
+  }
+  if (!worker) {
+    worker = subprocs_.StartWorker(command);
+    if (!worker)
+      return RealCommandRunner::StartCommand(edge);
+    workers_.push_back(worker);
+  }
+  Subprocess* subproc = subprocs_.AddRequest(worker, edge->EvaluateCommand());
+  if (!subproc)
+    return false;
+  subproc_to_edge_.insert(make_pair(subproc, edge));
+  return true;
+}
+
+bool WorkerCommandRunner::WaitForCommand(Result* result) {
+  bool ret = RealCommandRunner::WaitForCommand(result);
+  StopWorkers(false);
+  return ret;
+}
+
+void WorkerCommandRunner::Abort() {
+  RealCommandRunner::Abort();
+  StopWorkers(true);
+}
+
+void WorkerCommandRunner::StopWorkers(bool all) {
+  vector<Worker*>::iterator end = workers_.begin();
+  for (vector<Worker*>::iterator w = workers_.begin(); w != workers_.end(); ++w) {
+    if (all || (*w)->broken())
+      delete *w;
+    else
+      *end++ = *w;
+  }
+  workers_.erase(end, workers_.end());
+}
+
 Builder::Builder(State* state, const BuildConfig& config, BuildLog* build_log, DepsLog* deps_log,
                  DiskInterface* disk_interface, Status* status, int64_t start_time_millis)
     : state_(state),
@@ -628,6 +945,8 @@ Builder::Builder(State* state, const BuildConfig& config, BuildLog* build_log, D
       start_time_millis_(start_time_millis),
       disk_interface_(disk_interface),
       scan_(state, build_log, deps_log, disk_interface, &config_.depfile_parser_options) {
+  scan_.set_batch_stat(config_.batch_stat);
+  plan_.set_memory_budget(config_.memory_budget_kb);
   lock_file_path_ = ".ninja_lock";
   string build_dir = state_->bindings_.LookupVariable("builddir");
   if (!build_dir.empty())
@@ -645,7 +964,7 @@ void Builder::Cleanup() {
 
     for (vector<Edge*>::iterator e = active_edges.begin(); e != active_edges.end(); ++e) {
       string depfile = (*e)->GetUnescapedDepfile();
-      for (vector<Node*>::iterator o = (*e)->outputs_.begin(); o != (*e)->outputs_.end(); ++o) {
+      for (ArenaVector<Node*>::iterator o = (*e)->outputs_.begin(); o != (*e)->outputs_.end(); ++o) {
         // Only delete this output if it was actually modified.  This is
         // important for things like the generator where we don't want to
         // delete the manifest file if we can avoid it.  But if the rule
@@ -654,11 +973,11 @@ void Builder::Cleanup() {
         // mentioned in a depfile, and the command touches its depfile
         // but is interrupted before it touches its output file.)
         string err;
-        TimeStamp new_mtime = disk_interface_->Stat((*o)->path(), &err);
+        TimeStamp new_mtime = disk_interface_->Stat((*o)->path().AsString(), &err);
         if (new_mtime == -1)  // Log and ignore Stat() errors.
           status_->Error("%s", err.c_str());
         if (!depfile.empty() || (*o)->mtime() != new_mtime)
-          disk_interface_->RemoveFile((*o)->path());
+          disk_interface_->RemoveFile((*o)->path().AsString());
       }
       if (!depfile.empty())
         disk_interface_->RemoveFile(depfile);
@@ -722,7 +1041,7 @@ bool Builder::Build(string* err) {
     if (config_.dry_run)
       command_runner_.reset(new DryRunCommandRunner);
     else
-      command_runner_.reset(new RealCommandRunner(config_));
+      command_runner_.reset(new WorkerCommandRunner(config_));
   }
 
   // We are about to start the build process.
@@ -836,8 +1155,8 @@ bool Builder::StartEdge(Edge* edge, string* err) {
   // Create directories necessary for outputs and remember the current
   // filesystem mtime to record later
   // XXX: this will block; do we care?
-  for (vector<Node*>::iterator o = edge->outputs_.begin(); o != edge->outputs_.end(); ++o) {
-    if (!disk_interface_->MakeDirs((*o)->path()))
+  for (ArenaVector<Node*>::iterator o = edge->outputs_.begin(); o != edge->outputs_.end(); ++o) {
+    if (!disk_interface_->MakeDirs((*o)->path().AsString()))
       return false;
     if (build_start == -1) {
       disk_interface_->WriteFile(lock_file_path_, "");
@@ -917,8 +1236,8 @@ bool Builder::FinishCommand(CommandRunner::Result* result, string* err) {
     // we should fall back to recording the outputs' current mtime in the
     // log.
     if (record_mtime == 0 || restat || generator) {
-      for (vector<Node*>::iterator o = edge->outputs_.begin(); o != edge->outputs_.end(); ++o) {
-        TimeStamp new_mtime = disk_interface_->Stat((*o)->path(), err);
+      for (ArenaVector<Node*>::iterator o = edge->outputs_.begin(); o != edge->outputs_.end(); ++o) {
+        TimeStamp new_mtime = disk_interface_->Stat((*o)->path().AsString(), err);
         if (new_mtime == -1)
           return false;
         if (new_mtime > record_mtime)
@@ -947,7 +1266,7 @@ bool Builder::FinishCommand(CommandRunner::Result* result, string* err) {
     disk_interface_->RemoveFile(rspfile);
 
   if (scan_.build_log()) {
-    if (!scan_.build_log()->RecordCommand(edge, start_time_millis, end_time_millis, record_mtime)) {
+    if (!scan_.build_log()->RecordCommand(edge, start_time_millis, end_time_millis, record_mtime, result->usage)) {
       *err = string("Error writing to build log: ") + strerror(errno);
       return false;
     }
@@ -955,8 +1274,8 @@ bool Builder::FinishCommand(CommandRunner::Result* result, string* err) {
 
   if (!deps_type.empty() && !config_.dry_run) {
     assert(!edge->outputs_.empty() && "should have been rejected by parser");
-    for (std::vector<Node*>::const_iterator o = edge->outputs_.begin(); o != edge->outputs_.end(); ++o) {
-      TimeStamp deps_mtime = disk_interface_->Stat((*o)->path(), err);
+    for (ArenaVector<Node*>::const_iterator o = edge->outputs_.begin(); o != edge->outputs_.end(); ++o) {
+      TimeStamp deps_mtime = disk_interface_->Stat((*o)->path().AsString(), err);
       if (deps_mtime == -1)
         return false;
       if (!scan_.deps_log()->RecordDeps(*o, deps_mtime, deps_nodes)) {
@@ -975,7 +1294,7 @@ bool Builder::ExtractDeps(CommandRunner::Result* result, const string& deps_type
     string output;
     if (!parser.Parse(result->output, deps_prefix, &output, err))
       return false;
-    result->output = output;
+    result->output.swap(output);
     for (set<string>::iterator i = parser.includes_.begin(); i != parser.includes_.end(); ++i) {
       // ~0 is assuming that with MSVC-parsed headers, it's ok to always make
       // all backslashes (as some of the slashes will certainly be backslashes
@@ -24,6 +24,7 @@
 #include "depfile_parser.h"
 #include "exit_status.h"
 #include "graph.h"
+#include "resource_usage.h"
 #include "util.h"  // int64_t
 
 struct BuildLog;
@@ -75,6 +76,12 @@ struct Plan {
   // After all targets have been added, prepares the ready queue for find work.
   void PrepareQueue();
 
+  /// Admit commands only while the memory they are expected to use adds up
+  /// to at most \a kb KiB; 0 admits them regardless.  A command is expected
+  /// to use the peak RSS it reached last time, else its "memory" binding,
+  /// else the largest peak RSS recorded for any command of its rule.
+  void set_memory_budget(int64_t kb) { memory_budget_kb_ = kb; }
+
   /// Update the build plan to account for modifications made to the graph
   /// by information loaded from a dyndep file.
   bool DyndepsLoaded(DependencyScan* scan, const Node* node, const DyndepFile& ddf, std::string* err);
@@ -88,7 +95,9 @@ struct Plan {
     kWantToStart,
     /// We want to build the edge, have scheduled it, and are waiting
     /// for it to complete.
-    kWantToFinish
+    kWantToFinish,
+    /// The edge is not in the plan: we want neither it nor its dependents.
+    kNotInPlan
   };
 
  private:
@@ -108,21 +117,59 @@ struct Plan {
   bool NodeFinished(Node* node, std::string* err);
 
   void EdgeWanted(const Edge* edge);
-  bool EdgeMaybeReady(std::map<Edge*, Want>::iterator want_e, std::string* err);
+  bool EdgeMaybeReady(Edge* edge, std::string* err);
 
   /// Submits a ready edge as a candidate for execution.
   /// The edge may be delayed from running, for example if it's a member of a
   /// currently-full pool.
-  void ScheduleWork(std::map<Edge*, Want>::iterator want_e);
+  void ScheduleWork(Edge* edge);
+
+  /// The KiB of memory |edge| is expected to use; see set_memory_budget().
+  int64_t EstimateMemory(const Edge* edge) const;
+
+  /// Move the edges in deferred_ that now fit in the budget back to ready_.
+  void RequeueDeferred();
+
+  /// Count the inputs of |edge| that wait on an edge still in the plan.
+  int CountPendingInputs(const Edge* edge) const;
 
-  /// Keep track of which edges we want to build in this plan.  If this map does
-  /// not contain an entry for an edge, we do not want to build the entry or its
-  /// dependents.  If it does contain an entry, the enumeration indicates what
-  /// we want for the edge.
-  std::map<Edge*, Want> want_;
+  /// Whether |edge| has an entry in want_.
+  bool InPlan(const Edge* edge) const { return edge->id_ < want_.size() && want_[edge->id_] != kNotInPlan; }
+
+  /// Keep track of which edges we want to build in this plan, indexed by edge
+  /// id.  If an edge's entry is kNotInPlan, we do not want to build the edge or
+  /// its dependents.  Otherwise the enumeration indicates what we want for the
+  /// edge.
+  std::vector<Want> want_;
+
+  /// For each edge in the plan, indexed by edge id, how many of its inputs
+  /// are produced by edges also still in the plan.  The edge is ready once
+  /// this reaches zero.  An input listed twice counts twice, matching the
+  /// producer's two entries in Node::out_edges().
+  std::vector<int> pending_inputs_;
+
+  /// Edges given an entry in want_, in the order they were added.  Edges
+  /// that have since finished stay here with an entry of kNotInPlan.
+  std::vector<Edge*> plan_edges_;
 
   EdgePriorityQueue ready_;
 
+  /// The memory budget in KiB, or 0 for none.
+  int64_t memory_budget_kb_;
+  /// The sum of admitted_kb_.
+  int64_t admitted_memory_kb_;
+  /// For each edge FindWork() returned that has not finished, indexed by
+  /// edge id, the KiB it was expected to use.
+  std::vector<int64_t> admitted_kb_;
+  /// For each edge in the plan, indexed by edge id, EstimateMemory() as of
+  /// the first time FindWork() considered it, or -1 before then.
+  std::vector<int64_t> estimate_kb_;
+  /// Ready edges FindWork() passed over because they did not fit in the
+  /// budget, in no particular order.
+  std::vector<Edge*> deferred_;
+  /// The largest peak RSS recorded for an edge of each rule in the plan.
+  std::map<const Rule*, int64_t> rule_peak_kb_;
+
   Builder* builder_;
   /// user provided targets in build order, earlier one have higher priority
   std::vector<const Node*> targets_;
@@ -136,11 +183,15 @@ struct Plan {
 
 /// CommandRunner is an interface that wraps running the build
 /// subcommands.  This allows tests to abstract out running commands.
-/// RealCommandRunner is an implementation that actually runs commands.
+/// RealCommandRunner is an implementation that actually runs commands, and
+/// WorkerCommandRunner one that hands some to persistent worker processes.
 struct CommandRunner {
   virtual ~CommandRunner() {}
 
-  virtual size_t CanRunMore() const = 0;
+  /// How many more commands may start now.  This may claim job slots
+  /// for them, such as jobserver tokens, that go back once fewer commands
+  /// run.
+  virtual size_t CanRunMore() = 0;
   virtual bool StartCommand(Edge* edge) = 0;
 
   /// The result of waiting for a command.
@@ -150,6 +201,7 @@ struct CommandRunner {
     Edge* edge;
     ExitStatus status;
     std::string output;
+    ResourceUsage usage;
 
     bool success() const { return status == ExitSuccess; }
   };
@@ -164,7 +216,17 @@ struct CommandRunner {
 
 /// Options (e.g. verbosity, parallelism) passed to a build.
 struct BuildConfig {
-  BuildConfig() : verbosity(NORMAL), dry_run(false), parallelism(1), failures_allowed(1), max_load_average(-0.0f) {}
+  BuildConfig()
+      : verbosity(NORMAL),
+        dry_run(false),
+        parallelism(1),
+        failures_allowed(1),
+        max_load_average(-0.0f),
+        batch_stat(false),
+        jobserver_client(false),
+        jobserver_server(false),
+        memory_budget_kb(0),
+        output_limit_kb(1024) {}
 
   enum Verbosity {
     QUIET,             // No output -- used when testing.
@@ -180,6 +242,22 @@ struct BuildConfig {
   /// The maximum load average we must not exceed. A negative value
   /// means that we do not have any limit.
   double max_load_average;
+  /// Whether to stat the files a target needs as one batch before
+  /// scanning it; see DependencyScan::set_batch_stat().
+  bool batch_stat;
+  /// Whether to take job slots beyond the first from the GNU make jobserver
+  /// named in MAKEFLAGS, if there is one.
+  bool jobserver_client;
+  /// Whether, if no jobserver was passed down, to start one with
+  /// |parallelism| slots and pass it on to the commands run.
+  bool jobserver_server;
+  /// The memory in KiB that running commands may be expected to use
+  /// together; see Plan::set_memory_budget().  0 means no limit.
+  int64_t memory_budget_kb;
+  /// The output in KiB of each running command to hold in memory; past it
+  /// the output waits in a temporary file until the command ends.  0 means
+  /// no limit.
+  int64_t output_limit_kb;
   DepfileParserOptions depfile_parser_options;
 };
 
@@ -26,6 +26,7 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <algorithm>
 #include <cassert>
 
 #ifndef _WIN32
@@ -35,6 +36,8 @@
 
 #include "build.h"
 #include "graph.h"
+#include "hash.h"
+#include "hash_map.h"
 #include "metrics.h"
 #include "util.h"
 #if defined(_MSC_VER) && (_MSC_VER < 1800)
@@ -49,90 +52,96 @@ using namespace std;
 // older runs.
 // Once the number of redundant entries exceeds a threshold, we write
 // out a new file and replace the existing one with it.
+//
+// From version 9 the log is binary.  After the signature line come
+// records: a path record is a uint32_t of kPathRecord | the path's length
+// and then the path; an entry record is an EntryRecord, whose first field
+// (the offset of its path's record in the file) lacks that bit.  Numbers
+// are in the machine's byte order, and records are not aligned.  Loading
+// maps the file and only notes where each output's last record is; the
+// LogEntry is made when the output is first looked up.
+//
+// Version 10 hashes commands with XXH3 rather than MurmurHash64A.  Entries
+// of older logs keep their hashes, marked with kLegacyHash in the flags
+// of their records, until their commands run again.
 
 namespace {
 
 const char kFileSignature[] = "# ninja log v%d\n";
+const char kFileSignaturePrefix[] = "# ninja log v";
 const int kOldestSupportedVersion = 6;
-const int kCurrentVersion = 6;
-
-// 64bit MurmurHash2, by Austin Appleby
-#if defined(_MSC_VER)
-#define BIG_CONSTANT(x) (x)
-#else  // defined(_MSC_VER)
-#define BIG_CONSTANT(x) (x##LLU)
-#endif  // !defined(_MSC_VER)
-inline uint64_t MurmurHash64A(const void* key, size_t len) {
-  static const uint64_t seed = 0xDECAFBADDECAFBADull;
-  const uint64_t m = BIG_CONSTANT(0xc6a4a7935bd1e995);
-  const int r = 47;
-  uint64_t h = seed ^ (len * m);
-  const unsigned char* data = (const unsigned char*)key;
-  while (len >= 8) {
-    uint64_t k;
-    memcpy(&k, data, sizeof k);
-    k *= m;
-    k ^= k >> r;
-    k *= m;
-    h ^= k;
-    h *= m;
-    data += 8;
-    len -= 8;
-  }
-  switch (len & 7) {
-    case 7:
-      h ^= uint64_t(data[6]) << 48;
-      NINJA_FALLTHROUGH;
-    case 6:
-      h ^= uint64_t(data[5]) << 40;
-      NINJA_FALLTHROUGH;
-    case 5:
-      h ^= uint64_t(data[4]) << 32;
-      NINJA_FALLTHROUGH;
-    case 4:
-      h ^= uint64_t(data[3]) << 24;
-      NINJA_FALLTHROUGH;
-    case 3:
-      h ^= uint64_t(data[2]) << 16;
-      NINJA_FALLTHROUGH;
-    case 2:
-      h ^= uint64_t(data[1]) << 8;
-      NINJA_FALLTHROUGH;
-    case 1:
-      h ^= uint64_t(data[0]);
-      h *= m;
-  };
-  h ^= h >> r;
-  h *= m;
-  h ^= h >> r;
-  return h;
+/// Versions before this one wrote a line of text per entry.
+const int kFirstBinaryVersion = 9;
+/// Versions before this one hashed commands with MurmurHash64A.
+const int kFirstXxh3Version = 10;
+const int kCurrentVersion = 10;
+
+const uint32_t kPathRecord = 0x80000000;
+/// EntryRecord::flags: command_hash is a MurmurHash64A.
+const uint32_t kLegacyHash = 1;
+
+struct EntryRecord {
+  uint32_t path_offset;
+  int32_t start_time;
+  int32_t end_time;
+  uint32_t flags;
+  int64_t mtime;
+  uint64_t command_hash;
+  int64_t usage[5];
+};
+static_assert(sizeof(EntryRecord) == 72, "EntryRecord has padding");
+
+void ReadEntryRecord(const char* data, bool legacy_hash, BuildLog::LogEntry* entry) {
+  EntryRecord record;
+  memcpy(&record, data, sizeof(record));
+  entry->legacy_hash = legacy_hash || (record.flags & kLegacyHash);
+  entry->start_time = record.start_time;
+  entry->end_time = record.end_time;
+  entry->mtime = record.mtime;
+  entry->command_hash = record.command_hash;
+  entry->usage.peak_rss_kb = record.usage[0];
+  entry->usage.user_time_millis = record.usage[1];
+  entry->usage.system_time_millis = record.usage[2];
+  entry->usage.read_blocks = record.usage[3];
+  entry->usage.written_blocks = record.usage[4];
 }
 
-#undef BIG_CONSTANT
-
 }  // namespace
 
 // static
 uint64_t BuildLog::LogEntry::HashCommand(StringPiece command) {
-  return MurmurHash64A(command.str_, command.len_);
+  return Xxh3Hash64(command.str_, command.len_);
+}
+
+bool BuildLog::LogEntry::MatchesCommand(StringPiece command) const {
+  if (legacy_hash)
+    return MurmurHash64A(command.str_, command.len_) == command_hash;
+  return HashCommand(command) == command_hash;
 }
 
-BuildLog::LogEntry::LogEntry(const string& output) : output(output) {}
+BuildLog::LogEntry::LogEntry(const string& output) : output(output), legacy_hash(false) {}
 
 BuildLog::LogEntry::LogEntry(const string& output, uint64_t command_hash, int start_time, int end_time, TimeStamp mtime)
-    : output(output), command_hash(command_hash), start_time(start_time), end_time(end_time), mtime(mtime) {}
+    : output(output), command_hash(command_hash), start_time(start_time), end_time(end_time), mtime(mtime),
+      legacy_hash(false) {}
 
-BuildLog::BuildLog() : log_file_(NULL), needs_recompaction_(false) {}
+BuildLog::BuildLog()
+    : legacy_hashes_(false), log_file_(NULL), needs_recompaction_(false), needs_upgrade_(false) {}
 
 BuildLog::~BuildLog() {
   Close();
+  for (Entries::iterator i = entries_.begin(); i != entries_.end(); ++i)
+    delete i->second;
 }
 
 bool BuildLog::OpenForWrite(const string& path, const BuildLogUser& user, string* err) {
-  if (needs_recompaction_) {
+  if (needs_upgrade_) {
     if (!Recompact(path, user, err))
       return false;
   }
+  // The path records we know of are those of the log we loaded.
+  if (path != loaded_path_)
+    path_offsets_.clear();
 
   assert(!log_file_);
   log_file_path_ = path;  // we don't actually open the file right now, but will
@@ -140,29 +149,26 @@ bool BuildLog::OpenForWrite(const string& path, const BuildLogUser& user, string
   return true;
 }
 
-bool BuildLog::RecordCommand(Edge* edge, int start_time, int end_time, TimeStamp mtime) {
-  string command = edge->EvaluateCommand(true);
-  uint64_t command_hash = LogEntry::HashCommand(command);
-  for (vector<Node*>::iterator out = edge->outputs_.begin(); out != edge->outputs_.end(); ++out) {
-    const string& path = (*out)->path();
-    Entries::iterator i = entries_.find(path);
-    LogEntry* log_entry;
-    if (i != entries_.end()) {
-      log_entry = i->second;
-    } else {
-      log_entry = new LogEntry(path);
-      entries_.insert(Entries::value_type(log_entry->output, log_entry));
+bool BuildLog::RecordCommand(Edge* edge, int start_time, int end_time, TimeStamp mtime, const ResourceUsage& usage) {
+  uint64_t command_hash = edge->HashCommand(true);
+  for (ArenaVector<Node*>::iterator out = edge->outputs_.begin(); out != edge->outputs_.end(); ++out) {
+    LogEntry* log_entry = Materialize((*out)->path_id());
+    if (!log_entry) {
+      log_entry = new LogEntry((*out)->path().AsString());
+      entries_.Set((*out)->path_id(), log_entry);
     }
     log_entry->command_hash = command_hash;
+    log_entry->legacy_hash = false;
     log_entry->start_time = start_time;
     log_entry->end_time = end_time;
     log_entry->mtime = mtime;
+    log_entry->usage = usage;
 
     if (!OpenForWriteIfNeeded()) {
       return false;
     }
     if (log_file_) {
-      if (!WriteEntry(log_file_, *log_entry))
+      if (!WriteEntry(log_file_, *log_entry, &path_offsets_))
         return false;
       if (fflush(log_file_) != 0) {
         return false;
@@ -187,7 +193,7 @@ bool BuildLog::OpenForWriteIfNeeded() {
   if (!log_file_) {
     return false;
   }
-  if (setvbuf(log_file_, NULL, _IOLBF, BUFSIZ) != 0) {
+  if (setvbuf(log_file_, NULL, _IOFBF, BUFSIZ) != 0) {
     return false;
   }
   SetCloseOnExec(fileno(log_file_));
@@ -197,6 +203,7 @@ bool BuildLog::OpenForWriteIfNeeded() {
   fseek(log_file_, 0, SEEK_END);
 
   if (ftell(log_file_) == 0) {
+    path_offsets_.clear();
     if (fprintf(log_file_, kFileSignature, kCurrentVersion) < 0) {
       return false;
     }
@@ -256,6 +263,108 @@ struct LineReader {
 
 LoadStatus BuildLog::Load(const string& path, string* err) {
   METRIC_RECORD(".ninja_log load");
+  // Entries not yet read point into the file loaded before.
+  MaterializeAll();
+  file_.Close();
+  loaded_path_.clear();
+  path_offsets_.clear();
+
+  int ret = file_.Open(path, err);
+  if (ret == -ENOENT) {
+    err->clear();
+    return LOAD_NOT_FOUND;
+  }
+  if (ret < 0)
+    return LOAD_ERROR;
+  const char* data = file_.data();
+  size_t size = file_.size();
+
+  int log_version = 0;
+  size_t offset = sizeof(kFileSignaturePrefix) - 1;
+  if (size > offset && memcmp(data, kFileSignaturePrefix, offset) == 0) {
+    while (offset < size && offset < 20 && data[offset] >= '0' && data[offset] <= '9')
+      log_version = log_version * 10 + data[offset++] - '0';
+    if (offset == size || data[offset++] != '\n')
+      log_version = 0;
+  }
+  if (log_version < kFirstBinaryVersion) {
+    file_.Close();
+    return LoadText(path, err);
+  }
+  if (log_version > kCurrentVersion) {
+    *err = "build log version is too new; starting over";
+    file_.Close();
+    unlink(path.c_str());
+    return LOAD_NOT_FOUND;
+  }
+  legacy_hashes_ = log_version < kFirstXxh3Version;
+
+  // The ids of the paths, by the offsets of their records.
+  vector<pair<uint32_t, uint32_t> > paths;
+  int unique_entry_count = 0;
+  int total_entry_count = 0;
+  while (offset + sizeof(uint32_t) <= size) {
+    uint32_t tag;
+    memcpy(&tag, data + offset, sizeof(tag));
+    if (tag & kPathRecord) {
+      size_t length = tag & ~kPathRecord;
+      if (size - offset - sizeof(tag) < length)
+        break;
+      StringPiece output(data + offset + sizeof(tag), length);
+      paths.push_back(make_pair((uint32_t)offset, PathTable::Global().Intern(output)));
+      offset += sizeof(tag) + length;
+      continue;
+    }
+
+    if (size - offset < sizeof(EntryRecord))
+      break;
+    // Most entries follow the record of their path.
+    vector<pair<uint32_t, uint32_t> >::iterator path = paths.end();
+    if (paths.empty() || paths.back().first != tag)
+      path = lower_bound(paths.begin(), paths.end(), make_pair(tag, 0u));
+    else
+      --path;
+    if (path == paths.end() || path->first != tag)
+      break;
+    uint32_t id = path->second;
+    if (LogEntry* entry = entries_.Get(id)) {
+      ReadEntryRecord(data + offset, legacy_hashes_, entry);
+    } else {
+      unique_entry_count += !records_.Get(id);
+      records_.Set(id, data + offset);
+    }
+    ++total_entry_count;
+    offset += sizeof(EntryRecord);
+  }
+
+  loaded_path_ = path;
+  for (size_t i = 0; i < paths.size(); ++i)
+    path_offsets_.Set(paths[i].second, paths[i].first);
+
+  // Decide whether it's time to rebuild the log: if we're upgrading
+  // versions, if it's getting large, or if it's too large for the offsets
+  // of path records.
+  int kMinCompactionEntryCount = 100;
+  int kCompactionRatio = 3;
+  if (log_version < kCurrentVersion || size > kPathRecord / 2) {
+    needs_upgrade_ = true;
+  } else if (total_entry_count > kMinCompactionEntryCount &&
+             total_entry_count > unique_entry_count * kCompactionRatio) {
+    needs_recompaction_ = true;
+  }
+
+  if (offset < size) {
+    // Recover from a write cut short by truncating the file to the last
+    // whole record.  The records before it stay mapped.
+    *err = "premature end of file";
+    if (!Truncate(path, offset, err))
+      return LOAD_ERROR;
+    *err += "; recovering";
+  }
+  return LOAD_SUCCESS;
+}
+
+LoadStatus BuildLog::LoadText(const string& path, string* err) {
   FILE* file = fopen(path.c_str(), "r");
   if (!file) {
     if (errno == ENOENT)
@@ -328,18 +437,16 @@ LoadStatus BuildLog::Load(const string& path, string* err) {
     end = (char*)memchr(start, kFieldSeparator, line_end - start);
     if (!end)
       continue;
-    string output = string(start, end - start);
+    StringPiece output(start, end - start);
 
     start = end + 1;
     end = line_end;
 
-    LogEntry* entry;
-    Entries::iterator i = entries_.find(output);
-    if (i != entries_.end()) {
-      entry = i->second;
-    } else {
-      entry = new LogEntry(output);
-      entries_.insert(Entries::value_type(entry->output, entry));
+    uint32_t path_id = PathTable::Global().Intern(output);
+    LogEntry* entry = Materialize(path_id);
+    if (!entry) {
+      entry = new LogEntry(output.AsString());
+      entries_.Set(path_id, entry);
       ++unique_entry_count;
     }
     ++total_entry_count;
@@ -349,7 +456,17 @@ LoadStatus BuildLog::Load(const string& path, string* err) {
     entry->mtime = mtime;
     char c = *end;
     *end = '\0';
-    entry->command_hash = (uint64_t)strtoull(start, NULL, 16);
+    char* hash_end;
+    entry->command_hash = (uint64_t)strtoull(start, &hash_end, 16);
+    entry->legacy_hash = true;
+    // Version 7 appends the command's peak RSS, and version 8 the rest of
+    // its ResourceUsage.
+    entry->usage = ResourceUsage();
+    int64_t* const usage_fields[] = { &entry->usage.peak_rss_kb, &entry->usage.user_time_millis,
+                                      &entry->usage.system_time_millis, &entry->usage.read_blocks,
+                                      &entry->usage.written_blocks };
+    for (size_t i = 0; i < sizeof(usage_fields) / sizeof(usage_fields[0]) && *hash_end == kFieldSeparator; ++i)
+      *usage_fields[i] = strtoll(hash_end + 1, &hash_end, 10);
     *end = c;
   }
   fclose(file);
@@ -364,7 +481,7 @@ LoadStatus BuildLog::Load(const string& path, string* err) {
   int kMinCompactionEntryCount = 100;
   int kCompactionRatio = 3;
   if (log_version < kCurrentVersion) {
-    needs_recompaction_ = true;
+    needs_upgrade_ = true;
   } else if (total_entry_count > kMinCompactionEntryCount &&
              total_entry_count > unique_entry_count * kCompactionRatio) {
     needs_recompaction_ = true;
@@ -374,71 +491,121 @@ LoadStatus BuildLog::Load(const string& path, string* err) {
 }
 
 BuildLog::LogEntry* BuildLog::LookupByOutput(const string& path) {
-  Entries::iterator i = entries_.find(path);
-  if (i != entries_.end())
-    return i->second;
-  return NULL;
+  uint32_t id = PathTable::Global().Find(path);
+  return id == PathTable::kNone ? NULL : Materialize(id);
 }
 
-bool BuildLog::WriteEntry(FILE* f, const LogEntry& entry) {
-  return fprintf(f, "%d\t%d\t%" PRId64 "\t%s\t%" PRIx64 "\n", entry.start_time, entry.end_time, entry.mtime,
-                 entry.output.c_str(), entry.command_hash) > 0;
+BuildLog::LogEntry* BuildLog::LookupByOutput(const Node* output) {
+  return Materialize(output->path_id());
 }
 
-bool BuildLog::Recompact(const string& path, const BuildLogUser& user, string* err) {
-  METRIC_RECORD(".ninja_log recompact");
+const BuildLog::Entries& BuildLog::entries() {
+  MaterializeAll();
+  return entries_;
+}
 
-  Close();
-  string temp_path = path + ".recompact";
-  FILE* f = fopen(temp_path.c_str(), "wb");
-  if (!f) {
-    *err = strerror(errno);
-    return false;
-  }
+BuildLog::LogEntry* BuildLog::Materialize(uint32_t id) {
+  if (LogEntry* entry = entries_.Get(id))
+    return entry;
+  const char* record = records_.Get(id);
+  if (!record)
+    return NULL;
+  LogEntry* entry = new LogEntry(PathTable::Global().path(id).AsString());
+  ReadEntryRecord(record, legacy_hashes_, entry);
+  entries_.Set(id, entry);
+  records_.Set(id, NULL);
+  return entry;
+}
 
-  if (fprintf(f, kFileSignature, kCurrentVersion) < 0) {
-    *err = strerror(errno);
-    fclose(f);
-    return false;
+void BuildLog::MaterializeAll() {
+  if (records_.empty())
+    return;
+  for (uint32_t id = 0, n = PathTable::Global().size(); id < n; ++id) {
+    if (records_.Get(id))
+      Materialize(id);
   }
+  records_.clear();
+}
 
-  vector<StringPiece> dead_outputs;
-  for (Entries::iterator i = entries_.begin(); i != entries_.end(); ++i) {
-    if (user.IsPathDead(i->first)) {
-      dead_outputs.push_back(i->first);
-      continue;
-    }
-
-    if (!WriteEntry(f, *i->second)) {
-      *err = strerror(errno);
-      fclose(f);
+// static
+bool BuildLog::WriteEntry(FILE* f, const LogEntry& entry, PathMap<uint32_t>* path_offsets) {
+  uint32_t id = PathTable::Global().Intern(entry.output);
+  uint32_t path_offset = path_offsets->Get(id);
+  if (!path_offset) {
+    long offset = ftell(f);
+    if (offset < 0)
+      return false;
+    uint32_t tag = kPathRecord | (uint32_t)entry.output.size();
+    if ((unsigned long)offset >= kPathRecord || entry.output.size() >= kPathRecord) {
+      errno = EFBIG;
       return false;
     }
+    if (fwrite(&tag, sizeof(tag), 1, f) != 1 ||
+        fwrite(entry.output.data(), 1, entry.output.size(), f) != entry.output.size())
+      return false;
+    path_offset = (uint32_t)offset;
+    path_offsets->Set(id, path_offset);
   }
 
-  for (size_t i = 0; i < dead_outputs.size(); ++i)
-    entries_.erase(dead_outputs[i]);
+  const ResourceUsage& usage = entry.usage;
+  EntryRecord record = { path_offset,
+                         entry.start_time,
+                         entry.end_time,
+                         entry.legacy_hash ? kLegacyHash : 0,
+                         entry.mtime,
+                         entry.command_hash,
+                         { usage.peak_rss_kb, usage.user_time_millis, usage.system_time_millis, usage.read_blocks,
+                           usage.written_blocks } };
+  return fwrite(&record, sizeof(record), 1, f) == 1;
+}
 
-  fclose(f);
-  if (unlink(path.c_str()) < 0) {
-    *err = strerror(errno);
-    return false;
-  }
+bool BuildLog::Recompact(const string& path, const BuildLogUser& user, string* err) {
+  METRIC_RECORD(".ninja_log recompact");
 
-  if (rename(temp_path.c_str(), path.c_str()) < 0) {
-    *err = strerror(errno);
-    return false;
+  MaterializeAll();
+  vector<StringPiece> dead_outputs;
+  for (Entries::iterator i = entries_.begin(); i != entries_.end(); ++i) {
+    if (user.IsPathDead(i->first))
+      dead_outputs.push_back(i->first);
   }
+  for (size_t i = 0; i < dead_outputs.size(); ++i)
+    entries_.erase(dead_outputs[i]);
 
-  return true;
+  return Rewrite(path, path + ".recompact", err);
 }
 
 bool BuildLog::Restat(const StringPiece path, const DiskInterface& disk_interface, const int output_count,
                       char** outputs, std::string* const err) {
   METRIC_RECORD(".ninja_log restat");
 
+  // Stat every output to refresh up front, as one batch.
+  MaterializeAll();
+  vector<LogEntry*> restat;
+  vector<const string*> restat_paths;
+  for (Entries::iterator i = entries_.begin(); i != entries_.end(); ++i) {
+    bool skip = output_count > 0;
+    for (int j = 0; j < output_count; ++j) {
+      if (i->second->output == outputs[j]) {
+        skip = false;
+        break;
+      }
+    }
+    if (!skip) {
+      restat.push_back(i->second);
+      restat_paths.push_back(&i->second->output);
+    }
+  }
+  vector<TimeStamp> mtimes;
+  if (!disk_interface.StatMany(restat_paths, &mtimes, err))
+    return false;
+  for (size_t i = 0; i < restat.size(); ++i)
+    restat[i]->mtime = mtimes[i];
+
+  return Rewrite(path.AsString(), path.AsString() + ".restat", err);
+}
+
+bool BuildLog::Rewrite(const string& path, const string& temp_path, string* err) {
   Close();
-  std::string temp_path = path.AsString() + ".restat";
   FILE* f = fopen(temp_path.c_str(), "wb");
   if (!f) {
     *err = strerror(errno);
@@ -450,24 +617,9 @@ bool BuildLog::Restat(const StringPiece path, const DiskInterface& disk_interfac
     fclose(f);
     return false;
   }
+  PathMap<uint32_t> path_offsets;
   for (Entries::iterator i = entries_.begin(); i != entries_.end(); ++i) {
-    bool skip = output_count > 0;
-    for (int j = 0; j < output_count; ++j) {
-      if (i->second->output == outputs[j]) {
-        skip = false;
-        break;
-      }
-    }
-    if (!skip) {
-      const TimeStamp mtime = disk_interface.Stat(i->second->output, err);
-      if (mtime == -1) {
-        fclose(f);
-        return false;
-      }
-      i->second->mtime = mtime;
-    }
-
-    if (!WriteEntry(f, *i->second)) {
+    if (!WriteEntry(f, *i->second, &path_offsets)) {
       *err = strerror(errno);
       fclose(f);
       return false;
@@ -475,15 +627,14 @@ bool BuildLog::Restat(const StringPiece path, const DiskInterface& disk_interfac
   }
 
   fclose(f);
-  if (unlink(path.str_) < 0) {
-    *err = strerror(errno);
+  // Every entry is read, so the old file is of no more use.
+  file_.Close();
+  if (!RenameFile(temp_path, path, err))
     return false;
-  }
-
-  if (rename(temp_path.c_str(), path.str_) < 0) {
-    *err = strerror(errno);
-    return false;
-  }
 
+  loaded_path_ = path;
+  path_offsets_ = path_offsets;
+  needs_recompaction_ = false;
+  needs_upgrade_ = false;
   return true;
 }
@@ -18,13 +18,15 @@
 #include <stdio.h>
 #include <string>
 
-#include "hash_map.h"
 #include "load_status.h"
+#include "path_table.h"
+#include "resource_usage.h"
 #include "timestamp.h"
 #include "util.h"  // uint64_t
 
 struct DiskInterface;
 struct Edge;
+struct Node;
 
 /// Can answer questions about the manifest for the BuildLog.
 struct BuildLogUser {
@@ -47,7 +49,8 @@ struct BuildLog {
   /// Prepares writing to the log file without actually opening it - that will
   /// happen when/if it's needed
   bool OpenForWrite(const std::string& path, const BuildLogUser& user, std::string* err);
-  bool RecordCommand(Edge* edge, int start_time, int end_time, TimeStamp mtime = 0);
+  bool RecordCommand(Edge* edge, int start_time, int end_time, TimeStamp mtime = 0,
+                     const ResourceUsage& usage = ResourceUsage());
   void Close();
 
   /// Load the on-disk log.
@@ -59,13 +62,23 @@ struct BuildLog {
     int start_time;
     int end_time;
     TimeStamp mtime;
+    ResourceUsage usage;
+    /// Whether command_hash is the MurmurHash64A that logs before version
+    /// 10 hold, rather than HashCommand.  Recording the command again
+    /// replaces it.
+    bool legacy_hash;
 
     static uint64_t HashCommand(StringPiece command);
+    /// Whether \a command hashes to command_hash.
+    bool MatchesCommand(StringPiece command) const;
 
     // Used by tests.
     bool operator==(const LogEntry& o) const {
       return output == o.output && command_hash == o.command_hash && start_time == o.start_time &&
-             end_time == o.end_time && mtime == o.mtime;
+             end_time == o.end_time && mtime == o.mtime && usage.peak_rss_kb == o.usage.peak_rss_kb &&
+             usage.user_time_millis == o.usage.user_time_millis &&
+             usage.system_time_millis == o.usage.system_time_millis && usage.read_blocks == o.usage.read_blocks &&
+             usage.written_blocks == o.usage.written_blocks && legacy_hash == o.legacy_hash;
     }
 
     explicit LogEntry(const std::string& output);
@@ -74,30 +87,64 @@ struct BuildLog {
 
   /// Lookup a previously-run command by its output path.
   LogEntry* LookupByOutput(const std::string& path);
-
-  /// Serialize an entry into a log file.
-  bool WriteEntry(FILE* f, const LogEntry& entry);
+  LogEntry* LookupByOutput(const Node* output);
 
   /// Rewrite the known log entries, throwing away old data.
   bool Recompact(const std::string& path, const BuildLogUser& user, std::string* err);
 
+  /// Whether the log loaded has grown enough dead entries to be worth a
+  /// Recompact().  OpenForWrite() leaves that for later, so that it can run
+  /// once the build is done, with whatever the build recorded in it too.
+  bool needs_recompaction() const { return needs_recompaction_; }
+
   /// Restat all outputs in the log
   bool Restat(StringPiece path, const DiskInterface& disk_interface, int output_count, char** outputs,
               std::string* err);
 
-  typedef ExternalStringHashMap<LogEntry*>::Type Entries;
+  /// Entries by path id.
+  typedef PathMap<LogEntry*> Entries;
 
-  const Entries& entries() const { return entries_; }
+  /// All entries, each read from the log file if it was not yet.
+  const Entries& entries();
 
  private:
   /// Should be called before using log_file_. When false is returned, errno
   /// will be set.
   bool OpenForWriteIfNeeded();
 
+  /// Load a text log, which older versions wrote.
+  LoadStatus LoadText(const std::string& path, std::string* err);
+
+  /// The entry for path \a id, read from its record if it was not yet.
+  LogEntry* Materialize(uint32_t id);
+  void MaterializeAll();
+
+  /// Serialize an entry into a log file, after a record of its path if the
+  /// file has none yet.  \a path_offsets maps path ids to the offsets of
+  /// the path records in the file.
+  static bool WriteEntry(FILE* f, const LogEntry& entry, PathMap<uint32_t>* path_offsets);
+
+  /// Rewrite all entries to \a path by way of a temporary file \a temp_path.
+  bool Rewrite(const std::string& path, const std::string& temp_path, std::string* err);
+
   Entries entries_;
+  /// The records in file_ of entries not yet read, by path id.
+  PathMap<const char*> records_;
+  /// The log last loaded, which records_ point into.
+  MappedFile file_;
+  std::string loaded_path_;
+  /// Whether file_ is older than version 10, so that all its hashes are
+  /// legacy ones.
+  bool legacy_hashes_;
+  /// The path records in the log file, for appending to it.
+  PathMap<uint32_t> path_offsets_;
   FILE* log_file_;
   std::string log_file_path_;
   bool needs_recompaction_;
+  /// Whether the log loaded is of an older version or too large for the
+  /// offsets of path records, so that OpenForWrite() must rewrite it before
+  /// appending to it.
+  bool needs_upgrade_;
 };
 
 #endif  // NINJA_BUILD_LOG_H_
@@ -12,138 +12,134 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+// Compares loading a large build log in the text format of version 8 with
+// loading it in the binary format it migrates to, with and without looking
+// up every entry afterwards as a no-op build does.
+
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 
-#include "build_log.h"
-#include "graph.h"
-#include "manifest_parser.h"
-#include "metrics.h"
-#include "state.h"
-#include "util.h"
+#include <string>
+#include <vector>
 
 #ifndef _WIN32
 #include <unistd.h>
 #endif
 
+#include "build_log.h"
+#include "metrics.h"
+#include "util.h"
+
 using namespace std;
 
-const char kTestFilename[] = "BuildLogPerfTest-tempfile";
+namespace {
+
+const char kLogPath[] = "BuildLogPerfTest-tempfile";
 
 struct NoDeadPaths : public BuildLogUser {
   virtual bool IsPathDead(StringPiece) const { return false; }
 };
 
-bool WriteTestData(string* err) {
-  BuildLog log;
-
-  NoDeadPaths no_dead_paths;
-  if (!log.OpenForWrite(kTestFilename, no_dead_paths, err))
+/// Write a version 8 log of \a count entries for \a paths.
+bool WriteTextLog(const vector<string>& paths, int count) {
+  FILE* f = fopen(kLogPath, "wb");
+  if (!f)
     return false;
-
-  /*
-  A histogram of command lengths in chromium. For example, 407 builds,
-  1.4% of all builds, had commands longer than 32 bytes but shorter than 64.
-       32    407   1.4%
-       64    183   0.6%
-      128   1461   5.1%
-      256    791   2.8%
-      512   1314   4.6%
-     1024   6114  21.3%
-     2048  11759  41.0%
-     4096   2056   7.2%
-     8192   4567  15.9%
-    16384     13   0.0%
-    32768      4   0.0%
-    65536      5   0.0%
-  The average command length is 4.1 kB and there were 28674 commands in total,
-  which makes for a total log size of ~120 MB (also counting output filenames).
-
-  Based on this, write 30000 many 4 kB long command lines.
-  */
-
-  // ManifestParser is the only object allowed to create Rules.
-  const size_t kRuleSize = 4000;
-  string long_rule_command = "gcc ";
-  for (int i = 0; long_rule_command.size() < kRuleSize; ++i) {
-    char buf[80];
-    sprintf(buf, "-I../../and/arbitrary/but/fairly/long/path/suffixed/%d ", i);
-    long_rule_command += buf;
+  fprintf(f, "# ninja log v8\n");
+  for (int i = 0; i < count; ++i) {
+    const string& path = paths[i % paths.size()];
+    uint64_t hash = BuildLog::LogEntry::HashCommand("cc -c " + path);
+    fprintf(f, "%d\t%d\t%d\t%s\t%" PRIx64 "\t%d\t%d\t%d\t0\t%d\n", i, i + 100, 1700000000 + i, path.c_str(), hash,
+            20000 + i % 1000, 90 + i % 50, 10, 64);
   }
-  long_rule_command += "$in -o $out\n";
-
-  State state;
-  ManifestParser parser(&state, NULL);
-  if (!parser.ParseTest("rule cxx\n  command = " + long_rule_command, err))
-    return false;
+  return fclose(f) == 0;
+}
 
-  // Create build edges. Using ManifestParser is as fast as using the State api
-  // for edge creation, so just use that.
-  const int kNumCommands = 30000;
-  string build_rules;
-  for (int i = 0; i < kNumCommands; ++i) {
-    char buf[80];
-    sprintf(buf, "build input%d.o: cxx input%d.cc\n", i, i);
-    build_rules += buf;
+/// Load the log, and then look up each of \a paths if \a lookup.
+/// @return the milliseconds it took, or -1 on error.
+int TimeLoad(const vector<string>& paths, bool lookup) {
+  int64_t start = GetTimeMillis();
+  BuildLog log;
+  string err;
+  if (log.Load(kLogPath, &err) != LOAD_SUCCESS || !err.empty()) {
+    fprintf(stderr, "load: %s\n", err.c_str());
+    return -1;
   }
-
-  if (!parser.ParseTest(build_rules, err))
-    return false;
-
-  for (int i = 0; i < kNumCommands; ++i) {
-    log.RecordCommand(state.edges_[i],
-                      /*start_time=*/100 * i,
-                      /*end_time=*/100 * i + 1,
-                      /*mtime=*/0);
+  if (lookup) {
+    for (size_t i = 0; i < paths.size(); ++i) {
+      if (!log.LookupByOutput(paths[i])) {
+        fprintf(stderr, "no entry for %s\n", paths[i].c_str());
+        return -1;
+      }
+    }
   }
+  return (int)(GetTimeMillis() - start);
+}
 
-  return true;
+/// The best of \a runs of TimeLoad().
+int BestLoad(const vector<string>& paths, bool lookup, int runs) {
+  int best = -1;
+  for (int i = 0; i < runs; ++i) {
+    int t = TimeLoad(paths, lookup);
+    if (t < 0)
+      return -1;
+    if (best < 0 || t < best)
+      best = t;
+  }
+  return best;
 }
 
-int main() {
-  vector<int> times;
-  string err;
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+  int outputs = argc > 1 ? atoi(argv[1]) : 1000000;
+  const int kRuns = 3;
 
-  if (!WriteTestData(&err)) {
-    fprintf(stderr, "Failed to write test data: %s\n", err.c_str());
+  vector<string> paths;
+  char path[128];
+  for (int i = 0; i < outputs; ++i) {
+    snprintf(path, sizeof(path), "out/obj/third_party/lib%d/src/module_%d.o", i / 100, i);
+    paths.push_back(path);
+  }
+
+  printf("writing a text log of %d outputs...\n", outputs);
+  if (!WriteTextLog(paths, outputs)) {
+    perror(kLogPath);
     return 1;
   }
+  // The first load interns the paths, as parsing the manifest would.
+  if (TimeLoad(paths, false) < 0)
+    return 1;
+  int text = BestLoad(paths, false, kRuns);
+  int text_lookup = BestLoad(paths, true, kRuns);
 
+  // Loading a text log and opening it for writing migrates it.
   {
-    // Read once to warm up disk cache.
     BuildLog log;
-    if (log.Load(kTestFilename, &err) == LOAD_ERROR) {
-      fprintf(stderr, "Failed to read test data: %s\n", err.c_str());
-      return 1;
-    }
-  }
-  const int kNumRepetitions = 5;
-  for (int i = 0; i < kNumRepetitions; ++i) {
+    NoDeadPaths user;
+    string err;
     int64_t start = GetTimeMillis();
-    BuildLog log;
-    if (log.Load(kTestFilename, &err) == LOAD_ERROR) {
-      fprintf(stderr, "Failed to read test data: %s\n", err.c_str());
+    if (log.Load(kLogPath, &err) != LOAD_SUCCESS || !log.OpenForWrite(kLogPath, user, &err)) {
+      fprintf(stderr, "migrate: %s\n", err.c_str());
       return 1;
     }
-    int delta = (int)(GetTimeMillis() - start);
-    printf("%dms\n", delta);
-    times.push_back(delta);
+    log.Close();
+    printf("migrate to binary  %5dms\n", (int)(GetTimeMillis() - start));
   }
+  int binary = BestLoad(paths, false, kRuns);
+  int binary_lookup = BestLoad(paths, true, kRuns);
+  if (text < 0 || text_lookup < 0 || binary < 0 || binary_lookup < 0)
+    return 1;
 
-  int min = times[0];
-  int max = times[0];
-  float total = 0;
-  for (size_t i = 0; i < times.size(); ++i) {
-    total += times[i];
-    if (times[i] < min)
-      min = times[i];
-    else if (times[i] > max)
-      max = times[i];
-  }
-
-  printf("min %dms  max %dms  avg %.1fms\n", min, max, total / times.size());
-
-  unlink(kTestFilename);
-
+  printf("text load          %5dms\n", text);
+  printf("text load+lookup   %5dms\n", text_lookup);
+  printf("binary load        %5dms\n", binary);
+  printf("binary load+lookup %5dms\n", binary_lookup);
+  unlink(kLogPath);
   return 0;
 }
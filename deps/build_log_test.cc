@@ -14,6 +14,7 @@
 
 #include "build_log.h"
 
+#include "hash_map.h"
 #include "test.h"
 #include "util.h"
 
@@ -33,6 +34,11 @@ namespace {
 
 const char kTestFilename[] = "BuildLogTest-tempfile";
 
+/// The hash of \a command in logs before version 10.
+uint64_t OldHash(const char* command) {
+  return MurmurHash64A(command, strlen(command));
+}
+
 struct BuildLogTest : public StateTestWithBuiltinRules, public BuildLogUser {
   virtual void SetUp() {
     // In case a crashing test left a stale file behind.
@@ -73,8 +79,8 @@ TEST_F(BuildLogTest, WriteRead) {
 }
 
 TEST_F(BuildLogTest, FirstWriteAddsSignature) {
-  const char kExpectedVersion[] = "# ninja log vX\n";
-  const size_t kVersionPos = strlen(kExpectedVersion) - 2;  // Points at 'X'.
+  const char kExpectedVersion[] = "# ninja log vXX\n";
+  const size_t kVersionPos = strlen(kExpectedVersion) - 3;  // Points at 'XX'.
 
   BuildLog log;
   string contents, err;
@@ -85,8 +91,8 @@ TEST_F(BuildLogTest, FirstWriteAddsSignature) {
 
   ASSERT_EQ(0, ReadFile(kTestFilename, &contents, &err));
   ASSERT_EQ("", err);
-  if (contents.size() >= kVersionPos)
-    contents[kVersionPos] = 'X';
+  if (contents.size() >= kVersionPos + 2)
+    contents.replace(kVersionPos, 2, "XX");
   EXPECT_EQ(kExpectedVersion, contents);
 
   // Opening the file anew shouldn't add a second version string.
@@ -97,16 +103,16 @@ TEST_F(BuildLogTest, FirstWriteAddsSignature) {
   contents.clear();
   ASSERT_EQ(0, ReadFile(kTestFilename, &contents, &err));
   ASSERT_EQ("", err);
-  if (contents.size() >= kVersionPos)
-    contents[kVersionPos] = 'X';
+  if (contents.size() >= kVersionPos + 2)
+    contents.replace(kVersionPos, 2, "XX");
   EXPECT_EQ(kExpectedVersion, contents);
 }
 
 TEST_F(BuildLogTest, DoubleEntry) {
   FILE* f = fopen(kTestFilename, "wb");
   fprintf(f, "# ninja log v6\n");
-  fprintf(f, "0\t1\t2\tout\t%" PRIx64 "\n", BuildLog::LogEntry::HashCommand("command abc"));
-  fprintf(f, "0\t1\t2\tout\t%" PRIx64 "\n", BuildLog::LogEntry::HashCommand("command def"));
+  fprintf(f, "0\t1\t2\tout\t%" PRIx64 "\n", OldHash("command abc"));
+  fprintf(f, "0\t1\t2\tout\t%" PRIx64 "\n", OldHash("command def"));
   fclose(f);
 
   string err;
@@ -116,7 +122,7 @@ TEST_F(BuildLogTest, DoubleEntry) {
 
   BuildLog::LogEntry* e = log.LookupByOutput("out");
   ASSERT_TRUE(e);
-  ASSERT_NO_FATAL_FAILURE(AssertHash("command def", e->command_hash));
+  EXPECT_TRUE(e->MatchesCommand("command def"));
 }
 
 TEST_F(BuildLogTest, Truncate) {
@@ -176,7 +182,7 @@ TEST_F(BuildLogTest, ObsoleteOldVersion) {
 TEST_F(BuildLogTest, SpacesInOutput) {
   FILE* f = fopen(kTestFilename, "wb");
   fprintf(f, "# ninja log v6\n");
-  fprintf(f, "123\t456\t456\tout with space\t%" PRIx64 "\n", BuildLog::LogEntry::HashCommand("command"));
+  fprintf(f, "123\t456\t456\tout with space\t%" PRIx64 "\n", OldHash("command"));
   fclose(f);
 
   string err;
@@ -189,7 +195,227 @@ TEST_F(BuildLogTest, SpacesInOutput) {
   ASSERT_EQ(123, e->start_time);
   ASSERT_EQ(456, e->end_time);
   ASSERT_EQ(456, e->mtime);
-  ASSERT_NO_FATAL_FAILURE(AssertHash("command", e->command_hash));
+  EXPECT_TRUE(e->MatchesCommand("command"));
+}
+
+TEST_F(BuildLogTest, ResourceUsage) {
+  AssertParse(&state_,
+              "build out: cat mid\n"
+              "build mid: cat in\n");
+
+  BuildLog log1;
+  string err;
+  EXPECT_TRUE(log1.OpenForWrite(kTestFilename, *this, &err));
+  ASSERT_EQ("", err);
+  ResourceUsage usage;
+  usage.peak_rss_kb = 123456;
+  usage.user_time_millis = 2500;
+  usage.system_time_millis = 300;
+  usage.read_blocks = 8;
+  usage.written_blocks = 4096;
+  log1.RecordCommand(state_.edges_[0], 15, 18, 0, usage);
+  log1.RecordCommand(state_.edges_[1], 20, 25);
+  log1.Close();
+
+  BuildLog log2;
+  EXPECT_TRUE(log2.Load(kTestFilename, &err));
+  ASSERT_EQ("", err);
+  BuildLog::LogEntry* e = log2.LookupByOutput("out");
+  ASSERT_TRUE(e);
+  EXPECT_EQ(123456, e->usage.peak_rss_kb);
+  EXPECT_EQ(2500, e->usage.user_time_millis);
+  EXPECT_EQ(300, e->usage.system_time_millis);
+  EXPECT_EQ(8, e->usage.read_blocks);
+  EXPECT_EQ(4096, e->usage.written_blocks);
+  EXPECT_TRUE(*e == *log1.LookupByOutput("out"));
+  e = log2.LookupByOutput("mid");
+  ASSERT_TRUE(e);
+  EXPECT_EQ(0, e->usage.peak_rss_kb);
+  EXPECT_EQ(0, e->usage.user_time_millis);
+}
+
+TEST_F(BuildLogTest, UpgradeV6) {
+  // Version 6 lines have no peak RSS; they load as unknown and the log is
+  // rewritten in the current version.
+  FILE* f = fopen(kTestFilename, "wb");
+  fprintf(f, "# ninja log v6\n");
+  fprintf(f, "123\t456\t456\tout\t%" PRIx64 "\n", OldHash("command"));
+  fclose(f);
+
+  string err;
+  BuildLog log;
+  EXPECT_TRUE(log.Load(kTestFilename, &err));
+  ASSERT_EQ("", err);
+  BuildLog::LogEntry* e = log.LookupByOutput("out");
+  ASSERT_TRUE(e);
+  EXPECT_EQ(456, e->mtime);
+  EXPECT_EQ(0, e->usage.peak_rss_kb);
+  EXPECT_TRUE(e->MatchesCommand("command"));
+
+  EXPECT_TRUE(log.OpenForWrite(kTestFilename, *this, &err));
+  ASSERT_EQ("", err);
+  log.Close();
+  string contents;
+  ASSERT_EQ(0, ReadFile(kTestFilename, &contents, &err));
+  EXPECT_EQ(0u, contents.find("# ninja log v10\n"));
+
+  // The rewritten log is binary, and holds the same.
+  BuildLog log2;
+  EXPECT_TRUE(log2.Load(kTestFilename, &err));
+  ASSERT_EQ("", err);
+  BuildLog::LogEntry* e2 = log2.LookupByOutput("out");
+  ASSERT_TRUE(e2);
+  EXPECT_TRUE(*e == *e2);
+}
+
+TEST_F(BuildLogTest, UpgradeV9) {
+  // Version 9 records hold MurmurHash64A hashes.  They stay valid through
+  // the upgrade until the command runs again.
+  AssertParse(&state_, "build out: cat in\n");
+  string command = state_.edges_[0]->EvaluateCommand(true);
+  FILE* f = fopen(kTestFilename, "wb");
+  fprintf(f, "# ninja log v9\n");
+  uint32_t path_offset = (uint32_t)ftell(f);
+  uint32_t tag = 0x80000000 | 3;
+  fwrite(&tag, sizeof(tag), 1, f);
+  fwrite("out", 1, 3, f);
+  int32_t times[2] = { 123, 456 };
+  uint32_t reserved = 0;
+  int64_t mtime = 456;
+  uint64_t hash = MurmurHash64A(command.data(), command.size());
+  int64_t usage[5] = { 2048, 0, 0, 0, 0 };
+  fwrite(&path_offset, sizeof(path_offset), 1, f);
+  fwrite(times, sizeof(times), 1, f);
+  fwrite(&reserved, sizeof(reserved), 1, f);
+  fwrite(&mtime, sizeof(mtime), 1, f);
+  fwrite(&hash, sizeof(hash), 1, f);
+  fwrite(usage, sizeof(usage), 1, f);
+  fclose(f);
+
+  string err;
+  {
+    BuildLog log;
+    EXPECT_TRUE(log.Load(kTestFilename, &err));
+    ASSERT_EQ("", err);
+    BuildLog::LogEntry* e = log.LookupByOutput("out");
+    ASSERT_TRUE(e);
+    EXPECT_TRUE(e->legacy_hash);
+    EXPECT_TRUE(e->MatchesCommand(command));
+    EXPECT_EQ(2048, e->usage.peak_rss_kb);
+    EXPECT_TRUE(log.OpenForWrite(kTestFilename, *this, &err));
+    ASSERT_EQ("", err);
+    log.Close();
+  }
+  string contents;
+  ASSERT_EQ(0, ReadFile(kTestFilename, &contents, &err));
+  EXPECT_EQ(0u, contents.find("# ninja log v10\n"));
+
+  {
+    BuildLog log;
+    EXPECT_TRUE(log.Load(kTestFilename, &err));
+    ASSERT_EQ("", err);
+    BuildLog::LogEntry* e = log.LookupByOutput("out");
+    ASSERT_TRUE(e);
+    EXPECT_TRUE(e->legacy_hash);
+    EXPECT_TRUE(e->MatchesCommand(command));
+    EXPECT_FALSE(e->MatchesCommand(command + " "));
+    EXPECT_TRUE(log.OpenForWrite(kTestFilename, *this, &err));
+    log.RecordCommand(state_.edges_[0], 1, 2);
+    log.Close();
+  }
+
+  BuildLog log;
+  EXPECT_TRUE(log.Load(kTestFilename, &err));
+  ASSERT_EQ("", err);
+  BuildLog::LogEntry* e = log.LookupByOutput("out");
+  ASSERT_TRUE(e);
+  EXPECT_FALSE(e->legacy_hash);
+  EXPECT_EQ(BuildLog::LogEntry::HashCommand(command), e->command_hash);
+  EXPECT_TRUE(e->MatchesCommand(command));
+}
+
+TEST_F(BuildLogTest, AppendAfterLoad) {
+  AssertParse(&state_,
+              "build out: cat mid\n"
+              "build mid: cat in\n");
+  string err;
+  {
+    BuildLog log1;
+    EXPECT_TRUE(log1.OpenForWrite(kTestFilename, *this, &err));
+    log1.RecordCommand(state_.edges_[1], 1, 2);
+    log1.Close();
+  }
+  {
+    // Appending refers to the paths already in the file.
+    BuildLog log2;
+    EXPECT_TRUE(log2.Load(kTestFilename, &err));
+    EXPECT_TRUE(log2.OpenForWrite(kTestFilename, *this, &err));
+    ASSERT_EQ("", err);
+    log2.RecordCommand(state_.edges_[1], 3, 4);
+    log2.RecordCommand(state_.edges_[0], 5, 6);
+    log2.Close();
+  }
+
+  string contents;
+  ASSERT_EQ(0, ReadFile(kTestFilename, &contents, &err));
+  size_t mid = contents.find("mid");
+  EXPECT_NE(string::npos, mid);
+  EXPECT_EQ(string::npos, contents.find("mid", mid + 1));
+
+  BuildLog log3;
+  EXPECT_TRUE(log3.Load(kTestFilename, &err));
+  ASSERT_EQ("", err);
+  ASSERT_EQ(2u, log3.entries().size());
+  EXPECT_EQ(3, log3.LookupByOutput("mid")->start_time);
+  EXPECT_EQ(5, log3.LookupByOutput("out")->start_time);
+}
+
+TEST_F(BuildLogTest, RecoverTruncatedRecord) {
+  AssertParse(&state_,
+              "build out: cat mid\n"
+              "build mid: cat in\n");
+  string err;
+  {
+    BuildLog log1;
+    EXPECT_TRUE(log1.OpenForWrite(kTestFilename, *this, &err));
+    log1.RecordCommand(state_.edges_[0], 1, 2);
+    log1.RecordCommand(state_.edges_[1], 3, 4);
+    log1.Close();
+  }
+  string contents;
+  ASSERT_EQ(0, ReadFile(kTestFilename, &contents, &err));
+  ASSERT_TRUE(Truncate(kTestFilename, contents.size() - 10, &err));
+
+  // The cut entry record is dropped, and the file cut back to the record
+  // before, the path record of "mid".
+  BuildLog log2;
+  EXPECT_EQ(LOAD_SUCCESS, log2.Load(kTestFilename, &err));
+  EXPECT_NE(string::npos, err.find("recovering"));
+  EXPECT_TRUE(log2.LookupByOutput("out"));
+  EXPECT_FALSE(log2.LookupByOutput("mid"));
+  string truncated;
+  ASSERT_EQ(0, ReadFile(kTestFilename, &truncated, &err));
+  EXPECT_EQ(contents.substr(0, truncated.size()), truncated);
+  EXPECT_EQ(contents.find("mid") + 3, truncated.size());
+}
+
+TEST_F(BuildLogTest, UpgradeV7) {
+  // Version 7 lines have only the peak RSS.
+  FILE* f = fopen(kTestFilename, "wb");
+  fprintf(f, "# ninja log v7\n");
+  fprintf(f, "123\t456\t456\tout\t%" PRIx64 "\t2048\n", OldHash("command"));
+  fclose(f);
+
+  string err;
+  BuildLog log;
+  EXPECT_TRUE(log.Load(kTestFilename, &err));
+  ASSERT_EQ("", err);
+  BuildLog::LogEntry* e = log.LookupByOutput("out");
+  ASSERT_TRUE(e);
+  EXPECT_TRUE(e->MatchesCommand("command"));
+  EXPECT_EQ(2048, e->usage.peak_rss_kb);
+  EXPECT_EQ(0, e->usage.user_time_millis);
+  EXPECT_EQ(0, e->usage.written_blocks);
 }
 
 TEST_F(BuildLogTest, DuplicateVersionHeader) {
@@ -198,9 +424,9 @@ TEST_F(BuildLogTest, DuplicateVersionHeader) {
   // should be ignored.
   FILE* f = fopen(kTestFilename, "wb");
   fprintf(f, "# ninja log v6\n");
-  fprintf(f, "123\t456\t456\tout\t%" PRIx64 "\n", BuildLog::LogEntry::HashCommand("command"));
+  fprintf(f, "123\t456\t456\tout\t%" PRIx64 "\n", OldHash("command"));
   fprintf(f, "# ninja log v6\n");
-  fprintf(f, "456\t789\t789\tout2\t%" PRIx64 "\n", BuildLog::LogEntry::HashCommand("command2"));
+  fprintf(f, "456\t789\t789\tout2\t%" PRIx64 "\n", OldHash("command2"));
   fclose(f);
 
   string err;
@@ -213,14 +439,14 @@ TEST_F(BuildLogTest, DuplicateVersionHeader) {
   ASSERT_EQ(123, e->start_time);
   ASSERT_EQ(456, e->end_time);
   ASSERT_EQ(456, e->mtime);
-  ASSERT_NO_FATAL_FAILURE(AssertHash("command", e->command_hash));
+  EXPECT_TRUE(e->MatchesCommand("command"));
 
   e = log.LookupByOutput("out2");
   ASSERT_TRUE(e);
   ASSERT_EQ(456, e->start_time);
   ASSERT_EQ(789, e->end_time);
   ASSERT_EQ(789, e->mtime);
-  ASSERT_NO_FATAL_FAILURE(AssertHash("command2", e->command_hash));
+  EXPECT_TRUE(e->MatchesCommand("command2"));
 }
 
 struct TestDiskInterface : public DiskInterface {
@@ -283,7 +509,7 @@ TEST_F(BuildLogTest, VeryLongInputLine) {
   for (size_t i = 0; i < (512 << 10) / strlen(" more_command"); ++i)
     fputs(" more_command", f);
   fprintf(f, "\n");
-  fprintf(f, "456\t789\t789\tout2\t%" PRIx64 "\n", BuildLog::LogEntry::HashCommand("command2"));
+  fprintf(f, "456\t789\t789\tout2\t%" PRIx64 "\n", OldHash("command2"));
   fclose(f);
 
   string err;
@@ -299,7 +525,7 @@ TEST_F(BuildLogTest, VeryLongInputLine) {
   ASSERT_EQ(456, e->start_time);
   ASSERT_EQ(789, e->end_time);
   ASSERT_EQ(789, e->mtime);
-  ASSERT_NO_FATAL_FAILURE(AssertHash("command2", e->command_hash));
+  EXPECT_TRUE(e->MatchesCommand("command2"));
 }
 
 TEST_F(BuildLogTest, MultiTargetEdge) {
@@ -348,8 +574,12 @@ TEST_F(BuildLogRecompactTest, Recompact) {
   ASSERT_EQ(2u, log2.entries().size());
   ASSERT_TRUE(log2.LookupByOutput("out"));
   ASSERT_TRUE(log2.LookupByOutput("out2"));
-  // ...and force a recompaction.
+  // ...and recompact, which opening for write leaves for later.
+  EXPECT_TRUE(log2.needs_recompaction());
   EXPECT_TRUE(log2.OpenForWrite(kTestFilename, *this, &err));
+  EXPECT_TRUE(log2.needs_recompaction());
+  EXPECT_TRUE(log2.Recompact(kTestFilename, *this, &err));
+  EXPECT_FALSE(log2.needs_recompaction());
   log2.Close();
 
   // "out2" is dead, it should've been removed.
@@ -361,4 +591,44 @@ TEST_F(BuildLogRecompactTest, Recompact) {
   ASSERT_FALSE(log2.LookupByOutput("out2"));
 }
 
+TEST_F(BuildLogRecompactTest, RecompactAfterAppending) {
+  AssertParse(&state_,
+              "build out: cat in\n"
+              "build out3: cat in\n");
+
+  BuildLog log1;
+  string err;
+  EXPECT_TRUE(log1.OpenForWrite(kTestFilename, *this, &err));
+  ASSERT_EQ("", err);
+  for (int i = 0; i < 200; ++i)
+    log1.RecordCommand(state_.edges_[0], 15, 18 + i);
+  log1.Close();
+
+  // Recompacting once the log was appended to keeps what was appended.
+  BuildLog log2;
+  EXPECT_TRUE(log2.Load(kTestFilename, &err));
+  ASSERT_EQ("", err);
+  EXPECT_TRUE(log2.needs_recompaction());
+  EXPECT_TRUE(log2.OpenForWrite(kTestFilename, *this, &err));
+  log2.RecordCommand(state_.edges_[0], 30, 31);
+  log2.RecordCommand(state_.edges_[1], 40, 41);
+  EXPECT_TRUE(log2.Recompact(kTestFilename, *this, &err));
+  ASSERT_EQ("", err);
+  log2.Close();
+
+  BuildLog log3;
+  EXPECT_TRUE(log3.Load(kTestFilename, &err));
+  ASSERT_EQ("", err);
+  EXPECT_FALSE(log3.needs_recompaction());
+  ASSERT_EQ(2u, log3.entries().size());
+  BuildLog::LogEntry* e = log3.LookupByOutput("out");
+  ASSERT_TRUE(e);
+  EXPECT_EQ(31, e->end_time);
+  e = log3.LookupByOutput("out3");
+  ASSERT_TRUE(e);
+  EXPECT_EQ(41, e->end_time);
+  struct stat statbuf;
+  EXPECT_NE(0, stat((kTestFilename + string(".recompact")).c_str(), &statbuf));
+}
+
 }  // anonymous namespace
@@ -27,7 +27,9 @@
 using namespace std;
 
 struct CompareEdgesByOutput {
-  static bool cmp(const Edge* a, const Edge* b) { return a->outputs_[0]->path() < b->outputs_[0]->path(); }
+  static bool cmp(const Edge* a, const Edge* b) {
+    return a->outputs_[0]->path().AsString() < b->outputs_[0]->path().AsString();
+  }
 };
 
 /// Fixture for tests involving Plan.
@@ -94,6 +96,35 @@ TEST_F(PlanTest, Basic) {
 }
 
 // Test that two outputs from one rule can be handled as inputs to the next.
+TEST_F(PlanTest, RepeatedInputs) {
+  // An edge reading two outputs of one edge, one of them twice, waits for
+  // that edge and nothing more.
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+                                      "build a b: cat in\n"
+                                      "build c: cat in\n"
+                                      "build out: cat a b a c\n"));
+  GetNode("a")->MarkDirty();
+  GetNode("b")->MarkDirty();
+  GetNode("c")->MarkDirty();
+  GetNode("out")->MarkDirty();
+  PrepareForTarget("out");
+
+  deque<Edge*> edges;
+  FindWorkSorted(&edges, 2);
+  string err;
+  ASSERT_TRUE(plan_.EdgeFinished(edges[0], Plan::kEdgeSucceeded, &err));
+  ASSERT_EQ("", err);
+  ASSERT_FALSE(plan_.FindWork());
+  ASSERT_TRUE(plan_.EdgeFinished(edges[1], Plan::kEdgeSucceeded, &err));
+  ASSERT_EQ("", err);
+
+  Edge* edge = plan_.FindWork();
+  ASSERT_TRUE(edge);
+  EXPECT_EQ("out", edge->outputs_[0]->path());
+  ASSERT_TRUE(plan_.EdgeFinished(edge, Plan::kEdgeSucceeded, &err));
+  EXPECT_FALSE(plan_.more_to_do());
+}
+
 TEST_F(PlanTest, DoubleOutputDirect) {
   ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
                                       "build out: cat mid1 mid2\n"
@@ -510,12 +541,158 @@ TEST_F(PlanTest, PriorityWithoutBuildLog) {
   EXPECT_FALSE(plan_.FindWork());
 }
 
+TEST_F(PlanTest, PriorityWithElapsedTimes) {
+  // With recorded times, the critical path is the slowest chain rather than
+  // the deepest one.  Test with the following graph:
+  //   a1  b1
+  //   |   |
+  //   a0  b0  c0
+  //    \  |  /
+  //      out
+  // where b0 is slow, and c0 never ran but shares b0's rule.
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+                                      "rule r\n"
+                                      "  command = unused\n"
+                                      "rule slow\n"
+                                      "  command = unused\n"
+                                      "build out: r a0 b0 c0\n"
+                                      "build a0: r a1\n"
+                                      "build b0: slow b1\n"
+                                      "build c0: slow\n"));
+  GetNode("a0")->MarkDirty();
+  GetNode("b0")->MarkDirty();
+  GetNode("c0")->MarkDirty();
+  GetNode("out")->MarkDirty();
+  GetNode("out")->in_edge()->prev_elapsed_time_millis = 10;
+  GetNode("a0")->in_edge()->prev_elapsed_time_millis = 20;
+  GetNode("b0")->in_edge()->prev_elapsed_time_millis = 100;
+  PrepareForTarget("out");
+
+  EXPECT_EQ(10, GetNode("out")->in_edge()->critical_path_weight());
+  EXPECT_EQ(30, GetNode("a0")->in_edge()->critical_path_weight());
+  EXPECT_EQ(110, GetNode("b0")->in_edge()->critical_path_weight());
+  EXPECT_EQ(110, GetNode("c0")->in_edge()->critical_path_weight());
+
+  Edge* edge = plan_.FindWork();
+  ASSERT_TRUE(edge != nullptr);
+  EXPECT_TRUE(edge == GetNode("b0")->in_edge() || edge == GetNode("c0")->in_edge());
+}
+
+TEST_F(PlanTest, PriorityWithPool) {
+  // Each of three edges queued on a pool of depth one expects to wait for
+  // half of the other two.
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+                                      "pool link\n"
+                                      "  depth = 1\n"
+                                      "rule r\n"
+                                      "  command = unused\n"
+                                      "rule link\n"
+                                      "  command = unused\n"
+                                      "  pool = link\n"
+                                      "build out: r a b l1 l2 l3\n"
+                                      "build a: r\n"
+                                      "build b: r\n"
+                                      "build l1: link\n"
+                                      "build l2: link\n"
+                                      "build l3: link\n"));
+  const char* dirty[] = { "a", "b", "l1", "l2", "l3", "out" };
+  for (size_t i = 0; i < sizeof(dirty) / sizeof(dirty[0]); ++i) {
+    GetNode(dirty[i])->MarkDirty();
+    GetNode(dirty[i])->in_edge()->prev_elapsed_time_millis = 10;
+  }
+  GetNode("a")->in_edge()->prev_elapsed_time_millis = 15;
+  PrepareForTarget("out");
+
+  EXPECT_EQ(25, GetNode("a")->in_edge()->critical_path_weight());
+  EXPECT_EQ(20, GetNode("b")->in_edge()->critical_path_weight());
+  EXPECT_EQ(30, GetNode("l1")->in_edge()->critical_path_weight());
+
+  // The pool's first edge is the most urgent.
+  Edge* edge = plan_.FindWork();
+  ASSERT_TRUE(edge != nullptr);
+  EXPECT_EQ("link", edge->pool()->name());
+}
+
+TEST_F(PlanTest, MemoryBudget) {
+  // Three links that each used 4G last time, or say they will, share a
+  // budget of 10G with a compile of unknown size.
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+                                      "rule link\n"
+                                      "  command = unused\n"
+                                      "  memory = 4G\n"
+                                      "build out: cat l1 l2 l3 c\n"
+                                      "build l1: link\n"
+                                      "build l2: link\n"
+                                      "build l3: link\n"
+                                      "build c: cat\n"));
+  const char* dirty[] = { "l1", "l2", "l3", "c", "out" };
+  for (size_t i = 0; i < sizeof(dirty) / sizeof(dirty[0]); ++i)
+    GetNode(dirty[i])->MarkDirty();
+  GetNode("l1")->in_edge()->prev_elapsed_time_millis = 2000;
+  GetNode("l2")->in_edge()->prev_elapsed_time_millis = 2000;
+  GetNode("c")->in_edge()->prev_elapsed_time_millis = 1;
+  // l3 recorded its peak, and is the most urgent; the others fall back on
+  // the binding.
+  GetNode("l3")->in_edge()->prev_peak_rss_kb = 4 << 20;
+  GetNode("l3")->in_edge()->prev_elapsed_time_millis = 3000;
+  plan_.set_memory_budget(10 << 20);
+  PrepareForTarget("out");
+
+  // Two links fit, and the compile fills in beside them.
+  Edge* first = plan_.FindWork();
+  ASSERT_TRUE(first);
+  EXPECT_EQ("l3", first->outputs_[0]->path());
+  Edge* second = plan_.FindWork();
+  ASSERT_TRUE(second);
+  EXPECT_EQ("link", second->rule().name());
+  Edge* compile = plan_.FindWork();
+  ASSERT_TRUE(compile);
+  EXPECT_EQ("c", compile->outputs_[0]->path());
+  EXPECT_FALSE(plan_.FindWork());
+
+  // A finished link makes room for the last.
+  string err;
+  ASSERT_TRUE(plan_.EdgeFinished(first, Plan::kEdgeSucceeded, &err));
+  ASSERT_EQ("", err);
+  Edge* third = plan_.FindWork();
+  ASSERT_TRUE(third);
+  EXPECT_EQ("link", third->rule().name());
+  EXPECT_NE(second, third);
+  EXPECT_FALSE(plan_.FindWork());
+}
+
+TEST_F(PlanTest, MemoryBudgetOversized) {
+  // A command larger than the whole budget runs, but only alone; one of
+  // its rule that never ran is expected to use as much.
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+                                      "rule link\n"
+                                      "  command = unused\n"
+                                      "build out: cat big1 big2\n"
+                                      "build big1: link\n"
+                                      "build big2: link\n"));
+  GetNode("big1")->MarkDirty();
+  GetNode("big2")->MarkDirty();
+  GetNode("out")->MarkDirty();
+  GetNode("big1")->in_edge()->prev_peak_rss_kb = 8 << 20;
+  plan_.set_memory_budget(1 << 20);
+  PrepareForTarget("out");
+
+  Edge* first = plan_.FindWork();
+  ASSERT_TRUE(first);
+  EXPECT_FALSE(plan_.FindWork());
+  string err;
+  ASSERT_TRUE(plan_.EdgeFinished(first, Plan::kEdgeFailed, &err));
+  Edge* second = plan_.FindWork();
+  ASSERT_TRUE(second);
+  EXPECT_NE(first, second);
+}
+
 /// Fake implementation of CommandRunner, useful for tests.
 struct FakeCommandRunner : public CommandRunner {
   explicit FakeCommandRunner(VirtualFileSystem* fs) : max_active_edges_(1), fs_(fs) {}
 
   // CommandRunner impl
-  virtual size_t CanRunMore() const;
+  virtual size_t CanRunMore();
   virtual bool StartCommand(Edge* edge);
   virtual bool WaitForCommand(Result* result);
   virtual vector<Edge*> GetActiveEdges();
@@ -616,7 +793,7 @@ void BuildTest::RebuildTarget(const string& target, const char* manifest, const
   builder.command_runner_.release();
 }
 
-size_t FakeCommandRunner::CanRunMore() const {
+size_t FakeCommandRunner::CanRunMore() {
   if (active_edges_.size() < max_active_edges_)
     return SIZE_MAX;
 
@@ -631,8 +808,8 @@ bool FakeCommandRunner::StartCommand(Edge* edge) {
       edge->rule().name() == "cc" || edge->rule().name() == "cp_multi_msvc" || edge->rule().name() == "cp_multi_gcc" ||
       edge->rule().name() == "touch" || edge->rule().name() == "touch-interrupt" ||
       edge->rule().name() == "touch-fail-tick2") {
-    for (vector<Node*>::iterator out = edge->outputs_.begin(); out != edge->outputs_.end(); ++out) {
-      fs_->Create((*out)->path(), "");
+    for (ArenaVector<Node*>::iterator out = edge->outputs_.begin(); out != edge->outputs_.end(); ++out) {
+      fs_->Create((*out)->path().AsString(), "");
     }
   } else if (edge->rule().name() == "true" || edge->rule().name() == "fail" || edge->rule().name() == "interrupt" ||
              edge->rule().name() == "console") {
@@ -642,20 +819,20 @@ bool FakeCommandRunner::StartCommand(Edge* edge) {
     assert(edge->outputs_.size() == 1);
     string content;
     string err;
-    if (fs_->ReadFile(edge->inputs_[0]->path(), &content, &err) == DiskInterface::Okay)
-      fs_->WriteFile(edge->outputs_[0]->path(), content);
+    if (fs_->ReadFile(edge->inputs_[0]->path().AsString(), &content, &err) == DiskInterface::Okay)
+      fs_->WriteFile(edge->outputs_[0]->path().AsString(), content);
   } else if (edge->rule().name() == "touch-implicit-dep-out") {
     string dep = edge->GetBinding("test_dependency");
     fs_->Tick();
     fs_->Create(dep, "");
     fs_->Tick();
-    for (vector<Node*>::iterator out = edge->outputs_.begin(); out != edge->outputs_.end(); ++out) {
-      fs_->Create((*out)->path(), "");
+    for (ArenaVector<Node*>::iterator out = edge->outputs_.begin(); out != edge->outputs_.end(); ++out) {
+      fs_->Create((*out)->path().AsString(), "");
     }
   } else if (edge->rule().name() == "touch-out-implicit-dep") {
     string dep = edge->GetBinding("test_dependency");
-    for (vector<Node*>::iterator out = edge->outputs_.begin(); out != edge->outputs_.end(); ++out) {
-      fs_->Create((*out)->path(), "");
+    for (ArenaVector<Node*>::iterator out = edge->outputs_.begin(); out != edge->outputs_.end(); ++out) {
+      fs_->Create((*out)->path().AsString(), "");
     }
     fs_->Tick();
     fs_->Create(dep, "");
@@ -668,21 +845,21 @@ bool FakeCommandRunner::StartCommand(Edge* edge) {
       fs_->Create(dep, "");
     }
     string contents;
-    for (vector<Node*>::iterator out = edge->outputs_.begin(); out != edge->outputs_.end(); ++out) {
-      contents += (*out)->path() + ": " + dep + "\n";
-      fs_->Create((*out)->path(), "");
+    for (ArenaVector<Node*>::iterator out = edge->outputs_.begin(); out != edge->outputs_.end(); ++out) {
+      contents += (*out)->path().AsString() + ": " + dep + "\n";
+      fs_->Create((*out)->path().AsString(), "");
     }
     fs_->Create(depfile, contents);
   } else if (edge->rule().name() == "long-cc") {
     string dep = edge->GetBinding("test_dependency");
     string depfile = edge->GetUnescapedDepfile();
     string contents;
-    for (vector<Node*>::iterator out = edge->outputs_.begin(); out != edge->outputs_.end(); ++out) {
+    for (ArenaVector<Node*>::iterator out = edge->outputs_.begin(); out != edge->outputs_.end(); ++out) {
       fs_->Tick();
       fs_->Tick();
       fs_->Tick();
-      fs_->Create((*out)->path(), "");
-      contents += (*out)->path() + ": " + dep + "\n";
+      fs_->Create((*out)->path().AsString(), "");
+      contents += (*out)->path().AsString() + ": " + dep + "\n";
     }
     if (!dep.empty() && !depfile.empty())
       fs_->Create(depfile, contents);
@@ -727,8 +904,8 @@ bool FakeCommandRunner::WaitForCommand(Result* result) {
 
   if (edge->rule().name() == "cp_multi_msvc") {
     const std::string prefix = edge->GetBinding("msvc_deps_prefix");
-    for (std::vector<Node*>::iterator in = edge->inputs_.begin(); in != edge->inputs_.end(); ++in) {
-      result->output += prefix + (*in)->path() + '\n';
+    for (ArenaVector<Node*>::iterator in = edge->inputs_.begin(); in != edge->inputs_.end(); ++in) {
+      result->output += prefix + (*in)->path().AsString() + '\n';
     }
   }
 
@@ -1048,7 +1225,7 @@ TEST_F(BuildTest, EncounterReadyTwice) {
                                       "build b: touch || c\n"
                                       "build a: touch | b || c\n"));
 
-  vector<Edge*> c_out = GetNode("c")->out_edges();
+  const ArenaVector<Edge*>& c_out = GetNode("c")->out_edges();
   ASSERT_EQ(2u, c_out.size());
   EXPECT_EQ("b", c_out[0]->outputs_[0]->path());
   EXPECT_EQ("a", c_out[1]->outputs_[0]->path());
@@ -109,8 +109,8 @@ int Cleaner::CleanAll(bool generator) {
     // Do not remove generator's files unless generator specified.
     if (!generator && (*e)->GetBindingBool("generator"))
       continue;
-    for (vector<Node*>::iterator out_node = (*e)->outputs_.begin(); out_node != (*e)->outputs_.end(); ++out_node) {
-      Remove((*out_node)->path());
+    for (ArenaVector<Node*>::iterator out_node = (*e)->outputs_.begin(); out_node != (*e)->outputs_.end(); ++out_node) {
+      Remove((*out_node)->path().AsString());
     }
 
     RemoveEdgeFiles(*e);
@@ -146,10 +146,10 @@ void Cleaner::DoCleanTarget(Node* target) {
   if (Edge* e = target->in_edge()) {
     // Do not try to remove phony targets
     if (!e->is_phony()) {
-      Remove(target->path());
+      Remove(target->path().AsString());
       RemoveEdgeFiles(e);
     }
-    for (vector<Node*>::iterator n = e->inputs_.begin(); n != e->inputs_.end(); ++n) {
+    for (ArenaVector<Node*>::iterator n = e->inputs_.begin(); n != e->inputs_.end(); ++n) {
       Node* next = *n;
       // call DoCleanTarget recursively if this node has not been visited
       if (cleaned_.count(next) == 0) {
@@ -219,8 +219,9 @@ void Cleaner::DoCleanRule(const Rule* rule) {
 
   for (vector<Edge*>::iterator e = state_->edges_.begin(); e != state_->edges_.end(); ++e) {
     if ((*e)->rule().name() == rule->name()) {
-      for (vector<Node*>::iterator out_node = (*e)->outputs_.begin(); out_node != (*e)->outputs_.end(); ++out_node) {
-        Remove((*out_node)->path());
+      for (ArenaVector<Node*>::iterator out_node = (*e)->outputs_.begin(); out_node != (*e)->outputs_.end();
+           ++out_node) {
+        Remove((*out_node)->path().AsString());
         RemoveEdgeFiles(*e);
       }
     }
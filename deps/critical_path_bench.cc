@@ -0,0 +1,202 @@
+// Copyright (c) 2024 Aniket Ray
+//
+// Licensed under the MIT License; see LICENSE.txt.
+
+// Simulates scheduling a clean build of a synthetic C++ project on N job
+// slots, and reports the makespan Plan achieves with and without the
+// durations recorded by a previous build.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "build.h"
+#include "graph.h"
+#include "state.h"
+
+using namespace std;
+
+namespace {
+
+/// Deterministic across platforms, unlike rand().
+struct Random {
+  explicit Random(uint64_t seed) : state_(seed * 2654435761u + 1) {}
+
+  uint64_t Next() {
+    state_ ^= state_ << 13;
+    state_ ^= state_ >> 7;
+    state_ ^= state_ << 17;
+    return state_;
+  }
+
+  /// Uniform in [low, high].
+  int64_t Range(int64_t low, int64_t high) { return low + (int64_t)(Next() % (uint64_t)(high - low + 1)); }
+
+  uint64_t state_;
+};
+
+/// A project of |libs| libraries of 10-60 compiles each, with slow code
+/// generators feeding some of them, and 8 executables linked through a
+/// pool of depth 2.  Each edge's actual duration goes into |durations|;
+/// the previous build's record of it, within 20%, goes into
+/// prev_elapsed_time_millis when |record| is set.
+Node* MakeProject(State* state, int libs, uint64_t seed, bool record, vector<int64_t>* durations) {
+  Random random(seed);
+  Random noise(seed + 1);  // Kept apart so |record| doesn't change the graph.
+  Rule* cc = new Rule("cc");
+  Rule* gen = new Rule("gen");
+  Rule* ar = new Rule("ar");
+  Rule* link = new Rule("link");
+  state->bindings_.AddRule(cc);
+  state->bindings_.AddRule(gen);
+  state->bindings_.AddRule(ar);
+  state->bindings_.AddRule(link);
+  Pool* link_pool = new Pool("link_pool", 2);
+  state->AddPool(link_pool);
+
+  string err;
+  char path[64];
+  durations->clear();
+  auto add = [&](const Rule* rule, const string& out, int64_t duration) {
+    Edge* edge = state->AddEdge(rule);
+    state->AddOut(edge, out, 0, &err);
+    edge->outputs_[0]->MarkDirty();
+    if (record)
+      edge->prev_elapsed_time_millis = duration * noise.Range(80, 120) / 100;
+    durations->resize(edge->id_ + 1);
+    (*durations)[edge->id_] = duration;
+    return edge;
+  };
+
+  vector<string> archives;
+  for (int l = 0; l < libs; ++l) {
+    string header;
+    if (random.Range(0, 3) == 0) {
+      snprintf(path, sizeof(path), "gen/lib%d.h", l);
+      header = path;
+      add(gen, header, random.Range(20000, 60000));
+    }
+    snprintf(path, sizeof(path), "lib%d.a", l);
+    Edge* archive = add(ar, path, random.Range(100, 500));
+    archives.push_back(path);
+    int objects = (int)random.Range(10, 60);
+    for (int o = 0; o < objects; ++o) {
+      snprintf(path, sizeof(path), "obj/lib%d/%d.o", l, o);
+      // Mostly quick compiles, with the odd template-heavy file.
+      int64_t duration = random.Range(0, 9) == 0 ? random.Range(15000, 40000) : random.Range(500, 5000);
+      Edge* compile = add(cc, path, duration);
+      state->AddIn(archive, path, 0);
+      snprintf(path, sizeof(path), "src/lib%d/%d.cc", l, o);
+      state->AddIn(compile, path, 0);
+      if (!header.empty())
+        state->AddIn(compile, header, 0);
+    }
+  }
+
+  Edge* all = state->AddEdge(&State::kPhonyRule);
+  state->AddOut(all, "all", 0, &err);
+  all->outputs_[0]->MarkDirty();
+  durations->resize(all->id_ + 1);
+  for (int e = 0; e < 8; ++e) {
+    snprintf(path, sizeof(path), "bin/exe%d", e);
+    Edge* exe = add(link, path, random.Range(5000, 30000));
+    exe->pool_ = link_pool;
+    for (size_t l = 0; l < archives.size(); ++l)
+      if (random.Range(0, 1) == 0)
+        state->AddIn(exe, archives[l], 0);
+    state->AddIn(all, path, 0);
+  }
+  return all->outputs_[0];
+}
+
+/// The longest chain of durations ending with \a edge.
+int64_t LongestChain(const Edge* edge, const vector<int64_t>& durations, vector<int64_t>* memo) {
+  int64_t& longest = (*memo)[edge->id_];
+  if (longest < 0) {
+    int64_t inputs = 0;
+    for (size_t i = 0; i < edge->inputs_.size(); ++i)
+      if (const Edge* in = edge->inputs_[i]->in_edge())
+        inputs = max(inputs, LongestChain(in, durations, memo));
+    longest = inputs + durations[edge->id_];
+  }
+  return longest;
+}
+
+/// Run a Plan to completion on |slots| simulated job slots, and return the
+/// makespan.
+int64_t Simulate(Node* target, int slots, const vector<int64_t>& durations) {
+  Plan plan;
+  string err;
+  if (!plan.AddTarget(target, &err)) {
+    fprintf(stderr, "%s\n", err.c_str());
+    exit(1);
+  }
+  plan.PrepareQueue();
+
+  typedef pair<int64_t, Edge*> Running;  // (finish time, edge)
+  priority_queue<Running, vector<Running>, greater<Running> > running;
+  int64_t now = 0;
+  while (plan.more_to_do()) {
+    while ((int)running.size() < slots) {
+      Edge* edge = plan.FindWork();
+      if (!edge)
+        break;
+      running.push(Running(now + durations[edge->id_], edge));
+    }
+    if (running.empty()) {
+      fprintf(stderr, "stuck\n");
+      exit(1);
+    }
+    now = running.top().first;
+    Edge* edge = running.top().second;
+    running.pop();
+    if (!plan.EdgeFinished(edge, Plan::kEdgeSucceeded, &err)) {
+      fprintf(stderr, "%s\n", err.c_str());
+      exit(1);
+    }
+  }
+  return now;
+}
+
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+  int libs = argc > 1 ? atoi(argv[1]) : 40;
+  const int kSeeds = 5;
+  const int kSlots[] = { 8, 32, 128 };
+
+  printf("%d libraries, mean of %d projects\n", libs, kSeeds);
+  printf("%6s %12s %12s %12s %8s\n", "slots", "bound(ms)", "no log(ms)", "elapsed(ms)", "gain");
+  for (size_t s = 0; s < sizeof(kSlots) / sizeof(kSlots[0]); ++s) {
+    int slots = kSlots[s];
+    int64_t bound = 0, depth = 0, elapsed = 0;
+    for (int seed = 0; seed < kSeeds; ++seed) {
+      vector<int64_t> durations;
+      {
+        State state;
+        Node* all = MakeProject(&state, libs, seed, false, &durations);
+        depth += Simulate(all, slots, durations);
+
+        // No schedule beats the total work spread over every slot, nor the
+        // longest chain.
+        int64_t total = 0;
+        for (size_t i = 0; i < durations.size(); ++i)
+          total += durations[i];
+        vector<int64_t> memo(durations.size(), -1);
+        bound += max(total / slots, LongestChain(all->in_edge(), durations, &memo));
+      }
+      {
+        State state;
+        Node* all = MakeProject(&state, libs, seed, true, &durations);
+        elapsed += Simulate(all, slots, durations);
+      }
+    }
+    printf("%6d %12lld %12lld %12lld %7.1f%%\n", slots, (long long)bound / kSeeds, (long long)depth / kSeeds,
+           (long long)elapsed / kSeeds, 100.0 * (depth - elapsed) / depth);
+  }
+  return 0;
+}
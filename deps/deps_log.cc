@@ -45,12 +45,7 @@ DepsLog::~DepsLog() {
   Close();
 }
 
-bool DepsLog::OpenForWrite(const string& path, string* err) {
-  if (needs_recompaction_) {
-    if (!Recompact(path, err))
-      return false;
-  }
-
+bool DepsLog::OpenForWrite(const string& path, string* /*err*/) {
   assert(!file_);
   file_path_ = path;  // we don't actually open the file right now, but will do
                       // so on the first write attempt
@@ -146,132 +141,108 @@ void DepsLog::Close() {
 
 LoadStatus DepsLog::Load(const string& path, State* state, string* err) {
   METRIC_RECORD(".ninja_deps load");
-  char buf[kMaxRecordSize + 1];
-  FILE* f = fopen(path.c_str(), "rb");
-  if (!f) {
-    if (errno == ENOENT)
-      return LOAD_NOT_FOUND;
-    *err = strerror(errno);
-    return LOAD_ERROR;
+  // Deps not yet read point into the file loaded before.
+  MaterializeAll();
+  loaded_file_.Close();
+
+  int ret = loaded_file_.Open(path, err);
+  if (ret == -ENOENT) {
+    err->clear();
+    return LOAD_NOT_FOUND;
   }
+  if (ret < 0)
+    return LOAD_ERROR;
+  const char* data = loaded_file_.data();
+  size_t size = loaded_file_.size();
 
-  bool valid_header = true;
+  const size_t kSignatureLen = sizeof(kFileSignature) - 1;
   int version = 0;
-  if (!fgets(buf, sizeof(buf), f) || fread(&version, 4, 1, f) < 1)
-    valid_header = false;
+  bool valid_header = size >= kSignatureLen + 4 && memcmp(data, kFileSignature, kSignatureLen) == 0;
+  if (valid_header)
+    memcpy(&version, data + kSignatureLen, 4);
   // Note: For version differences, this should migrate to the new format.
   // But the v1 format could sometimes (rarely) end up with invalid data, so
   // don't migrate v1 to v3 to force a rebuild. (v2 only existed for a few days,
   // and there was no release with it, so pretend that it never happened.)
-  if (!valid_header || strcmp(buf, kFileSignature) != 0 || version != kCurrentVersion) {
+  if (!valid_header || version != kCurrentVersion) {
     if (version == 1)
       *err = "deps log version change; rebuilding";
     else
       *err = "bad deps log signature or version; starting over";
-    fclose(f);
+    loaded_file_.Close();
     unlink(path.c_str());
     // Don't report this as a failure.  An empty deps log will cause
     // us to rebuild the outputs anyway.
     return LOAD_SUCCESS;
   }
 
-  long offset;
-  bool read_failed = false;
+  size_t offset = kSignatureLen + 4;
   int unique_dep_record_count = 0;
   int total_dep_record_count = 0;
-  for (;;) {
-    offset = ftell(f);
-
-    unsigned size;
-    if (fread(&size, 4, 1, f) < 1) {
-      if (!feof(f))
-        read_failed = true;
-      break;
-    }
-    bool is_deps = (size >> 31) != 0;
-    size = size & 0x7FFFFFFF;
-
-    if (size > kMaxRecordSize || fread(buf, size, 1, f) < 1) {
-      read_failed = true;
+  while (offset + 4 <= size) {
+    unsigned record_size;
+    memcpy(&record_size, data + offset, 4);
+    bool is_deps = (record_size >> 31) != 0;
+    record_size = record_size & 0x7FFFFFFF;
+    if (record_size > kMaxRecordSize || record_size > size - offset - 4)
       break;
-    }
+    const char* record = data + offset + 4;
 
     if (is_deps) {
-      assert(size % 4 == 0);
-      int* deps_data = reinterpret_cast<int*>(buf);
-      int out_id = deps_data[0];
-      TimeStamp mtime;
-      mtime = (TimeStamp)(((uint64_t)(unsigned int)deps_data[2] << 32) | (uint64_t)(unsigned int)deps_data[1]);
-      deps_data += 3;
-      int deps_count = (size / 4) - 3;
-
-      Deps* deps = new Deps(mtime, deps_count);
-      for (int i = 0; i < deps_count; ++i) {
-        assert(deps_data[i] < (int)nodes_.size());
-        assert(nodes_[deps_data[i]]);
-        deps->nodes[i] = nodes_[deps_data[i]];
-      }
-
+      // Note where the deps are, to read them if they are asked for.
+      if (record_size < 12 || record_size % 4 != 0)
+        break;
+      int out_id;
+      memcpy(&out_id, record, 4);
+      if (out_id < 0)
+        break;
+      if (out_id >= (int)records_.size())
+        records_.resize(out_id + 1);
       total_dep_record_count++;
-      if (!UpdateDeps(out_id, deps))
+      if (!records_[out_id])
         ++unique_dep_record_count;
+      records_[out_id] = data + offset;
+      // Deps read from a log loaded before are out of date.
+      if (out_id < (int)deps_.size() && deps_[out_id]) {
+        delete deps_[out_id];
+        deps_[out_id] = NULL;
+      }
     } else {
-      int path_size = size - 4;
+      int path_size = record_size - 4;
       assert(path_size > 0);  // CanonicalizePath() rejects empty paths.
       // There can be up to 3 bytes of padding.
-      if (buf[path_size - 1] == '\0')
+      if (record[path_size - 1] == '\0')
         --path_size;
-      if (buf[path_size - 1] == '\0')
+      if (record[path_size - 1] == '\0')
         --path_size;
-      if (buf[path_size - 1] == '\0')
+      if (record[path_size - 1] == '\0')
         --path_size;
-      StringPiece subpath(buf, path_size);
-      // It is not necessary to pass in a correct slash_bits here. It will
-      // either be a Node that's in the manifest (in which case it will already
-      // have a correct slash_bits that GetNode will look up), or it is an
-      // implicit dependency from a .d which does not affect the build command
-      // (and so need not have its slashes maintained).
-      Node* node = state->GetNode(subpath, 0);
+      StringPiece subpath(record, path_size);
 
       // Check that the expected index matches the actual index. This can only
       // happen if two ninja processes write to the same deps log concurrently.
       // (This uses unary complement to make the checksum look less like a
       // dependency record entry.)
-      unsigned checksum = *reinterpret_cast<unsigned*>(buf + size - 4);
+      unsigned checksum;
+      memcpy(&checksum, record + record_size - 4, 4);
       int expected_id = ~checksum;
       int id = nodes_.size();
-      if (id != expected_id) {
-        read_failed = true;
+      if (id != expected_id)
         break;
-      }
 
+      // It is not necessary to pass in a correct slash_bits here. It will
+      // either be a Node that's in the manifest (in which case it will already
+      // have a correct slash_bits that GetNode will look up), or it is an
+      // implicit dependency from a .d which does not affect the build command
+      // (and so need not have its slashes maintained).
+      Node* node = state->GetNode(subpath, 0);
       assert(node->id() < 0);
       node->set_id(id);
       nodes_.push_back(node);
     }
+    offset += 4 + record_size;
   }
 
-  if (read_failed) {
-    // An error occurred while loading; try to recover by truncating the
-    // file to the last fully-read record.
-    if (ferror(f)) {
-      *err = strerror(ferror(f));
-    } else {
-      *err = "premature end of file";
-    }
-    fclose(f);
-
-    if (!Truncate(path, offset, err))
-      return LOAD_ERROR;
-
-    // The truncate succeeded; we'll just report the load error as a
-    // warning because the build can proceed.
-    *err += "; recovering";
-    return LOAD_SUCCESS;
-  }
-
-  fclose(f);
-
   // Rebuild the log if there are too many dead records.
   int kMinCompactionEntryCount = 1000;
   int kCompactionRatio = 3;
@@ -280,18 +251,67 @@ LoadStatus DepsLog::Load(const string& path, State* state, string* err) {
     needs_recompaction_ = true;
   }
 
+  if (offset < size) {
+    // An error occurred while loading; try to recover by truncating the
+    // file to the last fully-read record.  The records before it stay
+    // mapped.
+    *err = "premature end of file";
+    if (!Truncate(path, offset, err))
+      return LOAD_ERROR;
+
+    // The truncate succeeded; we'll just report the load error as a
+    // warning because the build can proceed.
+    *err += "; recovering";
+  }
   return LOAD_SUCCESS;
 }
 
 DepsLog::Deps* DepsLog::GetDeps(Node* node) {
   // Abort if the node has no id (never referenced in the deps) or if
   // there's no deps recorded for the node.
-  if (node->id() < 0 || node->id() >= (int)deps_.size())
+  if (node->id() < 0)
+    return NULL;
+  return Materialize(node->id());
+}
+
+DepsLog::Deps* DepsLog::Materialize(int id) {
+  if (id < (int)deps_.size() && deps_[id])
+    return deps_[id];
+  if (id >= (int)records_.size() || !records_[id])
     return NULL;
-  return deps_[node->id()];
+
+  const char* record = records_[id];
+  unsigned size;
+  memcpy(&size, record, 4);
+  size &= 0x7FFFFFFF;
+  uint32_t mtime_parts[2];
+  memcpy(mtime_parts, record + 8, sizeof(mtime_parts));
+  TimeStamp mtime = (TimeStamp)(((uint64_t)mtime_parts[1] << 32) | (uint64_t)mtime_parts[0]);
+  const char* deps_data = record + 16;
+  int deps_count = (size / 4) - 3;
+
+  Deps* deps = new Deps(mtime, deps_count);
+  for (int i = 0; i < deps_count; ++i) {
+    int dep_id;
+    memcpy(&dep_id, deps_data + 4 * i, 4);
+    assert(dep_id >= 0 && dep_id < (int)nodes_.size());
+    assert(nodes_[dep_id]);
+    deps->nodes[i] = nodes_[dep_id];
+  }
+  UpdateDeps(id, deps);
+  return deps;
+}
+
+void DepsLog::MaterializeAll() {
+  for (size_t id = 0; id < records_.size(); ++id) {
+    if (records_[id])
+      Materialize(id);
+  }
+  records_.clear();
 }
 
 Node* DepsLog::GetFirstReverseDepsNode(Node* node) {
+  MaterializeAll();
   for (size_t id = 0; id < deps_.size(); ++id) {
     Deps* deps = deps_[id];
     if (!deps)
@@ -308,6 +328,7 @@ bool DepsLog::Recompact(const string& path, string* err) {
   METRIC_RECORD(".ninja_deps recompact");
 
   Close();
+  MaterializeAll();
   string temp_path = path + ".recompact";
 
   // OpenForWrite() opens for append.  Make sure it's not appending to a
@@ -343,17 +364,13 @@ bool DepsLog::Recompact(const string& path, string* err) {
   // All nodes now have ids that refer to new_log, so steal its data.
   deps_.swap(new_log.deps_);
   nodes_.swap(new_log.nodes_);
+  // Every deps is read, so the old file is of no more use.
+  loaded_file_.Close();
 
-  if (unlink(path.c_str()) < 0) {
-    *err = strerror(errno);
+  if (!RenameFile(temp_path, path, err))
     return false;
-  }
-
-  if (rename(temp_path.c_str(), path.c_str()) < 0) {
-    *err = strerror(errno);
-    return false;
-  }
 
+  needs_recompaction_ = false;
   return true;
 }
 
@@ -375,6 +392,10 @@ bool DepsLog::UpdateDeps(int out_id, Deps* deps) {
   if (delete_old)
     delete deps_[out_id];
   deps_[out_id] = deps;
+  if (out_id < (int)records_.size() && records_[out_id]) {
+    records_[out_id] = NULL;
+    delete_old = true;
+  }
   return delete_old;
 }
 
@@ -393,7 +414,7 @@ bool DepsLog::RecordId(Node* node) {
   }
   if (fwrite(&size, 4, 1, file_) < 1)
     return false;
-  if (fwrite(node->path().data(), path_size, 1, file_) < 1) {
+  if (fwrite(node->path().str_, path_size, 1, file_) < 1) {
     assert(!node->path().empty());
     return false;
   }
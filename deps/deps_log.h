@@ -22,6 +22,7 @@
 
 #include "load_status.h"
 #include "timestamp.h"
+#include "util.h"
 
 struct Node;
 struct State;
@@ -36,7 +37,9 @@ struct State;
 /// - it can be read all at once on startup.  (Alternative designs, where
 ///   it contains indexing information, were considered and discarded as
 ///   too complicated to implement; if the file is small than reading it
-///   fully on startup is acceptable.)
+///   fully on startup is acceptable.)  Loading maps the file, names the
+///   nodes of its path records and notes where the last dependency list of
+///   each output is; a list is only read once GetDeps() asks for it.
 /// Here are some stats from the Windows Chrome dependency files, to
 /// help guide the design space.  The total text in the files sums to
 /// 90mb so some compression is warranted to keep load-time fast.
@@ -88,12 +91,18 @@ struct DepsLog {
   };
 
   LoadStatus Load(const std::string& path, State* state, std::string* err);
+  /// The deps of \a node, read from its record in the log if they were not
+  /// yet, or NULL if the log has none.
   Deps* GetDeps(Node* node);
   Node* GetFirstReverseDepsNode(Node* node);
 
   /// Rewrite the known log entries, throwing away old data.
   bool Recompact(const std::string& path, std::string* err);
 
+  /// Whether the log loaded has enough dead records to be worth a
+  /// Recompact(), which renumbers nodes and so is left for after the build.
+  bool needs_recompaction() const { return needs_recompaction_; }
+
   /// Returns if the deps entry for a node is still reachable from the manifest.
   ///
   /// The deps log can contain deps entries for files that were built in the
@@ -105,12 +114,19 @@ struct DepsLog {
   /// Used for tests.
   const std::vector<Node*>& nodes() const { return nodes_; }
 
-  const std::vector<Deps*>& deps() const { return deps_; }
+  /// All deps, each read from the log file if it was not yet.
+  const std::vector<Deps*>& deps() {
+    MaterializeAll();
+    return deps_;
+  }
 
  private:
   // Updates the in-memory representation.  Takes ownership of |deps|.
   // Returns true if a prior deps record was deleted.
   bool UpdateDeps(int out_id, Deps* deps);
+  /// The deps of node \a id, read from its record if they were not yet.
+  Deps* Materialize(int id);
+  void MaterializeAll();
   // Write a node name record, assigning it an id.
   bool RecordId(Node* node);
 
@@ -126,6 +142,10 @@ struct DepsLog {
   std::vector<Node*> nodes_;
   /// Maps id -> deps of that id.
   std::vector<Deps*> deps_;
+  /// Maps id -> the record in loaded_file_ of deps not yet read.
+  std::vector<const char*> records_;
+  /// The log last loaded, which records_ point into.
+  MappedFile loaded_file_;
 
   friend struct DepsLogTest;
 };
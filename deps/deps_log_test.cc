@@ -350,6 +350,104 @@ TEST_F(DepsLogTest, Recompact) {
   }
 }
 
+// Verify that opening for write leaves recompaction for later, and that
+// recompacting then keeps the deps recorded in between.
+TEST_F(DepsLogTest, RecompactAfterAppending) {
+  const char kManifest[] =
+      "rule cc\n"
+      "  command = cc\n"
+      "  deps = gcc\n"
+      "build out.o: cc\n"
+      "build other_out.o: cc\n";
+
+  {
+    State state;
+    ASSERT_NO_FATAL_FAILURE(AssertParse(&state, kManifest));
+    DepsLog log;
+    string err;
+    ASSERT_TRUE(log.OpenForWrite(kTestFilename, &err));
+    vector<Node*> deps;
+    deps.push_back(state.GetNode("foo.h", 0));
+    for (int i = 0; i < 1001; ++i)
+      log.RecordDeps(state.GetNode("out.o", 0), i, deps);
+    log.Close();
+  }
+
+  {
+    State state;
+    ASSERT_NO_FATAL_FAILURE(AssertParse(&state, kManifest));
+    DepsLog log;
+    string err;
+    ASSERT_TRUE(log.Load(kTestFilename, &state, &err));
+    EXPECT_TRUE(log.needs_recompaction());
+    ASSERT_TRUE(log.OpenForWrite(kTestFilename, &err));
+    EXPECT_TRUE(log.needs_recompaction());
+
+    vector<Node*> deps;
+    deps.push_back(state.GetNode("bar.h", 0));
+    log.RecordDeps(state.GetNode("other_out.o", 0), 5, deps);
+    ASSERT_TRUE(log.Recompact(kTestFilename, &err));
+    EXPECT_FALSE(log.needs_recompaction());
+    log.Close();
+  }
+
+  State state;
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state, kManifest));
+  DepsLog log;
+  string err;
+  ASSERT_TRUE(log.Load(kTestFilename, &state, &err));
+  EXPECT_FALSE(log.needs_recompaction());
+  DepsLog::Deps* deps = log.GetDeps(state.GetNode("out.o", 0));
+  ASSERT_TRUE(deps);
+  EXPECT_EQ(1000, deps->mtime);
+  deps = log.GetDeps(state.GetNode("other_out.o", 0));
+  ASSERT_TRUE(deps);
+  EXPECT_EQ(5, deps->mtime);
+  ASSERT_EQ(1, deps->node_count);
+  EXPECT_EQ("bar.h", deps->nodes[0]->path());
+}
+
+// Verify that deps recorded over deps not yet read from the log win, and
+// that reading the log again replaces deps read before.
+TEST_F(DepsLogTest, RecordBeforeRead) {
+  State state;
+  {
+    DepsLog log;
+    string err;
+    ASSERT_TRUE(log.OpenForWrite(kTestFilename, &err));
+    vector<Node*> deps;
+    deps.push_back(state.GetNode("foo.h", 0));
+    log.RecordDeps(state.GetNode("out.o", 0), 1, deps);
+    log.RecordDeps(state.GetNode("out2.o", 0), 2, deps);
+    log.Close();
+  }
+
+  State state2;
+  DepsLog log;
+  string err;
+  ASSERT_TRUE(log.Load(kTestFilename, &state2, &err));
+  ASSERT_EQ("", err);
+  ASSERT_TRUE(log.OpenForWrite(kTestFilename, &err));
+  vector<Node*> deps;
+  deps.push_back(state2.GetNode("bar.h", 0));
+  deps.push_back(state2.GetNode("foo.h", 0));
+  ASSERT_TRUE(log.RecordDeps(state2.GetNode("out2.o", 0), 3, deps));
+  log.Close();
+
+  DepsLog::Deps* log_deps = log.GetDeps(state2.GetNode("out2.o", 0));
+  ASSERT_TRUE(log_deps);
+  EXPECT_EQ(3, log_deps->mtime);
+  ASSERT_EQ(2, log_deps->node_count);
+  EXPECT_EQ("bar.h", log_deps->nodes[0]->path());
+  log_deps = log.GetDeps(state2.GetNode("out.o", 0));
+  ASSERT_TRUE(log_deps);
+  EXPECT_EQ(1, log_deps->mtime);
+  ASSERT_EQ(1, log_deps->node_count);
+  EXPECT_EQ("foo.h", log_deps->nodes[0]->path());
+  EXPECT_FALSE(log.GetDeps(state2.GetNode("foo.h", 0)));
+  EXPECT_FALSE(log.GetDeps(state2.GetNode("missing.h", 0)));
+}
+
 // Verify that invalid file headers cause a new build.
 TEST_F(DepsLogTest, InvalidHeader) {
   const char* kInvalidHeaders[] = {
@@ -32,6 +32,8 @@
 #endif
 
 #include "metrics.h"
+#include "stat_ring.h"
+#include "thread_pool.h"
 #include "util.h"
 
 using namespace std;
@@ -147,6 +149,20 @@ bool DiskInterface::MakeDirs(const string& path) {
   return MakeDir(dir);
 }
 
+bool DiskInterface::StatMany(const vector<const string*>& paths, vector<TimeStamp>* mtimes, string* err) const {
+  mtimes->resize(paths.size());
+  bool ok = true;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    string stat_err;
+    (*mtimes)[i] = Stat(*paths[i], &stat_err);
+    if ((*mtimes)[i] == -1 && ok) {
+      *err = stat_err;
+      ok = false;
+    }
+  }
+  return ok;
+}
+
 // RealDiskInterface -----------------------------------------------------------
 RealDiskInterface::RealDiskInterface()
 #ifdef _WIN32
@@ -168,6 +184,8 @@ RealDiskInterface::RealDiskInterface()
 }
 #endif
 
+RealDiskInterface::~RealDiskInterface() {}
+
 TimeStamp RealDiskInterface::Stat(const string& path, string* err) const {
   METRIC_RECORD("node stat");
 #ifdef _WIN32
@@ -234,6 +252,55 @@ return (int64_t)st.st_mtime * 1000000000LL + st.st_mtimensec;
 #endif
 }
 
+bool RealDiskInterface::StatMany(const vector<const string*>& paths, vector<TimeStamp>* mtimes, string* err) const {
+  METRIC_RECORD("batch stat");
+#ifdef _WIN32
+  // The stat cache already reads whole directories at a time.
+  return DiskInterface::StatMany(paths, mtimes, err);
+#else
+  mtimes->resize(paths.size());
+  vector<string> errs(paths.size());
+  bool done = false;
+  if (use_ring_ && !ring_failed_) {
+    if (!ring_) {
+      ring_.reset(StatRing::Create());
+      ring_failed_ = !ring_;
+    }
+    if (ring_ && !(done = ring_->Stat(paths.size(), paths.data(), mtimes->data(), errs.data()))) {
+      ring_.reset();
+      ring_failed_ = true;
+    }
+  }
+  if (!done && stat_threads_ > 1 && paths.size() > 1) {
+    if (!stat_pool_)
+      stat_pool_.reset(new ThreadPool(stat_threads_));
+    // Enough files per task to keep the pool's overhead small.
+    const size_t kBatch = 32;
+    for (size_t begin = 0; begin < paths.size(); begin += kBatch) {
+      size_t end = min(begin + kBatch, paths.size());
+      stat_pool_->Post([this, &paths, mtimes, &errs, begin, end]() {
+        for (size_t i = begin; i < end; ++i)
+          (*mtimes)[i] = Stat(*paths[i], &errs[i]);
+      });
+    }
+    stat_pool_->Wait();
+    done = true;
+  }
+  if (!done) {
+    for (size_t i = 0; i < paths.size(); ++i)
+      (*mtimes)[i] = Stat(*paths[i], &errs[i]);
+  }
+
+  for (size_t i = 0; i < paths.size(); ++i) {
+    if ((*mtimes)[i] == -1) {
+      *err = errs[i];
+      return false;
+    }
+  }
+  return true;
+#endif
+}
+
 bool RealDiskInterface::WriteFile(const string& path, const string& contents) {
   FILE* fp = fopen(path.c_str(), "w");
   if (fp == NULL) {
@@ -16,10 +16,15 @@
 #define NINJA_DISK_INTERFACE_H_
 
 #include <map>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "timestamp.h"
 
+struct StatRing;
+struct ThreadPool;
+
 /// Interface for reading files from disk.  See DiskInterface for details.
 /// This base offers the minimum interface needed just to read files.
 struct FileReader {
@@ -42,6 +47,14 @@ struct DiskInterface : public FileReader {
   /// other errors.
   virtual TimeStamp Stat(const std::string& path, std::string* err) const = 0;
 
+  /// Stat each of \a paths, storing what Stat() returns for it at the same
+  /// index of \a mtimes.  Implementations may run the stats concurrently;
+  /// this one runs them in turn.
+  /// @return false if any stat failed, with the error for the first such
+  /// path in \a err.
+  virtual bool StatMany(const std::vector<const std::string*>& paths, std::vector<TimeStamp>* mtimes,
+                        std::string* err) const;
+
   /// Create a directory, returning false on failure.
   virtual bool MakeDir(const std::string& path) = 0;
 
@@ -65,9 +78,13 @@ struct DiskInterface : public FileReader {
 struct RealDiskInterface : public DiskInterface {
   RealDiskInterface();
 
-  virtual ~RealDiskInterface() {}
+  virtual ~RealDiskInterface();
 
   virtual TimeStamp Stat(const std::string& path, std::string* err) const;
+  /// Submits the stats in batches through io_uring where the system
+  /// supports it, and otherwise spreads them over a thread pool.
+  virtual bool StatMany(const std::vector<const std::string*>& paths, std::vector<TimeStamp>* mtimes,
+                        std::string* err) const;
   virtual bool MakeDir(const std::string& path);
   virtual bool WriteFile(const std::string& path, const std::string& contents);
   virtual Status ReadFile(const std::string& path, std::string* contents, std::string* err);
@@ -76,12 +93,26 @@ struct RealDiskInterface : public DiskInterface {
   /// Whether stat information can be cached.  Only has an effect on Windows.
   void AllowStatCache(bool allow);
 
+  /// Whether StatMany() may use io_uring.  Only has an effect on Linux.
+  void AllowStatRing(bool allow) { use_ring_ = allow; }
+
+  /// Threads StatMany() uses when it cannot use io_uring; 1 runs the
+  /// stats in turn.
+  void set_stat_threads(int threads) { stat_threads_ = threads; }
+
 #ifdef _WIN32
   /// Whether long paths are enabled.  Only has an effect on Windows.
   bool AreLongPathsEnabled() const;
 #endif
 
  private:
+  bool use_ring_ = true;
+  int stat_threads_ = 1;
+  /// Created on first use; ring_failed_ once it turns out to be unusable.
+  mutable std::unique_ptr<StatRing> ring_;
+  mutable bool ring_failed_ = false;
+  mutable std::unique_ptr<ThreadPool> stat_pool_;
+
 #ifdef _WIN32
   /// Whether stat information can be cached.
   bool use_cache_;
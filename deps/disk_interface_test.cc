@@ -130,6 +130,54 @@ TEST_F(DiskInterfaceTest, StatExistingDir) {
   EXPECT_EQ(disk_.Stat("subdir/subsubdir", &err), disk_.Stat("subdir/subsubdir/.", &err));
 }
 
+TEST_F(DiskInterfaceTest, StatMany) {
+  ASSERT_TRUE(Touch("file"));
+  ASSERT_TRUE(Touch("notadir"));
+  ASSERT_TRUE(disk_.MakeDir("subdir"));
+  string names[] = { "file", "nosuchfile", "notadir/nosuchfile", "subdir" };
+  vector<const string*> paths;
+  for (int i = 0; i < 300; ++i)  // More than one io_uring wave.
+    paths.push_back(&names[i % 4]);
+
+  // io_uring (where available), the thread pool and the serial loop must
+  // all agree with Stat().
+  for (int mode = 0; mode < 3; ++mode) {
+    RealDiskInterface disk;
+    disk.AllowStatRing(mode == 0);
+    disk.set_stat_threads(mode == 1 ? 4 : 1);
+    vector<TimeStamp> mtimes;
+    string err;
+    ASSERT_TRUE(disk.StatMany(paths, &mtimes, &err)) << mode;
+    EXPECT_EQ("", err);
+    ASSERT_EQ(paths.size(), mtimes.size());
+    for (size_t i = 0; i < paths.size(); ++i)
+      EXPECT_EQ(disk_.Stat(*paths[i], &err), mtimes[i]) << mode << " " << *paths[i];
+  }
+}
+
+TEST_F(DiskInterfaceTest, StatManyBadPath) {
+  string good("nosuchfile");
+#ifdef _WIN32
+  string bad("cc:\\foo");
+#else
+  string bad(512, 'x');
+#endif
+  vector<const string*> paths;
+  paths.push_back(&good);
+  paths.push_back(&bad);
+  for (int mode = 0; mode < 3; ++mode) {
+    RealDiskInterface disk;
+    disk.AllowStatRing(mode == 0);
+    disk.set_stat_threads(mode == 1 ? 4 : 1);
+    vector<TimeStamp> mtimes;
+    string err;
+    EXPECT_FALSE(disk.StatMany(paths, &mtimes, &err)) << mode;
+    EXPECT_NE("", err);
+    EXPECT_EQ(0, mtimes[0]);
+    EXPECT_EQ(-1, mtimes[1]);
+  }
+}
+
 #ifdef _WIN32
 TEST_F(DiskInterfaceTest, StatCache) {
   string err;
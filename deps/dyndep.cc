@@ -36,24 +36,24 @@ bool DyndepLoader::LoadDyndeps(Node* node, DyndepFile* ddf, std::string* err) co
   node->set_dyndep_pending(false);
 
   // Load the dyndep information from the file.
-  EXPLAIN("loading dyndep file '%s'", node->path().c_str());
+  EXPLAIN("loading dyndep file '%s'", node->path().str_);
   if (!LoadDyndepFile(node, ddf, err))
     return false;
 
   // Update each edge that specified this node as its dyndep binding.
-  std::vector<Edge*> const& out_edges = node->out_edges();
-  for (std::vector<Edge*>::const_iterator oe = out_edges.begin(); oe != out_edges.end(); ++oe) {
+  ArenaVector<Edge*> const& out_edges = node->out_edges();
+  for (ArenaVector<Edge*>::const_iterator oe = out_edges.begin(); oe != out_edges.end(); ++oe) {
     Edge* const edge = *oe;
     if (edge->dyndep_ != node)
       continue;
 
     DyndepFile::iterator ddi = ddf->find(edge);
     if (ddi == ddf->end()) {
-      *err = ("'" + edge->outputs_[0]->path() +
+      *err = ("'" + edge->outputs_[0]->path().AsString() +
               "' "
               "not mentioned in its dyndep file "
               "'" +
-              node->path() + "'");
+              node->path().AsString() + "'");
       return false;
     }
 
@@ -68,10 +68,10 @@ bool DyndepLoader::LoadDyndeps(Node* node, DyndepFile* ddf, std::string* err) co
   for (DyndepFile::const_iterator oe = ddf->begin(); oe != ddf->end(); ++oe) {
     if (!oe->second.used_) {
       Edge* const edge = oe->first;
-      *err = ("dyndep file '" + node->path() +
+      *err = ("dyndep file '" + node->path().AsString() +
               "' mentions output "
               "'" +
-              edge->outputs_[0]->path() +
+              edge->outputs_[0]->path().AsString() +
               "' whose build statement "
               "does not have a dyndep binding for the file");
       return false;
@@ -97,7 +97,7 @@ bool DyndepLoader::UpdateEdge(Edge* edge, Dyndeps const* dyndeps, std::string* e
        ++i) {
     if ((*i)->in_edge()) {
       // This node already has an edge producing it.
-      *err = "multiple rules generate " + (*i)->path();
+      *err = "multiple rules generate " + (*i)->path().AsString();
       return false;
     }
     (*i)->set_in_edge(edge);
@@ -118,5 +118,5 @@ bool DyndepLoader::UpdateEdge(Edge* edge, Dyndeps const* dyndeps, std::string* e
 
 bool DyndepLoader::LoadDyndepFile(Node* file, DyndepFile* ddf, std::string* err) const {
   DyndepParser parser(state_, disk_interface_, ddf);
-  return parser.Load(file->path(), err);
+  return parser.Load(file->path().AsString(), err);
 }
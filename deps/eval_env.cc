@@ -27,6 +27,14 @@ string BindingEnv::LookupVariable(const string& var) {
   return "";
 }
 
+void BindingEnv::AppendVariable(const string& var, EvalSink* out) {
+  map<string, string>::iterator i = bindings_.find(var);
+  if (i != bindings_.end())
+    out->Append(i->second);
+  else if (parent_)
+    parent_->AppendVariable(var, out);
+}
+
 void BindingEnv::AddBinding(const string& key, const string& val) {
   bindings_[key] = val;
 }
@@ -66,14 +74,27 @@ const EvalString* Rule::GetBinding(const string& key) const {
 // static
 bool Rule::IsReservedBinding(const string& var) {
   return var == "command" || var == "depfile" || var == "dyndep" || var == "description" || var == "deps" ||
-         var == "generator" || var == "pool" || var == "restat" || var == "rspfile" || var == "rspfile_content" ||
-         var == "msvc_deps_prefix";
+         var == "generator" || var == "memory" || var == "pool" || var == "restat" || var == "rspfile" ||
+         var == "rspfile_content" || var == "msvc_deps_prefix" || var == "worker";
 }
 
 const map<string, const Rule*>& BindingEnv::GetRules() const {
   return rules_;
 }
 
+const map<string, string>& BindingEnv::GetBindings() const {
+  return bindings_;
+}
+
+void BindingEnv::Flatten(BindingEnv* out) const {
+  if (parent_)
+    parent_->Flatten(out);
+  for (map<string, string>::const_iterator i = bindings_.begin(); i != bindings_.end(); ++i)
+    out->bindings_[i->first] = i->second;
+  for (map<string, const Rule*>::const_iterator i = rules_.begin(); i != rules_.end(); ++i)
+    out->rules_[i->first] = i->second;
+}
+
 string BindingEnv::LookupWithFallback(const string& var, const EvalString* eval, Env* env) {
   map<string, string>::iterator i = bindings_.find(var);
   if (i != bindings_.end())
@@ -88,6 +109,16 @@ string BindingEnv::LookupWithFallback(const string& var, const EvalString* eval,
   return "";
 }
 
+void BindingEnv::LookupWithFallback(const string& var, const EvalString* eval, Env* env, EvalSink* out) {
+  map<string, string>::iterator i = bindings_.find(var);
+  if (i != bindings_.end())
+    out->Append(i->second);
+  else if (eval)
+    eval->Evaluate(env, out);
+  else if (parent_)
+    parent_->AppendVariable(var, out);
+}
+
 string EvalString::Evaluate(Env* env) const {
   string result;
   for (TokenList::const_iterator i = parsed_.begin(); i != parsed_.end(); ++i) {
@@ -99,6 +130,15 @@ string EvalString::Evaluate(Env* env) const {
   return result;
 }
 
+void EvalString::Evaluate(Env* env, EvalSink* out) const {
+  for (TokenList::const_iterator i = parsed_.begin(); i != parsed_.end(); ++i) {
+    if (i->second == RAW)
+      out->Append(i->first);
+    else
+      env->AppendVariable(i->first, out);
+  }
+}
+
 void EvalString::AddText(StringPiece text) {
   // Add it to the end of an existing RAW token if possible.
   if (!parsed_.empty() && parsed_.back().second == RAW) {
@@ -23,11 +23,23 @@
 
 struct Rule;
 
+/// Takes an evaluated string piece by piece, for callers that only look
+/// at it once and need not build it.
+struct EvalSink {
+  virtual ~EvalSink() {}
+
+  virtual void Append(StringPiece piece) = 0;
+};
+
 /// An interface for a scope for variable (e.g. "$foo") lookups.
 struct Env {
   virtual ~Env() {}
 
   virtual std::string LookupVariable(const std::string& var) = 0;
+
+  /// Give the value of \a var to \a out.  By default it is looked up as a
+  /// whole.
+  virtual void AppendVariable(const std::string& var, EvalSink* out) { out->Append(LookupVariable(var)); }
 };
 
 /// A tokenized string that contains variable references.
@@ -36,6 +48,8 @@ struct EvalString {
   /// @return The evaluated string with variable expanded using value found in
   ///         environment @a env.
   std::string Evaluate(Env* env) const;
+  /// Give the evaluated string to \a out, one text or variable at a time.
+  void Evaluate(Env* env, EvalSink* out) const;
 
   /// @return The string with variables not expanded.
   std::string Unparse() const;
@@ -51,10 +65,13 @@ struct EvalString {
   /// for use in tests.
   std::string Serialize() const;
 
- private:
   enum TokenType { RAW, SPECIAL };
-
   typedef std::vector<std::pair<std::string, TokenType>> TokenList;
+
+  /// The parsed tokens, for writing out a loaded State.
+  const TokenList& tokens() const { return parsed_; }
+
+ private:
   TokenList parsed_;
 };
 
@@ -70,12 +87,14 @@ struct Rule {
 
   const EvalString* GetBinding(const std::string& key) const;
 
+  typedef std::map<std::string, EvalString> Bindings;
+  const Bindings& bindings() const { return bindings_; }
+
  private:
   // Allow the parsers to reach into this object and fill out its fields.
   friend struct ManifestParser;
 
   std::string name_;
-  typedef std::map<std::string, EvalString> Bindings;
   Bindings bindings_;
 };
 
@@ -89,11 +108,20 @@ struct BindingEnv : public Env {
   virtual ~BindingEnv() {}
 
   virtual std::string LookupVariable(const std::string& var);
+  virtual void AppendVariable(const std::string& var, EvalSink* out);
 
   void AddRule(const Rule* rule);
   const Rule* LookupRule(const std::string& rule_name);
   const Rule* LookupRuleCurrentScope(const std::string& rule_name);
   const std::map<std::string, const Rule*>& GetRules() const;
+  const std::map<std::string, std::string>& GetBindings() const;
+
+  BindingEnv* parent() const { return parent_; }
+  void set_parent(BindingEnv* parent) { parent_ = parent; }
+
+  /// Copy every binding and rule visible from this scope into \a out, with
+  /// inner scopes shadowing outer ones.
+  void Flatten(BindingEnv* out) const;
 
   void AddBinding(const std::string& key, const std::string& val);
 
@@ -103,6 +131,7 @@ struct BindingEnv : public Env {
   /// 3) value set on enclosing scope of edge (edge_->env_->parent_)
   /// This function takes as parameters the necessary info to do (2).
   std::string LookupWithFallback(const std::string& var, const EvalString* eval, Env* env);
+  void LookupWithFallback(const std::string& var, const EvalString* eval, Env* env, EvalSink* out);
 
  private:
   std::map<std::string, std::string> bindings_;
@@ -18,12 +18,14 @@
 #include <stdio.h>
 #include <algorithm>
 #include <deque>
+#include <unordered_set>
 
 #include "build_log.h"
 #include "debug_flags.h"
 #include "depfile_parser.h"
 #include "deps_log.h"
 #include "disk_interface.h"
+#include "hash.h"
 #include "manifest_parser.h"
 #include "metrics.h"
 #include "state.h"
@@ -32,7 +34,11 @@
 using namespace std;
 
 bool Node::Stat(DiskInterface* disk_interface, string* err) {
-  mtime_ = disk_interface->Stat(path_, err);
+  return SetStatResult(disk_interface->Stat(path().AsString(), err));
+}
+
+bool Node::SetStatResult(TimeStamp mtime) {
+  mtime_ = mtime;
   if (mtime_ == -1) {
     return false;
   }
@@ -46,7 +52,65 @@ void Node::UpdatePhonyMtime(TimeStamp mtime) {
   }
 }
 
+namespace {
+
+/// Below this many files batching costs more than it saves.
+const size_t kMinBatchStats = 64;
+
+}  // anonymous namespace
+
+void DependencyScan::StatFrontier(Node* initial_node) {
+  METRIC_RECORD("stat frontier");
+  vector<Node*> unknown;
+  unordered_set<Node*> seen;
+  vector<Node*> pending(1, initial_node);
+  DepsLog* deps_log = this->deps_log();
+  auto visit = [&](Node* node) {
+    if (seen.insert(node).second)
+      pending.push_back(node);
+  };
+  seen.insert(initial_node);
+  while (!pending.empty()) {
+    Node* node = pending.back();
+    pending.pop_back();
+    if (!node->status_known())
+      unknown.push_back(node);
+    Edge* edge = node->in_edge();
+    if (!edge || edge->mark_ == Edge::VisitDone)
+      continue;
+    for (ArenaVector<Node*>::iterator i = edge->inputs_.begin(); i != edge->inputs_.end(); ++i)
+      visit(*i);
+    for (ArenaVector<Node*>::iterator o = edge->outputs_.begin(); o != edge->outputs_.end(); ++o) {
+      visit(*o);
+      // Inputs recorded in the deps log are added to the edge, and
+      // statted, when the walk loads them.
+      DepsLog::Deps* deps = deps_log ? deps_log->GetDeps(*o) : NULL;
+      for (int i = 0; deps && i < deps->node_count; ++i)
+        visit(deps->nodes[i]);
+    }
+    for (ArenaVector<Node*>::iterator v = edge->validations_.begin(); v != edge->validations_.end(); ++v)
+      visit(*v);
+  }
+  if (unknown.size() < kMinBatchStats)
+    return;
+
+  vector<string> storage(unknown.size());
+  vector<const string*> paths(unknown.size());
+  for (size_t i = 0; i < unknown.size(); ++i) {
+    storage[i] = unknown[i]->path().AsString();
+    paths[i] = &storage[i];
+  }
+  vector<TimeStamp> mtimes;
+  string err;
+  disk_interface_->StatMany(paths, &mtimes, &err);
+  for (size_t i = 0; i < unknown.size(); ++i)
+    unknown[i]->SetStatResult(mtimes[i]);
+}
+
 bool DependencyScan::RecomputeDirty(Node* initial_node, std::vector<Node*>* validation_nodes, string* err) {
+  if (batch_stat_)
+    StatFrontier(initial_node);
+
   std::vector<Node*> stack;
   std::vector<Node*> new_validation_nodes;
 
@@ -84,7 +148,7 @@ bool DependencyScan::RecomputeNodeDirty(Node* node, std::vector<Node*>* stack, s
     if (!node->StatIfNecessary(disk_interface_, err))
       return false;
     if (!node->exists())
-      EXPLAIN("%s has no in-edge and is missing", node->path().c_str());
+      EXPLAIN("%s has no in-edge and is missing", node->path().str_);
     node->set_dirty(!node->exists());
     return true;
   }
@@ -130,7 +194,7 @@ bool DependencyScan::RecomputeNodeDirty(Node* node, std::vector<Node*>* stack, s
   }
 
   // Load output mtimes so we can compare them to the most recent input below.
-  for (vector<Node*>::iterator o = edge->outputs_.begin(); o != edge->outputs_.end(); ++o) {
+  for (ArenaVector<Node*>::iterator o = edge->outputs_.begin(); o != edge->outputs_.end(); ++o) {
     if (!(*o)->StatIfNecessary(disk_interface_, err))
       return false;
   }
@@ -156,7 +220,7 @@ bool DependencyScan::RecomputeNodeDirty(Node* node, std::vector<Node*>* stack, s
 
   // Visit all inputs; we're dirty if any of the inputs are dirty.
   Node* most_recent_input = NULL;
-  for (vector<Node*>::iterator i = edge->inputs_.begin(); i != edge->inputs_.end(); ++i) {
+  for (ArenaVector<Node*>::iterator i = edge->inputs_.begin(); i != edge->inputs_.end(); ++i) {
     // Visit this input.
     if (!RecomputeNodeDirty(*i, stack, validation_nodes, err))
       return false;
@@ -171,7 +235,7 @@ bool DependencyScan::RecomputeNodeDirty(Node* node, std::vector<Node*>* stack, s
       // If a regular input is dirty (or missing), we're dirty.
       // Otherwise consider mtime.
       if ((*i)->dirty()) {
-        EXPLAIN("%s is dirty", (*i)->path().c_str());
+        EXPLAIN("%s is dirty", (*i)->path().str_);
         dirty = true;
       } else {
         if (!most_recent_input || (*i)->mtime() > most_recent_input->mtime()) {
@@ -188,7 +252,7 @@ bool DependencyScan::RecomputeNodeDirty(Node* node, std::vector<Node*>* stack, s
       return false;
 
   // Finally, visit each output and update their dirty state if necessary.
-  for (vector<Node*>::iterator o = edge->outputs_.begin(); o != edge->outputs_.end(); ++o) {
+  for (ArenaVector<Node*>::iterator o = edge->outputs_.begin(); o != edge->outputs_.end(); ++o) {
     if (dirty)
       (*o)->MarkDirty();
   }
@@ -235,10 +299,10 @@ bool DependencyScan::VerifyDAG(Node* node, vector<Node*>* stack, string* err) {
   // Construct the error message rejecting the cycle.
   *err = "dependency cycle: ";
   for (vector<Node*>::const_iterator i = start; i != stack->end(); ++i) {
-    err->append((*i)->path());
+    err->append((*i)->path().AsString());
     err->append(" -> ");
   }
-  err->append((*start)->path());
+  err->append((*start)->path().AsString());
 
   if ((start + 1) == stack->end() && edge->maybe_phonycycle_diagnostic()) {
     // The manifest parser would have filtered out the self-referencing
@@ -250,9 +314,9 @@ bool DependencyScan::VerifyDAG(Node* node, vector<Node*>* stack, string* err) {
 }
 
 bool DependencyScan::RecomputeOutputsDirty(Edge* edge, Node* most_recent_input, bool* outputs_dirty, string* err) {
-  string command = edge->EvaluateCommand(/*incl_rsp_file=*/true);
-  for (vector<Node*>::iterator o = edge->outputs_.begin(); o != edge->outputs_.end(); ++o) {
-    if (RecomputeOutputDirty(edge, most_recent_input, command, *o)) {
+  uint64_t command_hash = edge->HashCommand(/*incl_rsp_file=*/true);
+  for (ArenaVector<Node*>::iterator o = edge->outputs_.begin(); o != edge->outputs_.end(); ++o) {
+    if (RecomputeOutputDirty(edge, most_recent_input, command_hash, *o)) {
       *outputs_dirty = true;
       return true;
     }
@@ -260,13 +324,13 @@ bool DependencyScan::RecomputeOutputsDirty(Edge* edge, Node* most_recent_input,
   return true;
 }
 
-bool DependencyScan::RecomputeOutputDirty(const Edge* edge, const Node* most_recent_input, const string& command,
+bool DependencyScan::RecomputeOutputDirty(const Edge* edge, const Node* most_recent_input, uint64_t command_hash,
                                           Node* output) {
   if (edge->is_phony()) {
     // Phony edges don't write any output.  Outputs are only dirty if
     // there are no inputs and we're missing the output.
     if (edge->inputs_.empty() && !output->exists()) {
-      EXPLAIN("output %s of phony edge with no inputs doesn't exist", output->path().c_str());
+      EXPLAIN("output %s of phony edge with no inputs doesn't exist", output->path().str_);
       return true;
     }
 
@@ -282,7 +346,7 @@ bool DependencyScan::RecomputeOutputDirty(const Edge* edge, const Node* most_rec
 
   // Dirty if we're missing the output.
   if (!output->exists()) {
-    EXPLAIN("output %s doesn't exist", output->path().c_str());
+    EXPLAIN("output %s doesn't exist", output->path().str_);
     return true;
   }
 
@@ -295,7 +359,7 @@ bool DependencyScan::RecomputeOutputDirty(const Edge* edge, const Node* most_rec
   // output file's actual mtime and simply check the recorded mtime from
   // the log against the most recent input's mtime (see below)
   bool used_restat = false;
-  if (edge->GetBindingBool("restat") && build_log() && (entry = build_log()->LookupByOutput(output->path()))) {
+  if (edge->GetBindingBool("restat") && build_log() && (entry = build_log()->LookupByOutput(output))) {
     used_restat = true;
   }
 
@@ -304,18 +368,20 @@ bool DependencyScan::RecomputeOutputDirty(const Edge* edge, const Node* most_rec
     EXPLAIN(
         "output %s older than most recent input %s "
         "(%" PRId64 " vs %" PRId64 ")",
-        output->path().c_str(), most_recent_input->path().c_str(), output->mtime(), most_recent_input->mtime());
+        output->path().str_, most_recent_input->path().str_, output->mtime(), most_recent_input->mtime());
     return true;
   }
 
   if (build_log()) {
     bool generator = edge->GetBindingBool("generator");
-    if (entry || (entry = build_log()->LookupByOutput(output->path()))) {
-      if (!generator && BuildLog::LogEntry::HashCommand(command) != entry->command_hash) {
+    if (entry || (entry = build_log()->LookupByOutput(output))) {
+      // Entries of old logs hold another hash, of the whole command.
+      if (!generator && (entry->legacy_hash ? !entry->MatchesCommand(edge->EvaluateCommand(/*incl_rsp_file=*/true))
+                                            : entry->command_hash != command_hash)) {
         // May also be dirty due to the command changing since the last build.
         // But if this is a generator rule, the command changing does not make us
         // dirty.
-        EXPLAIN("command line changed for %s", output->path().c_str());
+        EXPLAIN("command line changed for %s", output->path().str_);
         return true;
       }
       if (most_recent_input && entry->mtime < most_recent_input->mtime()) {
@@ -326,12 +392,12 @@ bool DependencyScan::RecomputeOutputDirty(const Edge* edge, const Node* most_rec
         // then we only check the recorded mtime against the most recent input
         // mtime and ignore the actual output's mtime above.
         EXPLAIN("recorded mtime of %s older than most recent input %s (%" PRId64 " vs %" PRId64 ")",
-                output->path().c_str(), most_recent_input->path().c_str(), entry->mtime, most_recent_input->mtime());
+                output->path().str_, most_recent_input->path().str_, entry->mtime, most_recent_input->mtime());
         return true;
       }
     }
     if (!entry && !generator) {
-      EXPLAIN("command line not found in log for %s", output->path().c_str());
+      EXPLAIN("command line not found in log for %s", output->path().str_);
       return true;
     }
   }
@@ -348,13 +414,42 @@ bool DependencyScan::LoadDyndeps(Node* node, DyndepFile* ddf, string* err) const
 }
 
 bool Edge::AllInputsReady() const {
-  for (vector<Node*>::const_iterator i = inputs_.begin(); i != inputs_.end(); ++i) {
+  for (ArenaVector<Node*>::const_iterator i = inputs_.begin(); i != inputs_.end(); ++i) {
     if ((*i)->in_edge() && !(*i)->in_edge()->outputs_ready())
       return false;
   }
   return true;
 }
 
+namespace {
+
+/// Collects what it is given into a string.
+struct StringSink : public EvalSink {
+  virtual void Append(StringPiece piece) { str.append(piece.str_, piece.len_); }
+  string str;
+};
+
+/// Hashes what it is given, after \a prefix if it is given anything.
+struct HashSink : public EvalSink {
+  HashSink(Xxh3Hasher* hasher, StringPiece prefix) : hasher_(hasher), prefix_(prefix) {}
+
+  virtual void Append(StringPiece piece) {
+    if (piece.len_ == 0)
+      return;
+    if (prefix_.len_) {
+      hasher_->Update(prefix_.str_, prefix_.len_);
+      prefix_ = StringPiece();
+    }
+    hasher_->Update(piece.str_, piece.len_);
+  }
+
+ private:
+  Xxh3Hasher* hasher_;
+  StringPiece prefix_;
+};
+
+}  // anonymous namespace
+
 /// An Env for an Edge, providing $in and $out.
 struct EdgeEnv : public Env {
   enum EscapeKind { kShellEscape, kDoNotEscape };
@@ -362,25 +457,36 @@ struct EdgeEnv : public Env {
   EdgeEnv(const Edge* const edge, const EscapeKind escape) : edge_(edge), escape_in_out_(escape), recursive_(false) {}
 
   virtual string LookupVariable(const string& var);
+  virtual void AppendVariable(const string& var, EvalSink* out);
 
-  /// Given a span of Nodes, construct a list of paths suitable for a command
-  /// line.
-  std::string MakePathList(const Node* const* span, size_t size, char sep) const;
+  /// Given a span of Nodes, give a list of paths suitable for a command
+  /// line to \a out.
+  void AppendPathList(const Node* const* span, size_t size, char sep, EvalSink* out);
 
  private:
   std::vector<std::string> lookups_;
+  /// The escaped path AppendPathList gives out, kept for its capacity.
+  std::string escaped_;
   const Edge* const edge_;
   EscapeKind escape_in_out_;
   bool recursive_;
 };
 
 string EdgeEnv::LookupVariable(const string& var) {
+  StringSink result;
+  AppendVariable(var, &result);
+  return result.str;
+}
+
+void EdgeEnv::AppendVariable(const string& var, EvalSink* out) {
   if (var == "in" || var == "in_newline") {
     int explicit_deps_count = edge_->inputs_.size() - edge_->implicit_deps_ - edge_->order_only_deps_;
-    return MakePathList(edge_->inputs_.data(), explicit_deps_count, var == "in" ? ' ' : '\n');
+    AppendPathList(edge_->inputs_.data(), explicit_deps_count, var == "in" ? ' ' : '\n', out);
+    return;
   } else if (var == "out") {
     int explicit_outs_count = edge_->outputs_.size() - edge_->implicit_outs_;
-    return MakePathList(&edge_->outputs_[0], explicit_outs_count, ' ');
+    AppendPathList(edge_->outputs_.data(), explicit_outs_count, ' ', out);
+    return;
   }
 
   // Technical note about the lookups_ vector.
@@ -436,33 +542,39 @@ string EdgeEnv::LookupVariable(const string& var) {
   // In practice, variables defined on rules never use another rule variable.
   // For performance, only start checking for cycles after the first lookup.
   recursive_ = true;
-  std::string result = edge_->env_->LookupWithFallback(var, eval, this);
+  edge_->env_->LookupWithFallback(var, eval, this, out);
   if (record_varname)
     lookups_.pop_back();
-  return result;
 }
 
-std::string EdgeEnv::MakePathList(const Node* const* const span, const size_t size, const char sep) const {
-  string result;
+void EdgeEnv::AppendPathList(const Node* const* const span, const size_t size, const char sep, EvalSink* out) {
+  size_t appended = 0;
   for (const Node* const* i = span; i != span + size; ++i) {
-    if (!result.empty())
-      result.push_back(sep);
-    const string& path = (*i)->PathDecanonicalized();
+    if (appended)
+      out->Append(StringPiece(&sep, 1));
+#ifdef _WIN32
+    const string path = (*i)->PathDecanonicalized();
+#else
+    StringPiece path = (*i)->path();
+#endif
     if (escape_in_out_ == kShellEscape) {
+      escaped_.clear();
 #ifdef _WIN32
-      GetWin32EscapedString(path, &result);
+      GetWin32EscapedString(path, &escaped_);
 #else
-      GetShellEscapedString(path, &result);
+      GetShellEscapedString(path, &escaped_);
 #endif
+      out->Append(escaped_);
+      appended += escaped_.size();
     } else {
-      result.append(path);
+      out->Append(path);
+      appended += path.size();
     }
   }
-  return result;
 }
 
 void Edge::CollectInputs(bool shell_escape, std::vector<std::string>* out) const {
-  for (std::vector<Node*>::const_iterator it = inputs_.begin(); it != inputs_.end(); ++it) {
+  for (ArenaVector<Node*>::const_iterator it = inputs_.begin(); it != inputs_.end(); ++it) {
     std::string path = (*it)->PathDecanonicalized();
     if (shell_escape) {
       std::string unescaped;
@@ -491,6 +603,17 @@ std::string Edge::EvaluateCommand(const bool incl_rsp_file) const {
   return command;
 }
 
+uint64_t Edge::HashCommand(const bool incl_rsp_file) const {
+  Xxh3Hasher hasher;
+  HashSink command(&hasher, StringPiece());
+  EdgeEnv(this, EdgeEnv::kShellEscape).AppendVariable("command", &command);
+  if (incl_rsp_file) {
+    HashSink rspfile_content(&hasher, ";rspfile=");
+    EdgeEnv(this, EdgeEnv::kShellEscape).AppendVariable("rspfile_content", &rspfile_content);
+  }
+  return hasher.Digest();
+}
+
 std::string Edge::GetBinding(const std::string& key) const {
   EdgeEnv env(this, EdgeEnv::kShellEscape);
   return env.LookupVariable(key);
@@ -517,17 +640,17 @@ std::string Edge::GetUnescapedRspfile() const {
 
 void Edge::Dump(const char* prefix) const {
   printf("%s[ ", prefix);
-  for (vector<Node*>::const_iterator i = inputs_.begin(); i != inputs_.end() && *i != NULL; ++i) {
-    printf("%s ", (*i)->path().c_str());
+  for (ArenaVector<Node*>::const_iterator i = inputs_.begin(); i != inputs_.end() && *i != NULL; ++i) {
+    printf("%s ", (*i)->path().str_);
   }
   printf("--%s-> ", rule_->name().c_str());
-  for (vector<Node*>::const_iterator i = outputs_.begin(); i != outputs_.end() && *i != NULL; ++i) {
-    printf("%s ", (*i)->path().c_str());
+  for (ArenaVector<Node*>::const_iterator i = outputs_.begin(); i != outputs_.end() && *i != NULL; ++i) {
+    printf("%s ", (*i)->path().str_);
   }
   if (!validations_.empty()) {
     printf(" validations ");
-    for (std::vector<Node*>::const_iterator i = validations_.begin(); i != validations_.end() && *i != NULL; ++i) {
-      printf("%s ", (*i)->path().c_str());
+    for (ArenaVector<Node*>::const_iterator i = validations_.begin(); i != validations_.end() && *i != NULL; ++i) {
+      printf("%s ", (*i)->path().str_);
     }
   }
   if (pool_) {
@@ -548,6 +671,13 @@ bool Edge::use_console() const {
   return pool() == &State::kConsolePool;
 }
 
+void Edge::MoveToArena(Arena* arena) {
+  ArenaAllocator<Node*> alloc(arena);
+  inputs_ = ArenaVector<Node*>(inputs_.begin(), inputs_.end(), alloc);
+  outputs_ = ArenaVector<Node*>(outputs_.begin(), outputs_.end(), alloc);
+  validations_ = ArenaVector<Node*>(validations_.begin(), validations_.end(), alloc);
+}
+
 bool Edge::maybe_phonycycle_diagnostic() const {
   // CMake 2.8.12.x and 3.0.x produced self-referencing phony rules
   // of the form "build a: phony ... a ...".   Restrict our
@@ -556,8 +686,8 @@ bool Edge::maybe_phonycycle_diagnostic() const {
 }
 
 // static
-string Node::PathDecanonicalized(const string& path, uint64_t slash_bits) {
-  string result = path;
+string Node::PathDecanonicalized(StringPiece path, uint64_t slash_bits) {
+  string result = path.AsString();
 #ifdef _WIN32
   uint64_t mask = 1;
   for (char* c = &result[0]; (c = strchr(c, '/')) != NULL;) {
@@ -571,7 +701,7 @@ string Node::PathDecanonicalized(const string& path, uint64_t slash_bits) {
 }
 
 void Node::Dump(const char* prefix) const {
-  printf("%s <%s 0x%p> mtime: %" PRId64 "%s, (:%s), ", prefix, path().c_str(), this, mtime(),
+  printf("%s <%s 0x%p> mtime: %" PRId64 "%s, (:%s), ", prefix, path().str_, this, mtime(),
          exists() ? "" : " (:missing)", dirty() ? " dirty" : " clean");
   if (in_edge()) {
     in_edge()->Dump("in-edge: ");
@@ -579,12 +709,12 @@ void Node::Dump(const char* prefix) const {
     printf("no in-edge\n");
   }
   printf(" out edges:\n");
-  for (vector<Edge*>::const_iterator e = out_edges().begin(); e != out_edges().end() && *e != NULL; ++e) {
+  for (ArenaVector<Edge*>::const_iterator e = out_edges().begin(); e != out_edges().end() && *e != NULL; ++e) {
     (*e)->Dump(" +- ");
   }
   if (!validation_out_edges().empty()) {
     printf(" validation out edges:\n");
-    for (std::vector<Edge*>::const_iterator e = validation_out_edges().begin();
+    for (ArenaVector<Edge*>::const_iterator e = validation_out_edges().begin();
          e != validation_out_edges().end() && *e != NULL; ++e) {
       (*e)->Dump(" +- ");
     }
@@ -656,7 +786,7 @@ bool ImplicitDepLoader::LoadDepFile(Edge* edge, const string& path, string* err)
   Node* first_output = edge->outputs_[0];
   StringPiece opath = StringPiece(first_output->path());
   if (opath != *primary_out) {
-    EXPLAIN("expected depfile '%s' to mention '%s', got '%s'", path.c_str(), first_output->path().c_str(),
+    EXPLAIN("expected depfile '%s' to mention '%s', got '%s'", path.c_str(), first_output->path().str_,
             primary_out->AsString().c_str());
     return false;
   }
@@ -675,7 +805,7 @@ bool ImplicitDepLoader::LoadDepFile(Edge* edge, const string& path, string* err)
 
 bool ImplicitDepLoader::ProcessDepfileDeps(Edge* edge, std::vector<StringPiece>* depfile_ins, std::string* err) {
   // Preallocate space in edge->inputs_ to be filled in below.
-  vector<Node*>::iterator implicit_dep = PreallocateSpace(edge, depfile_ins->size());
+  ArenaVector<Node*>::iterator implicit_dep = PreallocateSpace(edge, depfile_ins->size());
 
   // Add all its in-edges.
   for (std::vector<StringPiece>::iterator i = depfile_ins->begin(); i != depfile_ins->end(); ++i, ++implicit_dep) {
@@ -694,18 +824,18 @@ bool ImplicitDepLoader::LoadDepsFromLog(Edge* edge, string* err) {
   Node* output = edge->outputs_[0];
   DepsLog::Deps* deps = deps_log_ ? deps_log_->GetDeps(output) : NULL;
   if (!deps) {
-    EXPLAIN("deps for '%s' are missing", output->path().c_str());
+    EXPLAIN("deps for '%s' are missing", output->path().str_);
     return false;
   }
 
   // Deps are invalid if the output is newer than the deps.
   if (output->mtime() > deps->mtime) {
-    EXPLAIN("stored deps info out of date for '%s' (%" PRId64 " vs %" PRId64 ")", output->path().c_str(), deps->mtime,
+    EXPLAIN("stored deps info out of date for '%s' (%" PRId64 " vs %" PRId64 ")", output->path().str_, deps->mtime,
             output->mtime());
     return false;
   }
 
-  vector<Node*>::iterator implicit_dep = PreallocateSpace(edge, deps->node_count);
+  ArenaVector<Node*>::iterator implicit_dep = PreallocateSpace(edge, deps->node_count);
   for (int i = 0; i < deps->node_count; ++i, ++implicit_dep) {
     Node* node = deps->nodes[i];
     *implicit_dep = node;
@@ -714,7 +844,7 @@ bool ImplicitDepLoader::LoadDepsFromLog(Edge* edge, string* err) {
   return true;
 }
 
-vector<Node*>::iterator ImplicitDepLoader::PreallocateSpace(Edge* edge, int count) {
+ArenaVector<Node*>::iterator ImplicitDepLoader::PreallocateSpace(Edge* edge, int count) {
   edge->inputs_.insert(edge->inputs_.end() - edge->order_only_deps_, (size_t)count, 0);
   edge->implicit_deps_ += count;
   return edge->inputs_.end() - edge->order_only_deps_ - count;
@@ -21,8 +21,10 @@
 #include <string>
 #include <vector>
 
+#include "arena.h"
 #include "dyndep.h"
 #include "eval_env.h"
+#include "path_table.h"
 #include "timestamp.h"
 #include "util.h"
 
@@ -38,11 +40,22 @@ struct State;
 /// Information about a node in the dependency graph: the file, whether
 /// it's dirty, mtime, etc.
 struct Node {
-  Node(const std::string& path, uint64_t slash_bits) : path_(path), slash_bits_(slash_bits) {}
+  Node(StringPiece path, uint64_t slash_bits)
+      : slash_bits_(slash_bits), path_id_(PathTable::Global().Intern(path)) {}
+  /// A node whose edge lists take their memory from \a arena.
+  Node(uint32_t path_id, uint64_t slash_bits, Arena* arena)
+      : slash_bits_(slash_bits),
+        out_edges_(ArenaAllocator<Edge*>(arena)),
+        validation_out_edges_(ArenaAllocator<Edge*>(arena)),
+        path_id_(path_id) {}
 
   /// Return false on error.
   bool Stat(DiskInterface* disk_interface, std::string* err);
 
+  /// Record \a mtime, as returned by DiskInterface::Stat() for this node.
+  /// Return false if it is the error value -1.
+  bool SetStatResult(TimeStamp mtime);
+
   /// If the file doesn't exist, set the mtime_ from its dependencies
   void UpdatePhonyMtime(TimeStamp mtime);
 
@@ -72,12 +85,14 @@ struct Node {
 
   bool status_known() const { return exists_ != ExistenceStatusUnknown; }
 
-  const std::string& path() const { return path_; }
+  /// The path as interned in PathTable::Global(), which owns its bytes.
+  /// They are NUL-terminated, so path().str_ is also a C string.
+  StringPiece path() const { return PathTable::Global().path(path_id_); }
 
   /// Get |path()| but use slash_bits to convert back to original slash styles.
-  std::string PathDecanonicalized() const { return PathDecanonicalized(path_, slash_bits_); }
+  std::string PathDecanonicalized() const { return PathDecanonicalized(path(), slash_bits_); }
 
-  static std::string PathDecanonicalized(const std::string& path, uint64_t slash_bits);
+  static std::string PathDecanonicalized(StringPiece path, uint64_t slash_bits);
 
   uint64_t slash_bits() const { return slash_bits_; }
 
@@ -105,21 +120,30 @@ struct Node {
 
   int id() const { return id_; }
 
+  /// The id of path() in PathTable::Global().
+  uint32_t path_id() const { return path_id_; }
+
   void set_id(int id) { id_ = id; }
 
-  const std::vector<Edge*>& out_edges() const { return out_edges_; }
+  const ArenaVector<Edge*>& out_edges() const { return out_edges_; }
 
-  const std::vector<Edge*>& validation_out_edges() const { return validation_out_edges_; }
+  const ArenaVector<Edge*>& validation_out_edges() const { return validation_out_edges_; }
 
   void AddOutEdge(Edge* edge) { out_edges_.push_back(edge); }
 
   void AddValidationOutEdge(Edge* edge) { validation_out_edges_.push_back(edge); }
 
+  /// Unlink this node from all edges, e.g. before moving it to another
+  /// State, whose \a arena then backs its edge lists.
+  void ClearEdges(Arena* arena) {
+    in_edge_ = nullptr;
+    out_edges_ = ArenaVector<Edge*>(ArenaAllocator<Edge*>(arena));
+    validation_out_edges_ = ArenaVector<Edge*>(ArenaAllocator<Edge*>(arena));
+  }
+
   void Dump(const char* prefix = "") const;
 
  private:
-  std::string path_;
-
   /// Set bits starting from lowest for backslashes that were normalized to
   /// forward slashes by CanonicalizePath. See |PathDecanonicalized|.
   uint64_t slash_bits_ = 0;
@@ -162,13 +186,15 @@ struct Node {
   Edge* in_edge_ = nullptr;
 
   /// All Edges that use this Node as an input.
-  std::vector<Edge*> out_edges_;
+  ArenaVector<Edge*> out_edges_;
 
   /// All Edges that use this Node as a validation.
-  std::vector<Edge*> validation_out_edges_;
+  ArenaVector<Edge*> validation_out_edges_;
 
   /// A dense integer id for the node, assigned and used by DepsLog.
   int id_ = -1;
+
+  uint32_t path_id_;
 };
 
 /// An edge in the dependency graph; links between Nodes using Rules.
@@ -176,6 +202,15 @@ struct Edge {
   enum VisitMark { VisitNone, VisitInStack, VisitDone };
 
   Edge() = default;
+  /// An edge whose node lists take their memory from \a arena.
+  explicit Edge(Arena* arena)
+      : inputs_(ArenaAllocator<Node*>(arena)),
+        outputs_(ArenaAllocator<Node*>(arena)),
+        validations_(ArenaAllocator<Node*>(arena)) {}
+
+  /// Have the node lists take further memory from \a arena, once the
+  /// edge is merged into a State other than the one that allocated it.
+  void MoveToArena(Arena* arena);
 
   /// Return true if all inputs' in-edges are ready.
   bool AllInputsReady() const;
@@ -184,6 +219,9 @@ struct Edge {
   /// If incl_rsp_file is enabled, the string will also contain the
   /// full contents of a response file (if applicable)
   std::string EvaluateCommand(bool incl_rsp_file = false) const;
+  /// BuildLog::LogEntry::HashCommand(EvaluateCommand(incl_rsp_file)), but
+  /// hashing the pieces of the command as they are evaluated.
+  uint64_t HashCommand(bool incl_rsp_file = false) const;
 
   /// Returns the shell-escaped value of |key|.
   std::string GetBinding(const std::string& key) const;
@@ -211,9 +249,9 @@ struct Edge {
 
   const Rule* rule_ = nullptr;
   Pool* pool_ = nullptr;
-  std::vector<Node*> inputs_;
-  std::vector<Node*> outputs_;
-  std::vector<Node*> validations_;
+  ArenaVector<Node*> inputs_;
+  ArenaVector<Node*> outputs_;
+  ArenaVector<Node*> validations_;
   Node* dyndep_ = nullptr;
   BindingEnv* env_ = nullptr;
   VisitMark mark_ = VisitNone;
@@ -266,6 +304,8 @@ struct Edge {
   // Historical info: how long did this edge take last time,
   // as per .ninja_log, if known? Defaults to -1 if unknown.
   int64_t prev_elapsed_time_millis = -1;
+  // Likewise its peak RSS in KiB, or 0 if unknown.
+  int64_t prev_peak_rss_kb = 0;
 };
 
 struct EdgeCmp {
@@ -306,7 +346,7 @@ struct ImplicitDepLoader {
 
   /// Preallocate \a count spaces in the input array on \a edge, returning
   /// an iterator pointing at the first new space.
-  std::vector<Node*>::iterator PreallocateSpace(Edge* edge, int count);
+  ArenaVector<Node*>::iterator PreallocateSpace(Edge* edge, int count);
 
   State* state_;
   DiskInterface* disk_interface_;
@@ -350,19 +390,31 @@ struct DependencyScan {
   bool LoadDyndeps(Node* node, std::string* err) const;
   bool LoadDyndeps(Node* node, DyndepFile* ddf, std::string* err) const;
 
+  /// Have RecomputeDirty stat the files it will need in one
+  /// DiskInterface::StatMany() call before walking the graph, rather than
+  /// one at a time as the walk reaches them.
+  void set_batch_stat(bool batch_stat) { batch_stat_ = batch_stat; }
+
  private:
+  /// Stat, as a batch, every node reachable from \a node through the
+  /// manifest and the deps log whose status is not yet known.  Failures
+  /// are left for the walk to stat again and report.
+  void StatFrontier(Node* node);
+
   bool RecomputeNodeDirty(Node* node, std::vector<Node*>* stack, std::vector<Node*>* validation_nodes,
                           std::string* err);
   bool VerifyDAG(Node* node, std::vector<Node*>* stack, std::string* err);
 
   /// Recompute whether a given single output should be marked dirty.
   /// Returns true if so.
-  bool RecomputeOutputDirty(const Edge* edge, const Node* most_recent_input, const std::string& command, Node* output);
+  /// \a command_hash is the edge's HashCommand(true).
+  bool RecomputeOutputDirty(const Edge* edge, const Node* most_recent_input, uint64_t command_hash, Node* output);
 
   BuildLog* build_log_;
   DiskInterface* disk_interface_;
   ImplicitDepLoader dep_loader_;
   DyndepLoader dyndep_loader_;
+  bool batch_stat_ = false;
 };
 
 // Implements a less comparison for edges by priority, where highest
@@ -14,6 +14,7 @@
 
 #include "graph.h"
 #include "build.h"
+#include "build_log.h"
 
 #include "test.h"
 
@@ -202,7 +203,7 @@ TEST_F(GraphTest, RootNodes) {
   vector<Node*> root_nodes = state_.RootNodes(&err);
   EXPECT_EQ(4u, root_nodes.size());
   for (size_t i = 0; i < root_nodes.size(); ++i) {
-    string name = root_nodes[i]->path();
+    string name = root_nodes[i]->path().AsString();
     EXPECT_EQ("out", name.substr(0, 3));
   }
 }
@@ -249,6 +250,43 @@ TEST_F(GraphTest, VarInOutPathEscaping) {
 #endif
 }
 
+TEST_F(GraphTest, HashCommand) {
+  // Hashing the command as it is evaluated gives the hash of the whole of
+  // it: escaped paths, rule, edge and file bindings, response files, and
+  // commands long enough to take the hash through several blocks.
+  string flags;
+  for (int i = 0; i < 300; ++i)
+    flags += " -Ithird_party/include/" + to_string(i);
+  string manifest = "flags =" + flags + "\n"
+                    "extra = -DTOP\n"
+                    "rule cc\n"
+                    "  command = cc $flags $extra -c $in -o $out\n"
+                    "rule link\n"
+                    "  command = ld @$out.rsp -o $out\n"
+                    "  rspfile = $out.rsp\n"
+                    "  rspfile_content = $in_newline $rspfile\n"
+                    "rule empty_rsp\n"
+                    "  command = touch $out\n"
+                    "  rspfile = $out.rsp\n"
+                    "  rspfile_content = $nothing\n"
+                    "build a.o: cc a.c | a.h || gen\n"
+                    "build with$ space.o: cc with$ space.c quote'.c\n"
+                    "  extra = -DEDGE\n"
+                    "build out: link a.o with$ space.o\n"
+                    "build none: cc\n"
+                    "build t: empty_rsp\n"
+                    "build p: phony a.o\n";
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_, manifest.c_str()));
+  for (size_t i = 0; i < state_.edges_.size(); ++i) {
+    Edge* edge = state_.edges_[i];
+    for (int rsp = 0; rsp < 2; ++rsp) {
+      EXPECT_EQ(BuildLog::LogEntry::HashCommand(edge->EvaluateCommand(rsp)), edge->HashCommand(rsp))
+          << edge->EvaluateCommand(rsp);
+    }
+  }
+  EXPECT_NE(GetNode("out")->in_edge()->HashCommand(false), GetNode("out")->in_edge()->HashCommand(true));
+}
+
 // Regression test for https://github.com/ninja-build/ninja/issues/380
 TEST_F(GraphTest, DepfileWithCanonicalizablePath) {
   ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
@@ -977,3 +1015,51 @@ TEST_F(GraphTest, EdgeQueuePriority) {
   }
   EXPECT_TRUE(queue.empty());
 }
+
+TEST_F(GraphTest, BatchStatFrontier) {
+  // Enough inputs for the scan to stat them as a batch.
+  string manifest = "build out: cat";
+  char buf[32];
+  for (int i = 0; i < 200; ++i) {
+    snprintf(buf, sizeof(buf), " in%d", i);
+    manifest += buf;
+    fs_.Create(buf + 1, "");
+  }
+  manifest += " | missing\n";
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_, manifest.c_str()));
+  fs_.Create("out", "");
+  fs_.Tick();
+  fs_.Create("in7", "");
+
+  scan_.set_batch_stat(true);
+  string err;
+  EXPECT_TRUE(scan_.RecomputeDirty(GetNode("out"), NULL, &err));
+  ASSERT_EQ("", err);
+  EXPECT_TRUE(GetNode("out")->dirty());
+  for (int i = 0; i < 200; ++i) {
+    snprintf(buf, sizeof(buf), "in%d", i);
+    EXPECT_TRUE(GetNode(buf)->exists());
+  }
+  EXPECT_EQ(fs_.now_ - 1, GetNode("out")->mtime());
+  EXPECT_FALSE(GetNode("missing")->exists());
+}
+
+TEST_F(GraphTest, BatchStatFrontierError) {
+  // A stat failure in the pre-pass is reported by the walk.
+  string manifest = "build out: cat";
+  char buf[32];
+  for (int i = 0; i < 200; ++i) {
+    snprintf(buf, sizeof(buf), " in%d", i);
+    manifest += buf;
+    fs_.Create(buf + 1, "");
+  }
+  manifest += "\n";
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_, manifest.c_str()));
+  fs_.files_["in150"].mtime = -1;
+  fs_.files_["in150"].stat_error = "stat failed";
+
+  scan_.set_batch_stat(true);
+  string err;
+  EXPECT_FALSE(scan_.RecomputeDirty(GetNode("out"), NULL, &err));
+  EXPECT_EQ("stat failed", err);
+}
@@ -26,7 +26,7 @@ void GraphViz::AddTarget(Node* node) {
   if (visited_nodes_.find(node) != visited_nodes_.end())
     return;
 
-  string pathstr = node->path();
+  string pathstr = node->path().AsString();
   replace(pathstr.begin(), pathstr.end(), '\\', '/');
   printf("\"%p\" [label=\"%s\"]\n", node, pathstr.c_str());
   visited_nodes_.insert(node);
@@ -57,10 +57,10 @@ void GraphViz::AddTarget(Node* node) {
     printf("\"%p\" -> \"%p\" [label=\" %s\"]\n", edge->inputs_[0], edge->outputs_[0], edge->rule_->name().c_str());
   } else {
     printf("\"%p\" [label=\"%s\", shape=ellipse]\n", edge, edge->rule_->name().c_str());
-    for (vector<Node*>::iterator out = edge->outputs_.begin(); out != edge->outputs_.end(); ++out) {
+    for (ArenaVector<Node*>::iterator out = edge->outputs_.begin(); out != edge->outputs_.end(); ++out) {
       printf("\"%p\" -> \"%p\"\n", edge, *out);
     }
-    for (vector<Node*>::iterator in = edge->inputs_.begin(); in != edge->inputs_.end(); ++in) {
+    for (ArenaVector<Node*>::iterator in = edge->inputs_.begin(); in != edge->inputs_.end(); ++in) {
       const char* order_only = "";
       if (edge->is_order_only(in - edge->inputs_.begin()))
         order_only = " style=dotted";
@@ -68,7 +68,7 @@ void GraphViz::AddTarget(Node* node) {
     }
   }
 
-  for (vector<Node*>::iterator in = edge->inputs_.begin(); in != edge->inputs_.end(); ++in) {
+  for (ArenaVector<Node*>::iterator in = edge->inputs_.begin(); in != edge->inputs_.end(); ++in) {
     AddTarget(*in);
   }
 }
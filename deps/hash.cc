@@ -0,0 +1,348 @@
+// Copyright (c) 2024 Aniket Ray
+//
+// Licensed under the MIT License; see LICENSE.txt.
+
+#include "hash.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NINJA_HASH_SSE2 1
+#include <emmintrin.h>
+#endif
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#pragma intrinsic(_umul128)
+#endif
+
+// Implementation details:
+// This follows the reference XXH3_64bits() of xxHash 0.8 (BSD licensed,
+// https://github.com/Cyan4973/xxHash), for a seed of 0 only.  Short inputs
+// each have their own mix of a few reads; longer ones are cut into 64-byte
+// stripes that update eight 64-bit accumulators, which are scrambled after
+// each block of 16 stripes and merged at the end.  Xxh3Hasher keeps the
+// input that might still turn out to be short, and otherwise the stripes
+// but the one holding the last byte go into the accumulators as they come.
+
+namespace {
+
+const uint32_t kPrime32_1 = 0x9E3779B1U;
+const uint32_t kPrime32_2 = 0x85EBCA77U;
+const uint32_t kPrime32_3 = 0xC2B2AE3DU;
+const uint64_t kPrime64_1 = 0x9E3779B185EBCA87ULL;
+const uint64_t kPrime64_2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t kPrime64_3 = 0x165667B19E3779F9ULL;
+const uint64_t kPrime64_4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t kPrime64_5 = 0x27D4EB2F165667C5ULL;
+const uint64_t kPrimeMx1 = 0x165667919E3779F9ULL;
+const uint64_t kPrimeMx2 = 0x9FB21C651E98DF25ULL;
+
+const size_t kSecretSize = 192;
+const unsigned char kSecret[kSecretSize] = {
+  0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+  0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+  0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+  0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+  0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+  0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+  0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+  0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+  0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+  0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+  0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+  0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+const size_t kStripeLen = 64;
+/// Each stripe of a block starts this much further into the secret.
+const size_t kSecretConsumeRate = 8;
+const size_t kStripesPerBlock = (kSecretSize - kStripeLen) / kSecretConsumeRate;
+const size_t kMidSizeMax = 240;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+inline uint32_t Read32(const unsigned char* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return __builtin_bswap32(v);
+}
+inline uint64_t Read64(const unsigned char* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return __builtin_bswap64(v);
+}
+#else
+inline uint32_t Read32(const unsigned char* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+inline uint64_t Read64(const unsigned char* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+#endif
+
+inline uint64_t Swap64(uint64_t x) {
+  return ((x << 56) & 0xff00000000000000ULL) | ((x << 40) & 0x00ff000000000000ULL) |
+         ((x << 24) & 0x0000ff0000000000ULL) | ((x << 8) & 0x000000ff00000000ULL) |
+         ((x >> 8) & 0x00000000ff000000ULL) | ((x >> 24) & 0x0000000000ff0000ULL) |
+         ((x >> 40) & 0x000000000000ff00ULL) | ((x >> 56) & 0x00000000000000ffULL);
+}
+
+inline uint64_t Rotl64(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+/// The 128-bit product of \a lhs and \a rhs, its halves xored together.
+inline uint64_t Mul128Fold64(uint64_t lhs, uint64_t rhs) {
+#if defined(__SIZEOF_INT128__)
+  __uint128_t product = (__uint128_t)lhs * rhs;
+  return (uint64_t)product ^ (uint64_t)(product >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+  uint64_t high;
+  uint64_t low = _umul128(lhs, rhs, &high);
+  return low ^ high;
+#else
+  uint64_t lo_lo = (lhs & 0xFFFFFFFF) * (rhs & 0xFFFFFFFF);
+  uint64_t hi_lo = (lhs >> 32) * (rhs & 0xFFFFFFFF);
+  uint64_t lo_hi = (lhs & 0xFFFFFFFF) * (rhs >> 32);
+  uint64_t hi_hi = (lhs >> 32) * (rhs >> 32);
+  uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFF) + lo_hi;
+  uint64_t upper = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+  uint64_t lower = (cross << 32) | (lo_lo & 0xFFFFFFFF);
+  return lower ^ upper;
+#endif
+}
+
+inline uint64_t Xxh64Avalanche(uint64_t h) {
+  h ^= h >> 33;
+  h *= kPrime64_2;
+  h ^= h >> 29;
+  h *= kPrime64_3;
+  h ^= h >> 32;
+  return h;
+}
+
+inline uint64_t Avalanche(uint64_t h) {
+  h ^= h >> 37;
+  h *= kPrimeMx1;
+  h ^= h >> 32;
+  return h;
+}
+
+inline uint64_t RrmxmxAvalanche(uint64_t h, uint64_t len) {
+  h ^= Rotl64(h, 49) ^ Rotl64(h, 24);
+  h *= kPrimeMx2;
+  h ^= (h >> 35) + len;
+  h *= kPrimeMx2;
+  h ^= h >> 28;
+  return h;
+}
+
+inline uint64_t Mix16B(const unsigned char* input, const unsigned char* secret) {
+  return Mul128Fold64(Read64(input) ^ Read64(secret), Read64(input + 8) ^ Read64(secret + 8));
+}
+
+uint64_t Hash0To16(const unsigned char* input, size_t len) {
+  if (len > 8) {
+    uint64_t lo = Read64(input) ^ (Read64(kSecret + 24) ^ Read64(kSecret + 32));
+    uint64_t hi = Read64(input + len - 8) ^ (Read64(kSecret + 40) ^ Read64(kSecret + 48));
+    return Avalanche(len + Swap64(lo) + hi + Mul128Fold64(lo, hi));
+  }
+  if (len >= 4) {
+    uint64_t combined = Read32(input + len - 4) + ((uint64_t)Read32(input) << 32);
+    return RrmxmxAvalanche(combined ^ (Read64(kSecret + 8) ^ Read64(kSecret + 16)), len);
+  }
+  if (len > 0) {
+    uint32_t combined = ((uint32_t)input[0] << 16) | ((uint32_t)input[len >> 1] << 24) | input[len - 1] |
+                        ((uint32_t)len << 8);
+    return Xxh64Avalanche(combined ^ (uint64_t)(Read32(kSecret) ^ Read32(kSecret + 4)));
+  }
+  return Xxh64Avalanche(Read64(kSecret + 56) ^ Read64(kSecret + 64));
+}
+
+uint64_t Hash17To128(const unsigned char* input, size_t len) {
+  uint64_t acc = len * kPrime64_1;
+  if (len > 32) {
+    if (len > 64) {
+      if (len > 96) {
+        acc += Mix16B(input + 48, kSecret + 96);
+        acc += Mix16B(input + len - 64, kSecret + 112);
+      }
+      acc += Mix16B(input + 32, kSecret + 64);
+      acc += Mix16B(input + len - 48, kSecret + 80);
+    }
+    acc += Mix16B(input + 16, kSecret + 32);
+    acc += Mix16B(input + len - 32, kSecret + 48);
+  }
+  acc += Mix16B(input, kSecret);
+  acc += Mix16B(input + len - 16, kSecret + 16);
+  return Avalanche(acc);
+}
+
+uint64_t Hash129To240(const unsigned char* input, size_t len) {
+  const size_t kStartOffset = 3;
+  const size_t kLastOffset = 17;
+  uint64_t acc = len * kPrime64_1;
+  for (size_t i = 0; i < 8; ++i)
+    acc += Mix16B(input + 16 * i, kSecret + 16 * i);
+  acc = Avalanche(acc);
+  for (size_t i = 8; i < len / 16; ++i)
+    acc += Mix16B(input + 16 * i, kSecret + 16 * (i - 8) + kStartOffset);
+  acc += Mix16B(input + len - 16, kSecret + 136 - kLastOffset);
+  return Avalanche(acc);
+}
+
+/// Fold \a stripes stripes of \a input into \a acc, the first with
+/// \a secret and each next one with the secret 8 bytes further on.
+void Accumulate(uint64_t* acc, const unsigned char* input, const unsigned char* secret, size_t stripes) {
+#ifdef NINJA_HASH_SSE2
+  // Each 128-bit register holds two lanes.  _mm_mul_epu32 multiplies the
+  // low halves of its two lanes, so shuffling the high halves down gives
+  // lo * hi of each.
+  __m128i lanes[4];
+  for (int i = 0; i < 4; ++i)
+    lanes[i] = _mm_loadu_si128((const __m128i*)(acc + 2 * i));
+  for (size_t n = 0; n < stripes; ++n, input += kStripeLen, secret += kSecretConsumeRate) {
+    for (int i = 0; i < 4; ++i) {
+      __m128i data = _mm_loadu_si128((const __m128i*)(input + 16 * i));
+      __m128i key = _mm_xor_si128(data, _mm_loadu_si128((const __m128i*)(secret + 16 * i)));
+      __m128i product = _mm_mul_epu32(key, _mm_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1)));
+      __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+      lanes[i] = _mm_add_epi64(product, _mm_add_epi64(lanes[i], swapped));
+    }
+  }
+  for (int i = 0; i < 4; ++i)
+    _mm_storeu_si128((__m128i*)(acc + 2 * i), lanes[i]);
+#else
+  for (size_t n = 0; n < stripes; ++n, input += kStripeLen, secret += kSecretConsumeRate) {
+    for (int i = 0; i < 8; ++i) {
+      uint64_t data = Read64(input + 8 * i);
+      uint64_t key = data ^ Read64(secret + 8 * i);
+      acc[i ^ 1] += data;
+      acc[i] += (key & 0xFFFFFFFF) * (key >> 32);
+    }
+  }
+#endif
+}
+
+void Scramble(uint64_t* acc, const unsigned char* secret) {
+#ifdef NINJA_HASH_SSE2
+  const __m128i prime = _mm_set1_epi32((int)kPrime32_1);
+  for (int i = 0; i < 4; ++i) {
+    __m128i lane = _mm_loadu_si128((const __m128i*)(acc + 2 * i));
+    lane = _mm_xor_si128(lane, _mm_srli_epi64(lane, 47));
+    __m128i key = _mm_xor_si128(lane, _mm_loadu_si128((const __m128i*)(secret + 16 * i)));
+    __m128i product_lo = _mm_mul_epu32(key, prime);
+    __m128i product_hi = _mm_mul_epu32(_mm_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+    _mm_storeu_si128((__m128i*)(acc + 2 * i), _mm_add_epi64(product_lo, _mm_slli_epi64(product_hi, 32)));
+  }
+#else
+  for (int i = 0; i < 8; ++i) {
+    uint64_t lane = acc[i];
+    lane ^= lane >> 47;
+    lane ^= Read64(secret + 8 * i);
+    acc[i] = lane * kPrime32_1;
+  }
+#endif
+}
+
+const uint64_t kInitAcc[8] = { kPrime32_3, kPrime64_1, kPrime64_2, kPrime64_3,
+                               kPrime64_4, kPrime32_2, kPrime64_5, kPrime32_1 };
+
+/// Fold \a stripes stripes of \a input into \a acc, which already holds
+/// \a stripes_in_block of the current block, scrambling it after each
+/// block.  Input must follow the stripes, as a block is only scrambled
+/// once it is known not to be the last.
+void ConsumeStripes(uint64_t* acc, size_t* stripes_in_block, const unsigned char* input, size_t stripes) {
+  while (stripes > 0) {
+    size_t n = std::min(stripes, kStripesPerBlock - *stripes_in_block);
+    Accumulate(acc, input, kSecret + *stripes_in_block * kSecretConsumeRate, n);
+    input += n * kStripeLen;
+    stripes -= n;
+    *stripes_in_block += n;
+    if (*stripes_in_block == kStripesPerBlock) {
+      Scramble(acc, kSecret + kSecretSize - kStripeLen);
+      *stripes_in_block = 0;
+    }
+  }
+}
+
+/// Finish the hash of \a len bytes with the stripe holding the last byte.
+uint64_t Finish(uint64_t* acc, const unsigned char* last_stripe, uint64_t len) {
+  const size_t kLastAccStart = 7;
+  Accumulate(acc, last_stripe, kSecret + kSecretSize - kStripeLen - kLastAccStart, 1);
+
+  const size_t kMergeAccsStart = 11;
+  uint64_t result = len * kPrime64_1;
+  for (int i = 0; i < 4; ++i)
+    result += Mul128Fold64(acc[2 * i] ^ Read64(kSecret + kMergeAccsStart + 16 * i),
+                           acc[2 * i + 1] ^ Read64(kSecret + kMergeAccsStart + 16 * i + 8));
+  return Avalanche(result);
+}
+
+uint64_t HashLong(const unsigned char* input, size_t len) {
+  uint64_t acc[8];
+  memcpy(acc, kInitAcc, sizeof(acc));
+  size_t stripes_in_block = 0;
+  // The last stripe is hashed apart, even if it is a whole one.
+  ConsumeStripes(acc, &stripes_in_block, input, (len - 1) / kStripeLen);
+  return Finish(acc, input + len - kStripeLen, len);
+}
+
+}  // anonymous namespace
+
+uint64_t Xxh3Hash64(const void* data, size_t len) {
+  const unsigned char* input = (const unsigned char*)data;
+  if (len <= 16)
+    return Hash0To16(input, len);
+  if (len <= 128)
+    return Hash17To128(input, len);
+  if (len <= kMidSizeMax)
+    return Hash129To240(input, len);
+  return HashLong(input, len);
+}
+
+Xxh3Hasher::Xxh3Hasher() : stripes_in_block_(0), total_len_(0), buffered_(0) {
+  memcpy(acc_, kInitAcc, sizeof(acc_));
+}
+
+void Xxh3Hasher::Update(const void* data, size_t len) {
+  const unsigned char* input = (const unsigned char*)data;
+  total_len_ += len;
+  while (len > 0) {
+    if (buffered_ == 0 && len > kBufferSize) {
+      // Hash the stripes straight from the input.  More than kMidSizeMax
+      // bytes are coming, so they are not a short input.
+      size_t stripes = (len - 1) / kStripeLen;
+      ConsumeStripes(acc_, &stripes_in_block_, input, stripes);
+      input += stripes * kStripeLen;
+      len -= stripes * kStripeLen;
+      memcpy(buffer_, input - kStripeLen, kStripeLen);
+    }
+    size_t n = std::min(len, kBufferSize - buffered_);
+    memcpy(buffer_ + kStripeLen + buffered_, input, n);
+    buffered_ += n;
+    input += n;
+    len -= n;
+    if (len > 0) {
+      // The buffer is full, and more follows.
+      ConsumeStripes(acc_, &stripes_in_block_, buffer_ + kStripeLen, kBufferSize / kStripeLen);
+      memcpy(buffer_, buffer_ + kBufferSize, kStripeLen);
+      buffered_ = 0;
+    }
+  }
+}
+
+uint64_t Xxh3Hasher::Digest() const {
+  if (total_len_ <= kMidSizeMax)
+    return Xxh3Hash64(buffer_ + kStripeLen, (size_t)total_len_);
+  uint64_t acc[8];
+  memcpy(acc, acc_, sizeof(acc));
+  size_t stripes_in_block = stripes_in_block_;
+  ConsumeStripes(acc, &stripes_in_block, buffer_ + kStripeLen, (buffered_ - 1) / kStripeLen);
+  return Finish(acc, buffer_ + buffered_, total_len_);
+}
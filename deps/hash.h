@@ -0,0 +1,39 @@
+// Copyright (c) 2024 Aniket Ray
+//
+// Licensed under the MIT License; see LICENSE.txt.
+
+#ifndef NINJA_HASH_H_
+#define NINJA_HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// XXH3, the 64-bit hash of xxHash 0.8 by Yann Collet, with a seed of 0
+/// and the default secret: XXH3_64bits().  Inputs over 240 bytes go
+/// through eight independent lanes, 64 bytes at a time, which SSE2 runs
+/// two at once.
+uint64_t Xxh3Hash64(const void* data, size_t len);
+
+/// Xxh3Hash64 of input given in pieces: the hash of all the pieces Update()
+/// was given so far, one after the other, is Digest().
+struct Xxh3Hasher {
+  Xxh3Hasher();
+
+  void Update(const void* data, size_t len);
+  uint64_t Digest() const;
+
+ private:
+  uint64_t acc_[8];
+  /// Stripes of the current block that are in acc_.
+  size_t stripes_in_block_;
+  uint64_t total_len_;
+  /// Input not yet in acc_, which is all of it up to kBufferSize bytes, is
+  /// at buffer_ + kStripeLen.  The kStripeLen bytes before it are the last
+  /// ones that went into acc_, for the last stripe to overlap.
+  static const size_t kStripeLen = 64;
+  static const size_t kBufferSize = 4 * kStripeLen;
+  unsigned char buffer_[kStripeLen + kBufferSize];
+  size_t buffered_;
+};
+
+#endif  // NINJA_HASH_H_
@@ -15,10 +15,16 @@
 #include "build_log.h"
 
 #include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <stdlib.h>
 #include <time.h>
 
+#include "hash_map.h"
+#include "metrics.h"
+
 using namespace std;
 
 int random(int low, int high) {
@@ -33,8 +39,43 @@ void RandomCommand(char** s) {
   (*s)[len] = '\0';
 }
 
-int main() {
-  const int N = 20 * 1000 * 1000;
+/// Time inserting \a n keys into a Map, then looking each one up along
+/// with a key that is absent, as the path and log tables do.
+template <typename Map>
+void TimeMap(const char* name, char** keys, int n) {
+  vector<string> misses(keys, keys + n);
+  for (int i = 0; i < n; ++i)
+    misses[i] += '~';
+
+  // Repeat small sizes so each measurement covers enough operations.
+  const int rounds = max(1, 4 * 1000 * 1000 / n);
+  int64_t insert = 0, hit = 0, miss = 0;
+  int found = 0;
+  for (int r = 0; r < rounds; ++r) {
+    Map map;
+    int64_t start = GetTimeMillis();
+    for (int i = 0; i < n; ++i)
+      map.insert(typename Map::value_type(keys[i], i));
+    int64_t mid = GetTimeMillis();
+    for (int i = 0; i < n; ++i)
+      found += map.find(keys[i]) != map.end();
+    int64_t mid2 = GetTimeMillis();
+    for (int i = 0; i < n; ++i)
+      found += map.find(misses[i]) != map.end();
+    int64_t end = GetTimeMillis();
+    insert += mid - start;
+    hit += mid2 - mid;
+    miss += end - mid2;
+  }
+  double ops = 1e-6 * n * rounds;  // ms per op -> ns per op
+  printf("  %-14s %8d keys  insert %6.1fns  hit %6.1fns  miss %6.1fns  (%d found)\n", name, n, insert / ops,
+         hit / ops, miss / ops, found / rounds);
+}
+
+int main(int argc, char** argv) {
+  int N = 20 * 1000 * 1000;
+  if (argc > 1)
+    N = atoi(argv[1]);
 
   // Leak these, else 10% of the runtime is spent destroying strings.
   char** commands = new char*[N];
@@ -60,4 +101,15 @@ int main() {
     }
   }
   printf("\n\n%d collisions after %d runs\n", collision_count, N);
+
+  // Compare the flat map behind ExternalStringHashMap with the
+  // node-based std::unordered_map it replaced, from cache-resident to
+  // memory-bound sizes.
+  printf("\nStringPiece map lookups:\n");
+  const int kSizes[] = { 1000, 64 * 1000, 1000 * 1000 };
+  for (size_t i = 0; i < sizeof(kSizes) / sizeof(kSizes[0]); ++i) {
+    int n = min(kSizes[i], N);
+    TimeMap<unordered_map<StringPiece, int> >("unordered_map", commands, n);
+    TimeMap<FlatStringHashMap<int> >("flat", commands, n);
+  }
 }
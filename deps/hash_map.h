@@ -15,11 +15,23 @@
 #ifndef NINJA_MAP_H_
 #define NINJA_MAP_H_
 
+#include <stdint.h>
 #include <string.h>
 #include <algorithm>
+#include <iterator>
+#include <new>
+#include <utility>
 #include "string_piece.h"
 #include "util.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NINJA_HASH_MAP_SSE2 1
+#include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 // MurmurHash2, by Austin Appleby
 static inline unsigned int MurmurHash2(const void* key, size_t len) {
   static const unsigned int seed = 0xDECAFBAD;
@@ -55,6 +67,53 @@ static inline unsigned int MurmurHash2(const void* key, size_t len) {
   return h;
 }
 
+// 64bit MurmurHash2, by Austin Appleby
+static inline uint64_t MurmurHash64A(const void* key, size_t len) {
+  static const uint64_t seed = 0xDECAFBADDECAFBADull;
+  const uint64_t m = 0xc6a4a7935bd1e995ull;
+  const int r = 47;
+  uint64_t h = seed ^ (len * m);
+  const unsigned char* data = (const unsigned char*)key;
+  while (len >= 8) {
+    uint64_t k;
+    memcpy(&k, data, sizeof k);
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+    h ^= k;
+    h *= m;
+    data += 8;
+    len -= 8;
+  }
+  switch (len & 7) {
+    case 7:
+      h ^= uint64_t(data[6]) << 48;
+      NINJA_FALLTHROUGH;
+    case 6:
+      h ^= uint64_t(data[5]) << 40;
+      NINJA_FALLTHROUGH;
+    case 5:
+      h ^= uint64_t(data[4]) << 32;
+      NINJA_FALLTHROUGH;
+    case 4:
+      h ^= uint64_t(data[3]) << 24;
+      NINJA_FALLTHROUGH;
+    case 3:
+      h ^= uint64_t(data[2]) << 16;
+      NINJA_FALLTHROUGH;
+    case 2:
+      h ^= uint64_t(data[1]) << 8;
+      NINJA_FALLTHROUGH;
+    case 1:
+      h ^= uint64_t(data[0]);
+      h *= m;
+  };
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+  return h;
+}
+
 #include <unordered_map>
 
 namespace std {
@@ -67,13 +126,303 @@ struct hash<StringPiece> {
 };
 }  // namespace std
 
+/// The control bytes of 16 consecutive slots of a FlatStringHashMap,
+/// matched all at once: each is kEmpty, kDeleted, or the low 7 bits of
+/// the hash of the key in a full slot.
+struct HashMapGroup {
+  static const size_t kWidth = 16;
+  static const int8_t kEmpty = -128;
+  static const int8_t kDeleted = -2;
+
+  explicit HashMapGroup(const int8_t* ctrl) {
+#ifdef NINJA_HASH_MAP_SSE2
+    ctrl_ = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+#else
+    memcpy(ctrl_, ctrl, kWidth);
+#endif
+  }
+
+  /// @return a mask with bit i set if slot i holds hash bits \a h2.
+  uint32_t Match(int8_t h2) const {
+#ifdef NINJA_HASH_MAP_SSE2
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl_, _mm_set1_epi8(h2)));
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < kWidth; ++i)
+      mask |= uint32_t(ctrl_[i] == h2) << i;
+    return mask;
+#endif
+  }
+
+  uint32_t MatchEmpty() const { return Match(kEmpty); }
+
+  /// Empty and deleted are the only negative control bytes.
+  uint32_t MatchEmptyOrDeleted() const {
+#ifdef NINJA_HASH_MAP_SSE2
+    return _mm_movemask_epi8(ctrl_);
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < kWidth; ++i)
+      mask |= uint32_t(ctrl_[i] < 0) << i;
+    return mask;
+#endif
+  }
+
+  static int LowestBit(uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long bit;
+    _BitScanForward(&bit, mask);
+    return bit;
+#else
+    return __builtin_ctz(mask);
+#endif
+  }
+
+ private:
+#ifdef NINJA_HASH_MAP_SSE2
+  __m128i ctrl_;
+#else
+  int8_t ctrl_[kWidth];
+#endif
+};
+
+/// A hash map from StringPiece to V, keyed by strings owned elsewhere.
+/// It is open addressed, in the style of Swiss tables: entries live in one
+/// flat array, and probing checks a whole group of 16 slots' control bytes
+/// per step, so most lookups touch one cache line of control bytes and
+/// compare a single key.  It has the subset of std::unordered_map's
+/// interface this code uses; like it, insertions may invalidate iterators,
+/// but the keyed strings themselves are never copied.
+template <typename V>
+class FlatStringHashMap {
+ public:
+  typedef StringPiece key_type;
+  typedef V mapped_type;
+  typedef std::pair<StringPiece, V> value_type;
+
+  template <typename Map, typename Value>
+  struct Iterator {
+    typedef std::forward_iterator_tag iterator_category;
+    typedef typename FlatStringHashMap::value_type value_type;
+    typedef ptrdiff_t difference_type;
+    typedef Value* pointer;
+    typedef Value& reference;
+
+    Iterator(Map* map, size_t i) : map_(map), i_(i) { Settle(); }
+    /// Allow iterator -> const_iterator.
+    template <typename M, typename W>
+    Iterator(const Iterator<M, W>& other) : map_(other.map_), i_(other.i_) {}
+
+    Value& operator*() const { return map_->slots_[i_]; }
+    Value* operator->() const { return &map_->slots_[i_]; }
+    Iterator& operator++() {
+      ++i_;
+      Settle();
+      return *this;
+    }
+    template <typename M, typename W>
+    bool operator==(const Iterator<M, W>& other) const {
+      return i_ == other.i_;
+    }
+    template <typename M, typename W>
+    bool operator!=(const Iterator<M, W>& other) const {
+      return i_ != other.i_;
+    }
+
+    Map* map_;
+    size_t i_;
+
+   private:
+    void Settle() {
+      while (i_ < map_->capacity_ && map_->ctrl_[i_] < 0)
+        ++i_;
+    }
+  };
+  typedef Iterator<FlatStringHashMap, value_type> iterator;
+  typedef Iterator<const FlatStringHashMap, const value_type> const_iterator;
+
+  FlatStringHashMap() {}
+  FlatStringHashMap(const FlatStringHashMap& other) {
+    reserve(other.size_);
+    for (const_iterator i = other.begin(); i != other.end(); ++i)
+      emplace(i->first, i->second);
+  }
+  FlatStringHashMap(FlatStringHashMap&& other) noexcept { swap(other); }
+  FlatStringHashMap& operator=(FlatStringHashMap other) {
+    swap(other);
+    return *this;
+  }
+  ~FlatStringHashMap() {
+    Destroy();
+    delete[] ctrl_;
+    ::operator delete(slots_);
+  }
+
+  void swap(FlatStringHashMap& other) {
+    std::swap(ctrl_, other.ctrl_);
+    std::swap(slots_, other.slots_);
+    std::swap(capacity_, other.capacity_);
+    std::swap(size_, other.size_);
+    std::swap(deleted_, other.deleted_);
+  }
+
+  iterator find(StringPiece key) { return iterator(this, Find(key, Hash(key))); }
+  const_iterator find(StringPiece key) const { return const_iterator(this, Find(key, Hash(key))); }
+  size_t count(StringPiece key) const { return Find(key, Hash(key)) != capacity_; }
+
+  /// Insert \a key => \a value unless \a key is already present.
+  /// @return the entry for \a key, and whether it was inserted.
+  std::pair<iterator, bool> emplace(StringPiece key, const V& value) {
+    uint64_t hash = Hash(key);
+    size_t i = Find(key, hash);
+    if (i != capacity_)
+      return std::make_pair(iterator(this, i), false);
+    i = Insert(hash);
+    new (&slots_[i]) value_type(key, value);
+    return std::make_pair(iterator(this, i), true);
+  }
+  std::pair<iterator, bool> insert(const value_type& value) { return emplace(value.first, value.second); }
+
+  V& operator[](StringPiece key) { return emplace(key, V()).first->second; }
+
+  size_t erase(StringPiece key) {
+    size_t i = Find(key, Hash(key));
+    if (i == capacity_)
+      return 0;
+    Erase(i);
+    return 1;
+  }
+  iterator erase(const_iterator pos) {
+    Erase(pos.i_);
+    return iterator(this, pos.i_ + 1);
+  }
+
+  /// Make room for \a n entries without growing.
+  void reserve(size_t n) {
+    if (n * 8 > capacity_ * 7)
+      Rehash(n);
+  }
+
+  void clear() {
+    Destroy();
+    if (capacity_)
+      memset(ctrl_, HashMapGroup::kEmpty, capacity_);
+    size_ = deleted_ = 0;
+  }
+
+  iterator begin() { return iterator(this, 0); }
+  iterator end() { return iterator(this, capacity_); }
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, capacity_); }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  size_t bucket_count() const { return capacity_; }
+
+ private:
+  static uint64_t Hash(StringPiece key) { return MurmurHash64A(key.str_, key.len_); }
+  /// The low 7 bits of the hash go in the control byte, the rest picks the
+  /// first group to probe.
+  static int8_t H2(uint64_t hash) { return hash & 0x7f; }
+
+  /// Groups are probed at triangular offsets from the first, which visits
+  /// each of a power-of-two number of groups once.
+  size_t Find(StringPiece key, uint64_t hash) const {
+    if (!size_)
+      return capacity_;
+    size_t mask = capacity_ / HashMapGroup::kWidth - 1;
+    size_t group = (hash >> 7) & mask;
+    for (size_t step = 1;; ++step) {
+      const size_t base = group * HashMapGroup::kWidth;
+      HashMapGroup g(ctrl_ + base);
+      for (uint32_t match = g.Match(H2(hash)); match; match &= match - 1) {
+        size_t i = base + HashMapGroup::LowestBit(match);
+        if (slots_[i].first == key)
+          return i;
+      }
+      if (g.MatchEmpty())
+        return capacity_;
+      group = (group + step) & mask;
+    }
+  }
+
+  /// Claim a slot for a new key with \a hash, growing if needed.
+  /// @return its index; the slot is uninitialized.
+  size_t Insert(uint64_t hash) {
+    // Deleted slots count against the load, as they lengthen probes.
+    if ((size_ + deleted_ + 1) * 8 > capacity_ * 7)
+      Rehash(size_ + 1);
+    size_t mask = capacity_ / HashMapGroup::kWidth - 1;
+    size_t group = (hash >> 7) & mask;
+    for (size_t step = 1;; ++step) {
+      const size_t base = group * HashMapGroup::kWidth;
+      uint32_t free = HashMapGroup(ctrl_ + base).MatchEmptyOrDeleted();
+      if (free) {
+        size_t i = base + HashMapGroup::LowestBit(free);
+        if (ctrl_[i] == HashMapGroup::kDeleted)
+          --deleted_;
+        ctrl_[i] = H2(hash);
+        ++size_;
+        return i;
+      }
+      group = (group + step) & mask;
+    }
+  }
+
+  void Erase(size_t i) {
+    slots_[i].~value_type();
+    ctrl_[i] = HashMapGroup::kDeleted;
+    --size_;
+    ++deleted_;
+  }
+
+  /// Move every entry into new arrays sized for \a n entries at a load of
+  /// at most 7/16, dropping deleted slots.
+  void Rehash(size_t n) {
+    size_t capacity = HashMapGroup::kWidth;
+    while (n * 16 > capacity * 7)
+      capacity *= 2;
+
+    int8_t* old_ctrl = ctrl_;
+    value_type* old_slots = slots_;
+    size_t old_capacity = capacity_;
+    ctrl_ = new int8_t[capacity];
+    memset(ctrl_, HashMapGroup::kEmpty, capacity);
+    slots_ = static_cast<value_type*>(::operator new(capacity * sizeof(value_type)));
+    capacity_ = capacity;
+    size_ = deleted_ = 0;
+    for (size_t i = 0; i < old_capacity; ++i) {
+      if (old_ctrl[i] < 0)
+        continue;
+      value_type& old = old_slots[i];
+      size_t j = Insert(Hash(old.first));
+      new (&slots_[j]) value_type(std::move(old));
+      old.~value_type();
+    }
+    delete[] old_ctrl;
+    ::operator delete(old_slots);
+  }
+
+  void Destroy() {
+    for (size_t i = 0; i < capacity_; ++i) {
+      if (ctrl_[i] >= 0)
+        slots_[i].~value_type();
+    }
+  }
+
+  int8_t* ctrl_ = nullptr;
+  value_type* slots_ = nullptr;
+  size_t capacity_ = 0;
+  size_t size_ = 0;
+  size_t deleted_ = 0;
+};
+
 /// A template for hash_maps keyed by a StringPiece whose string is
 /// owned externally (typically by the values).  Use like:
 /// ExternalStringHash<Foo*>::Type foos; to make foos into a hash
 /// mapping StringPiece => Foo*.
 template <typename V>
 struct ExternalStringHashMap {
-  typedef std::unordered_map<StringPiece, V> Type;
+  typedef FlatStringHashMap<V> Type;
 };
 
 #endif  // NINJA_MAP_H_
@@ -0,0 +1,106 @@
+// Copyright (c) 2024 Aniket Ray
+//
+// Licensed under the MIT License; see LICENSE.txt.
+
+#include "hash_map.h"
+
+#include <stdio.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "test.h"
+
+using namespace std;
+
+namespace {
+
+TEST(FlatStringHashMap, Basic) {
+  FlatStringHashMap<int> map;
+  EXPECT_TRUE(map.empty());
+  EXPECT_TRUE(map.find("a") == map.end());
+
+  EXPECT_TRUE(map.emplace("a", 1).second);
+  EXPECT_TRUE(map.insert(FlatStringHashMap<int>::value_type("b", 2)).second);
+  EXPECT_FALSE(map.emplace("a", 3).second);
+  map["c"] = 4;
+  EXPECT_EQ(3u, map.size());
+  EXPECT_EQ(1, map.find("a")->second);
+  EXPECT_EQ(4, map["c"]);
+  EXPECT_EQ(1u, map.count("b"));
+  EXPECT_EQ(0u, map.count("d"));
+
+  EXPECT_EQ(1u, map.erase("a"));
+  EXPECT_EQ(0u, map.erase("a"));
+  EXPECT_TRUE(map.find("a") == map.end());
+  EXPECT_EQ(2u, map.size());
+  EXPECT_TRUE(map.emplace("a", 5).second);
+  EXPECT_EQ(5, map.find("a")->second);
+
+  map.clear();
+  EXPECT_TRUE(map.empty());
+  EXPECT_TRUE(map.find("b") == map.end());
+}
+
+TEST(FlatStringHashMap, AgreesWithMap) {
+  // Enough keys to grow several times, with erasures leaving deleted slots
+  // behind, checked against std::map.
+  vector<string> keys;
+  char buf[32];
+  for (int i = 0; i < 5000; ++i) {
+    snprintf(buf, sizeof(buf), "out/%d", i);
+    keys.push_back(buf);
+  }
+
+  FlatStringHashMap<int> map;
+  std::map<string, int> expected;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    map.emplace(keys[i], i);
+    expected[keys[i]] = i;
+    if (i % 3 == 0) {
+      map.erase(keys[i / 2]);
+      expected.erase(keys[i / 2]);
+    }
+  }
+  ASSERT_EQ(expected.size(), map.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    FlatStringHashMap<int>::const_iterator it = map.find(keys[i]);
+    if (expected.count(keys[i]))
+      ASSERT_TRUE(it != map.end() && it->second == expected[keys[i]]) << keys[i];
+    else
+      ASSERT_TRUE(it == map.end()) << keys[i];
+  }
+
+  size_t iterated = 0;
+  for (FlatStringHashMap<int>::const_iterator i = map.begin(); i != map.end(); ++i) {
+    EXPECT_EQ(expected[i->first.AsString()], i->second);
+    ++iterated;
+  }
+  EXPECT_EQ(expected.size(), iterated);
+
+  FlatStringHashMap<int> copy(map);
+  EXPECT_EQ(map.size(), copy.size());
+  EXPECT_EQ(expected[keys.back()], copy.find(keys.back())->second);
+  EXPECT_TRUE(copy.find(keys[1]) == copy.end());
+}
+
+TEST(FlatStringHashMap, EraseWhileIterating) {
+  FlatStringHashMap<int> map;
+  vector<string> keys;
+  for (int i = 0; i < 100; ++i)
+    keys.push_back(string(i + 1, 'x'));
+  for (int i = 0; i < 100; ++i)
+    map.emplace(keys[i], i);
+  for (FlatStringHashMap<int>::iterator i = map.begin(); i != map.end();) {
+    if (i->second % 2)
+      i = map.erase(i);
+    else
+      ++i;
+  }
+  EXPECT_EQ(50u, map.size());
+  EXPECT_TRUE(map.find(keys[1]) == map.end());
+  EXPECT_EQ(2, map.find(keys[2])->second);
+}
+
+}  // anonymous namespace
@@ -0,0 +1,71 @@
+// Copyright (c) 2024 Aniket Ray
+//
+// Licensed under the MIT License; see LICENSE.txt.
+
+// Compares the hash that build logs before version 10 used for commands
+// with the one they use now, across command lengths.
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "hash.h"
+#include "hash_map.h"
+#include "metrics.h"
+
+using namespace std;
+
+namespace {
+
+/// A compile command of about \a len bytes, mostly include flags.
+string MakeCommand(size_t len, int salt) {
+  char buf[96];
+  snprintf(buf, sizeof(buf), "c++ -MMD -MF obj/foo_%d.o.d -c ../../src/foo_%d.cc -o obj/foo_%d.o", salt, salt, salt);
+  string command = buf;
+  for (int i = 0; command.size() < len; ++i) {
+    snprintf(buf, sizeof(buf), " -I../../third_party/some/library/include/%d", i);
+    command += buf;
+  }
+  command.resize(len);
+  return command;
+}
+
+/// Hash each of \a commands over and over, about 1 GB in all.
+/// @return the nanoseconds each hash took.
+template <uint64_t (*Hash)(const void*, size_t)>
+double TimeHash(const vector<string>& commands) {
+  size_t rounds = (1 << 30) / (commands.size() * commands[0].size()) + 1;
+  uint64_t sink = 0;
+  int64_t start = GetTimeMillis();
+  for (size_t r = 0; r < rounds; ++r) {
+    for (size_t i = 0; i < commands.size(); ++i)
+      sink += Hash(commands[i].data(), commands[i].size());
+  }
+  int64_t delta = GetTimeMillis() - start;
+  if (sink == 42)
+    printf(" ");
+  return delta * 1e6 / (double)(rounds * commands.size());
+}
+
+uint64_t Murmur(const void* data, size_t len) {
+  return MurmurHash64A(data, len);
+}
+
+}  // anonymous namespace
+
+int main() {
+  const size_t kLengths[] = { 16, 64, 256, 1 << 10, 4 << 10, 16 << 10, 64 << 10 };
+  printf("%8s  %22s  %22s\n", "length", "MurmurHash64A", "XXH3");
+  for (size_t i = 0; i < sizeof(kLengths) / sizeof(kLengths[0]); ++i) {
+    // Enough commands to not fit in the L1 cache, few enough for L2.
+    vector<string> commands;
+    for (int salt = 0; commands.size() * kLengths[i] < (256 << 10) || commands.size() < 16; ++salt)
+      commands.push_back(MakeCommand(kLengths[i], salt));
+    double murmur = TimeHash<Murmur>(commands);
+    double xxh3 = TimeHash<Xxh3Hash64>(commands);
+    printf("%8zu  %9.1fns %6.2fGB/s  %9.1fns %6.2fGB/s\n", kLengths[i], murmur, kLengths[i] / murmur, xxh3,
+           kLengths[i] / xxh3);
+  }
+  return 0;
+}
@@ -0,0 +1,89 @@
+// Copyright (c) 2024 Aniket Ray
+//
+// Licensed under the MIT License; see LICENSE.txt.
+
+#include "hash.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+
+#include "test.h"
+
+using namespace std;
+
+namespace {
+
+string TestInput(size_t len) {
+  string input(len, '\0');
+  for (size_t i = 0; i < len; ++i)
+    input[i] = (char)(i * 31 + 7);
+  return input;
+}
+
+TEST(Xxh3Hash64, KnownValues) {
+  // From the reference XXH3_64bits(), at the lengths where its code paths
+  // change: 1-3, 4-8, 9-16, 17-128 and 129-240 bytes, then stripes, and
+  // blocks of 1024 bytes whose last stripe is hashed apart.
+  static const struct {
+    size_t len;
+    uint64_t hash;
+  } kCases[] = {
+    { 0, 0x2d06800538d394c2ULL },    { 1, 0x4c5cca45d0f4811fULL },    { 3, 0x15f7093b173d005cULL },
+    { 4, 0xdca012f95811b6b9ULL },    { 8, 0xdec6a9a43575982eULL },    { 9, 0xcbe393399f17ffbdULL },
+    { 16, 0x7e484c18d74895d0ULL },   { 17, 0x208bde5ee2bed407ULL },   { 100, 0x8c97158042fbf926ULL },
+    { 128, 0xf92b70eaa21a6288ULL },  { 129, 0xf8f76713f2bb60faULL },  { 240, 0xccc7375172c41f03ULL },
+    { 241, 0x0b3b630948ce4a00ULL },  { 1024, 0x23bc880ebf0d29c6ULL }, { 1088, 0xa16bad67843c5a45ULL },
+    { 1089, 0x822327a86aad957cULL }, { 4096, 0xa3c19f8174cde0bbULL },
+  };
+  string input = TestInput(4096);
+  for (size_t i = 0; i < sizeof(kCases) / sizeof(kCases[0]); ++i)
+    EXPECT_EQ(kCases[i].hash, Xxh3Hash64(input.data(), kCases[i].len)) << kCases[i].len;
+}
+
+TEST(Xxh3Hash64, Unaligned) {
+  string input = TestInput(3000);
+  string shifted = " " + input;
+  EXPECT_EQ(Xxh3Hash64(input.data(), input.size()), Xxh3Hash64(shifted.data() + 1, input.size()));
+}
+
+TEST(Xxh3Hash64, EveryByteCounts) {
+  // Flipping any one bit of a long input changes its hash.
+  string input = TestInput(1500);
+  uint64_t hash = Xxh3Hash64(input.data(), input.size());
+  for (size_t i = 0; i < input.size(); i += 7) {
+    input[i] ^= 1;
+    EXPECT_NE(hash, Xxh3Hash64(input.data(), input.size())) << i;
+    input[i] ^= 1;
+  }
+}
+
+TEST(Xxh3Hasher, Pieces) {
+  // Cut inputs up to several blocks long into pieces of every size around
+  // those the hasher buffers and takes straight from its input.
+  string input = TestInput(5000);
+  const size_t kPieces[] = { 1, 7, 63, 64, 65, 200, 256, 257, 1000 };
+  for (size_t len = 0; len <= input.size(); len += len < 600 ? 1 : 97) {
+    uint64_t hash = Xxh3Hash64(input.data(), len);
+    for (size_t p = 0; p < sizeof(kPieces) / sizeof(kPieces[0]); ++p) {
+      Xxh3Hasher hasher;
+      for (size_t pos = 0; pos < len; pos += kPieces[p]) {
+        hasher.Update(input.data() + pos, min(kPieces[p], len - pos));
+        hasher.Update(input.data(), 0);
+      }
+      ASSERT_EQ(hash, hasher.Digest()) << len << " in pieces of " << kPieces[p];
+    }
+  }
+}
+
+TEST(Xxh3Hasher, DigestMidway) {
+  string input = TestInput(3000);
+  Xxh3Hasher hasher;
+  for (size_t len = 0; len < input.size(); len += 100) {
+    EXPECT_EQ(Xxh3Hash64(input.data(), len), hasher.Digest()) << len;
+    hasher.Update(input.data() + len, 100);
+  }
+}
+
+}  // anonymous namespace
@@ -0,0 +1,219 @@
+// Copyright (c) 2024 Aniket Ray
+//
+// Licensed under the MIT License; see LICENSE.txt.
+
+#include "jobserver.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "util.h"
+
+using namespace std;
+
+// static
+string Jobserver::ParseMakeflags(const string& makeflags) {
+  static const char* const kOptions[] = { "--jobserver-auth=", "--jobserver-fds=" };
+  string auth;
+  size_t pos = 0;
+  while (pos < makeflags.size()) {
+    size_t end = makeflags.find(' ', pos);
+    if (end == string::npos)
+      end = makeflags.size();
+    for (size_t i = 0; i < sizeof(kOptions) / sizeof(kOptions[0]); ++i) {
+      size_t len = strlen(kOptions[i]);
+      if (makeflags.compare(pos, len, kOptions[i]) == 0 && end >= pos + len)
+        auth = makeflags.substr(pos + len, end - pos - len);
+    }
+    pos = end + 1;
+  }
+  return auth;
+}
+
+Jobserver::Jobserver()
+#ifdef _WIN32
+    : semaphore_(NULL) {
+}
+#else
+    : fd_(-1) {
+}
+#endif
+
+#ifdef _WIN32
+
+// static
+Jobserver* Jobserver::Connect(const string& makeflags, string* err) {
+  string auth = ParseMakeflags(makeflags);
+  if (auth.empty())
+    return NULL;
+  HANDLE semaphore = OpenSemaphoreA(SEMAPHORE_MODIFY_STATE | SYNCHRONIZE, FALSE, auth.c_str());
+  if (!semaphore) {
+    *err = "OpenSemaphore(" + auth + "): " + GetLastErrorString();
+    return NULL;
+  }
+  Jobserver* jobserver = new Jobserver;
+  jobserver->semaphore_ = semaphore;
+  return jobserver;
+}
+
+// static
+Jobserver* Jobserver::Create(int slots, string* err) {
+  char name[64];
+  snprintf(name, sizeof(name), "cppcmake_jobserver_%lu", GetCurrentProcessId());
+  HANDLE semaphore = CreateSemaphoreA(NULL, slots - 1, slots - 1, name);
+  if (!semaphore) {
+    *err = string("CreateSemaphore: ") + GetLastErrorString();
+    return NULL;
+  }
+  Jobserver* jobserver = new Jobserver;
+  jobserver->semaphore_ = semaphore;
+  jobserver->makeflags_ = "-j" + to_string(slots) + " --jobserver-auth=" + name;
+  return jobserver;
+}
+
+Jobserver::~Jobserver() {
+  Release(0);
+  CloseHandle(semaphore_);
+}
+
+int Jobserver::Acquire(int count) {
+  while (held() < count && WaitForSingleObject(semaphore_, 0) == WAIT_OBJECT_0)
+    held_ += '+';
+  return held();
+}
+
+void Jobserver::Release(int count) {
+  while (held() > count) {
+    ReleaseSemaphore(semaphore_, 1, NULL);
+    held_.resize(held_.size() - 1);
+  }
+}
+
+#else  // !_WIN32
+
+namespace {
+
+/// Open \a path for non-blocking reads and writes.  For a pipe, going
+/// through /proc gives a descriptor of our own, so that the parent's
+/// blocking reads are left alone.
+int OpenPool(const string& path, string* err) {
+  int fd = open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) {
+    *err = "open(" + path + "): " + strerror(errno);
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0 || !S_ISFIFO(st.st_mode)) {
+    *err = path + " is not a fifo";
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+}  // anonymous namespace
+
+// static
+Jobserver* Jobserver::Connect(const string& makeflags, string* err) {
+  string auth = ParseMakeflags(makeflags);
+  if (auth.empty())
+    return NULL;
+
+  int fd;
+  if (auth.compare(0, 5, "fifo:") == 0) {
+    fd = OpenPool(auth.substr(5), err);
+  } else {
+    int read_fd, write_fd;
+    char extra;
+    if (sscanf(auth.c_str(), "%d,%d%c", &read_fd, &write_fd, &extra) != 2) {
+      *err = "unknown jobserver '" + auth + "'";
+      return NULL;
+    }
+    // make closes these for commands it does not think are makes.
+    if (fcntl(read_fd, F_GETFD) < 0 || fcntl(write_fd, F_GETFD) < 0) {
+      *err = "make did not pass down the pipe " + auth + "; prefix the command with '+' in the makefile";
+      return NULL;
+    }
+    fd = OpenPool("/proc/self/fd/" + to_string(read_fd), err);
+  }
+  if (fd < 0)
+    return NULL;
+  Jobserver* jobserver = new Jobserver;
+  jobserver->fd_ = fd;
+  return jobserver;
+}
+
+// static
+Jobserver* Jobserver::Create(int slots, string* err) {
+  const char* tmpdir = getenv("TMPDIR");
+  char path[256];
+  snprintf(path, sizeof(path), "%s/cppcmake-jobserver-%d", tmpdir && *tmpdir ? tmpdir : "/tmp", (int)getpid());
+  unlink(path);
+  if (mkfifo(path, 0600) < 0) {
+    *err = string("mkfifo(") + path + "): " + strerror(errno);
+    return NULL;
+  }
+  int fd = OpenPool(path, err);
+  if (fd < 0) {
+    unlink(path);
+    return NULL;
+  }
+  Jobserver* jobserver = new Jobserver;
+  jobserver->fd_ = fd;
+  jobserver->fifo_ = path;
+  jobserver->makeflags_ = "-j" + to_string(slots) + " --jobserver-auth=fifo:" + path;
+
+  // Fill the pool.  We hold the first slot ourselves.
+  string tokens(slots - 1, '+');
+  if (!tokens.empty() && write(fd, tokens.data(), tokens.size()) != (ssize_t)tokens.size()) {
+    *err = string("write(") + path + "): " + strerror(errno);
+    delete jobserver;
+    return NULL;
+  }
+  return jobserver;
+}
+
+Jobserver::~Jobserver() {
+  Release(0);
+  close(fd_);
+  if (!fifo_.empty())
+    unlink(fifo_.c_str());
+}
+
+int Jobserver::Acquire(int count) {
+  while (held() < count) {
+    char token;
+    ssize_t ret = read(fd_, &token, 1);
+    if (ret == 1) {
+      held_ += token;
+      continue;
+    }
+    if (ret < 0 && errno == EINTR)
+      continue;
+    break;  // EAGAIN: the pool is dry.
+  }
+  return held();
+}
+
+void Jobserver::Release(int count) {
+  while (held() > count) {
+    ssize_t ret = write(fd_, &held_[held_.size() - 1], 1);
+    if (ret < 0 && errno == EINTR)
+      continue;
+    if (ret != 1)
+      Warning("jobserver: returning a token: %s", strerror(errno));
+    held_.resize(held_.size() - 1);
+  }
+}
+
+#endif  // _WIN32
@@ -0,0 +1,69 @@
+// Copyright (c) 2024 Aniket Ray
+//
+// Licensed under the MIT License; see LICENSE.txt.
+
+#ifndef NINJA_JOBSERVER_H_
+#define NINJA_JOBSERVER_H_
+
+#include <string>
+
+/// A GNU make jobserver: a pool of tokens, one per job slot beyond the
+/// first, shared by every process of a nested build.  Each process may
+/// always run one job; each further job it runs at once needs a token,
+/// which goes back to the pool when the job ends.
+///
+/// The pool is a fifo (make 4.4's "fifo:PATH"), a pipe whose descriptors
+/// are inherited ("R,W"), or on Windows a named semaphore.
+struct Jobserver {
+  /// The value of the last --jobserver-auth= (or older --jobserver-fds=)
+  /// option in \a makeflags, or "" if there is none.
+  static std::string ParseMakeflags(const std::string& makeflags);
+
+  /// Join the jobserver that \a makeflags names, as a parent make passes it
+  /// on in MAKEFLAGS.
+  /// @return NULL if it names none, or with \a err set if it names one that
+  /// cannot be used, such as a pipe the parent did not pass down.
+  static Jobserver* Connect(const std::string& makeflags, std::string* err);
+
+  /// Start a jobserver for \a slots parallel jobs, which the caller joins
+  /// and passes on to child processes through makeflags().
+  /// @return NULL with \a err set on failure.
+  static Jobserver* Create(int slots, std::string* err);
+
+  /// Return any held tokens and, for a server, remove the pool.
+  ~Jobserver();
+
+  /// Take tokens from the pool, without waiting, until \a count are held
+  /// or the pool runs dry.
+  /// @return the number of tokens held.
+  int Acquire(int count);
+
+  /// Return tokens to the pool until at most \a count are held.
+  void Release(int count);
+
+  /// The number of tokens held.
+  int held() const { return (int)held_.size(); }
+
+  /// The MAKEFLAGS that pass a server's pool on to child processes.
+  const std::string& makeflags() const { return makeflags_; }
+
+ private:
+  Jobserver();
+
+#ifdef _WIN32
+  void* semaphore_;
+#else
+  /// Open for reading and writing, and non-blocking.
+  int fd_;
+  /// The fifo to remove, for a server.
+  std::string fifo_;
+#endif
+  /// The tokens held; make wants the same bytes back.
+  std::string held_;
+  std::string makeflags_;
+
+  Jobserver(const Jobserver&);
+  void operator=(const Jobserver&);
+};
+
+#endif  // NINJA_JOBSERVER_H_
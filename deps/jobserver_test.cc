@@ -0,0 +1,85 @@
+// Copyright (c) 2024 Aniket Ray
+//
+// Licensed under the MIT License; see LICENSE.txt.
+
+#include "jobserver.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include <memory>
+
+#include "test.h"
+
+using namespace std;
+
+namespace {
+
+TEST(Jobserver, ParseMakeflags) {
+  EXPECT_EQ("", Jobserver::ParseMakeflags(""));
+  EXPECT_EQ("", Jobserver::ParseMakeflags("kn -j4"));
+  EXPECT_EQ("3,4", Jobserver::ParseMakeflags(" -j4 --jobserver-fds=3,4"));
+  EXPECT_EQ("fifo:/tmp/f", Jobserver::ParseMakeflags("k -j --jobserver-auth=fifo:/tmp/f -- X=1"));
+  // A sub-make appends its own; the last one wins.
+  EXPECT_EQ("5,6", Jobserver::ParseMakeflags("--jobserver-auth=3,4 --jobserver-auth=5,6"));
+}
+
+TEST(Jobserver, NoJobserver) {
+  string err;
+  EXPECT_EQ(NULL, Jobserver::Connect("-j8", &err));
+  EXPECT_EQ("", err);
+}
+
+TEST(Jobserver, ServerAndClient) {
+  string err;
+  unique_ptr<Jobserver> server(Jobserver::Create(3, &err));
+  ASSERT_TRUE(server.get()) << err;
+  unique_ptr<Jobserver> client(Jobserver::Connect("k " + server->makeflags(), &err));
+  ASSERT_TRUE(client.get()) << err;
+
+  // Three slots make two tokens, shared by both.
+  EXPECT_EQ(1, client->Acquire(1));
+  EXPECT_EQ(1, server->Acquire(5));
+  EXPECT_EQ(1, client->Acquire(5));
+  client->Release(0);
+  EXPECT_EQ(0, client->held());
+  EXPECT_EQ(2, server->Acquire(2));
+
+  // Tokens still held go back when a client leaves.
+  server->Release(0);
+  EXPECT_EQ(2, client->Acquire(2));
+  client.reset();
+  EXPECT_EQ(2, server->Acquire(3));
+}
+
+#ifndef _WIN32
+TEST(Jobserver, Pipe) {
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  ASSERT_EQ(2, write(fds[1], "+-", 2));
+  string makeflags = "-j3 --jobserver-auth=" + to_string(fds[0]) + "," + to_string(fds[1]);
+
+  string err;
+  unique_ptr<Jobserver> client(Jobserver::Connect(makeflags, &err));
+#ifdef __linux__
+  ASSERT_TRUE(client.get()) << err;
+  EXPECT_EQ(2, client->Acquire(3));
+  client.reset();
+  // The tokens came back as they were.
+  char tokens[3];
+  EXPECT_EQ(2, read(fds[0], tokens, sizeof(tokens)));
+  EXPECT_EQ('-', tokens[0]);
+  EXPECT_EQ('+', tokens[1]);
+#endif
+  close(fds[0]);
+  close(fds[1]);
+
+  // The parent make did not pass the pipe down.
+  client.reset(Jobserver::Connect(makeflags, &err));
+  EXPECT_FALSE(client.get());
+  EXPECT_NE("", err);
+}
+#endif
+
+}  // anonymous namespace
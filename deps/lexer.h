@@ -87,6 +87,11 @@ struct Lexer {
   /// Construct an error message with context.
   bool Error(const std::string& message, std::string* err);
 
+  /// The start of the last token read.  Saving it lets an error found
+  /// after lexing has moved on still point at the right place.
+  const char* position() const { return last_token_; }
+  void set_position(const char* position) { last_token_ = position; }
+
  private:
   /// Skip past whitespace (called after each read token/ident/etc.).
   void EatWhitespace();
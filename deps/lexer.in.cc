@@ -15,12 +15,51 @@
 #include "lexer.h"
 
 #include <stdio.h>
+#include <string.h>
 
 #include "eval_env.h"
+#include "lexer_scan.h"
 #include "util.h"
 
 using namespace std;
 
+namespace {
+
+bool IsVarnameChar(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '.' ||
+         c == '-';
+}
+
+/// The token for a complete run of varname characters: a keyword if it
+/// spells one exactly, as the matcher prefers keywords on equal length.
+Lexer::Token IdentOrKeyword(const char* ident, size_t len) {
+  switch (len) {
+    case 4:
+      if (memcmp(ident, "pool", 4) == 0)
+        return Lexer::POOL;
+      if (memcmp(ident, "rule", 4) == 0)
+        return Lexer::RULE;
+      break;
+    case 5:
+      if (memcmp(ident, "build", 5) == 0)
+        return Lexer::BUILD;
+      break;
+    case 7:
+      if (memcmp(ident, "default", 7) == 0)
+        return Lexer::DEFAULT;
+      if (memcmp(ident, "include", 7) == 0)
+        return Lexer::INCLUDE;
+      break;
+    case 8:
+      if (memcmp(ident, "subninja", 8) == 0)
+        return Lexer::SUBNINJA;
+      break;
+  }
+  return Lexer::IDENT;
+}
+
+}  // anonymous namespace
+
 bool Lexer::Error(const string& message, string* err) {
   // Compute line/column.
   int line = 1;
@@ -137,8 +176,40 @@ Lexer::Token Lexer::ReadToken() {
   const char* q;
   const char* start;
   Lexer::Token token;
+  const LexerScan& scan = LexerScan::Get();
+  const char* end = input_.str_ + input_.len_;
   for (;;) {
     start = p;
+    // Indentation, comment lines and identifiers make up most of a
+    // manifest, so scan those in bulk.  Anything else goes to the matcher
+    // below, which yields the same tokens a byte at a time.
+    if (*p == ' ' || *p == '#') {
+      const char* r = scan.spaces(p, end);
+      if (*r == '#') {
+        const char* eol = scan.comment(r + 1, end);
+        if (*eol == '\n') {
+          p = eol + 1;
+          continue;
+        }
+        // An unterminated comment; let the matcher sort it out.
+      } else if (*r == '\n') {
+        p = r + 1;
+        token = NEWLINE;
+        break;
+      } else if (r[0] == '\r' && r[1] == '\n') {
+        p = r + 2;
+        token = NEWLINE;
+        break;
+      } else {
+        p = r;
+        token = INDENT;
+        break;
+      }
+    } else if (IsVarnameChar(*p)) {
+      p = scan.varname(p, end);
+      token = IdentOrKeyword(start, p - start);
+      break;
+    }
     /*!re2c
     re2c:define:YYCTYPE = "unsigned char";
     re2c:define:YYCURSOR = p;
@@ -201,22 +272,12 @@ void Lexer::EatWhitespace() {
 }
 
 bool Lexer::ReadIdent(string* out) {
-  const char* p = ofs_;
-  const char* start;
-  for (;;) {
-    start = p;
-    /*!re2c
-    varname {
-      out->assign(start, p - start);
-      break;
-    }
-    [^] {
-      last_token_ = start;
-      return false;
-    }
-    */
-  }
+  const char* start = ofs_;
+  const char* p = LexerScan::Get().varname(start, input_.str_ + input_.len_);
   last_token_ = start;
+  if (p == start)
+    return false;
+  out->assign(start, p - start);
   ofs_ = p;
   EatWhitespace();
   return true;
@@ -226,8 +287,15 @@ bool Lexer::ReadEvalString(EvalString* eval, bool path, string* err) {
   const char* p = ofs_;
   const char* q;
   const char* start;
+  const LexerScan& scan = LexerScan::Get();
+  const char* end = input_.str_ + input_.len_;
   for (;;) {
     start = p;
+    const char* text = scan.text(p, end);
+    if (text != p) {
+      eval->AddText(StringPiece(p, text - p));
+      start = p = text;
+    }
     /*!re2c
     [^$ :\r\n|\000]+ {
       eval->AddText(StringPiece(start, p - start));
@@ -0,0 +1,133 @@
+// Copyright (c) 2024 Aniket Ray
+//
+// Licensed under the MIT License; see LICENSE.txt.
+
+// Tests lexer throughput, in MB/s, with each scanner implementation.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "eval_env.h"
+#include "lexer.h"
+#include "lexer_scan.h"
+#include "metrics.h"
+
+using namespace std;
+
+/// A manifest shaped like generated ones: a comment header, a few rules,
+/// then mostly build statements with long paths and the odd binding.
+string MakeManifest(size_t min_size) {
+  string manifest =
+      "# This file is generated.  Do not edit.\n"
+      "ninja_required_version = 1.5\n"
+      "rule cxx\n"
+      "  command = c++ -MMD -MF $out.d $defines $includes $cflags -c $in -o $out\n"
+      "  description = CXX $out\n"
+      "  depfile = $out.d\n"
+      "  deps = gcc\n"
+      "rule link\n"
+      "  command = c++ $ldflags -o $out @$out.rsp\n"
+      "  rspfile = $out.rsp\n"
+      "  rspfile_content = $in_newline\n";
+  char line[512];
+  for (int i = 0; manifest.size() < min_size; ++i) {
+    snprintf(line, sizeof(line),
+             "build obj/third_party/webkit/source/core/layout/layout_block_flow_%d.o: cxx "
+             "../../third_party/webkit/source/core/layout/layout_block_flow_%d.cc || "
+             "gen/third_party/webkit/source/core/headers_%d.stamp\n",
+             i, i, i / 100);
+    manifest += line;
+    if (i % 100 == 0) {
+      snprintf(line, sizeof(line),
+               "  # Per-target flags.\n"
+               "  defines = -DTARGET_%d -DNDEBUG -D_FORTIFY_SOURCE=2\n",
+               i);
+      manifest += line;
+    }
+  }
+  return manifest;
+}
+
+/// Lex \a manifest the way ManifestParser drives the Lexer.
+/// @return the number of tokens read.
+int Lex(const string& manifest) {
+  Lexer lexer;
+  lexer.Start("build.ninja", manifest);
+  string err;
+  string ident;
+  int tokens = 0;
+  for (;;) {
+    EvalString eval;
+    Lexer::Token token = lexer.ReadToken();
+    ++tokens;
+    switch (token) {
+      case Lexer::IDENT:
+      case Lexer::INDENT:
+        if (token == Lexer::INDENT && !lexer.ReadIdent(&ident))
+          break;
+        lexer.ReadToken();  // '='
+        lexer.ReadVarValue(&eval, &err);
+        break;
+      case Lexer::RULE:
+      case Lexer::POOL:
+        lexer.ReadIdent(&ident);
+        lexer.ReadToken();  // newline
+        break;
+      case Lexer::BUILD:
+        for (;;) {
+          lexer.ReadPath(&eval, &err);
+          if (eval.empty())
+            break;
+          eval.Clear();
+          ++tokens;
+        }
+        lexer.ReadToken();  // ':'
+        lexer.ReadIdent(&ident);
+        for (;;) {
+          lexer.ReadPath(&eval, &err);
+          if (eval.empty() && !lexer.PeekToken(Lexer::PIPE2))
+            break;
+          eval.Clear();
+          ++tokens;
+        }
+        lexer.ReadToken();  // newline
+        break;
+      case Lexer::TEOF:
+        return tokens;
+      case Lexer::ERROR:
+        fprintf(stderr, "lexing error\n");
+        exit(1);
+      default:
+        break;
+    }
+  }
+}
+
+int main() {
+  const string manifest = MakeManifest(64 << 20);
+  const double megabytes = manifest.size() / (1024.0 * 1024.0);
+  printf("%.1f MB manifest\n", megabytes);
+
+  const char* kImplementations[] = { "scalar", "sse2", "avx2" };
+  for (size_t i = 0; i < sizeof(kImplementations) / sizeof(kImplementations[0]); ++i) {
+    if (!LexerScan::Select(kImplementations[i])) {
+      printf("%-7s unsupported\n", kImplementations[i]);
+      continue;
+    }
+    int best = -1;
+    int tokens = 0;
+    for (int j = 0; j < 5; ++j) {
+      int64_t start = GetTimeMillis();
+      tokens = Lex(manifest);
+      int delta = (int)(GetTimeMillis() - start);
+      if (best < 0 || delta < best)
+        best = delta;
+    }
+    printf("%-7s %5dms  %7.1f MB/s  (%d tokens)\n", kImplementations[i], best,
+           megabytes * 1000 / (best > 0 ? best : 1), tokens);
+  }
+  return 0;
+}
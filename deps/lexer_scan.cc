@@ -0,0 +1,212 @@
+// Copyright (c) 2024 Aniket Ray
+//
+// Licensed under the MIT License; see LICENSE.txt.
+
+#include "lexer_scan.h"
+
+#include <string.h>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define NINJA_LEXER_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+enum CharClass {
+  kVarnameChar = 1 << 0,
+  kTextChar = 1 << 1,
+  kCommentChar = 1 << 2,
+};
+
+/// The classes each byte belongs to, indexed by its unsigned value.
+struct CharClasses {
+  CharClasses() {
+    for (int c = 0; c < 256; ++c) {
+      bool varname = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' ||
+                     c == '.' || c == '-';
+      bool text = c != '$' && c != ' ' && c != ':' && c != '\r' && c != '\n' && c != '|' && c != '\0';
+      bool comment = c != '\n' && c != '\0';
+      table[c] = (varname ? kVarnameChar : 0) | (text ? kTextChar : 0) | (comment ? kCommentChar : 0);
+    }
+  }
+  unsigned char table[256];
+};
+
+const CharClasses kCharClasses;
+
+template <int Class>
+const char* ScalarScan(const char* p, const char* end) {
+  while (p < end && (kCharClasses.table[static_cast<unsigned char>(*p)] & Class))
+    ++p;
+  return p;
+}
+
+const char* ScalarVarname(const char* p, const char* end) {
+  return ScalarScan<kVarnameChar>(p, end);
+}
+
+const char* ScalarText(const char* p, const char* end) {
+  return ScalarScan<kTextChar>(p, end);
+}
+
+const char* ScalarComment(const char* p, const char* end) {
+  return ScalarScan<kCommentChar>(p, end);
+}
+
+const char* ScalarSpaces(const char* p, const char* end) {
+  while (p < end && *p == ' ')
+    ++p;
+  return p;
+}
+
+const LexerScan kScalar = { ScalarVarname, ScalarText, ScalarComment, ScalarSpaces, "scalar" };
+
+#ifdef NINJA_LEXER_SCAN_X86
+
+// Each vector loop classifies a block of bytes into a bit mask with one
+// bit per byte that ends the run, and stops at the lowest set bit.  The
+// remaining tail, shorter than a block, is left to the scalar loop.
+
+/// Bytes of \a v in [lo, hi], as unsigned values.
+__m128i InRange128(__m128i v, char lo, char hi) {
+  __m128i offset = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+  return _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(hi - lo)), offset);
+}
+
+__m128i Equal128(__m128i v, char c) {
+  return _mm_cmpeq_epi8(v, _mm_set1_epi8(c));
+}
+
+unsigned VarnameStops128(__m128i v) {
+  __m128i letter = InRange128(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+  __m128i digit = InRange128(v, '0', '9');
+  __m128i punct = _mm_or_si128(_mm_or_si128(Equal128(v, '_'), Equal128(v, '.')), Equal128(v, '-'));
+  return ~_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(letter, digit), punct)) & 0xffff;
+}
+
+unsigned TextStops128(__m128i v) {
+  __m128i stop = _mm_or_si128(Equal128(v, '$'), Equal128(v, ' '));
+  stop = _mm_or_si128(stop, _mm_or_si128(Equal128(v, ':'), Equal128(v, '|')));
+  stop = _mm_or_si128(stop, _mm_or_si128(Equal128(v, '\r'), Equal128(v, '\n')));
+  stop = _mm_or_si128(stop, Equal128(v, '\0'));
+  return _mm_movemask_epi8(stop);
+}
+
+unsigned CommentStops128(__m128i v) {
+  return _mm_movemask_epi8(_mm_or_si128(Equal128(v, '\n'), Equal128(v, '\0')));
+}
+
+unsigned SpacesStops128(__m128i v) {
+  return ~_mm_movemask_epi8(Equal128(v, ' ')) & 0xffff;
+}
+
+template <unsigned (*Stops)(__m128i), const char* (*Tail)(const char*, const char*)>
+const char* Scan128(const char* p, const char* end) {
+  for (; end - p >= 16; p += 16) {
+    unsigned stops = Stops(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+    if (stops)
+      return p + __builtin_ctz(stops);
+  }
+  return Tail(p, end);
+}
+
+const LexerScan kSSE2 = {
+  Scan128<VarnameStops128, ScalarVarname>,
+  Scan128<TextStops128, ScalarText>,
+  Scan128<CommentStops128, ScalarComment>,
+  Scan128<SpacesStops128, ScalarSpaces>,
+  "sse2",
+};
+
+#define NINJA_AVX2 __attribute__((target("avx2")))
+
+NINJA_AVX2 __m256i InRange256(__m256i v, char lo, char hi) {
+  __m256i offset = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+  return _mm256_cmpeq_epi8(_mm256_min_epu8(offset, _mm256_set1_epi8(hi - lo)), offset);
+}
+
+NINJA_AVX2 __m256i Equal256(__m256i v, char c) {
+  return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c));
+}
+
+NINJA_AVX2 unsigned VarnameStops256(__m256i v) {
+  __m256i letter = InRange256(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+  __m256i digit = InRange256(v, '0', '9');
+  __m256i punct = _mm256_or_si256(_mm256_or_si256(Equal256(v, '_'), Equal256(v, '.')), Equal256(v, '-'));
+  return ~static_cast<unsigned>(_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(letter, digit), punct)));
+}
+
+NINJA_AVX2 unsigned TextStops256(__m256i v) {
+  __m256i stop = _mm256_or_si256(Equal256(v, '$'), Equal256(v, ' '));
+  stop = _mm256_or_si256(stop, _mm256_or_si256(Equal256(v, ':'), Equal256(v, '|')));
+  stop = _mm256_or_si256(stop, _mm256_or_si256(Equal256(v, '\r'), Equal256(v, '\n')));
+  stop = _mm256_or_si256(stop, Equal256(v, '\0'));
+  return _mm256_movemask_epi8(stop);
+}
+
+NINJA_AVX2 unsigned CommentStops256(__m256i v) {
+  return _mm256_movemask_epi8(_mm256_or_si256(Equal256(v, '\n'), Equal256(v, '\0')));
+}
+
+NINJA_AVX2 unsigned SpacesStops256(__m256i v) {
+  return ~static_cast<unsigned>(_mm256_movemask_epi8(Equal256(v, ' ')));
+}
+
+template <unsigned (*Stops)(__m256i), const char* (*Tail)(const char*, const char*)>
+NINJA_AVX2 const char* Scan256(const char* p, const char* end) {
+  for (; end - p >= 32; p += 32) {
+    unsigned stops = Stops(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+    if (stops)
+      return p + __builtin_ctz(stops);
+  }
+  return Tail(p, end);
+}
+
+const LexerScan kAVX2 = {
+  Scan256<VarnameStops256, Scan128<VarnameStops128, ScalarVarname> >,
+  Scan256<TextStops256, Scan128<TextStops128, ScalarText> >,
+  Scan256<CommentStops256, Scan128<CommentStops128, ScalarComment> >,
+  Scan256<SpacesStops256, Scan128<SpacesStops128, ScalarSpaces> >,
+  "avx2",
+};
+
+bool SupportsAVX2() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+
+const LexerScan* Best() {
+  return SupportsAVX2() ? &kAVX2 : &kSSE2;
+}
+
+#else
+
+const LexerScan* Best() {
+  return &kScalar;
+}
+
+#endif  // NINJA_LEXER_SCAN_X86
+
+}  // anonymous namespace
+
+const LexerScan* LexerScan::current_ = Best();
+
+// static
+bool LexerScan::Select(const char* name) {
+  if (strcmp(name, kScalar.name) == 0) {
+    current_ = &kScalar;
+    return true;
+  }
+#ifdef NINJA_LEXER_SCAN_X86
+  if (strcmp(name, kSSE2.name) == 0) {
+    current_ = &kSSE2;
+    return true;
+  }
+  if (strcmp(name, kAVX2.name) == 0 && SupportsAVX2()) {
+    current_ = &kAVX2;
+    return true;
+  }
+#endif
+  return false;
+}
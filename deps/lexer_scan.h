@@ -0,0 +1,41 @@
+// Copyright (c) 2024 Aniket Ray
+//
+// Licensed under the MIT License; see LICENSE.txt.
+
+#ifndef NINJA_LEXER_SCAN_H_
+#define NINJA_LEXER_SCAN_H_
+
+/// Scanners for the runs of bytes that make up most of a manifest, used by
+/// the Lexer ahead of its generated matchers.  Each takes the run's first
+/// byte \a p and the end of the input, and returns the first byte in
+/// [p, end) that is not part of the run, or \a end.
+///
+/// They are vectorized with SSE2 or AVX2 where available, picked at
+/// startup from what the CPU supports, with a scalar fallback.
+struct LexerScan {
+  typedef const char* (*Function)(const char* p, const char* end);
+
+  /// [a-zA-Z0-9_.-]: identifiers and keywords.
+  Function varname;
+  /// Anything but [$ :\r\n|\0]: literal text in paths and values.
+  Function text;
+  /// Anything but [\n\0]: the body of a comment.
+  Function comment;
+  /// ' ': indentation.
+  Function spaces;
+
+  const char* name;
+
+  /// The implementation in use.
+  static const LexerScan& Get() { return *current_; }
+
+  /// Switch to the implementation called \a name ("avx2", "sse2" or
+  /// "scalar"), for tests and benchmarks.  Returns false if it is not
+  /// supported by this build or CPU.
+  static bool Select(const char* name);
+
+ private:
+  static const LexerScan* current_;
+};
+
+#endif  // NINJA_LEXER_SCAN_H_
@@ -15,6 +15,7 @@
 #include "lexer.h"
 
 #include "eval_env.h"
+#include "lexer_scan.h"
 #include "test.h"
 
 using namespace std;
@@ -94,3 +95,62 @@ TEST(Lexer, Tabs) {
   EXPECT_EQ(Lexer::ERROR, token);
   EXPECT_EQ("tabs are not allowed, use spaces", lexer.DescribeLastError());
 }
+
+TEST(Lexer, KeywordsAndIdents) {
+  Lexer lexer("build builds pool.x rule- default include_ subninja2 subninja\n");
+  EXPECT_EQ(Lexer::BUILD, lexer.ReadToken());
+  EXPECT_EQ(Lexer::IDENT, lexer.ReadToken());
+  EXPECT_EQ(Lexer::IDENT, lexer.ReadToken());
+  EXPECT_EQ(Lexer::IDENT, lexer.ReadToken());
+  EXPECT_EQ(Lexer::DEFAULT, lexer.ReadToken());
+  EXPECT_EQ(Lexer::IDENT, lexer.ReadToken());
+  EXPECT_EQ(Lexer::IDENT, lexer.ReadToken());
+  EXPECT_EQ(Lexer::SUBNINJA, lexer.ReadToken());
+  EXPECT_EQ(Lexer::NEWLINE, lexer.ReadToken());
+  EXPECT_EQ(Lexer::TEOF, lexer.ReadToken());
+}
+
+TEST(Lexer, IndentsAndComments) {
+  Lexer lexer("  # indented comment\n  \r\n  \rx\n  \n   ");
+  EXPECT_EQ(Lexer::NEWLINE, lexer.ReadToken());
+  EXPECT_EQ(Lexer::INDENT, lexer.ReadToken());
+  EXPECT_EQ(Lexer::ERROR, lexer.ReadToken());
+  EXPECT_EQ(Lexer::IDENT, lexer.ReadToken());
+  EXPECT_EQ(Lexer::NEWLINE, lexer.ReadToken());
+  EXPECT_EQ(Lexer::NEWLINE, lexer.ReadToken());
+  EXPECT_EQ(Lexer::INDENT, lexer.ReadToken());
+  EXPECT_EQ(Lexer::TEOF, lexer.ReadToken());
+
+  Lexer unterminated("  # foo");
+  EXPECT_EQ(Lexer::INDENT, unterminated.ReadToken());
+  EXPECT_EQ(Lexer::ERROR, unterminated.ReadToken());
+}
+
+TEST(Lexer, ScanImplementationsAgree) {
+  // Every byte value, in runs that straddle the vector block sizes and
+  // end at every offset within a block.
+  string input;
+  for (int c = 0; c < 256; ++c) {
+    for (int run = 0; run < 70; run += 13)
+      input += string(run, 'a' + run % 26) + string(run % 5, ' ') + (char)c;
+  }
+  const char* begin = input.data();
+  const char* end = begin + input.size();
+
+  ASSERT_TRUE(LexerScan::Select("scalar"));
+  const LexerScan scalar = LexerScan::Get();
+  const char* kImplementations[] = { "sse2", "avx2" };
+  for (size_t i = 0; i < sizeof(kImplementations) / sizeof(kImplementations[0]); ++i) {
+    if (!LexerScan::Select(kImplementations[i]))
+      continue;  // Not supported here.
+    const LexerScan& scan = LexerScan::Get();
+    for (const char* p = begin; p < end; ++p) {
+      ASSERT_EQ(scalar.varname(p, end), scan.varname(p, end)) << scan.name << " " << p - begin;
+      ASSERT_EQ(scalar.text(p, end), scan.text(p, end)) << scan.name << " " << p - begin;
+      ASSERT_EQ(scalar.comment(p, end), scan.comment(p, end)) << scan.name << " " << p - begin;
+      ASSERT_EQ(scalar.spaces(p, end), scan.spaces(p, end)) << scan.name << " " << p - begin;
+    }
+  }
+  // Back to the best one for the tests that follow.
+  LexerScan::Select("avx2") || LexerScan::Select("sse2") || LexerScan::Select("scalar");
+}
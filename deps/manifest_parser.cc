@@ -18,21 +18,148 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <vector>
 
+#include "disk_interface.h"
 #include "graph.h"
+#include "path_table.h"
 #include "state.h"
+#include "thread_pool.h"
 #include "util.h"
 #include "version.h"
 
 using namespace std;
 
+/// The result of parsing one subninja (or the top-level file) concurrently:
+/// a scratch State holding its pools, edges and nodes, and the order in
+/// which they, its defaults and its own subninjas must be merged.
+struct ManifestParser::ParsedFile {
+  enum EventType { kPool, kEdge, kDefault, kSubninja };
+  struct Event {
+    EventType type;
+    /// Index into pools, scratch.edges_, defaults or subninjas.
+    size_t index;
+    /// Index into sources, and the lexer position for errors found while
+    /// merging.
+    size_t source;
+    const char* pos;
+  };
+
+  /// A file's text, kept until the merge so that merge errors can still
+  /// show the offending line.  The top-level input is owned by the caller.
+  struct Source {
+    string filename;
+    string contents;
+    StringPiece input;
+  };
+
+  ParsedFile() {
+    // The scratch State holds a file's worth of the process's paths.
+    scratch.paths_.set_sparse();
+  }
+
+  void MarkDone() {
+    {
+      unique_lock<mutex> lock(mutex_);
+      done_ = true;
+    }
+    done_cv_.notify_all();
+  }
+
+  void WaitDone() {
+    unique_lock<mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] { return done_; });
+  }
+
+  State scratch;
+  /// This file's scope, and the scope it must be attached to once merged.
+  BindingEnv* env = nullptr;
+  BindingEnv* parent_env = nullptr;
+  deque<Source> sources;
+
+  vector<Event> events;
+  vector<Pool*> pools;
+  /// Pools used by edges in this file but declared elsewhere, by edge index.
+  map<size_t, string> pending_pools;
+  /// Phony edges that named their output as an input, with the number of
+  /// such inputs dropped, by edge index.
+  map<size_t, int> phony_self_references;
+  vector<string> defaults;
+  vector<unique_ptr<ParsedFile>> subninjas;
+  vector<unique_ptr<BindingEnv>> snapshots;
+
+  /// Set if the file could not be read, to be reported at the parent's
+  /// subninja statement.
+  string read_error;
+  /// Set if parsing stopped early; reported after all events are merged.
+  bool failed = false;
+  string error;
+
+  /// Real node for each scratch node, indexed by the scratch node's id.
+  vector<Node*> real_nodes;
+  size_t edges_merged = 0;
+
+ private:
+  mutex mutex_;
+  condition_variable done_cv_;
+  bool done_ = false;
+};
+
+/// What the workers parsing subninjas share.  Nested subninjas are posted
+/// by workers whose parsers are gone by the time the task runs, so nothing
+/// is taken from the posting parser.
+struct ManifestParser::Subninjas {
+  Subninjas(FileReader* file_reader, const ManifestParserOptions& options, bool quiet)
+      : file_reader(file_reader), options(options), quiet(quiet), pool(options.subninja_threads_) {}
+
+  FileReader* file_reader;
+  ManifestParserOptions options;
+  bool quiet;
+  ThreadPool pool;
+};
+
 ManifestParser::ManifestParser(State* state, FileReader* file_reader, ManifestParserOptions options)
     : Parser(state, file_reader), options_(options), quiet_(false) {
   env_ = &state->bindings_;
 }
 
 bool ManifestParser::Parse(const string& filename, const string& input, string* err) {
+  if (options_.subninja_threads_ <= 1 || file_)
+    return ParseStatements(filename, input, err);
+
+  // Parse the top-level file into a scratch State as well, so that its
+  // statements merge in order with those of its subninjas.  |subninjas|
+  // is declared last so that its workers are joined before |top| and
+  // |concurrent| go.
+  PathTable::Concurrent concurrent(&PathTable::Global());
+  ParsedFile top;
+  top.env = env_;
+  top.sources.push_back(ParsedFile::Source());
+  top.sources[0].filename = filename;
+  top.sources[0].input = input;
+  Subninjas subninjas(file_reader_, options_, quiet_);
+
+  State* state = state_;
+  state_ = &top.scratch;
+  file_ = &top;
+  subninjas_ = &subninjas;
+  if (!ParseStatements(filename, input, &top.error))
+    top.failed = true;
+  state_ = state;
+  file_ = NULL;
+  subninjas_ = NULL;
+  snapshot_ = NULL;
+  top.MarkDone();
+
+  return MergeFile(&top, err);
+}
+
+bool ManifestParser::ParseStatements(const string& filename, const string& input, string* err) {
   lexer_.Start(filename, input);
 
   for (;;) {
@@ -66,6 +193,7 @@ bool ManifestParser::Parse(const string& filename, const string& input, string*
         if (name == "ninja_required_version")
           CheckNinjaVersion(value);
         env_->AddBinding(name, value);
+        snapshot_ = NULL;
         break;
       }
       case Lexer::INCLUDE:
@@ -100,6 +228,7 @@ bool ManifestParser::ParsePool(string* err) {
 
   if (state_->LookupPool(name) != NULL)
     return lexer_.Error("duplicate pool '" + name + "'", err);
+  const char* pos = lexer_.position();
 
   int depth = -1;
 
@@ -122,7 +251,12 @@ bool ManifestParser::ParsePool(string* err) {
   if (depth < 0)
     return lexer_.Error("expected 'depth =' line", err);
 
-  state_->AddPool(new Pool(name, depth));
+  Pool* pool = new Pool(name, depth);
+  state_->AddPool(pool);
+  if (file_) {
+    AddEvent(ParsedFile::kPool, file_->pools.size(), pos);
+    file_->pools.push_back(pool);
+  }
   return true;
 }
 
@@ -165,6 +299,7 @@ bool ManifestParser::ParseRule(string* err) {
     return lexer_.Error("expected 'command =' line", err);
 
   env_->AddRule(rule);
+  snapshot_ = NULL;
   return true;
 }
 
@@ -191,9 +326,15 @@ bool ManifestParser::ParseDefault(string* err) {
       return lexer_.Error("empty path", err);
     uint64_t slash_bits;  // Unused because this only does lookup.
     CanonicalizePath(&path, &slash_bits);
-    std::string default_err;
-    if (!state_->AddDefault(path, &default_err))
-      return lexer_.Error(default_err, err);
+    if (file_) {
+      // The target may come from another file; check it when merging.
+      AddEvent(ParsedFile::kDefault, file_->defaults.size(), lexer_.position());
+      file_->defaults.push_back(path);
+    } else {
+      std::string default_err;
+      if (!state_->AddDefault(path, &default_err))
+        return lexer_.Error(default_err, err);
+    }
 
     eval.Clear();
     if (!lexer_.ReadPath(&eval, err))
@@ -315,15 +456,27 @@ bool ManifestParser::ParseEdge(string* err) {
 
   Edge* edge = state_->AddEdge(rule);
   edge->env_ = env;
+  if (file_)
+    AddEvent(ParsedFile::kEdge, edge->id_, lexer_.position());
 
   string pool_name = edge->GetBinding("pool");
   if (!pool_name.empty()) {
     Pool* pool = state_->LookupPool(pool_name);
-    if (pool == NULL)
+    if (pool == NULL && file_) {
+      // Possibly declared in an earlier file; look it up when merging.
+      file_->pending_pools[edge->id_] = pool_name;
+    } else if (pool == NULL) {
       return lexer_.Error("unknown pool name '" + pool_name + "'", err);
-    edge->pool_ = pool;
+    } else {
+      edge->pool_ = pool;
+    }
   }
 
+  string memory = edge->GetBinding("memory");
+  int64_t memory_kb;
+  if (!memory.empty() && !ParseMemorySize(memory, &memory_kb))
+    return lexer_.Error("invalid memory size '" + memory + "'", err);
+
   edge->outputs_.reserve(outs.size());
   for (size_t i = 0, e = outs.size(); i != e; ++i) {
     string path = outs[i].Evaluate(env);
@@ -341,7 +494,11 @@ bool ManifestParser::ParseEdge(string* err) {
     // All outputs of the edge are already created by other edges. Don't add
     // this edge.  Do this check before input nodes are connected to the edge.
     state_->edges_.pop_back();
-    delete edge;
+    if (file_) {
+      file_->events.pop_back();
+      file_->pending_pools.erase(edge->id_);
+    }
+    edge->~Edge();  // Its memory belongs to state_'s arena.
     return true;
   }
   edge->implicit_outs_ = implicit_outs;
@@ -374,14 +531,17 @@ bool ManifestParser::ParseEdge(string* err) {
     // build graph but that has since been fixed.  Filter them out to
     // support users of those old CMake versions.
     Node* out = edge->outputs_[0];
-    vector<Node*>::iterator new_end = remove(edge->inputs_.begin(), edge->inputs_.end(), out);
+    ArenaVector<Node*>::iterator new_end = remove(edge->inputs_.begin(), edge->inputs_.end(), out);
     if (new_end != edge->inputs_.end()) {
+      if (file_)
+        file_->phony_self_references[edge->id_] = edge->inputs_.end() - new_end;
       edge->inputs_.erase(new_end, edge->inputs_.end());
-      if (!quiet_) {
+      // When parsing concurrently the warning is issued by MergeFile().
+      if (!quiet_ && !file_) {
         Warning(
             "phony target '%s' names itself as an input; "
             "ignoring [-w phonycycle=warn]",
-            out->path().c_str());
+            out->path().str_);
       }
     }
   }
@@ -395,7 +555,7 @@ bool ManifestParser::ParseEdge(string* err) {
     CanonicalizePath(&dyndep, &slash_bits);
     edge->dyndep_ = state_->GetNode(dyndep, slash_bits);
     edge->dyndep_->set_dyndep_pending(true);
-    vector<Node*>::iterator dgi = std::find(edge->inputs_.begin(), edge->inputs_.end(), edge->dyndep_);
+    ArenaVector<Node*>::iterator dgi = std::find(edge->inputs_.begin(), edge->inputs_.end(), edge->dyndep_);
     if (dgi == edge->inputs_.end()) {
       return lexer_.Error("dyndep '" + dyndep + "' is not an input", err);
     }
@@ -411,6 +571,26 @@ bool ManifestParser::ParseFileInclude(bool new_scope, string* err) {
     return false;
   string path = eval.Evaluate(env_);
 
+  if (file_ && new_scope) {
+    // Parse the subninja concurrently against a frozen copy of the scope
+    // as it is now, as this file keeps changing env_ in the meantime.
+    if (!snapshot_) {
+      snapshot_ = new BindingEnv;
+      env_->Flatten(snapshot_);
+      file_->snapshots.emplace_back(snapshot_);
+    }
+    ParsedFile* child = new ParsedFile;
+    child->env = new BindingEnv(snapshot_);
+    child->parent_env = env_;
+    child->sources.push_back(ParsedFile::Source());
+    child->sources[0].filename = path;
+    AddEvent(ParsedFile::kSubninja, file_->subninjas.size(), lexer_.position());
+    file_->subninjas.emplace_back(child);
+    Subninjas* subninjas = subninjas_;
+    subninjas->pool.Post([subninjas, child] { ParseSubninja(subninjas, child); });
+    return ExpectToken(Lexer::NEWLINE, err);
+  }
+
   ManifestParser subparser(state_, file_reader_, options_);
   if (new_scope) {
     subparser.env_ = new BindingEnv(env_);
@@ -418,11 +598,196 @@ bool ManifestParser::ParseFileInclude(bool new_scope, string* err) {
     subparser.env_ = env_;
   }
 
-  if (!subparser.Load(path, err, &lexer_))
+  if (file_) {
+    // An include in a concurrently parsed file: keep its text for errors
+    // found while merging.
+    ParsedFile::Source source;
+    source.filename = path;
+    string read_err;
+    if (file_reader_->ReadFile(path, &source.contents, &read_err) != FileReader::Okay)
+      return lexer_.Error("loading '" + path + "': " + read_err, err);
+    file_->sources.push_back(source);
+    ParsedFile::Source& stored = file_->sources.back();
+    stored.input = stored.contents;
+    subparser.quiet_ = quiet_;
+    subparser.file_ = file_;
+    subparser.subninjas_ = subninjas_;
+    subparser.source_ = file_->sources.size() - 1;
+    if (!subparser.ParseStatements(path, stored.contents, err))
+      return false;
+  } else if (!subparser.Load(path, err, &lexer_)) {
     return false;
+  }
+  if (!new_scope)
+    snapshot_ = NULL;
 
   if (!ExpectToken(Lexer::NEWLINE, err))
     return false;
 
   return true;
 }
+
+void ManifestParser::AddEvent(int type, size_t index, const char* pos) {
+  ParsedFile::Event event = { static_cast<ParsedFile::EventType>(type), index, source_, pos };
+  file_->events.push_back(event);
+}
+
+// static
+void ManifestParser::ParseSubninja(Subninjas* subninjas, ParsedFile* file) {
+  ParsedFile::Source& source = file->sources[0];
+  string read_err;
+  if (subninjas->file_reader->ReadFile(source.filename, &source.contents, &read_err) != FileReader::Okay) {
+    file->read_error = "loading '" + source.filename + "': " + read_err;
+  } else {
+    source.input = source.contents;
+    ManifestParser parser(&file->scratch, subninjas->file_reader, subninjas->options);
+    parser.env_ = file->env;
+    parser.quiet_ = subninjas->quiet;
+    parser.file_ = file;
+    parser.subninjas_ = subninjas;
+    if (!parser.ParseStatements(source.filename, source.contents, &file->error))
+      file->failed = true;
+  }
+  file->MarkDone();
+}
+
+bool ManifestParser::MergeFile(ParsedFile* file, string* err) {
+  // Whatever gets merged points into the scratch arena.
+  state_->arena_.Adopt(&file->scratch.arena_);
+  bool merged = MergeEvents(file, err);
+
+  // Leave the scratch State owning only what was not merged, for its
+  // destructor.  Edges are merged in order, so those are a prefix.
+  vector<Edge*>& edges = file->scratch.edges_;
+  edges.erase(edges.begin(), edges.begin() + file->edges_merged);
+  State::Paths& paths = file->scratch.paths_;
+  for (State::Paths::iterator i = paths.begin(); i != paths.end();) {
+    Node* node = i->second;
+    if (node->id() >= 0 && file->real_nodes[node->id()] == node) {
+      node->set_id(-1);
+      i = paths.erase(i);
+    } else {
+      ++i;
+    }
+  }
+
+  if (merged && file->failed) {
+    *err = file->error;
+    return false;
+  }
+  return merged;
+}
+
+bool ManifestParser::MergeEvents(ParsedFile* file, string* err) {
+  auto fail = [file, err](const ParsedFile::Event& event, const string& message) {
+    const ParsedFile::Source& source = file->sources[event.source];
+    Lexer lexer;
+    lexer.Start(source.filename, source.input);
+    lexer.set_position(event.pos);
+    return lexer.Error(message, err);
+  };
+  // Map a scratch node to the real one on first use.  A path the real
+  // State has not seen yet takes the scratch node itself, relinked from
+  // scratch, rather than allocating it again.
+  auto real_node = [this, file](Node* node) {
+    if (node->id() < 0) {
+      node->set_id(file->real_nodes.size());
+      Node* real = state_->paths_.Get(node->path_id());
+      if (!real) {
+        real = node;
+        real->ClearEdges(&state_->arena_);
+        real->set_dyndep_pending(false);
+        state_->paths_.Set(real->path_id(), real);
+      }
+      file->real_nodes.push_back(real);
+    }
+    return file->real_nodes[node->id()];
+  };
+
+  for (vector<ParsedFile::Event>::const_iterator i = file->events.begin(); i != file->events.end(); ++i) {
+    const ParsedFile::Event& event = *i;
+    switch (event.type) {
+      case ParsedFile::kPool: {
+        Pool* pool = file->pools[event.index];
+        if (state_->LookupPool(pool->name()) != NULL)
+          return fail(event, "duplicate pool '" + pool->name() + "'");
+        state_->AddPool(pool);
+        break;
+      }
+      case ParsedFile::kEdge: {
+        Edge* edge = file->scratch.edges_[event.index];
+        map<size_t, string>::const_iterator pending = file->pending_pools.find(event.index);
+        if (pending != file->pending_pools.end()) {
+          Pool* pool = state_->LookupPool(pending->second);
+          if (pool == NULL)
+            return fail(event, "unknown pool name '" + pending->second + "'");
+          edge->pool_ = pool;
+        }
+        edge->id_ = state_->edges_.size();
+        state_->edges_.push_back(edge);
+        ++file->edges_merged;
+        // The scratch State's arena goes away with the file.
+        edge->MoveToArena(&state_->arena_);
+
+        // A phony self-reference dropped from inputs_ still left the edge
+        // in the output's out-edge list; keep that when relinking.
+        int self_references = 0;
+        map<size_t, int>::const_iterator phony = file->phony_self_references.find(event.index);
+        if (phony != file->phony_self_references.end())
+          self_references = phony->second;
+
+        for (ArenaVector<Node*>::iterator n = edge->outputs_.begin(); n != edge->outputs_.end(); ++n) {
+          Node* node = real_node(*n);
+          if (node->in_edge())
+            return fail(event, "multiple rules generate " + node->path().AsString());
+          node->set_in_edge(edge);
+          node->set_generated_by_dep_loader(false);
+          *n = node;
+        }
+        for (ArenaVector<Node*>::iterator n = edge->inputs_.begin(); n != edge->inputs_.end(); ++n) {
+          Node* node = real_node(*n);
+          node->set_generated_by_dep_loader(false);
+          node->AddOutEdge(edge);
+          *n = node;
+        }
+        for (int j = 0; j < self_references; ++j)
+          edge->outputs_[0]->AddOutEdge(edge);
+        if (self_references > 0 && !quiet_) {
+          Warning(
+              "phony target '%s' names itself as an input; "
+              "ignoring [-w phonycycle=warn]",
+              edge->outputs_[0]->path().str_);
+        }
+        for (ArenaVector<Node*>::iterator n = edge->validations_.begin(); n != edge->validations_.end(); ++n) {
+          Node* node = real_node(*n);
+          node->set_generated_by_dep_loader(false);
+          node->AddValidationOutEdge(edge);
+          *n = node;
+        }
+        if (edge->dyndep_) {
+          edge->dyndep_ = real_node(edge->dyndep_);
+          edge->dyndep_->set_dyndep_pending(true);
+        }
+        break;
+      }
+      case ParsedFile::kDefault: {
+        string default_err;
+        if (!state_->AddDefault(file->defaults[event.index], &default_err))
+          return fail(event, default_err);
+        break;
+      }
+      case ParsedFile::kSubninja: {
+        ParsedFile* child = file->subninjas[event.index].get();
+        child->WaitDone();
+        if (!child->read_error.empty())
+          return fail(event, child->read_error);
+        child->env->set_parent(child->parent_env);
+        if (!MergeFile(child, err))
+          return false;
+        file->subninjas[event.index].reset();
+        break;
+      }
+    }
+  }
+  return true;
+}
@@ -32,6 +32,14 @@ enum PhonyCycleAction {
 
 struct ManifestParserOptions {
   PhonyCycleAction phony_cycle_action_ = kPhonyCycleActionWarn;
+  /// Number of threads parsing subninja files.  With more than one, each
+  /// subninja is read and parsed into its own scratch State concurrently
+  /// and merged into the real one in manifest order, so edge ids and the
+  /// first error reported do not depend on the thread count.
+  ///
+  /// Experimental: no frontend sets this, and manifest_parser_perftest has
+  /// yet to show the concurrent path beating the sequential one.
+  int subninja_threads_ = 1;
 };
 
 /// Parses .ninja files.
@@ -45,9 +53,15 @@ struct ManifestParser : public Parser {
   }
 
  private:
+  struct ParsedFile;
+  struct Subninjas;
+
   /// Parse a file, given its contents as a string.
   bool Parse(const std::string& filename, const std::string& input, std::string* err);
 
+  /// Parse the statements of one file into state_ and env_.
+  bool ParseStatements(const std::string& filename, const std::string& input, std::string* err);
+
   /// Parse various statement types.
   bool ParsePool(std::string* err);
   bool ParseRule(std::string* err);
@@ -58,9 +72,32 @@ struct ManifestParser : public Parser {
   /// Parse either a 'subninja' or 'include' line.
   bool ParseFileInclude(bool new_scope, std::string* err);
 
+  /// Read and parse the subninja \a file into its scratch State.  Runs on
+  /// one of \a subninjas' worker threads.
+  static void ParseSubninja(Subninjas* subninjas, ParsedFile* file);
+
+  /// Move the pools, edges, nodes and defaults parsed into \a file's
+  /// scratch State into state_, in manifest order, then do the same for
+  /// each of its subninjas as they are reached.
+  bool MergeFile(ParsedFile* file, std::string* err);
+  bool MergeEvents(ParsedFile* file, std::string* err);
+
+  /// Record an event for the statement just parsed into file_; errors
+  /// found while merging it are reported at \a pos.
+  void AddEvent(int type, size_t index, const char* pos);
+
   BindingEnv* env_;
   ManifestParserOptions options_;
   bool quiet_;
+
+  /// Set while parsing into a scratch State for a concurrent parse.
+  ParsedFile* file_ = nullptr;
+  Subninjas* subninjas_ = nullptr;
+  /// Which of file_'s sources lexer_ is reading.
+  size_t source_ = 0;
+  /// A frozen copy of env_'s scope chain for subninjas being parsed
+  /// concurrently, reused until env_ changes.
+  BindingEnv* snapshot_ = nullptr;
 };
 
 #endif  // NINJA_MANIFEST_PARSER_H_
@@ -15,6 +15,7 @@
 // Tests manifest parser performance.  Expects to be run in ninja's root
 // directory.
 
+#include <algorithm>
 #include <numeric>
 
 #include <errno.h>
@@ -42,27 +43,71 @@
 
 using namespace std;
 
+/// Write a build.ninja that declares shared rules and pulls in
+/// |kNumSubninjas| generated subninja files, each describing one target of
+/// |kSourcesPerSubninja| compiled sources plus a link step, roughly the
+/// shape of a large generated tree.
 bool WriteFakeManifests(const string& dir, string* err) {
+  const int kNumSubninjas = 1000;
+  const int kSourcesPerSubninja = 100;
+
   RealDiskInterface disk_interface;
   TimeStamp mtime = disk_interface.Stat(dir + "/build.ninja", err);
   if (mtime != 0)  // 0 means that the file doesn't exist yet.
     return mtime != -1;
 
-  string command = "python misc/write_fake_manifests.py " + dir;
   printf("Creating manifest data...");
   fflush(stdout);
-  int exit_code = system(command.c_str());
+  if (!disk_interface.MakeDirs(dir + "/build.ninja")) {
+    *err = "mkdir " + dir + ": " + strerror(errno);
+    return false;
+  }
+
+  string manifest =
+      "cflags = -O2 -Wall -fno-exceptions\n"
+      "rule cxx\n"
+      "  command = c++ -MMD -MF $out.d $defines $includes $cflags -c $in -o $out\n"
+      "  description = CXX $out\n"
+      "  depfile = $out.d\n"
+      "  deps = gcc\n"
+      "rule link\n"
+      "  command = c++ $ldflags -o $out $in $libs\n"
+      "  description = LINK $out\n"
+      "pool link_pool\n"
+      "  depth = 4\n";
+  for (int i = 0; i < kNumSubninjas; ++i) {
+    char name[32];
+    snprintf(name, sizeof(name), "target%d", i);
+    string sub =
+        "defines = -DTARGET_" + string(name) + " -DNDEBUG\n"
+        "includes = -I" + name + "/include -Igen/" + name + "\n"
+        "ldflags = -Wl,--as-needed\n";
+    string objects;
+    for (int j = 0; j < kSourcesPerSubninja; ++j) {
+      char source[64];
+      snprintf(source, sizeof(source), "%s/src/file%d", name, j);
+      sub += "build obj/" + string(source) + ".o: cxx ../../" + source + ".cc || gen/" + name + ".stamp\n";
+      objects += " obj/" + string(source) + ".o";
+    }
+    sub += "build gen/" + string(name) + ".stamp: phony\n";
+    sub += "build bin/" + string(name) + ": link" + objects + "\n  pool = link_pool\n  libs = -lpthread\n";
+    if (!disk_interface.WriteFile(dir + "/" + name + ".ninja", sub))
+      return false;
+    manifest += "subninja " + string(name) + ".ninja\n";
+  }
+  if (!disk_interface.WriteFile(dir + "/build.ninja", manifest))
+    return false;
   printf("done.\n");
-  if (exit_code != 0)
-    *err = "Failed to run " + command;
-  return exit_code == 0;
+  return true;
 }
 
-int LoadManifests(bool measure_command_evaluation) {
+int LoadManifests(bool measure_command_evaluation, int threads) {
   string err;
   RealDiskInterface disk_interface;
   State state;
-  ManifestParser parser(&state, &disk_interface);
+  ManifestParserOptions options;
+  options.subninja_threads_ = threads;
+  ManifestParser parser(&state, &disk_interface, options);
   if (!parser.Load("build.ninja", &err)) {
     fprintf(stderr, "Failed to read test data: %s\n", err.c_str());
     exit(1);
@@ -77,21 +122,48 @@ int LoadManifests(bool measure_command_evaluation) {
   return optimization_guard;
 }
 
+/// Load the manifests a few times on \a threads threads.
+/// @return the fastest run in milliseconds.
+int Measure(bool measure_command_evaluation, int threads) {
+  const int kNumRepetitions = 5;
+  vector<int> times;
+  for (int i = 0; i < kNumRepetitions; ++i) {
+    int64_t start = GetTimeMillis();
+    int optimization_guard = LoadManifests(measure_command_evaluation, threads);
+    int delta = (int)(GetTimeMillis() - start);
+    printf("%dms (hash: %x)\n", delta, optimization_guard);
+    times.push_back(delta);
+  }
+
+  int min = *min_element(times.begin(), times.end());
+  int max = *max_element(times.begin(), times.end());
+  float total = accumulate(times.begin(), times.end(), 0.0f);
+  printf("min %dms  max %dms  avg %.1fms\n", min, max, total / times.size());
+  return min;
+}
+
 int main(int argc, char* argv[]) {
   bool measure_command_evaluation = true;
+  int max_threads = 0;
   int opt;
-  while ((opt = getopt(argc, argv, const_cast<char*>("fh"))) != -1) {
+  while ((opt = getopt(argc, argv, const_cast<char*>("fj:h"))) != -1) {
     switch (opt) {
       case 'f':
         measure_command_evaluation = false;
         break;
+      case 'j':
+        max_threads = atoi(optarg);
+        if (max_threads > 0)
+          break;
+        // Fall through.
       case 'h':
       default:
         printf(
             "usage: manifest_parser_perftest\n"
             "\n"
             "options:\n"
-            "  -f     only measure manifest load time, not command evaluation time\n");
+            "  -f     only measure manifest load time, not command evaluation time\n"
+            "  -j N   compare parsing subninjas on 1, 2, 4, ... up to N threads\n");
         return 1;
     }
   }
@@ -107,18 +179,23 @@ int main(int argc, char* argv[]) {
   if (chdir(kManifestDir) < 0)
     Fatal("chdir: %s", strerror(errno));
 
-  const int kNumRepetitions = 5;
-  vector<int> times;
-  for (int i = 0; i < kNumRepetitions; ++i) {
-    int64_t start = GetTimeMillis();
-    int optimization_guard = LoadManifests(measure_command_evaluation);
-    int delta = (int)(GetTimeMillis() - start);
-    printf("%dms (hash: %x)\n", delta, optimization_guard);
-    times.push_back(delta);
+  if (max_threads == 0) {
+    Measure(measure_command_evaluation, 1);
+    printf("peak RSS %.1fMB\n", GetPeakRSS() / 1048576.0);
+    return 0;
   }
 
-  int min = *min_element(times.begin(), times.end());
-  int max = *max_element(times.begin(), times.end());
-  float total = accumulate(times.begin(), times.end(), 0.0f);
-  printf("min %dms  max %dms  avg %.1fms\n", min, max, total / times.size());
+  vector<pair<int, int> > results;
+  for (int threads = 1;; threads = min(threads * 2, max_threads)) {
+    printf("%d thread(s):\n", threads);
+    results.push_back(make_pair(threads, Measure(measure_command_evaluation, threads)));
+    if (threads == max_threads)
+      break;
+  }
+  printf("\nthreads  min     speedup\n");
+  for (size_t i = 0; i < results.size(); ++i) {
+    printf("%-8d %4dms  %.2fx\n", results[i].first, results[i].second,
+           (double)results[0].second / max(results[i].second, 1));
+  }
+  return 0;
 }
@@ -838,6 +838,19 @@ TEST_F(ParserTest, Errors) {
                          &err));
     EXPECT_EQ("input:5: unknown pool name 'unnamed_pool'\n", err);
   }
+
+  {
+    State local_state;
+    ManifestParser parser(&local_state, NULL);
+    string err;
+    EXPECT_FALSE(
+        parser.ParseTest("rule link\n"
+                         "  command = ld\n"
+                         "  memory = lots\n"
+                         "build out: link in\n",
+                         &err));
+    EXPECT_EQ("input:5: invalid memory size 'lots'\n", err);
+  }
 }
 
 TEST_F(ParserTest, MissingInput) {
@@ -937,6 +950,108 @@ TEST_F(ParserTest, DuplicateRuleInDifferentSubninjasWithInclude) {
                        &err));
 }
 
+TEST_F(ParserTest, ConcurrentSubNinja) {
+  const char kInput[] =
+      "builddir = some_dir/\n"
+      "pool link_pool\n"
+      "  depth = 1\n"
+      "rule varref\n"
+      "  command = varref $var\n"
+      "var = outer\n"
+      "build $builddir/outer: varref\n"
+      "subninja a.ninja\n"
+      "var = changed\n"
+      "subninja b.ninja\n"
+      "build $builddir/outer2: varref $builddir/a $builddir/b\n"
+      "default $builddir/b\n";
+  fs_.Create("a.ninja",
+             "var = a\n"
+             "build $builddir/a: varref\n"
+             "  pool = link_pool\n"
+             "pool b_pool\n"
+             "  depth = 2\n"
+             "subninja c.ninja\n"
+             "default $builddir/outer\n");
+  fs_.Create("b.ninja",
+             "build $builddir/b: varref $builddir/c\n"
+             "  pool = b_pool\n"
+             "  dyndep = $builddir/c\n");
+  fs_.Create("c.ninja",
+             "rule varref\n"
+             "  command = c $var\n"
+             "build $builddir/c: varref\n");
+
+  State sequential;
+  ManifestParser sequential_parser(&sequential, &fs_);
+  string err;
+  EXPECT_TRUE(sequential_parser.ParseTest(kInput, &err));
+  ASSERT_EQ("", err);
+
+  ManifestParserOptions options;
+  options.subninja_threads_ = 4;
+  ManifestParser parser(&state, &fs_, options);
+  EXPECT_TRUE(parser.ParseTest(kInput, &err));
+  ASSERT_EQ("", err);
+  VerifyGraph(state);
+
+  ASSERT_EQ(sequential.edges_.size(), state.edges_.size());
+  for (size_t i = 0; i < state.edges_.size(); ++i) {
+    EXPECT_EQ(i, state.edges_[i]->id_);
+    EXPECT_EQ(sequential.edges_[i]->outputs_[0]->path(), state.edges_[i]->outputs_[0]->path());
+    EXPECT_EQ(sequential.edges_[i]->EvaluateCommand(), state.edges_[i]->EvaluateCommand());
+    EXPECT_EQ(sequential.edges_[i]->pool()->name(), state.edges_[i]->pool()->name());
+    EXPECT_EQ(sequential.edges_[i]->inputs_.size(), state.edges_[i]->inputs_.size());
+  }
+  // Top-level edges see the final value; subninjas see it as of the
+  // subninja statement.
+  EXPECT_EQ("varref changed", state.edges_[0]->EvaluateCommand());
+  EXPECT_EQ("varref a", state.edges_[1]->EvaluateCommand());
+  EXPECT_EQ("c a", state.edges_[2]->EvaluateCommand());
+  EXPECT_EQ("varref changed", state.edges_[3]->EvaluateCommand());
+  EXPECT_EQ(sequential.paths_.size(), state.paths_.size());
+  EXPECT_TRUE(state.LookupNode("some_dir/c")->dyndep_pending());
+  EXPECT_EQ(state.LookupNode("some_dir/c"), state.edges_[3]->dyndep_);
+
+  ASSERT_EQ(2u, state.defaults_.size());
+  EXPECT_EQ("some_dir/outer", state.defaults_[0]->path());
+  EXPECT_EQ("some_dir/b", state.defaults_[1]->path());
+}
+
+TEST_F(ParserTest, ConcurrentSubNinjaErrors) {
+  ManifestParserOptions options;
+  options.subninja_threads_ = 2;
+  fs_.Create("dup.ninja",
+             "rule cat\n"
+             "  command = cat\n"
+             "build out: cat\n");
+  fs_.Create("pool.ninja",
+             "rule cat\n"
+             "  command = cat\n"
+             "build other: cat\n"
+             "  pool = missing\n");
+  fs_.Create("bad.ninja", "build\n");
+
+  const char* kInputs[] = {
+    "subninja foo.ninja\n",
+    "rule cat\n  command = cat\nbuild out: cat\nsubninja dup.ninja\n",
+    "subninja pool.ninja\n",
+    "subninja bad.ninja\nsubninja foo.ninja\n",
+    "subninja dup.ninja\ndefault nonexistent\n",
+  };
+  for (size_t i = 0; i < sizeof(kInputs) / sizeof(kInputs[0]); ++i) {
+    State sequential;
+    ManifestParser sequential_parser(&sequential, &fs_);
+    string expected;
+    EXPECT_FALSE(sequential_parser.ParseTest(kInputs[i], &expected));
+
+    State local_state;
+    ManifestParser parser(&local_state, &fs_, options);
+    string err;
+    EXPECT_FALSE(parser.ParseTest(kInputs[i], &err));
+    EXPECT_EQ(expected, err) << kInputs[i];
+  }
+}
+
 TEST_F(ParserTest, Include) {
   fs_.Create("include.ninja", "var = inner\n");
   ASSERT_NO_FATAL_FAILURE(
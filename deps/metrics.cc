@@ -77,6 +77,7 @@ Metric* Metrics::NewMetric(const string& name) {
   metric->name = name;
   metric->count = 0;
   metric->sum = 0;
+  lock_guard<mutex> lock(mutex_);
   metrics_.push_back(metric);
   return metric;
 }
@@ -90,10 +91,12 @@ void Metrics::Report() {
   printf("%-*s\t%-6s\t%-9s\t%s\n", width, "metric", "count", "avg (us)", "total (ms)");
   for (vector<Metric*>::iterator i = metrics_.begin(); i != metrics_.end(); ++i) {
     Metric* metric = *i;
-    uint64_t micros = TimerToMicros(metric->sum);
+    int count = metric->count;
+    int64_t sum = metric->sum;
+    uint64_t micros = TimerToMicros(sum);
     double total = micros / (double)1000;
-    double avg = micros / (double)metric->count;
-    printf("%-*s\t%-6d\t%-8.1f\t%.1f\n", width, metric->name.c_str(), metric->count, avg, total);
+    double avg = micros / (double)count;
+    printf("%-*s\t%-6d\t%-8.1f\t%.1f\n", width, metric->name.c_str(), count, avg, total);
   }
 }
 
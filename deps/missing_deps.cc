@@ -58,7 +58,7 @@ bool NodeStoringImplicitDepLoader::ProcessDepfileDeps(Edge* edge, std::vector<St
 MissingDependencyScannerDelegate::~MissingDependencyScannerDelegate() {}
 
 void MissingDependencyPrinter::OnMissingDep(Node* node, const std::string& path, const Rule& generator) {
-  std::cout << "Missing dep: " << node->path() << " uses " << path << " (generated by " << generator.name() << ")\n";
+  std::cout << "Missing dep: " << node->path().AsString() << " uses " << path << " (generated by " << generator.name() << ")\n";
 }
 
 MissingDependencyScanner::MissingDependencyScanner(MissingDependencyScannerDelegate* delegate, DepsLog* deps_log,
@@ -78,7 +78,7 @@ void MissingDependencyScanner::ProcessNode(Node* node) {
   if (!seen_.insert(node).second)
     return;
 
-  for (std::vector<Node*>::iterator in = edge->inputs_.begin(); in != edge->inputs_.end(); ++in) {
+  for (ArenaVector<Node*>::iterator in = edge->inputs_.begin(); in != edge->inputs_.end(); ++in) {
     ProcessNode(*in);
   }
 
@@ -131,7 +131,7 @@ void MissingDependencyScanner::ProcessNodeDeps(Node* node, Node** dep_nodes, int
           generated_nodes_.insert(dep_nodes[i]);
           generator_rules_.insert(&(*ne)->rule());
           missing_deps_rule_names.insert((*ne)->rule().name());
-          delegate_->OnMissingDep(node, dep_nodes[i]->path(), (*ne)->rule());
+          delegate_->OnMissingDep(node, dep_nodes[i]->path().AsString(), (*ne)->rule());
         }
       }
     }
@@ -0,0 +1,120 @@
+// Copyright (c) 2024 Aniket Ray
+//
+// Licensed under the MIT License; see LICENSE.txt.
+
+#include "output_buffer.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include "util.h"
+
+using namespace std;
+
+namespace {
+
+// Most commands print nothing or a line or two; chunks start small and
+// double up to the size of a pipe's buffer.
+const size_t kFirstChunk = 4 << 10;
+const size_t kLastChunk = 64 << 10;
+
+}  // anonymous namespace
+
+OutputBuffer::OutputBuffer() : size_(0), limit_(kDefaultLimit), spill_(NULL) {}
+
+OutputBuffer::~OutputBuffer() {
+  Clear();
+}
+
+char* OutputBuffer::Prepare(size_t* size) {
+  if (chunks_.empty() || chunks_.back().size == chunks_.back().capacity) {
+    size_t capacity = chunks_.empty() ? kFirstChunk : min(chunks_.back().capacity * 2, kLastChunk);
+    Chunk chunk;
+    chunk.data.reset(new char[capacity]);
+    chunk.size = 0;
+    chunk.capacity = capacity;
+    chunks_.push_back(std::move(chunk));
+  }
+  Chunk& last = chunks_.back();
+  *size = last.capacity - last.size;
+  return last.data.get() + last.size;
+}
+
+void OutputBuffer::Commit(size_t size) {
+  Chunk& last = chunks_.back();
+  last.size += size;
+  size_ += size;
+  if (spill_) {
+    // Once spilled, the last chunk only stages reads on their way out.
+    if (fwrite(last.data.get(), 1, last.size, spill_) != last.size)
+      Fatal("write to temporary file: %s", strerror(errno));
+    last.size = 0;
+  } else if (limit_ && size_ > limit_) {
+    Spill();
+  }
+}
+
+void OutputBuffer::Append(const char* data, size_t size) {
+  while (size > 0) {
+    size_t room;
+    char* dest = Prepare(&room);
+    size_t len = min(room, size);
+    memcpy(dest, data, len);
+    Commit(len);
+    data += len;
+    size -= len;
+  }
+}
+
+bool OutputBuffer::Spill() {
+  spill_ = tmpfile();
+  if (!spill_) {
+    Warning("cannot spill command output to a temporary file: %s", strerror(errno));
+    limit_ = 0;
+    return false;
+  }
+  // Keep the commands started from here on from inheriting it.
+  SetCloseOnExec(fileno(spill_));
+  for (vector<Chunk>::const_iterator i = chunks_.begin(); i != chunks_.end(); ++i) {
+    if (fwrite(i->data.get(), 1, i->size, spill_) != i->size)
+      Fatal("write to temporary file: %s", strerror(errno));
+  }
+  chunks_.erase(chunks_.begin(), chunks_.end() - 1);
+  chunks_.back().size = 0;
+  return true;
+}
+
+void OutputBuffer::AppendTo(string* out) const {
+  out->reserve(out->size() + size_);
+  if (spill_) {
+    size_t start = out->size();
+    out->resize(start + size_);
+    if (fflush(spill_) != 0 || fseek(spill_, 0, SEEK_SET) != 0 ||
+        fread(&(*out)[start], 1, size_, spill_) != size_ || fseek(spill_, 0, SEEK_END) != 0)
+      Fatal("read temporary file: %s", strerror(errno));
+    return;
+  }
+  for (vector<Chunk>::const_iterator i = chunks_.begin(); i != chunks_.end(); ++i)
+    out->append(i->data.get(), i->size);
+}
+
+string OutputBuffer::str() const {
+  string out;
+  AppendTo(&out);
+  return out;
+}
+
+void OutputBuffer::Take(string* out) {
+  out->clear();
+  AppendTo(out);
+  Clear();
+}
+
+void OutputBuffer::Clear() {
+  chunks_.clear();
+  size_ = 0;
+  if (spill_) {
+    fclose(spill_);
+    spill_ = NULL;
+  }
+}
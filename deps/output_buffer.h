@@ -0,0 +1,68 @@
+// Copyright (c) 2024 Aniket Ray
+//
+// Licensed under the MIT License; see LICENSE.txt.
+
+#ifndef NINJA_OUTPUT_BUFFER_H_
+#define NINJA_OUTPUT_BUFFER_H_
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/// The output of a running command.  Reads go straight into a list of
+/// chunks, which never move once filled.  Past limit() bytes the output
+/// moves to an anonymous temporary file, so that many chatty commands at
+/// once hold at most one chunk each in memory.
+struct OutputBuffer {
+  /// The limit that SubprocessSet gives each subprocess by default.
+  static const size_t kDefaultLimit = 1 << 20;
+
+  OutputBuffer();
+  ~OutputBuffer();
+
+  /// Bytes to hold in memory before spilling to a file; 0 for no limit.
+  void set_limit(size_t limit) { limit_ = limit; }
+  size_t limit() const { return limit_; }
+
+  /// Space for the next read, of at least one byte; its size goes in \a size.
+  char* Prepare(size_t* size);
+  /// Take \a size bytes that were read into the space Prepare() gave.
+  void Commit(size_t size);
+  void Append(const char* data, size_t size);
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  bool spilled() const { return spill_ != NULL; }
+
+  /// A copy of the output.
+  std::string str() const;
+  /// Move the output into \a out and empty this buffer.
+  void Take(std::string* out);
+
+ private:
+  struct Chunk {
+    std::unique_ptr<char[]> data;
+    size_t size;
+    size_t capacity;
+  };
+
+  /// Write the chunks to a new temporary file and drop all but the last.
+  /// @return false, leaving the chunks in memory, if there is no file.
+  bool Spill();
+  /// Append the output to \a out.
+  void AppendTo(std::string* out) const;
+  void Clear();
+
+  std::vector<Chunk> chunks_;
+  size_t size_;
+  size_t limit_;
+  FILE* spill_;
+
+  OutputBuffer(const OutputBuffer&);
+  void operator=(const OutputBuffer&);
+};
+
+#endif  // NINJA_OUTPUT_BUFFER_H_
@@ -0,0 +1,88 @@
+// Copyright (c) 2024 Aniket Ray
+//
+// Licensed under the MIT License; see LICENSE.txt.
+
+#include "output_buffer.h"
+
+#include <string.h>
+
+#include "test.h"
+
+using namespace std;
+
+namespace {
+
+/// Append \a data in reads of at most \a read_size bytes, as a pipe gives it.
+void Read(OutputBuffer* buffer, const string& data, size_t read_size) {
+  for (size_t pos = 0; pos < data.size();) {
+    size_t size;
+    char* dest = buffer->Prepare(&size);
+    ASSERT_GT(size, 0u);
+    size = min(min(size, read_size), data.size() - pos);
+    memcpy(dest, data.data() + pos, size);
+    buffer->Commit(size);
+    pos += size;
+  }
+}
+
+string MakeData(size_t size) {
+  string data;
+  for (size_t i = 0; data.size() < size; ++i)
+    data += "line " + to_string(i) + "\n";
+  data.resize(size);
+  return data;
+}
+
+TEST(OutputBuffer, Empty) {
+  OutputBuffer buffer;
+  EXPECT_TRUE(buffer.empty());
+  string out = "stale";
+  buffer.Take(&out);
+  EXPECT_EQ("", out);
+}
+
+TEST(OutputBuffer, Chunks) {
+  OutputBuffer buffer;
+  string data = MakeData(300000);
+  Read(&buffer, data, 1000);
+  EXPECT_EQ(data.size(), buffer.size());
+  EXPECT_FALSE(buffer.spilled());
+  EXPECT_EQ(data, buffer.str());
+
+  string out;
+  buffer.Take(&out);
+  EXPECT_EQ(data, out);
+  EXPECT_TRUE(buffer.empty());
+}
+
+TEST(OutputBuffer, Spill) {
+  OutputBuffer buffer;
+  buffer.set_limit(10000);
+  string data = MakeData(200000);
+  Read(&buffer, data.substr(0, 5000), 3000);
+  EXPECT_FALSE(buffer.spilled());
+  Read(&buffer, data.substr(5000), 70000);
+  EXPECT_TRUE(buffer.spilled());
+  EXPECT_EQ(data.size(), buffer.size());
+
+  // Reading it back leaves it to grow.
+  EXPECT_EQ(data, buffer.str());
+  buffer.Append("tail", 4);
+  data += "tail";
+
+  string out;
+  buffer.Take(&out);
+  EXPECT_EQ(data, out);
+  EXPECT_FALSE(buffer.spilled());
+}
+
+TEST(OutputBuffer, NoLimit) {
+  OutputBuffer buffer;
+  buffer.set_limit(0);
+  string data = MakeData(3 * OutputBuffer::kDefaultLimit);
+  buffer.Append(data.data(), data.size());
+  EXPECT_FALSE(buffer.spilled());
+  EXPECT_EQ(data, buffer.str());
+}
+
+}  // anonymous namespace
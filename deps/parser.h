@@ -27,7 +27,7 @@ struct Parser {
   Parser(State* state, FileReader* file_reader) : state_(state), file_reader_(file_reader) {}
 
   /// Load and parse a file.
-  bool Load(const std::string& content, std::string* err, Lexer* parent = NULL);
+  bool Load(const std::string& filename, std::string* err, Lexer* parent = NULL);
 
  protected:
   /// If the next token is not \a expected, produce an error string
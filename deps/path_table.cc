@@ -0,0 +1,62 @@
+// Copyright (c) 2024 Aniket Ray
+//
+// Licensed under the MIT License; see LICENSE.txt.
+
+#include "path_table.h"
+
+#include <string.h>
+
+#include "util.h"
+
+using namespace std;
+
+const uint32_t PathTable::kNone;
+
+// static
+PathTable& PathTable::Global() {
+  // Never destroyed, so that paths stay valid during static destruction.
+  static PathTable* table = new PathTable;
+  return *table;
+}
+
+uint32_t PathTable::Intern(StringPiece path) {
+  unique_lock<mutex> lock = Lock();
+  pair<ExternalStringHashMap<uint32_t>::Type::iterator, bool> entry = index_.emplace(path, size_);
+  if (!entry.second)
+    return entry.first->second;
+
+  if (size_ == kNone)
+    Fatal("too many paths");
+  uint32_t id = size_++;
+  uint32_t chunk, offset;
+  Locate(id, &chunk, &offset);
+  if (!chunks_[chunk])
+    chunks_[chunk] = new StringPiece[1024u << chunk];
+  char* bytes = static_cast<char*>(arena_.Allocate(path.len_ + 1, 1));
+  memcpy(bytes, path.str_, path.len_);
+  bytes[path.len_] = '\0';
+  // Key the entry on the copy rather than the caller's string.
+  entry.first->first = chunks_[chunk][offset] = StringPiece(bytes, path.len_);
+  return id;
+}
+
+uint32_t PathTable::Find(StringPiece path) const {
+  unique_lock<mutex> lock = Lock();
+  ExternalStringHashMap<uint32_t>::Type::const_iterator i = index_.find(path);
+  return i == index_.end() ? kNone : i->second;
+}
+
+size_t PathTable::size() const {
+  unique_lock<mutex> lock = Lock();
+  return size_;
+}
+
+size_t PathTable::capacity() const {
+  unique_lock<mutex> lock = Lock();
+  return index_.bucket_count();
+}
+
+size_t PathTable::bytes() const {
+  unique_lock<mutex> lock = Lock();
+  return arena_.used();
+}
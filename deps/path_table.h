@@ -0,0 +1,273 @@
+// Copyright (c) 2024 Aniket Ray
+//
+// Licensed under the MIT License; see LICENSE.txt.
+
+#ifndef NINJA_PATH_TABLE_H_
+#define NINJA_PATH_TABLE_H_
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <iterator>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "arena.h"
+#include "hash_map.h"
+#include "string_piece.h"
+
+/// Interns path strings, giving each distinct path a small dense id that
+/// stays the same for the life of the process.  Code that keeps per-path
+/// data (the nodes of a State, the entries of a BuildLog) indexes vectors
+/// by that id instead of hashing the path again.
+///
+/// Path bytes are copied into arena blocks and never move, so the
+/// StringPieces handed out stay valid.  Each copy is followed by a NUL, so
+/// path(id).str_ may also be passed where a C string is wanted.  The
+/// methods may be called from several threads while a Concurrent is alive,
+/// as the subninja parser does; outside of one they take no lock.
+class PathTable {
+ public:
+  static const uint32_t kNone = UINT32_MAX;
+
+  /// Makes \a table safe to use from several threads for its lifetime.
+  /// Create it before starting the threads and destroy it after they
+  /// are joined.
+  struct Concurrent {
+    explicit Concurrent(PathTable* table) : table_(table) { ++table_->concurrent_; }
+    ~Concurrent() { --table_->concurrent_; }
+
+   private:
+    PathTable* table_;
+  };
+
+  /// The table shared by every State and log in the process.
+  static PathTable& Global();
+
+  PathTable() {}
+
+  /// @return the id of \a path, adding it if it is new.
+  uint32_t Intern(StringPiece path);
+
+  /// @return the id of \a path, or kNone if it was never interned.
+  uint32_t Find(StringPiece path) const;
+
+  /// @return the path with id \a id.  Does not lock: an id can only be
+  /// known to a thread after its path has been stored.
+  StringPiece path(uint32_t id) const {
+    uint32_t chunk, offset;
+    Locate(id, &chunk, &offset);
+    return chunks_[chunk][offset];
+  }
+
+  /// Number of paths interned.
+  size_t size() const;
+
+  /// Number of slots in the hash index, and bytes of path storage.
+  size_t capacity() const;
+  size_t bytes() const;
+
+ private:
+  /// Paths are kept by id in chunks that double in size and never move,
+  /// so that path() needs no lock: chunk c holds 1024 << c paths.
+  static const int kChunks = 23;
+  static void Locate(uint32_t id, uint32_t* chunk, uint32_t* offset) {
+    uint32_t n = (id >> 10) + 1;
+#ifdef _MSC_VER
+    unsigned long bit;
+    _BitScanReverse(&bit, n);
+    *chunk = bit;
+#else
+    *chunk = 31 - __builtin_clz(n);
+#endif
+    *offset = id - ((1024u << *chunk) - 1024u);
+  }
+
+  /// A lock on mutex_ if a Concurrent is alive, else an empty one.
+  std::unique_lock<std::mutex> Lock() const {
+    if (concurrent_.load(std::memory_order_relaxed) > 0)
+      return std::unique_lock<std::mutex>(mutex_);
+    return std::unique_lock<std::mutex>();
+  }
+
+  mutable std::mutex mutex_;
+  std::atomic<int> concurrent_{0};
+  /// Path => id, keyed on the copies in arena_.
+  ExternalStringHashMap<uint32_t>::Type index_;
+  uint32_t size_ = 0;
+  StringPiece* chunks_[kChunks] = {};
+  Arena arena_;
+
+  PathTable(const PathTable&);
+  void operator=(const PathTable&);
+};
+
+/// A map from path to V stored as a vector indexed by path id, where a
+/// value-initialized V means "absent".  It has enough of the interface of
+/// the hash maps it replaces that iteration and string lookups read the
+/// same, with Get()/Set() for callers that already hold a path id.
+///
+/// A sparse map instead keeps its values in the order they were added and
+/// finds them through a hash of the id, so that it takes space for the
+/// paths it holds rather than for every path interned so far.
+template <typename V>
+struct PathMap {
+  typedef std::pair<StringPiece, V> value_type;
+
+  struct const_iterator {
+    typedef std::forward_iterator_tag iterator_category;
+    typedef PathMap::value_type value_type;
+    typedef ptrdiff_t difference_type;
+    typedef const value_type* pointer;
+    typedef const value_type& reference;
+
+    const_iterator(const PathMap* map, uint32_t slot) : map_(map), slot_(slot) { Settle(); }
+
+    const value_type& operator*() const { return value_; }
+    const value_type* operator->() const { return &value_; }
+    const_iterator& operator++() {
+      ++slot_;
+      Settle();
+      return *this;
+    }
+    bool operator==(const const_iterator& other) const { return slot_ == other.slot_; }
+    bool operator!=(const const_iterator& other) const { return slot_ != other.slot_; }
+
+   private:
+    friend struct PathMap;
+
+    /// Skip to the next slot that has a value, and load it.
+    void Settle() {
+      while (slot_ < map_->values_.size() && map_->values_[slot_] == V())
+        ++slot_;
+      if (slot_ < map_->values_.size())
+        value_ = value_type(PathTable::Global().path(map_->IdAt(slot_)), map_->values_[slot_]);
+      else
+        slot_ = map_->values_.size();
+    }
+
+    const PathMap* map_;
+    uint32_t slot_;
+    value_type value_;
+  };
+  typedef const_iterator iterator;
+
+  /// Make this map sparse; see above.  It must be empty.
+  void set_sparse() {
+    assert(values_.empty());
+    sparse_ = true;
+  }
+
+  /// @return the value for \a id, or V() if there is none.
+  V Get(uint32_t id) const {
+    if (sparse_) {
+      std::unordered_map<uint32_t, uint32_t>::const_iterator i = slots_.find(id);
+      return i == slots_.end() ? V() : values_[i->second];
+    }
+    return id < values_.size() ? values_[id] : V();
+  }
+
+  /// Set the value for \a id; V() removes it.
+  void Set(uint32_t id, V value) {
+    uint32_t slot = id;
+    if (sparse_) {
+      std::unordered_map<uint32_t, uint32_t>::const_iterator i = slots_.find(id);
+      if (i != slots_.end()) {
+        slot = i->second;
+      } else {
+        if (value == V())
+          return;
+        slot = values_.size();
+        slots_.emplace(id, slot);
+        ids_.push_back(id);
+        values_.push_back(V());
+      }
+    } else if (id >= values_.size()) {
+      if (value == V())
+        return;
+      values_.resize(id + 1);
+    }
+    count_ += (values_[slot] == V()) - (value == V());
+    values_[slot] = value;
+  }
+
+  V Lookup(StringPiece path) const {
+    uint32_t id = PathTable::Global().Find(path);
+    return id == PathTable::kNone ? V() : Get(id);
+  }
+
+  const_iterator find(StringPiece path) const {
+    uint32_t id = PathTable::Global().Find(path);
+    if (id == PathTable::kNone || Get(id) == V())
+      return end();
+    return const_iterator(this, id);
+  }
+
+  /// Insert \a value unless its path already has a value.
+  /// @return whether it was inserted.
+  bool insert(const value_type& value) {
+    uint32_t id = PathTable::Global().Intern(value.first);
+    if (Get(id) != V())
+      return false;
+    Set(id, value.second);
+    return true;
+  }
+
+  void erase(StringPiece path) {
+    uint32_t id = PathTable::Global().Find(path);
+    if (id != PathTable::kNone)
+      Set(id, V());
+  }
+
+  /// Remove the value at \a i.  @return an iterator to the next value.
+  const_iterator erase(const_iterator i) {
+    values_[i.slot_] = V();
+    --count_;
+    return ++i;
+  }
+
+  /// Make room for ids up to those of \a n more paths than are interned,
+  /// or, if sparse, for \a n more values.
+  void reserve(size_t n) {
+    if (sparse_) {
+      values_.reserve(values_.size() + n);
+      ids_.reserve(ids_.size() + n);
+      slots_.reserve(slots_.size() + n);
+    } else {
+      values_.reserve(PathTable::Global().size() + n);
+    }
+  }
+
+  void clear() {
+    values_.clear();
+    ids_.clear();
+    slots_.clear();
+    count_ = 0;
+  }
+
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, values_.size()); }
+  size_t size() const { return count_; }
+  bool empty() const { return count_ == 0; }
+
+ private:
+  uint32_t IdAt(uint32_t slot) const { return sparse_ ? ids_[slot] : slot; }
+
+  /// Indexed by path id, or if sparse, by slot.
+  std::vector<V> values_;
+  size_t count_ = 0;
+  bool sparse_ = false;
+  /// If sparse, the path id of each slot, and the slot of each path id.
+  std::vector<uint32_t> ids_;
+  std::unordered_map<uint32_t, uint32_t> slots_;
+};
+
+#endif  // NINJA_PATH_TABLE_H_
@@ -0,0 +1,122 @@
+// Copyright (c) 2024 Aniket Ray
+//
+// Licensed under the MIT License; see LICENSE.txt.
+
+#include "path_table.h"
+
+#include <stdio.h>
+
+#include "build_log.h"
+#include "state.h"
+#include "test.h"
+
+using namespace std;
+
+namespace {
+
+TEST(PathTable, InternAndFind) {
+  PathTable table;
+  EXPECT_EQ(PathTable::kNone, table.Find("a"));
+
+  uint32_t a = table.Intern("a");
+  uint32_t b = table.Intern("dir/b");
+  uint32_t empty = table.Intern("");
+  EXPECT_EQ(0u, a);
+  EXPECT_EQ(1u, b);
+  EXPECT_EQ(2u, empty);
+  EXPECT_EQ(a, table.Intern("a"));
+  EXPECT_EQ(b, table.Find("dir/b"));
+  EXPECT_EQ(empty, table.Find(""));
+  EXPECT_EQ(PathTable::kNone, table.Find("dir"));
+  EXPECT_EQ("dir/b", table.path(b).AsString());
+  EXPECT_EQ(3u, table.size());
+}
+
+TEST(PathTable, ManyPaths) {
+  // Enough to grow the slot array and fill several path chunks.
+  PathTable table;
+  const int kCount = 20000;
+  char buf[32];
+  for (int i = 0; i < kCount; ++i) {
+    snprintf(buf, sizeof(buf), "obj/%d.o", i);
+    ASSERT_EQ((uint32_t)i, table.Intern(buf));
+  }
+  EXPECT_EQ((size_t)kCount, table.size());
+  EXPECT_LE(table.size(), table.capacity());
+  for (int i = 0; i < kCount; ++i) {
+    snprintf(buf, sizeof(buf), "obj/%d.o", i);
+    ASSERT_EQ((uint32_t)i, table.Find(buf));
+    ASSERT_EQ(string(buf), table.path(i).AsString());
+  }
+}
+
+TEST(PathTable, SharedIds) {
+  // Nodes of different States and the build log agree on a path's id.
+  State state1, state2;
+  Node* node1 = state1.GetNode("path_table_test/out", 0);
+  Node* node2 = state2.GetNode("path_table_test/out", 0);
+  EXPECT_NE(node1, node2);
+  EXPECT_EQ(node1->path_id(), node2->path_id());
+  EXPECT_EQ(node1->path_id(), PathTable::Global().Find("path_table_test/out"));
+  EXPECT_EQ(node1, state1.paths_.Get(node1->path_id()));
+  EXPECT_EQ(node1, state1.LookupNode("path_table_test/out"));
+  EXPECT_EQ(NULL, state2.LookupNode("path_table_test/other"));
+}
+
+TEST(PathMap, Iterate) {
+  PathMap<int> map;
+  EXPECT_TRUE(map.insert(PathMap<int>::value_type("path_map_test/a", 1)));
+  EXPECT_TRUE(map.insert(PathMap<int>::value_type("path_map_test/b", 2)));
+  EXPECT_FALSE(map.insert(PathMap<int>::value_type("path_map_test/a", 3)));
+  EXPECT_EQ(2u, map.size());
+  EXPECT_EQ(1, map.Lookup("path_map_test/a"));
+  EXPECT_EQ(0, map.Lookup("path_map_test/c"));
+
+  int sum = 0;
+  for (PathMap<int>::const_iterator i = map.begin(); i != map.end(); ++i) {
+    EXPECT_EQ(i->first == "path_map_test/a" ? 1 : 2, i->second);
+    sum += i->second;
+  }
+  EXPECT_EQ(3, sum);
+
+  map.erase("path_map_test/a");
+  EXPECT_EQ(1u, map.size());
+  EXPECT_TRUE(map.find("path_map_test/a") == map.end());
+  EXPECT_EQ(2, map.begin()->second);
+}
+
+TEST(PathMap, Sparse) {
+  // Ids interned before the map was made take no room in it.
+  char buf[32];
+  for (int i = 0; i < 5000; ++i) {
+    snprintf(buf, sizeof(buf), "path_map_sparse/%d", i);
+    PathTable::Global().Intern(buf);
+  }
+  PathMap<int> map;
+  map.set_sparse();
+  EXPECT_TRUE(map.insert(PathMap<int>::value_type("path_map_sparse/4999", 1)));
+  EXPECT_TRUE(map.insert(PathMap<int>::value_type("path_map_sparse/7", 2)));
+  EXPECT_FALSE(map.insert(PathMap<int>::value_type("path_map_sparse/7", 3)));
+  EXPECT_EQ(2u, map.size());
+  EXPECT_EQ(1, map.Lookup("path_map_sparse/4999"));
+  EXPECT_EQ(0, map.Lookup("path_map_sparse/8"));
+  EXPECT_EQ(0, map.Get(PathTable::kNone - 1));
+
+  // Values come in the order they were added.
+  PathMap<int>::const_iterator i = map.begin();
+  EXPECT_EQ("path_map_sparse/4999", i->first.AsString());
+  ++i;
+  EXPECT_EQ(2, i->second);
+  ++i;
+  EXPECT_TRUE(i == map.end());
+
+  i = map.erase(map.begin());
+  EXPECT_EQ(2, i->second);
+  EXPECT_EQ(1u, map.size());
+  EXPECT_EQ(0, map.Lookup("path_map_sparse/4999"));
+  map.Set(PathTable::Global().Find("path_map_sparse/4999"), 4);
+  EXPECT_EQ(4, map.Lookup("path_map_sparse/4999"));
+  EXPECT_EQ(2u, map.size());
+}
+
+}  // anonymous namespace
@@ -0,0 +1,155 @@
+// Copyright (c) 2024 Aniket Ray
+//
+// Licensed under the MIT License; see LICENSE.txt.
+
+// Times the Plan bookkeeping of clean builds: adding the target, preparing
+// the queue, and draining it edge by edge.  One graph is large and random;
+// the other fans many objects into a few links.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "build.h"
+#include "graph.h"
+#include "metrics.h"
+#include "state.h"
+
+using namespace std;
+
+namespace {
+
+/// |count| dirty edges, each reading a source and up to three outputs of
+/// earlier edges, all gathered under "all" by a tree of phony edges with
+/// |fan_in| inputs each.
+Node* MakeGraph(State* state, int count, int fan_in) {
+  Rule* cc = new Rule("cc");
+  state->bindings_.AddRule(cc);
+  string err;
+  char path[64];
+  uint64_t random = 88172645463325252ull;
+  vector<Node*> outputs;
+  for (int i = 0; i < count; ++i) {
+    Edge* edge = state->AddEdge(cc);
+    snprintf(path, sizeof(path), "out/%d.o", i);
+    state->AddOut(edge, path, 0, &err);
+    snprintf(path, sizeof(path), "src/%d.cc", i);
+    state->AddIn(edge, path, 0);
+    for (int j = 0; j < 3 && i > 0; ++j) {
+      random ^= random << 13;
+      random ^= random >> 7;
+      random ^= random << 17;
+      Node* input = outputs[random % outputs.size()];
+      if (input != edge->inputs_.back())
+        state->AddIn(edge, input->path(), 0);
+    }
+    edge->outputs_[0]->MarkDirty();
+    outputs.push_back(edge->outputs_[0]);
+  }
+
+  for (int level = 0; outputs.size() > 1; ++level) {
+    vector<Node*> groups;
+    for (size_t i = 0; i < outputs.size(); i += fan_in) {
+      Edge* group = state->AddEdge(&State::kPhonyRule);
+      snprintf(path, sizeof(path), "group/%d/%d", level, (int)groups.size());
+      state->AddOut(group, path, 0, &err);
+      for (size_t j = i; j < outputs.size() && j < i + fan_in; ++j)
+        state->AddIn(group, outputs[j]->path(), 0);
+      group->outputs_[0]->MarkDirty();
+      groups.push_back(group->outputs_[0]);
+    }
+    outputs.swap(groups);
+  }
+  return outputs[0];
+}
+
+/// |objects| dirty compiles, all linked into each of four binaries that
+/// "all" gathers.
+Node* MakeFanIn(State* state, int objects) {
+  Rule* cc = new Rule("cc");
+  Rule* link = new Rule("link");
+  state->bindings_.AddRule(cc);
+  state->bindings_.AddRule(link);
+  string err;
+  char path[64];
+  Edge* all = state->AddEdge(&State::kPhonyRule);
+  state->AddOut(all, "all", 0, &err);
+  all->outputs_[0]->MarkDirty();
+  vector<Edge*> links;
+  for (int i = 0; i < 4; ++i) {
+    Edge* edge = state->AddEdge(link);
+    snprintf(path, sizeof(path), "bin/%d", i);
+    state->AddOut(edge, path, 0, &err);
+    edge->outputs_[0]->MarkDirty();
+    state->AddIn(all, path, 0);
+    links.push_back(edge);
+  }
+  for (int i = 0; i < objects; ++i) {
+    Edge* edge = state->AddEdge(cc);
+    snprintf(path, sizeof(path), "obj/%d.o", i);
+    state->AddOut(edge, path, 0, &err);
+    edge->outputs_[0]->MarkDirty();
+    for (size_t l = 0; l < links.size(); ++l)
+      state->AddIn(links[l], path, 0);
+    snprintf(path, sizeof(path), "src/%d.cc", i);
+    state->AddIn(edge, path, 0);
+  }
+  return all->outputs_[0];
+}
+
+/// Build \a target through a Plan, printing the time each step takes.
+bool TimePlan(Node* target) {
+  Plan plan;
+  string err;
+  int64_t start = GetTimeMillis();
+  if (!plan.AddTarget(target, &err)) {
+    fprintf(stderr, "%s\n", err.c_str());
+    return false;
+  }
+  int64_t added = GetTimeMillis();
+  plan.PrepareQueue();
+  int64_t prepared = GetTimeMillis();
+  int built = 0;
+  while (Edge* edge = plan.FindWork()) {
+    if (!plan.EdgeFinished(edge, Plan::kEdgeSucceeded, &err)) {
+      fprintf(stderr, "%s\n", err.c_str());
+      return false;
+    }
+    ++built;
+  }
+  int64_t end = GetTimeMillis();
+  if (plan.more_to_do()) {
+    fprintf(stderr, "plan stalled after %d edges\n", built);
+    return false;
+  }
+
+  printf("  AddTarget     %6dms\n", (int)(added - start));
+  printf("  PrepareQueue  %6dms\n", (int)(prepared - added));
+  printf("  build %-7d %6dms\n", built, (int)(end - prepared));
+  return true;
+}
+
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+  int count = argc > 1 ? atoi(argv[1]) : 1000000;
+  int objects = argc > 2 ? atoi(argv[2]) : 20000;
+
+  {
+    State state;
+    Node* target = MakeGraph(&state, count, 16);
+    printf("random graph, %d edges\n", (int)state.edges_.size());
+    if (!TimePlan(target))
+      return 1;
+  }
+  {
+    State state;
+    Node* target = MakeFanIn(&state, objects);
+    printf("%d objects into 4 links\n", objects);
+    if (!TimePlan(target))
+      return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,28 @@
+// Copyright (c) 2024 Aniket Ray
+//
+// Licensed under the MIT License; see LICENSE.txt.
+
+#ifndef NINJA_RESOURCE_USAGE_H_
+#define NINJA_RESOURCE_USAGE_H_
+
+#include <stdint.h>
+
+/// What a finished command cost, as the system reports it when the
+/// command is reaped.  Zero where the system reports nothing.
+struct ResourceUsage {
+  ResourceUsage()
+      : peak_rss_kb(0), user_time_millis(0), system_time_millis(0), read_blocks(0), written_blocks(0) {}
+
+  /// Peak resident set size of the command's largest process, in KiB.
+  int64_t peak_rss_kb;
+  /// CPU time spent by all of the command's processes, in user and in
+  /// kernel mode.
+  int64_t user_time_millis;
+  int64_t system_time_millis;
+  /// Blocks of 512 bytes read from and written to storage, not counting
+  /// what the page cache served.
+  int64_t read_blocks;
+  int64_t written_blocks;
+};
+
+#endif  // NINJA_RESOURCE_USAGE_H_
@@ -0,0 +1,223 @@
+// Copyright (c) 2024 Aniket Ray
+//
+// Licensed under the MIT License; see LICENSE.txt.
+
+#include "stat_ring.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define NINJA_HAVE_IO_URING 1
+#endif
+#endif
+
+#ifdef NINJA_HAVE_IO_URING
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+/// Requests submitted per wave.
+const unsigned kEntries = 256;
+
+int SetUp(unsigned entries, io_uring_params* params) {
+  return syscall(__NR_io_uring_setup, entries, params);
+}
+
+int Enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+  return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+}  // anonymous namespace
+
+struct StatRing::Impl {
+  ~Impl() {
+    if (sqes)
+      munmap(sqes, sqes_size);
+    if (cq_ptr && cq_ptr != sq_ptr)
+      munmap(cq_ptr, cq_size);
+    if (sq_ptr)
+      munmap(sq_ptr, sq_size);
+    if (fd >= 0)
+      close(fd);
+  }
+
+  bool Init() {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    fd = SetUp(kEntries, &params);
+    if (fd < 0)
+      return false;
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap)
+      sq_size = cq_size = max(sq_size, cq_size);
+    sq_ptr = Map(sq_size, IORING_OFF_SQ_RING);
+    if (!sq_ptr)
+      return false;
+    cq_ptr = single_mmap ? sq_ptr : Map(cq_size, IORING_OFF_CQ_RING);
+    if (!cq_ptr)
+      return false;
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe*>(Map(sqes_size, IORING_OFF_SQES));
+    if (!sqes)
+      return false;
+
+    char* sq = static_cast<char*>(sq_ptr);
+    sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    char* cq = static_cast<char*>(cq_ptr);
+    cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    entries = min(params.sq_entries, kEntries);
+    return true;
+  }
+
+  void* Map(size_t size, off_t offset) {
+    void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    return p == MAP_FAILED ? NULL : p;
+  }
+
+  /// Submit one statx per path, at most |entries| of them, and wait for
+  /// all to complete, leaving the kernel's results in |results|.
+  bool Wave(size_t count, const string* const* paths) {
+    unsigned tail = *sq_tail;
+    for (size_t i = 0; i < count; ++i, ++tail) {
+      unsigned index = tail & sq_mask;
+      io_uring_sqe* sqe = &sqes[index];
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = IORING_OP_STATX;
+      sqe->fd = AT_FDCWD;
+      sqe->addr = reinterpret_cast<uintptr_t>(paths[i]->c_str());
+      sqe->len = STATX_MTIME;
+      sqe->off = reinterpret_cast<uintptr_t>(&buffers[i]);
+      sqe->statx_flags = AT_STATX_SYNC_AS_STAT;
+      sqe->user_data = i;
+      sq_array[index] = index;
+    }
+    __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+
+    // Once requests are queued they must be reaped before |buffers| is
+    // reused, even if a later call fails.
+    size_t submitted = 0;
+    size_t completed = 0;
+    bool failed = false;
+    while (completed < count) {
+      unsigned to_submit = count - submitted;
+      int ret = Enter(fd, to_submit, to_submit ? 0 : 1, to_submit ? 0 : IORING_ENTER_GETEVENTS);
+      if (ret < 0) {
+        if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+          continue;
+        if (submitted == 0)
+          return false;
+        // Nothing more can be submitted; wait for what was.
+        failed = true;
+        count = submitted;
+        continue;
+      }
+      if (to_submit)
+        submitted += ret;
+
+      unsigned head = *cq_head;
+      unsigned cq_end = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+      for (; head != cq_end; ++head, ++completed) {
+        const io_uring_cqe& cqe = cqes[head & cq_mask];
+        results[cqe.user_data] = cqe.res;
+      }
+      __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    }
+    return !failed;
+  }
+
+  int fd = -1;
+  void* sq_ptr = nullptr;
+  size_t sq_size = 0;
+  void* cq_ptr = nullptr;
+  size_t cq_size = 0;
+  io_uring_sqe* sqes = nullptr;
+  size_t sqes_size = 0;
+  unsigned* sq_tail = nullptr;
+  unsigned sq_mask = 0;
+  unsigned* sq_array = nullptr;
+  unsigned* cq_head = nullptr;
+  unsigned* cq_tail = nullptr;
+  unsigned cq_mask = 0;
+  io_uring_cqe* cqes = nullptr;
+  unsigned entries = 0;
+
+  struct statx buffers[kEntries];
+  int results[kEntries];
+};
+
+// static
+StatRing* StatRing::Create() {
+  Impl* impl = new Impl;
+  // Kernels before 5.6 accept the ring but reject the statx opcode.
+  string dot = ".";
+  const string* probe = &dot;
+  if (!impl->Init() || !impl->Wave(1, &probe) || impl->results[0] != 0) {
+    delete impl;
+    return NULL;
+  }
+  StatRing* ring = new StatRing;
+  ring->impl_ = impl;
+  return ring;
+}
+
+StatRing::~StatRing() {
+  delete impl_;
+}
+
+bool StatRing::Stat(size_t count, const string* const* paths, TimeStamp* mtimes, string* errs) {
+  for (size_t begin = 0; begin < count; begin += impl_->entries) {
+    size_t n = min<size_t>(impl_->entries, count - begin);
+    if (!impl_->Wave(n, paths + begin))
+      return false;
+    for (size_t i = 0; i < n; ++i) {
+      int res = impl_->results[i];
+      TimeStamp* mtime = &mtimes[begin + i];
+      if (res == -ENOENT || res == -ENOTDIR) {
+        *mtime = 0;
+      } else if (res < 0) {
+        *mtime = -1;
+        errs[begin + i] = "stat(" + *paths[begin + i] + "): " + strerror(-res);
+      } else {
+        const struct statx_timestamp& t = impl_->buffers[i].stx_mtime;
+        // As in RealDiskInterface::Stat(), an mtime of 0 means "exists".
+        *mtime = t.tv_sec == 0 ? 1 : (int64_t)t.tv_sec * 1000000000LL + t.tv_nsec;
+      }
+    }
+  }
+  return true;
+}
+
+#else  // NINJA_HAVE_IO_URING
+
+struct StatRing::Impl {};
+
+// static
+StatRing* StatRing::Create() {
+  return NULL;
+}
+
+StatRing::~StatRing() {}
+
+bool StatRing::Stat(size_t, const std::string* const*, TimeStamp*, std::string*) {
+  return false;
+}
+
+#endif  // NINJA_HAVE_IO_URING
@@ -0,0 +1,40 @@
+// Copyright (c) 2024 Aniket Ray
+//
+// Licensed under the MIT License; see LICENSE.txt.
+
+#ifndef NINJA_STAT_RING_H_
+#define NINJA_STAT_RING_H_
+
+#include <stddef.h>
+
+#include <string>
+
+#include "timestamp.h"
+
+/// Stats many files with few system calls by queueing statx requests on a
+/// Linux io_uring, so that the kernel can run them concurrently.  Talks to
+/// the kernel directly rather than through liburing.
+struct StatRing {
+  /// @return a ring, or NULL if this system (kernel, seccomp policy or
+  /// platform) cannot run statx through io_uring.
+  static StatRing* Create();
+
+  ~StatRing();
+
+  /// Stat \a count paths into \a mtimes, with the same results as
+  /// RealDiskInterface::Stat().  Failed stats give -1 and an error in the
+  /// matching entry of \a errs.
+  /// @return false if the ring itself failed, leaving the results unset.
+  bool Stat(size_t count, const std::string* const* paths, TimeStamp* mtimes, std::string* errs);
+
+ private:
+  StatRing() {}
+
+  struct Impl;
+  Impl* impl_ = nullptr;
+
+  StatRing(const StatRing&);
+  void operator=(const StatRing&);
+};
+
+#endif  // NINJA_STAT_RING_H_
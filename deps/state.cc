@@ -69,6 +69,15 @@ State::State() {
   AddPool(&kConsolePool);
 }
 
+State::~State() {
+  // The arena frees the memory, the edge lists' included.  Run the
+  // destructors anyway, for any member that does hold memory of its own.
+  for (Paths::iterator i = paths_.begin(); i != paths_.end(); ++i)
+    i->second->~Node();
+  for (vector<Edge*>::iterator i = edges_.begin(); i != edges_.end(); ++i)
+    (*i)->~Edge();
+}
+
 void State::AddPool(Pool* pool) {
   assert(LookupPool(pool->name()) == NULL);
   pools_[pool->name()] = pool;
@@ -82,7 +91,7 @@ Pool* State::LookupPool(const string& pool_name) {
 }
 
 Edge* State::AddEdge(const Rule* rule) {
-  Edge* edge = new Edge();
+  Edge* edge = arena_.New<Edge>(&arena_);
   edge->rule_ = rule;
   edge->pool_ = &State::kDefaultPool;
   edge->env_ = &bindings_;
@@ -92,19 +101,17 @@ Edge* State::AddEdge(const Rule* rule) {
 }
 
 Node* State::GetNode(StringPiece path, uint64_t slash_bits) {
-  Node* node = LookupNode(path);
+  uint32_t path_id = PathTable::Global().Intern(path);
+  Node* node = paths_.Get(path_id);
   if (node)
     return node;
-  node = new Node(path.AsString(), slash_bits);
-  paths_[node->path()] = node;
+  node = arena_.New<Node>(path_id, slash_bits, &arena_);
+  paths_.Set(path_id, node);
   return node;
 }
 
 Node* State::LookupNode(StringPiece path) const {
-  Paths::const_iterator i = paths_.find(path);
-  if (i != paths_.end())
-    return i->second;
-  return NULL;
+  return paths_.Lookup(path);
 }
 
 Node* State::SpellcheckNode(const string& path) {
@@ -167,7 +174,7 @@ vector<Node*> State::RootNodes(string* err) const {
   vector<Node*> root_nodes;
   // Search for nodes with no output.
   for (vector<Edge*>::const_iterator e = edges_.begin(); e != edges_.end(); ++e) {
-    for (vector<Node*>::const_iterator out = (*e)->outputs_.begin(); out != (*e)->outputs_.end(); ++out) {
+    for (ArenaVector<Node*>::const_iterator out = (*e)->outputs_.begin(); out != (*e)->outputs_.end(); ++out) {
       if ((*out)->out_edges().empty())
         root_nodes.push_back(*out);
     }
@@ -196,7 +203,7 @@ void State::Reset() {
 void State::Dump() {
   for (Paths::iterator i = paths_.begin(); i != paths_.end(); ++i) {
     Node* node = i->second;
-    printf("%s %s [id:%d]\n", node->path().c_str(),
+    printf("%s %s [id:%d]\n", node->path().str_,
            node->status_known() ? (node->dirty() ? "dirty" : "clean") : "unknown", node->id());
   }
   if (!pools_.empty()) {
@@ -20,9 +20,10 @@
 #include <string>
 #include <vector>
 
+#include "arena.h"
 #include "eval_env.h"
 #include "graph.h"
-#include "hash_map.h"
+#include "path_table.h"
 #include "util.h"
 
 struct Edge;
@@ -102,6 +103,7 @@ struct State {
   static const Rule kPhonyRule;
 
   State();
+  ~State();
 
   void AddPool(Pool* pool);
   Pool* LookupPool(const std::string& pool_name);
@@ -132,8 +134,12 @@ struct State {
   std::vector<Node*> RootNodes(std::string* error) const;
   std::vector<Node*> DefaultNodes(std::string* error) const;
 
-  /// Mapping of path -> Node.
-  typedef ExternalStringHashMap<Node*>::Type Paths;
+  /// Nodes and edges are allocated from arena_ and destroyed with the
+  /// State, so they must only be created through it.
+  Arena arena_;
+
+  /// Mapping of path -> Node, indexed by path id.
+  typedef PathMap<Node*> Paths;
   Paths paths_;
 
   /// All the pools used in the graph.
@@ -0,0 +1,411 @@
+// Copyright (c) 2024 Aniket Ray
+//
+// Licensed under the MIT License; see LICENSE.txt.
+
+#include "state_cache.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include <unordered_map>
+
+#include "build_log.h"
+#include "graph.h"
+#include "metrics.h"
+#include "state.h"
+#include "util.h"
+
+using namespace std;
+
+namespace {
+
+const char kFileSignature[] = "# ninjastate\n";
+const size_t kFileSignatureSize = sizeof(kFileSignature) - 1;
+const uint32_t kCurrentVersion = 2;
+const size_t kHeaderSize = kFileSignatureSize + sizeof(uint32_t) + 2 * sizeof(uint64_t);
+
+/// Index used for "no node", e.g. an edge without a dyndep binding.
+const uint32_t kNoIndex = ~0u;
+
+enum NodeFlags {
+  kNodeGeneratedByDepLoader = 1 << 0,
+  kNodeDyndepPending = 1 << 1,
+};
+
+struct Writer {
+  void U32(uint32_t v) { buf_.append(reinterpret_cast<const char*>(&v), sizeof(v)); }
+  void U64(uint64_t v) { buf_.append(reinterpret_cast<const char*>(&v), sizeof(v)); }
+  void Str(StringPiece s) {
+    U32(s.len_);
+    buf_.append(s.str_, s.len_);
+  }
+  string buf_;
+};
+
+/// Bounds-checked reads from the mapped payload.  Once a read runs past the
+/// end every later read returns zero and ok() stays false.
+struct Reader {
+  Reader(const char* data, size_t size) : p_(data), end_(data + size) {}
+
+  uint32_t U32() {
+    uint32_t v = 0;
+    Read(&v, sizeof(v));
+    return v;
+  }
+  uint64_t U64() {
+    uint64_t v = 0;
+    Read(&v, sizeof(v));
+    return v;
+  }
+  StringPiece Str() {
+    uint32_t len = U32();
+    if (!ok_ || (size_t)(end_ - p_) < len) {
+      ok_ = false;
+      return StringPiece();
+    }
+    StringPiece s(p_, len);
+    p_ += len;
+    return s;
+  }
+  /// Read an index that must be below \a limit.
+  uint32_t Index(size_t limit) {
+    uint32_t v = U32();
+    if (v >= limit)
+      ok_ = false;
+    return ok_ ? v : 0;
+  }
+
+  bool ok() const { return ok_; }
+  bool done() const { return ok_ && p_ == end_; }
+
+ private:
+  void Read(void* v, size_t size) {
+    if (!ok_ || (size_t)(end_ - p_) < size) {
+      ok_ = false;
+      return;
+    }
+    memcpy(v, p_, size);
+    p_ += size;
+  }
+
+  const char* p_;
+  const char* end_;
+  bool ok_ = true;
+};
+
+}  // namespace
+
+// static
+bool StateCache::Save(const string& path, uint64_t key, const State& state, string* err) {
+  METRIC_RECORD(".ninja_state save");
+  Writer w;
+
+  const map<string, string>& bindings = state.bindings_.GetBindings();
+  w.U32(bindings.size());
+  for (map<string, string>::const_iterator i = bindings.begin(); i != bindings.end(); ++i) {
+    w.Str(i->first);
+    w.Str(i->second);
+  }
+
+  // The built-in pools and the phony rule always come first, as a fresh
+  // State already has them.
+  unordered_map<const Pool*, uint32_t> pool_ids;
+  pool_ids[&State::kDefaultPool] = 0;
+  pool_ids[&State::kConsolePool] = 1;
+  w.U32(state.pools_.size() - 2);
+  for (map<string, Pool*>::const_iterator i = state.pools_.begin(); i != state.pools_.end(); ++i) {
+    if (pool_ids.count(i->second))
+      continue;
+    pool_ids.emplace(i->second, pool_ids.size());
+    w.Str(i->second->name());
+    w.U32(i->second->depth());
+  }
+
+  const map<string, const Rule*>& rules = state.bindings_.GetRules();
+  unordered_map<const Rule*, uint32_t> rule_ids;
+  rule_ids[&State::kPhonyRule] = 0;
+  w.U32(rules.size() - 1);
+  for (map<string, const Rule*>::const_iterator i = rules.begin(); i != rules.end(); ++i) {
+    if (i->second == &State::kPhonyRule)
+      continue;
+    rule_ids.emplace(i->second, rule_ids.size());
+    w.Str(i->second->name());
+    const Rule::Bindings& rule_bindings = i->second->bindings();
+    w.U32(rule_bindings.size());
+    for (Rule::Bindings::const_iterator b = rule_bindings.begin(); b != rule_bindings.end(); ++b) {
+      w.Str(b->first);
+      const EvalString::TokenList& tokens = b->second.tokens();
+      w.U32(tokens.size());
+      for (EvalString::TokenList::const_iterator t = tokens.begin(); t != tokens.end(); ++t) {
+        w.U32(t->second);
+        w.Str(t->first);
+      }
+    }
+  }
+
+  unordered_map<const Node*, uint32_t> node_ids;
+  node_ids.reserve(state.paths_.size());
+  w.U32(state.paths_.size());
+  for (State::Paths::const_iterator i = state.paths_.begin(); i != state.paths_.end(); ++i) {
+    const Node* node = i->second;
+    node_ids.emplace(node, node_ids.size());
+    w.Str(node->path());
+    w.U64(node->slash_bits());
+    w.U32((node->generated_by_dep_loader() ? kNodeGeneratedByDepLoader : 0) |
+          (node->dyndep_pending() ? kNodeDyndepPending : 0));
+  }
+
+  w.U32(state.edges_.size());
+  for (vector<Edge*>::const_iterator i = state.edges_.begin(); i != state.edges_.end(); ++i) {
+    const Edge* edge = *i;
+    if (edge->env_ != &state.bindings_) {
+      *err = "edge-level bindings are not supported";
+      return false;
+    }
+    unordered_map<const Rule*, uint32_t>::const_iterator rule = rule_ids.find(edge->rule_);
+    unordered_map<const Pool*, uint32_t>::const_iterator pool = pool_ids.find(edge->pool_);
+    if (rule == rule_ids.end() || pool == pool_ids.end()) {
+      *err = "edge refers to a rule or pool outside the top-level scope";
+      return false;
+    }
+    w.U32(rule->second);
+    w.U32(pool->second);
+    w.U32(edge->implicit_deps_);
+    w.U32(edge->order_only_deps_);
+    w.U32(edge->implicit_outs_);
+    w.U32(edge->dyndep_ ? node_ids[edge->dyndep_] : kNoIndex);
+    w.U32(edge->inputs_.size());
+    for (ArenaVector<Node*>::const_iterator n = edge->inputs_.begin(); n != edge->inputs_.end(); ++n)
+      w.U32(node_ids[*n]);
+    w.U32(edge->outputs_.size());
+    for (ArenaVector<Node*>::const_iterator n = edge->outputs_.begin(); n != edge->outputs_.end(); ++n)
+      w.U32(node_ids[*n]);
+    w.U32(edge->validations_.size());
+    for (ArenaVector<Node*>::const_iterator n = edge->validations_.begin(); n != edge->validations_.end(); ++n)
+      w.U32(node_ids[*n]);
+  }
+
+  // Out-edge lists are stored rather than derived from edge inputs, as
+  // they can differ (e.g. a phony self-reference removed from inputs_).
+  for (State::Paths::const_iterator i = state.paths_.begin(); i != state.paths_.end(); ++i) {
+    const Node* node = i->second;
+    w.U32(node->out_edges().size());
+    for (ArenaVector<Edge*>::const_iterator e = node->out_edges().begin(); e != node->out_edges().end(); ++e)
+      w.U32((*e)->id_);
+    w.U32(node->validation_out_edges().size());
+    for (ArenaVector<Edge*>::const_iterator e = node->validation_out_edges().begin();
+         e != node->validation_out_edges().end(); ++e)
+      w.U32((*e)->id_);
+  }
+
+  w.U32(state.defaults_.size());
+  for (vector<Node*>::const_iterator n = state.defaults_.begin(); n != state.defaults_.end(); ++n)
+    w.U32(node_ids[*n]);
+
+  string temp_path = path + ".tmp";
+  FILE* f = fopen(temp_path.c_str(), "wb");
+  if (!f) {
+    *err = strerror(errno);
+    return false;
+  }
+  uint64_t checksum = BuildLog::LogEntry::HashCommand(w.buf_);
+  bool ok = fwrite(kFileSignature, kFileSignatureSize, 1, f) == 1 &&
+            fwrite(&kCurrentVersion, sizeof(kCurrentVersion), 1, f) == 1 && fwrite(&key, sizeof(key), 1, f) == 1 &&
+            fwrite(&checksum, sizeof(checksum), 1, f) == 1 &&
+            (w.buf_.empty() || fwrite(w.buf_.data(), w.buf_.size(), 1, f) == 1);
+  if (fclose(f) != 0)
+    ok = false;
+  if (!ok) {
+    *err = strerror(errno);
+    unlink(temp_path.c_str());
+    return false;
+  }
+
+  return RenameFile(temp_path, path, err);
+}
+
+// static
+LoadStatus StateCache::Load(const string& path, uint64_t key, State* state, string* err) {
+  METRIC_RECORD(".ninja_state load");
+  MappedFile file;
+  int ret = file.Open(path, err);
+  if (ret == -ENOENT) {
+    err->clear();
+    return LOAD_NOT_FOUND;
+  }
+  if (ret < 0)
+    return LOAD_ERROR;
+
+  // A missing or different header means the cache is stale, not broken.
+  const char* data = file.data();
+  uint32_t version;
+  uint64_t file_key, checksum;
+  if (file.size() < kHeaderSize || memcmp(data, kFileSignature, kFileSignatureSize) != 0)
+    return LOAD_NOT_FOUND;
+  memcpy(&version, data + kFileSignatureSize, sizeof(version));
+  memcpy(&file_key, data + kFileSignatureSize + sizeof(version), sizeof(file_key));
+  memcpy(&checksum, data + kFileSignatureSize + sizeof(version) + sizeof(file_key), sizeof(checksum));
+  if (version != kCurrentVersion || file_key != key)
+    return LOAD_NOT_FOUND;
+
+  StringPiece payload(data + kHeaderSize, file.size() - kHeaderSize);
+  if (BuildLog::LogEntry::HashCommand(payload) != checksum) {
+    *err = "checksum mismatch";
+    return LOAD_ERROR;
+  }
+  Reader r(payload.str_, payload.len_);
+
+  for (uint32_t i = 0, n = r.U32(); r.ok() && i < n; ++i) {
+    string name = r.Str().AsString();
+    state->bindings_.AddBinding(name, r.Str().AsString());
+  }
+
+  vector<Pool*> pools;
+  pools.push_back(&State::kDefaultPool);
+  pools.push_back(&State::kConsolePool);
+  for (uint32_t i = 0, n = r.U32(); r.ok() && i < n; ++i) {
+    string name = r.Str().AsString();
+    int depth = r.U32();
+    if (!r.ok())
+      break;
+    if (state->LookupPool(name)) {
+      *err = "duplicate pool '" + name + "'";
+      return LOAD_ERROR;
+    }
+    Pool* pool = new Pool(name, depth);
+    state->AddPool(pool);
+    pools.push_back(pool);
+  }
+
+  vector<const Rule*> rules;
+  rules.push_back(&State::kPhonyRule);
+  for (uint32_t i = 0, n = r.U32(); r.ok() && i < n; ++i) {
+    Rule* rule = new Rule(r.Str().AsString());
+    for (uint32_t j = 0, bindings = r.U32(); r.ok() && j < bindings; ++j) {
+      string name = r.Str().AsString();
+      EvalString value;
+      for (uint32_t k = 0, tokens = r.U32(); r.ok() && k < tokens; ++k) {
+        uint32_t type = r.U32();
+        StringPiece text = r.Str();
+        if (type == EvalString::RAW)
+          value.AddText(text);
+        else
+          value.AddSpecial(text);
+      }
+      rule->AddBinding(name, value);
+    }
+    if (!r.ok()) {
+      delete rule;
+      break;
+    }
+    if (state->bindings_.LookupRuleCurrentScope(rule->name())) {
+      *err = "duplicate rule '" + rule->name() + "'";
+      delete rule;
+      return LOAD_ERROR;
+    }
+    state->bindings_.AddRule(rule);
+    rules.push_back(rule);
+  }
+
+  uint32_t node_count = r.U32();
+  vector<Node*> nodes;
+  if (r.ok()) {
+    nodes.reserve(node_count);
+    state->paths_.reserve(node_count);
+  }
+  for (uint32_t i = 0; r.ok() && i < node_count; ++i) {
+    StringPiece node_path = r.Str();
+    uint64_t slash_bits = r.U64();
+    uint32_t flags = r.U32();
+    if (!r.ok())
+      break;
+    uint32_t path_id = PathTable::Global().Intern(node_path);
+    if (state->paths_.Get(path_id)) {
+      *err = "duplicate path '" + node_path.AsString() + "'";
+      return LOAD_ERROR;
+    }
+    Node* node = state->arena_.New<Node>(path_id, slash_bits, &state->arena_);
+    node->set_generated_by_dep_loader(flags & kNodeGeneratedByDepLoader);
+    node->set_dyndep_pending(flags & kNodeDyndepPending);
+    state->paths_.Set(path_id, node);
+    nodes.push_back(node);
+  }
+
+  // Index into a table that may be empty; NULL once the reader has failed.
+  auto read_node = [&r, &nodes]() -> Node* {
+    uint32_t i = r.Index(nodes.size());
+    return r.ok() ? nodes[i] : NULL;
+  };
+  auto read_edge = [&r, state]() -> Edge* {
+    uint32_t i = r.Index(state->edges_.size());
+    return r.ok() ? state->edges_[i] : NULL;
+  };
+
+  uint32_t edge_count = r.U32();
+  if (r.ok())
+    state->edges_.reserve(edge_count);
+  for (uint32_t i = 0; r.ok() && i < edge_count; ++i) {
+    const Rule* rule = rules[r.Index(rules.size())];
+    Pool* pool = pools[r.Index(pools.size())];
+    int implicit_deps = r.U32();
+    int order_only_deps = r.U32();
+    int implicit_outs = r.U32();
+    if (!r.ok())
+      break;
+    Edge* edge = state->AddEdge(rule);
+    edge->pool_ = pool;
+    edge->implicit_deps_ = implicit_deps;
+    edge->order_only_deps_ = order_only_deps;
+    edge->implicit_outs_ = implicit_outs;
+    uint32_t dyndep = r.U32();
+    if (dyndep != kNoIndex && dyndep >= nodes.size()) {
+      *err = "corrupt state cache";
+      return LOAD_ERROR;
+    }
+    if (dyndep != kNoIndex)
+      edge->dyndep_ = nodes[dyndep];
+    uint32_t count = r.U32();
+    for (uint32_t j = 0; r.ok() && j < count; ++j) {
+      if (Node* in = read_node())
+        edge->inputs_.push_back(in);
+    }
+    count = r.U32();
+    for (uint32_t j = 0; r.ok() && j < count; ++j) {
+      if (Node* out = read_node()) {
+        edge->outputs_.push_back(out);
+        out->set_in_edge(edge);
+      }
+    }
+    count = r.U32();
+    for (uint32_t j = 0; r.ok() && j < count; ++j) {
+      if (Node* validation = read_node())
+        edge->validations_.push_back(validation);
+    }
+  }
+
+  for (size_t i = 0; r.ok() && i < nodes.size(); ++i) {
+    for (uint32_t j = 0, n = r.U32(); r.ok() && j < n; ++j) {
+      if (Edge* edge = read_edge())
+        nodes[i]->AddOutEdge(edge);
+    }
+    for (uint32_t j = 0, n = r.U32(); r.ok() && j < n; ++j) {
+      if (Edge* edge = read_edge())
+        nodes[i]->AddValidationOutEdge(edge);
+    }
+  }
+
+  for (uint32_t i = 0, n = r.U32(); r.ok() && i < n; ++i) {
+    if (Node* node = read_node())
+      state->defaults_.push_back(node);
+  }
+
+  if (!r.done()) {
+    *err = "corrupt state cache";
+    return LOAD_ERROR;
+  }
+  return LOAD_SUCCESS;
+}
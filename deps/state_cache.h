@@ -0,0 +1,38 @@
+// Copyright (c) 2024 Aniket Ray
+//
+// Licensed under the MIT License; see LICENSE.txt.
+
+#ifndef NINJA_STATE_CACHE_H_
+#define NINJA_STATE_CACHE_H_
+
+#include <stdint.h>
+
+#include <string>
+
+#include "load_status.h"
+
+struct State;
+
+/// A binary snapshot of a loaded State: top-level bindings, rules, pools,
+/// nodes, edges and defaults.  Loading it skips manifest parsing and
+/// evaluation entirely, so it is tagged with a caller-chosen \a key that
+/// must change whenever the manifest would produce a different graph.
+///
+/// The file is a signature, a version, the key, a checksum of the payload
+/// and the payload itself: counts, length-prefixed strings and indices in
+/// native byte order.  It is only meant to be read back on the machine
+/// that wrote it.
+struct StateCache {
+  /// Write \a state to \a path.  Only States whose edges all evaluate in
+  /// the top-level scope (no build-level bindings or subninja scopes) can
+  /// be written.
+  static bool Save(const std::string& path, uint64_t key, const State& state, std::string* err);
+
+  /// Populate a freshly constructed \a state from \a path.
+  /// @return LOAD_NOT_FOUND if the file is missing or was written for a
+  /// different key or version, LOAD_ERROR if it is unreadable or corrupt;
+  /// in the latter case \a state may be partially populated.
+  static LoadStatus Load(const std::string& path, uint64_t key, State* state, std::string* err);
+};
+
+#endif  // NINJA_STATE_CACHE_H_
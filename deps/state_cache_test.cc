@@ -0,0 +1,151 @@
+// Copyright (c) 2024 Aniket Ray
+//
+// Licensed under the MIT License; see LICENSE.txt.
+
+#include "state_cache.h"
+
+#include <stdio.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "graph.h"
+#include "state.h"
+#include "test.h"
+#include "util.h"
+
+using namespace std;
+
+namespace {
+
+const char kTestFilename[] = "StateCacheTest-tempfile";
+
+struct StateCacheTest : public testing::Test {
+  virtual void SetUp() {
+    // In case a crashing test left a stale file behind.
+    unlink(kTestFilename);
+  }
+
+  virtual void TearDown() { unlink(kTestFilename); }
+};
+
+TEST_F(StateCacheTest, RoundTrip) {
+  State state1;
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state1,
+                                      "cflags = -O2\n"
+                                      "pool link_pool\n"
+                                      "  depth = 3\n"
+                                      "rule cc\n"
+                                      "  command = cc $cflags -c $in -o $out\n"
+                                      "  depfile = $out.d\n"
+                                      "rule link\n"
+                                      "  command = ld $$LDFLAGS $in -o $out\n"
+                                      "  pool = link_pool\n"
+                                      "rule dd\n"
+                                      "  command = gen $out\n"
+                                      "  dyndep = out.dd\n"
+                                      "build a.o: cc a.c | a.h || gen\n"
+                                      "build b.o | b.o.stamp: cc b.c |@ check\n"
+                                      "build app: link a.o b.o\n"
+                                      "build gen: phony\n"
+                                      "build out.dd: phony\n"
+                                      "build out: dd in | out.dd\n"
+                                      "default app\n"));
+
+  string err;
+  EXPECT_TRUE(StateCache::Save(kTestFilename, 42, state1, &err));
+  ASSERT_EQ("", err);
+
+  State state2;
+  EXPECT_EQ(LOAD_SUCCESS, StateCache::Load(kTestFilename, 42, &state2, &err));
+  ASSERT_EQ("", err);
+
+  ASSERT_EQ(state1.edges_.size(), state2.edges_.size());
+  ASSERT_EQ(state1.paths_.size(), state2.paths_.size());
+  for (size_t i = 0; i < state1.edges_.size(); ++i) {
+    Edge* e1 = state1.edges_[i];
+    Edge* e2 = state2.edges_[i];
+    EXPECT_EQ(e1->rule().name(), e2->rule().name());
+    EXPECT_EQ(e1->pool()->name(), e2->pool()->name());
+    EXPECT_EQ(e1->EvaluateCommand(), e2->EvaluateCommand());
+    EXPECT_EQ(e1->GetBinding("depfile"), e2->GetBinding("depfile"));
+    EXPECT_EQ(e1->implicit_deps_, e2->implicit_deps_);
+    EXPECT_EQ(e1->order_only_deps_, e2->order_only_deps_);
+    EXPECT_EQ(e1->implicit_outs_, e2->implicit_outs_);
+    ASSERT_EQ(e1->inputs_.size(), e2->inputs_.size());
+    for (size_t j = 0; j < e1->inputs_.size(); ++j)
+      EXPECT_EQ(e1->inputs_[j]->path(), e2->inputs_[j]->path());
+    ASSERT_EQ(e1->outputs_.size(), e2->outputs_.size());
+    for (size_t j = 0; j < e1->outputs_.size(); ++j) {
+      EXPECT_EQ(e1->outputs_[j]->path(), e2->outputs_[j]->path());
+      EXPECT_EQ(e2, e2->outputs_[j]->in_edge());
+    }
+    ASSERT_EQ(e1->validations_.size(), e2->validations_.size());
+    EXPECT_EQ(e1->dyndep_ != NULL, e2->dyndep_ != NULL);
+  }
+
+  Node* a_o = state2.LookupNode("a.o");
+  ASSERT_TRUE(a_o);
+  EXPECT_EQ("cc -O2 -c a.c -o a.o", a_o->in_edge()->EvaluateCommand());
+  ASSERT_EQ(1u, a_o->out_edges().size());
+  EXPECT_EQ("app", a_o->out_edges()[0]->outputs_[0]->path());
+  EXPECT_EQ("ld $LDFLAGS a.o b.o -o app", state2.LookupNode("app")->in_edge()->EvaluateCommand());
+  EXPECT_EQ(3, state2.LookupPool("link_pool")->depth());
+  EXPECT_EQ(1u, state2.LookupNode("check")->validation_out_edges().size());
+  EXPECT_TRUE(state2.LookupNode("out.dd")->dyndep_pending());
+  EXPECT_FALSE(state2.LookupNode("a.c")->generated_by_dep_loader());
+  ASSERT_EQ(1u, state2.defaults_.size());
+  EXPECT_EQ("app", state2.defaults_[0]->path());
+}
+
+TEST_F(StateCacheTest, KeyMismatch) {
+  State state1;
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state1, "build out: phony in\n"));
+  string err;
+  EXPECT_TRUE(StateCache::Save(kTestFilename, 1, state1, &err));
+
+  State state2;
+  EXPECT_EQ(LOAD_NOT_FOUND, StateCache::Load(kTestFilename, 2, &state2, &err));
+  EXPECT_EQ("", err);
+  EXPECT_TRUE(state2.edges_.empty());
+}
+
+TEST_F(StateCacheTest, Missing) {
+  State state;
+  string err;
+  EXPECT_EQ(LOAD_NOT_FOUND, StateCache::Load(kTestFilename, 1, &state, &err));
+  EXPECT_EQ("", err);
+}
+
+TEST_F(StateCacheTest, Corrupt) {
+  State state1;
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state1, "build out: phony in\n"));
+  string err;
+  EXPECT_TRUE(StateCache::Save(kTestFilename, 1, state1, &err));
+
+  // Flip the last byte of the payload.
+  string contents;
+  ASSERT_EQ(0, ReadFile(kTestFilename, &contents, &err));
+  contents[contents.size() - 1] ^= 1;
+  FILE* f = fopen(kTestFilename, "wb");
+  fwrite(contents.data(), contents.size(), 1, f);
+  fclose(f);
+
+  State state2;
+  EXPECT_EQ(LOAD_ERROR, StateCache::Load(kTestFilename, 1, &state2, &err));
+  EXPECT_EQ("checksum mismatch", err);
+}
+
+TEST_F(StateCacheTest, EdgeBindingsUnsupported) {
+  State state;
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state,
+                                      "rule cat\n"
+                                      "  command = cat $in > $out\n"
+                                      "build out: cat in\n"
+                                      "  foo = bar\n"));
+  string err;
+  EXPECT_FALSE(StateCache::Save(kTestFilename, 1, state, &err));
+  EXPECT_EQ("edge-level bindings are not supported", err);
+}
+
+}  // namespace
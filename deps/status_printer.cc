@@ -190,8 +190,8 @@ void StatusPrinter::BuildEdgeFinished(Edge* edge, int64_t start_time_millis, int
   // Print the command that is spewing before printing its output.
   if (!success) {
     string outputs;
-    for (vector<Node*>::const_iterator o = edge->outputs_.begin(); o != edge->outputs_.end(); ++o)
-      outputs += (*o)->path() + " ";
+    for (ArenaVector<Node*>::const_iterator o = edge->outputs_.begin(); o != edge->outputs_.end(); ++o)
+      outputs += (*o)->path().AsString() + " ";
 
     if (printer_.supports_color()) {
       printer_.PrintOnNewLine(
@@ -217,11 +217,10 @@ void StatusPrinter::BuildEdgeFinished(Edge* edge, int64_t start_time_millis, int
     // (Launching subprocesses in pseudo ttys doesn't work because there are
     // only a few hundred available on some systems, and ninja can launch
     // thousands of parallel compile commands.)
-    string final_output;
+    string stripped;
     if (!printer_.supports_color())
-      final_output = StripAnsiEscapeCodes(output);
-    else
-      final_output = output;
+      stripped = StripAnsiEscapeCodes(output);
+    const string& final_output = printer_.supports_color() ? output : stripped;
 
 #ifdef _WIN32
     // Fix extra CR being added on Windows, writing out CR CR LF (#773)
@@ -50,6 +50,8 @@ struct StringPiece {
 
   size_t size() const { return len_; }
 
+  bool empty() const { return len_ == 0; }
+
   const char* str_;
   size_t len_;
 };
@@ -20,27 +20,165 @@
 #include <spawn.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/select.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
-#if defined(USE_PPOLL)
+#if defined(USE_EPOLL)
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#elif defined(USE_PPOLL)
 #include <poll.h>
 #else
 #include <sys/select.h>
 #endif
 
+#include <algorithm>
+
 extern char** environ;
 
 #include "util.h"
 
 using namespace std;
 
-Subprocess::Subprocess(bool use_console) : fd_(-1), pid_(-1), use_console_(use_console) {}
+namespace {
+
+/// Split \a command into words if /bin/sh would run it as a program with
+/// arguments and nothing more: no quoting, expansion, globbing, redirection
+/// or control operator, no variable assignment, and no builtin or keyword
+/// in command position.
+/// @return false if the command needs the shell.
+bool SplitPlainCommand(const string& command, vector<string>* words) {
+  static const char kSpecial[] = "|&;<>()$`\\\"'*?[]#~{}!\n";
+  if (command.find_first_of(kSpecial) != string::npos)
+    return false;
+
+  size_t pos = 0;
+  while ((pos = command.find_first_not_of(" \t", pos)) != string::npos) {
+    size_t end = command.find_first_of(" \t", pos);
+    if (end == string::npos)
+      end = command.size();
+    words->push_back(command.substr(pos, end - pos));
+    pos = end;
+  }
+  if (words->empty() || (*words)[0].find('=') != string::npos)
+    return false;
+
+  // Those that have no program of the same name, or that must change the
+  // shell itself.
+  static const char* const kBuiltins[] = {
+    ".",        ":",        "alias",    "bg",       "break",    "case",     "cd",       "command",
+    "continue", "do",       "done",     "elif",     "else",     "esac",     "eval",     "exec",
+    "exit",     "export",   "fc",       "fg",       "fi",       "for",      "getopts",  "hash",
+    "if",       "jobs",     "read",     "readonly", "return",   "set",      "shift",    "then",
+    "times",    "trap",     "type",     "ulimit",   "umask",    "unalias",  "unset",    "until",
+    "wait",     "while",
+  };
+  for (size_t i = 0; i < sizeof(kBuiltins) / sizeof(kBuiltins[0]); ++i) {
+    if ((*words)[0] == kBuiltins[i])
+      return false;
+  }
+  return true;
+}
+
+}  // anonymous namespace
+
+#ifdef USE_EPOLL
+namespace {
+
+/// @return a pidfd for \a pid, or -1 if the kernel (before 5.3) or the
+/// headers know of none.
+int PidfdOpen(pid_t pid) {
+#ifdef SYS_pidfd_open
+  return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+  return -1;
+#endif
+}
+
+}  // anonymous namespace
+#endif  // USE_EPOLL
+
+namespace {
+
+/// Write all of \a data to \a fd, holding back the SIGPIPE of a reader
+/// that is gone.
+/// @return false, with errno set, on failure.
+bool WriteAll(int fd, const string& data) {
+  sigset_t pipe_set, old_set;
+  sigemptyset(&pipe_set);
+  sigaddset(&pipe_set, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+  size_t written = 0;
+  while (written < data.size()) {
+    ssize_t ret = write(fd, data.data() + written, data.size() - written);
+    if (ret < 0 && errno == EINTR)
+      continue;
+    if (ret < 0)
+      break;
+    written += ret;
+  }
+  int saved_errno = errno;
+  sigset_t pending;
+  int signum;
+  if (!sigismember(&old_set, SIGPIPE) && sigpending(&pending) == 0 && sigismember(&pending, SIGPIPE))
+    sigwait(&pipe_set, &signum);
+  pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+  errno = saved_errno;
+  return written == data.size();
+}
+
+}  // anonymous namespace
+
+Worker::Worker(const string& command)
+    : command_(command), busy_(false), broken_(false), pid_(-1), in_fd_(-1), out_fd_(-1) {}
+
+Worker::~Worker() {
+  close(in_fd_);
+  close(out_fd_);
+  // An idle worker would exit now that its stdin is closed, but need not
+  // take its time about it.
+  kill(-pid_, SIGTERM);
+  // Give it a second to go, then see that a worker that ignores SIGTERM or
+  // is wedged cannot hold up the build.
+  int status;
+  for (int i = 0; i < 100; ++i) {
+    pid_t ret = waitpid(pid_, &status, WNOHANG);
+    if (ret == pid_ || (ret < 0 && errno != EINTR))
+      return;
+    usleep(10 * 1000);
+  }
+  kill(-pid_, SIGKILL);
+  while (waitpid(pid_, &status, 0) < 0 && errno == EINTR) {
+  }
+}
+
+Subprocess::Subprocess(bool use_console)
+    : fd_(-1),
+      pid_(-1),
+      worker_(NULL),
+      response_left_(-1),
+      exit_code_(0),
+#ifdef USE_EPOLL
+      pidfd_(-1),
+#endif
+      use_console_(use_console) {
+}
 
 Subprocess::~Subprocess() {
-  if (fd_ >= 0)
+  if (worker_ && fd_ >= 0) {
+    // The response will never be read; the worker is of no more use.
+    worker_->broken_ = true;
+    worker_->busy_ = false;
+  } else if (fd_ >= 0) {
     close(fd_);
+  }
+#ifdef USE_EPOLL
+  if (pidfd_ >= 0)
+    close(pidfd_);
+#endif
   // Reap child if forgotten.
   if (pid_ != -1)
     Finish();
@@ -51,12 +189,12 @@ bool Subprocess::Start(SubprocessSet* set, const string& command) {
   if (pipe(output_pipe) < 0)
     Fatal("pipe: %s", strerror(errno));
   fd_ = output_pipe[0];
-#if !defined(USE_PPOLL)
-  // If available, we use ppoll in DoWork(); otherwise we use pselect
-  // and so must avoid overly-large FDs.
+#if !defined(USE_EPOLL) && !defined(USE_PPOLL)
+  // If available, we use epoll or ppoll in DoWork(); otherwise we use
+  // pselect and so must avoid overly-large FDs.
   if (fd_ >= static_cast<int>(FD_SETSIZE))
     Fatal("pipe: %s", strerror(EMFILE));
-#endif  // !USE_PPOLL
+#endif  // !USE_EPOLL && !USE_PPOLL
   SetCloseOnExec(fd_);
 
   posix_spawn_file_actions_t action;
@@ -114,10 +252,23 @@ bool Subprocess::Start(SubprocessSet* set, const string& command) {
   if (err != 0)
     Fatal("posix_spawnattr_setflags: %s", strerror(err));
 
-  const char* spawned_args[] = {"/bin/sh", "-c", command.c_str(), NULL};
-  err = posix_spawn(&pid_, "/bin/sh", &action, &attr, const_cast<char**>(spawned_args), environ);
-  if (err != 0)
-    Fatal("posix_spawn: %s", strerror(err));
+  // Run a plain command line without a shell in between, if the program
+  // can be found and run; /bin/sh then reports why not, as it would have.
+  vector<string> words;
+  err = -1;
+  if (SplitPlainCommand(command, &words)) {
+    vector<char*> args;
+    for (vector<string>::iterator w = words.begin(); w != words.end(); ++w)
+      args.push_back(&(*w)[0]);
+    args.push_back(NULL);
+    err = posix_spawnp(&pid_, args[0], &action, &attr, &args[0], environ);
+  }
+  if (err != 0) {
+    const char* spawned_args[] = {"/bin/sh", "-c", command.c_str(), NULL};
+    err = posix_spawn(&pid_, "/bin/sh", &action, &attr, const_cast<char**>(spawned_args), environ);
+    if (err != 0)
+      Fatal("posix_spawn: %s", strerror(err));
+  }
 
   err = posix_spawnattr_destroy(&attr);
   if (err != 0)
@@ -127,28 +278,170 @@ bool Subprocess::Start(SubprocessSet* set, const string& command) {
     Fatal("posix_spawn_file_actions_destroy: %s", strerror(err));
 
   close(output_pipe[1]);
+
+#ifdef USE_EPOLL
+  // The pidfd, which is close-on-exec, reports the exit; the pipe is then
+  // drained without blocking.
+  pidfd_ = PidfdOpen(pid_);
+  if (pidfd_ >= 0 && fcntl(fd_, F_SETFL, O_NONBLOCK) < 0)
+    Fatal("fcntl: %s", strerror(errno));
+  epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.u64 = (uintptr_t)this;
+  if (epoll_ctl(set->epoll_fd_, EPOLL_CTL_ADD, fd_, &event) < 0)
+    Fatal("epoll_ctl: %s", strerror(errno));
+  // Tag the pidfd's events by the low bit of the (aligned) pointer.
+  event.data.u64 |= 1;
+  if (pidfd_ >= 0 && epoll_ctl(set->epoll_fd_, EPOLL_CTL_ADD, pidfd_, &event) < 0)
+    Fatal("epoll_ctl: %s", strerror(errno));
+#endif
   return true;
 }
 
+void Subprocess::StartRequest(SubprocessSet* set, Worker* worker, const string& request) {
+  worker_ = worker;
+  worker_->busy_ = true;
+  if (!WriteAll(worker_->in_fd_, to_string(request.size()) + "\n" + request)) {
+    AbandonWorker("cppcmake: worker '" + worker_->command_ + "': " + strerror(errno) + "\n");
+    return;
+  }
+  fd_ = worker_->out_fd_;
+#ifdef USE_EPOLL
+  epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.u64 = (uintptr_t)this;
+  if (epoll_ctl(set->epoll_fd_, EPOLL_CTL_ADD, fd_, &event) < 0)
+    Fatal("epoll_ctl: %s", strerror(errno));
+#else
+  (void)set;
+#endif
+}
+
+void Subprocess::OnResponseReady() {
+  ssize_t len;
+  if (response_left_ < 0) {
+    char buf[4 << 10];
+    len = read(fd_, buf, sizeof(buf));
+    if (len > 0) {
+      header_.append(buf, len);
+      size_t end = header_.find('\n');
+      if (end == string::npos) {
+        if (header_.size() > 64)
+          AbandonWorker("cppcmake: worker '" + worker_->command_ + "': bad response\n");
+        return;
+      }
+      long long length;
+      char extra;
+      header_[end] = '\0';
+      if (sscanf(header_.c_str(), "%d %lld%c", &exit_code_, &length, &extra) != 2 || length < 0 ||
+          header_.size() - end - 1 > (unsigned long long)length) {
+        AbandonWorker("cppcmake: worker '" + worker_->command_ + "': bad response\n");
+        return;
+      }
+      output_.Append(header_.data() + end + 1, header_.size() - end - 1);
+      response_left_ = length - (header_.size() - end - 1);
+      header_.clear();
+    }
+  } else {
+    size_t size;
+    char* buf = output_.Prepare(&size);
+    len = read(fd_, buf, (size_t)min<int64_t>(size, response_left_));
+    if (len > 0) {
+      output_.Commit(len);
+      response_left_ -= len;
+    }
+  }
+  if (len < 0 && (errno == EAGAIN || errno == EINTR))
+    return;
+  if (len <= 0) {
+    AbandonWorker("cppcmake: worker '" + worker_->command_ + "' " +
+                  (len < 0 ? strerror(errno) : "exited without a response") + "\n");
+    return;
+  }
+  if (response_left_ == 0) {
+    // The worker's stdout stays open for the next request.
+    fd_ = -1;
+    worker_->busy_ = false;
+  }
+}
+
+void Subprocess::AbandonWorker(const string& message) {
+  output_.Append(message.data(), message.size());
+  exit_code_ = 1;
+  fd_ = -1;
+  worker_->broken_ = true;
+  worker_->busy_ = false;
+}
+
 void Subprocess::OnPipeReady() {
-  char buf[4 << 10];
-  ssize_t len = read(fd_, buf, sizeof(buf));
+  if (worker_) {
+    OnResponseReady();
+    return;
+  }
+  size_t size;
+  char* buf = output_.Prepare(&size);
+  ssize_t len = read(fd_, buf, size);
   if (len > 0) {
-    buf_.append(buf, len);
+    output_.Commit(len);
+  } else if (len < 0 && errno == EAGAIN) {
+    return;
   } else {
     if (len < 0)
       Fatal("read: %s", strerror(errno));
+#ifdef USE_EPOLL
+    CloseFds();
+#else
     close(fd_);
     fd_ = -1;
+#endif
+  }
+}
+
+#ifdef USE_EPOLL
+void Subprocess::OnExit() {
+  // The pipe holds all that the process wrote before it exited.
+  ssize_t len;
+  for (;;) {
+    size_t size;
+    char* buf = output_.Prepare(&size);
+    if ((len = read(fd_, buf, size)) <= 0)
+      break;
+    output_.Commit(len);
   }
+  if (len < 0 && errno != EAGAIN)
+    Fatal("read: %s", strerror(errno));
+  CloseFds();
 }
 
+void Subprocess::CloseFds() {
+  // Closing them takes them out of the epoll set.
+  close(fd_);
+  fd_ = -1;
+  if (pidfd_ >= 0) {
+    close(pidfd_);
+    pidfd_ = -1;
+  }
+}
+#endif  // USE_EPOLL
+
 ExitStatus Subprocess::Finish() {
+  if (worker_)
+    return exit_code_ == 0 ? ExitSuccess : ExitFailure;
   assert(pid_ != -1);
   int status;
-  if (waitpid(pid_, &status, 0) < 0)
-    Fatal("waitpid(%d): %s", pid_, strerror(errno));
+  struct rusage usage;
+  if (wait4(pid_, &status, 0, &usage) < 0)
+    Fatal("wait4(%d): %s", pid_, strerror(errno));
   pid_ = -1;
+#ifdef __APPLE__
+  usage_.peak_rss_kb = usage.ru_maxrss / 1024;  // Bytes on macOS.
+#else
+  usage_.peak_rss_kb = usage.ru_maxrss;
+#endif
+  usage_.user_time_millis = (int64_t)usage.ru_utime.tv_sec * 1000 + usage.ru_utime.tv_usec / 1000;
+  usage_.system_time_millis = (int64_t)usage.ru_stime.tv_sec * 1000 + usage.ru_stime.tv_usec / 1000;
+  usage_.read_blocks = usage.ru_inblock;
+  usage_.written_blocks = usage.ru_oublock;
 
 #ifdef _AIX
   if (WIFEXITED(status) && WEXITSTATUS(status) & 0x80) {
@@ -175,8 +468,8 @@ bool Subprocess::Done() const {
   return fd_ == -1;
 }
 
-const string& Subprocess::GetOutput() const {
-  return buf_;
+string Subprocess::GetOutput() const {
+  return output_.str();
 }
 
 int SubprocessSet::interrupted_;
@@ -200,7 +493,7 @@ void SubprocessSet::HandlePendingInterruption() {
     interrupted_ = SIGHUP;
 }
 
-SubprocessSet::SubprocessSet() {
+SubprocessSet::SubprocessSet() : output_limit_(OutputBuffer::kDefaultLimit) {
   sigset_t set;
   sigemptyset(&set);
   sigaddset(&set, SIGINT);
@@ -218,10 +511,30 @@ SubprocessSet::SubprocessSet() {
     Fatal("sigaction: %s", strerror(errno));
   if (sigaction(SIGHUP, &act, &old_hup_act_) < 0)
     Fatal("sigaction: %s", strerror(errno));
+
+#ifdef USE_EPOLL
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ < 0)
+    Fatal("epoll_create1: %s", strerror(errno));
+  // The signals stay blocked, so instead of running the handler they wait
+  // for DoWork() to read them here.
+  signal_fd_ = signalfd(-1, &set, SFD_CLOEXEC | SFD_NONBLOCK);
+  if (signal_fd_ < 0)
+    Fatal("signalfd: %s", strerror(errno));
+  epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.u64 = 0;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, signal_fd_, &event) < 0)
+    Fatal("epoll_ctl: %s", strerror(errno));
+#endif
 }
 
 SubprocessSet::~SubprocessSet() {
   Clear();
+#ifdef USE_EPOLL
+  close(signal_fd_);
+  close(epoll_fd_);
+#endif
 
   if (sigaction(SIGINT, &old_int_act_, 0) < 0)
     Fatal("sigaction: %s", strerror(errno));
@@ -235,6 +548,7 @@ SubprocessSet::~SubprocessSet() {
 
 Subprocess* SubprocessSet::Add(const string& command, bool use_console) {
   Subprocess* subprocess = new Subprocess(use_console);
+  subprocess->output_.set_limit(output_limit_);
   if (!subprocess->Start(this, command)) {
     delete subprocess;
     return 0;
@@ -243,7 +557,106 @@ Subprocess* SubprocessSet::Add(const string& command, bool use_console) {
   return subprocess;
 }
 
-#ifdef USE_PPOLL
+Worker* SubprocessSet::StartWorker(const string& command) {
+  int in_pipe[2], out_pipe[2];
+  if (pipe(in_pipe) < 0 || pipe(out_pipe) < 0)
+    Fatal("pipe: %s", strerror(errno));
+#if !defined(USE_EPOLL) && !defined(USE_PPOLL)
+  if (out_pipe[0] >= static_cast<int>(FD_SETSIZE))
+    Fatal("pipe: %s", strerror(EMFILE));
+#endif  // !USE_EPOLL && !USE_PPOLL
+  SetCloseOnExec(in_pipe[1]);
+  SetCloseOnExec(out_pipe[0]);
+
+  posix_spawn_file_actions_t action;
+  int err = posix_spawn_file_actions_init(&action);
+  if (err != 0)
+    Fatal("posix_spawn_file_actions_init: %s", strerror(err));
+  if ((err = posix_spawn_file_actions_adddup2(&action, in_pipe[0], 0)) != 0 ||
+      (err = posix_spawn_file_actions_adddup2(&action, out_pipe[1], 1)) != 0 ||
+      (err = posix_spawn_file_actions_addclose(&action, in_pipe[0])) != 0 ||
+      (err = posix_spawn_file_actions_addclose(&action, out_pipe[1])) != 0)
+    Fatal("posix_spawn_file_actions: %s", strerror(err));
+
+  // Like a subprocess, the worker runs in its own process group, with the
+  // signal mask we found.
+  posix_spawnattr_t attr;
+  err = posix_spawnattr_init(&attr);
+  if (err != 0)
+    Fatal("posix_spawnattr_init: %s", strerror(err));
+  if ((err = posix_spawnattr_setsigmask(&attr, &old_mask_)) != 0 ||
+      (err = posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETPGROUP)) != 0)
+    Fatal("posix_spawnattr: %s", strerror(err));
+
+  Worker* worker = new Worker(command);
+  const char* spawned_args[] = {"/bin/sh", "-c", command.c_str(), NULL};
+  err = posix_spawn(&worker->pid_, "/bin/sh", &action, &attr, const_cast<char**>(spawned_args), environ);
+  if (err != 0)
+    Fatal("posix_spawn: %s", strerror(err));
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&action);
+
+  close(in_pipe[0]);
+  close(out_pipe[1]);
+  worker->in_fd_ = in_pipe[1];
+  worker->out_fd_ = out_pipe[0];
+  return worker;
+}
+
+Subprocess* SubprocessSet::AddRequest(Worker* worker, const string& request) {
+  assert(!worker->busy() && !worker->broken());
+  Subprocess* subprocess = new Subprocess(false);
+  subprocess->output_.set_limit(output_limit_);
+  subprocess->StartRequest(this, worker, request);
+  if (subprocess->Done())
+    finished_.push(subprocess);
+  else
+    running_.push_back(subprocess);
+  return subprocess;
+}
+
+#if defined(USE_EPOLL)
+bool SubprocessSet::DoWork() {
+  epoll_event events[64];
+  interrupted_ = 0;
+  int ret = epoll_wait(epoll_fd_, events, sizeof(events) / sizeof(events[0]), -1);
+  if (ret == -1) {
+    if (errno != EINTR) {
+      perror("ninja: epoll_wait");
+      return false;
+    }
+    return IsInterrupted();
+  }
+
+  for (int i = 0; i < ret; ++i) {
+    signalfd_siginfo info;
+    if (events[i].data.u64 == 0 && read(signal_fd_, &info, sizeof(info)) == sizeof(info))
+      interrupted_ = info.ssi_signo;
+  }
+  if (IsInterrupted())
+    return true;
+
+  for (int i = 0; i < ret; ++i) {
+    uint64_t data = events[i].data.u64;
+    Subprocess* subproc = (Subprocess*)(uintptr_t)(data & ~(uint64_t)1);
+    if (!subproc || subproc->Done())
+      continue;  // The signalfd, or a second event of a finished subprocess.
+    if (data & 1)
+      subproc->OnExit();
+    else
+      subproc->OnPipeReady();
+    if (subproc->Done()) {
+      if (subproc->worker_)
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, subproc->worker_->out_fd_, NULL);
+      finished_.push(subproc);
+      running_.erase(find(running_.begin(), running_.end(), subproc));
+    }
+  }
+
+  return IsInterrupted();
+}
+
+#elif defined(USE_PPOLL)
 bool SubprocessSet::DoWork() {
   vector<pollfd> fds;
   nfds_t nfds = 0;
@@ -291,7 +704,7 @@ bool SubprocessSet::DoWork() {
   return IsInterrupted();
 }
 
-#else   // !defined(USE_PPOLL)
+#else   // !defined(USE_EPOLL) && !defined(USE_PPOLL)
 bool SubprocessSet::DoWork() {
   fd_set set;
   int nfds = 0;
@@ -335,7 +748,7 @@ bool SubprocessSet::DoWork() {
 
   return IsInterrupted();
 }
-#endif  // !defined(USE_PPOLL)
+#endif  // USE_EPOLL, USE_PPOLL
 
 Subprocess* SubprocessSet::NextFinished() {
   if (finished_.empty())
@@ -346,11 +759,19 @@ Subprocess* SubprocessSet::NextFinished() {
 }
 
 void SubprocessSet::Clear() {
-  for (vector<Subprocess*>::iterator i = running_.begin(); i != running_.end(); ++i)
+  for (vector<Subprocess*>::iterator i = running_.begin(); i != running_.end(); ++i) {
+    if (Worker* worker = (*i)->worker_) {
+#ifdef USE_EPOLL
+      epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, worker->out_fd_, NULL);
+#endif
+      kill(-worker->pid_, interrupted_);
+      continue;
+    }
     // Since the foreground process is in our process group, it will receive
     // the interruption signal (i.e. SIGINT or SIGTERM) at the same time as us.
     if (!(*i)->use_console_)
       kill(-(*i)->pid_, interrupted_);
+  }
   for (vector<Subprocess*>::iterator i = running_.begin(); i != running_.end(); ++i)
     delete *i;
   running_.clear();
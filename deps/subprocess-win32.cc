@@ -15,6 +15,7 @@
 #include "subprocess.h"
 
 #include <assert.h>
+#include <psapi.h>
 #include <stdio.h>
 
 #include <algorithm>
@@ -109,9 +110,8 @@ bool Subprocess::Start(SubprocessSet* set, const string& command) {
       CloseHandle(nul);
       pipe_ = NULL;
       // child_ is already NULL;
-      buf_ =
-          "CreateProcess failed: The system cannot find the file "
-          "specified.\n";
+      static const char kMessage[] = "CreateProcess failed: The system cannot find the file specified.\n";
+      output_.Append(kMessage, sizeof(kMessage) - 1);
       return true;
     } else {
       fprintf(stderr, "\nCreateProcess failed. Command attempted:\n\"%s\"\n", command.c_str());
@@ -152,11 +152,15 @@ void Subprocess::OnPipeReady() {
   }
 
   if (is_reading_ && bytes)
-    buf_.append(overlapped_buf_, bytes);
+    output_.Commit(bytes);
 
+  // The read goes straight into the output buffer, whose chunks stay put
+  // until it completes.
   memset(&overlapped_, 0, sizeof(overlapped_));
   is_reading_ = true;
-  if (!::ReadFile(pipe_, overlapped_buf_, sizeof(overlapped_buf_), &bytes, &overlapped_)) {
+  size_t size;
+  char* buf = output_.Prepare(&size);
+  if (!::ReadFile(pipe_, buf, (DWORD)size, &bytes, &overlapped_)) {
     if (GetLastError() == ERROR_BROKEN_PIPE) {
       CloseHandle(pipe_);
       pipe_ = NULL;
@@ -180,6 +184,21 @@ ExitStatus Subprocess::Finish() {
   DWORD exit_code = 0;
   GetExitCodeProcess(child_, &exit_code);
 
+  PROCESS_MEMORY_COUNTERS counters;
+  if (K32GetProcessMemoryInfo(child_, &counters, sizeof(counters)))
+    usage_.peak_rss_kb = counters.PeakWorkingSetSize / 1024;
+  FILETIME creation, exit, kernel, user;
+  if (GetProcessTimes(child_, &creation, &exit, &kernel, &user)) {
+    // In units of 100ns.
+    usage_.user_time_millis = ((int64_t)user.dwHighDateTime << 32 | user.dwLowDateTime) / 10000;
+    usage_.system_time_millis = ((int64_t)kernel.dwHighDateTime << 32 | kernel.dwLowDateTime) / 10000;
+  }
+  IO_COUNTERS io;
+  if (GetProcessIoCounters(child_, &io)) {
+    usage_.read_blocks = io.ReadTransferCount / 512;
+    usage_.written_blocks = io.WriteTransferCount / 512;
+  }
+
   CloseHandle(child_);
   child_ = NULL;
 
@@ -190,13 +209,17 @@ bool Subprocess::Done() const {
   return pipe_ == NULL;
 }
 
-const string& Subprocess::GetOutput() const {
-  return buf_;
+string Subprocess::GetOutput() const {
+  return output_.str();
 }
 
+Worker::Worker(const string& command) : command_(command), busy_(false), broken_(false) {}
+
+Worker::~Worker() {}
+
 HANDLE SubprocessSet::ioport_;
 
-SubprocessSet::SubprocessSet() {
+SubprocessSet::SubprocessSet() : output_limit_(OutputBuffer::kDefaultLimit) {
   ioport_ = ::CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
   if (!ioport_)
     Win32Fatal("CreateIoCompletionPort");
@@ -223,6 +246,7 @@ BOOL WINAPI SubprocessSet::NotifyInterrupted(DWORD dwCtrlType) {
 
 Subprocess* SubprocessSet::Add(const string& command, bool use_console) {
   Subprocess* subprocess = new Subprocess(use_console);
+  subprocess->output_.set_limit(output_limit_);
   if (!subprocess->Start(this, command)) {
     delete subprocess;
     return 0;
@@ -234,6 +258,14 @@ Subprocess* SubprocessSet::Add(const string& command, bool use_console) {
   return subprocess;
 }
 
+Worker* SubprocessSet::StartWorker(const string& command) {
+  return NULL;
+}
+
+Subprocess* SubprocessSet::AddRequest(Worker* worker, const string& request) {
+  return NULL;
+}
+
 bool SubprocessSet::DoWork() {
   DWORD bytes_read;
   Subprocess* subproc;
@@ -34,6 +34,45 @@
 #endif
 
 #include "exit_status.h"
+#include "output_buffer.h"
+#include "resource_usage.h"
+
+/// A long-lived process that runs commands one at a time for a build,
+/// sparing each the cost of starting the tool.  Each request and response
+/// on its stdin and stdout starts with a header line that gives the length
+/// of what follows: a request is "LENGTH\n" and the command line, and the
+/// response "EXIT_CODE LENGTH\n" and the command's output.  The worker's
+/// stderr is the build's.  It should exit at the end of its stdin.
+struct Worker {
+  /// Stop the worker, whether or not a request is in flight.
+  ~Worker();
+
+  const std::string& command() const { return command_; }
+  /// Whether a request is in flight.
+  bool busy() const { return busy_; }
+  /// Whether the worker died, broke the protocol or was interrupted; it
+  /// takes no more requests.
+  bool broken() const { return broken_; }
+
+ private:
+  explicit Worker(const std::string& command);
+
+  std::string command_;
+  bool busy_;
+  bool broken_;
+#ifndef _WIN32
+  pid_t pid_;
+  /// The worker's stdin and stdout.
+  int in_fd_;
+  int out_fd_;
+#endif
+
+  friend struct Subprocess;
+  friend struct SubprocessSet;
+
+  Worker(const Worker&);
+  void operator=(const Worker&);
+};
 
 /// Subprocess wraps a single async subprocess.  It is entirely
 /// passive: it expects the caller to notify it when its fds are ready
@@ -48,14 +87,39 @@ struct Subprocess {
 
   bool Done() const;
 
-  const std::string& GetOutput() const;
+  /// A copy of the output so far.
+  std::string GetOutput() const;
+  /// Move the output into \a out, once the subprocess is done.
+  void TakeOutput(std::string* out) { output_.Take(out); }
+
+  /// What the process cost, once Finish() has reaped it.
+  const ResourceUsage& GetResourceUsage() const { return usage_; }
 
  private:
   Subprocess(bool use_console);
   bool Start(struct SubprocessSet* set, const std::string& command);
+#ifndef _WIN32
+  /// Send \a request to \a worker; this subprocess then stands for the
+  /// request until the response is in.
+  void StartRequest(struct SubprocessSet* set, Worker* worker, const std::string& request);
+  /// Read some of the response, and give up on the worker if it ends or
+  /// breaks the protocol.
+  void OnResponseReady();
+  /// Fail the request and stop using the worker.
+  void AbandonWorker(const std::string& message);
+#endif
   void OnPipeReady();
+#ifdef USE_EPOLL
+  /// Called when pidfd_ reports that the process exited: take what output
+  /// is left in the pipe and stop reading, even if a process the command
+  /// left behind still holds the pipe open.
+  void OnExit();
+  /// Stop watching the process: close fd_ and pidfd_.
+  void CloseFds();
+#endif
 
-  std::string buf_;
+  OutputBuffer output_;
+  ResourceUsage usage_;
 
 #ifdef _WIN32
   /// Set up pipe_ as the parent-side pipe of the subprocess; return the
@@ -65,25 +129,45 @@ struct Subprocess {
   HANDLE child_;
   HANDLE pipe_;
   OVERLAPPED overlapped_;
-  char overlapped_buf_[4 << 10];
   bool is_reading_;
 #else
   int fd_;
   pid_t pid_;
+  /// For a request, the worker it went to; fd_ is the worker's stdout
+  /// until the response is in.
+  Worker* worker_;
+  /// The response's header line as it arrives.
+  std::string header_;
+  /// The bytes of the response still to read, or -1 before the header.
+  int64_t response_left_;
+  int exit_code_;
+#ifdef USE_EPOLL
+  /// A pidfd that becomes readable when the process exits, or -1 if the
+  /// kernel has none; then the subprocess is done at EOF on fd_ alone.
+  int pidfd_;
+#endif
 #endif
   bool use_console_;
 
   friend struct SubprocessSet;
 };
 
-/// SubprocessSet runs a ppoll/pselect() loop around a set of Subprocesses.
-/// DoWork() waits for any state change in subprocesses; finished_
-/// is a queue of subprocesses as they finish.
+/// SubprocessSet runs an event loop around a set of Subprocesses: on
+/// Linux, one epoll set that holds each subprocess' output pipe and pidfd
+/// and a signalfd for interruptions; elsewhere, ppoll/pselect() over the
+/// output pipes.  DoWork() waits for any state change in subprocesses;
+/// finished_ is a queue of subprocesses as they finish.
 struct SubprocessSet {
   SubprocessSet();
   ~SubprocessSet();
 
   Subprocess* Add(const std::string& command, bool use_console = false);
+  /// Start a Worker that runs \a command.
+  /// @return NULL where there are no workers (Windows).
+  Worker* StartWorker(const std::string& command);
+  /// Send \a request to the idle \a worker.  The Subprocess returned is
+  /// done when the response is, and its output and status are the response's.
+  Subprocess* AddRequest(Worker* worker, const std::string& request);
   bool DoWork();
   Subprocess* NextFinished();
   void Clear();
@@ -91,6 +175,10 @@ struct SubprocessSet {
   std::vector<Subprocess*> running_;
   std::queue<Subprocess*> finished_;
 
+  /// Bytes of each subprocess' output to hold in memory, past which the
+  /// output waits in a temporary file; 0 for no limit.
+  size_t output_limit_;
+
 #ifdef _WIN32
   static BOOL WINAPI NotifyInterrupted(DWORD dwCtrlType);
   static HANDLE ioport_;
@@ -109,6 +197,11 @@ struct SubprocessSet {
   struct sigaction old_term_act_;
   struct sigaction old_hup_act_;
   sigset_t old_mask_;
+#ifdef USE_EPOLL
+  int epoll_fd_;
+  /// Reads the SIGINT, SIGTERM and SIGHUP that the mask holds back.
+  int signal_fd_;
+#endif
 #endif
 };
 
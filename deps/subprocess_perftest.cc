@@ -0,0 +1,128 @@
+// Copyright (c) 2024 Aniket Ray
+//
+// Licensed under the MIT License; see LICENSE.txt.
+
+// Times SubprocessSet on thousands of trivial commands: first run |jobs|
+// at a time, directly or through /bin/sh, then one at a time beside |jobs|
+// idle commands, which every wakeup of a poll loop has to look over.  The
+// CPU time is this process' own, spent spawning, waiting and reaping.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "metrics.h"
+#include "subprocess.h"
+
+using namespace std;
+
+namespace {
+
+/// The CPU time this process has used, not counting its children.
+int64_t CpuMillis() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return (int64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000 +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000;
+}
+
+/// Run |count| copies of |command|, |jobs| at a time, and print how long
+/// that took.  @return false if one failed.
+bool Run(SubprocessSet* subprocs, const char* label, const string& command, int count, int jobs) {
+  int started = 0, finished = 0;
+  int64_t start = GetTimeMillis();
+  int64_t start_cpu = CpuMillis();
+  while (finished < count) {
+    while (started < count && started - finished < jobs) {
+      if (!subprocs->Add(command))
+        return false;
+      ++started;
+    }
+    if (subprocs->DoWork())
+      return false;
+    while (Subprocess* subproc = subprocs->NextFinished()) {
+      ExitStatus status = subproc->Finish();
+      delete subproc;
+      if (status != ExitSuccess)
+        return false;
+      ++finished;
+    }
+  }
+  int64_t millis = GetTimeMillis() - start;
+  printf("  %-28s %6dms  %7.0f/s  %6dms cpu\n", label, (int)millis, count * 1000.0 / (millis ? millis : 1),
+         (int)(CpuMillis() - start_cpu));
+  return true;
+}
+
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+  int count = argc > 1 ? atoi(argv[1]) : 5000;
+  int jobs = argc > 2 ? atoi(argv[2]) : 256;
+
+#if defined(USE_EPOLL)
+  printf("epoll, %d commands\n", count);
+#elif defined(USE_PPOLL)
+  printf("ppoll, %d commands\n", count);
+#else
+  printf("pselect, %d commands\n", count);
+#endif
+
+  char prefix[64];
+  snprintf(prefix, sizeof(prefix), "/tmp/subprocess_perftest-%d", (int)getpid());
+  string file = string(prefix) + ".a", copy = string(prefix) + ".b", fifo = string(prefix) + ".fifo";
+
+  // A trailing ';' makes the shell run the command.
+  struct {
+    const char* label;
+    string command;
+  } tiny[] = {
+    { "true", "true" },
+    { "true, through /bin/sh", "true ;" },
+    { "touch", "touch " + file },
+    { "touch, through /bin/sh", "touch " + file + " ;" },
+    { "cp", "cp " + file + " " + copy },
+    { "cp, through /bin/sh", "cp " + file + " " + copy + " ;" },
+  };
+  SubprocessSet subprocs;
+  printf("%d at a time\n", jobs);
+  bool ok = true;
+  for (size_t i = 0; i < sizeof(tiny) / sizeof(tiny[0]) && ok; ++i)
+    ok = Run(&subprocs, tiny[i].label, tiny[i].command, count, jobs);
+  unlink(file.c_str());
+  unlink(copy.c_str());
+  if (!ok) {
+    fprintf(stderr, "a command failed\n");
+    return 1;
+  }
+
+  // The idle commands wait to read a fifo, and exit once it is opened and
+  // closed for writing.
+  if (mkfifo(fifo.c_str(), 0600) < 0) {
+    perror("mkfifo");
+    return 1;
+  }
+  for (int i = 0; i < jobs; ++i)
+    subprocs.Add("cat < " + fifo);
+  char label[64];
+  snprintf(label, sizeof(label), "1 at a time beside %d idle", jobs);
+  ok = Run(&subprocs, label, "true", count / 5, 1);
+  close(open(fifo.c_str(), O_WRONLY));
+  unlink(fifo.c_str());
+  while (!subprocs.running_.empty())
+    subprocs.DoWork();
+  while (Subprocess* subproc = subprocs.NextFinished()) {
+    subproc->Finish();
+    delete subproc;
+  }
+  if (!ok) {
+    fprintf(stderr, "a command failed\n");
+    return 1;
+  }
+  return 0;
+}
@@ -14,11 +14,13 @@
 
 #include "subprocess.h"
 
+#include "metrics.h"
 #include "test.h"
 
 #ifndef _WIN32
 // SetWithLots need setrlimit.
 #include <stdio.h>
+#include <stdlib.h>
 #include <sys/resource.h>
 #include <sys/time.h>
 #include <unistd.h>
@@ -246,6 +248,69 @@ TEST_F(SubprocessTest, SetWithLots) {
 }
 #endif  // !__APPLE__ && !_WIN32
 
+#ifndef _WIN32
+#ifdef __linux__
+// A command line with nothing for the shell to do runs without one.
+TEST_F(SubprocessTest, DirectExec) {
+  Subprocess* subproc = subprocs_.Add("head -c 200 /proc/self/stat");
+  ASSERT_NE((Subprocess*)0, subproc);
+  while (!subproc->Done())
+    subprocs_.DoWork();
+  ASSERT_EQ(ExitSuccess, subproc->Finish());
+  // "pid (comm) state ppid ..."
+  const string& stat = subproc->GetOutput();
+  size_t ppid = stat.find(") ");
+  ASSERT_NE(string::npos, ppid);
+  EXPECT_EQ(getpid(), atoi(stat.c_str() + ppid + 4));
+}
+#endif  // __linux__
+
+// Builtins and variable assignments still go through the shell.
+TEST_F(SubprocessTest, ShellBuiltins) {
+  Subprocess* cd = subprocs_.Add("cd /");
+  Subprocess* env = subprocs_.Add("CPPCMAKE_TEST_VAR=1 env");
+  ASSERT_NE((Subprocess*)0, cd);
+  ASSERT_NE((Subprocess*)0, env);
+  while (!cd->Done() || !env->Done())
+    subprocs_.DoWork();
+  EXPECT_EQ(ExitSuccess, cd->Finish());
+  EXPECT_EQ(ExitSuccess, env->Finish());
+  EXPECT_NE(string::npos, env->GetOutput().find("CPPCMAKE_TEST_VAR=1\n"));
+}
+
+// Output past the limit waits in a temporary file and comes back whole.
+TEST_F(SubprocessTest, SpillOutput) {
+  subprocs_.output_limit_ = 1000;
+  Subprocess* subproc = subprocs_.Add("seq 20000");
+  ASSERT_NE((Subprocess*)0, subproc);
+  while (!subproc->Done())
+    subprocs_.DoWork();
+  ASSERT_EQ(ExitSuccess, subproc->Finish());
+
+  string expected;
+  for (int i = 1; i <= 20000; ++i)
+    expected += to_string(i) + "\n";
+  string output;
+  subproc->TakeOutput(&output);
+  EXPECT_EQ(expected, output);
+  EXPECT_EQ("", subproc->GetOutput());
+}
+#endif  // !_WIN32
+
+#ifdef USE_EPOLL
+// A command is done when its process exits, even if a process it left
+// behind still holds the output pipe.  (Without a pidfd, before Linux 5.3,
+// it is done when that process exits too.)
+TEST_F(SubprocessTest, BackgroundChild) {
+  Subprocess* subproc = subprocs_.Add("sleep 2 & echo started");
+  ASSERT_NE((Subprocess*)0, subproc);
+  while (!subproc->Done())
+    subprocs_.DoWork();
+  ASSERT_EQ(ExitSuccess, subproc->Finish());
+  EXPECT_EQ("started\n", subproc->GetOutput());
+}
+#endif  // USE_EPOLL
+
 // TODO: this test could work on Windows, just not sure how to simply
 // read stdin.
 #ifndef _WIN32
@@ -260,3 +325,86 @@ TEST_F(SubprocessTest, ReadStdin) {
   ASSERT_EQ(1u, subprocs_.finished_.size());
 }
 #endif  // _WIN32
+
+#ifndef _WIN32
+// A worker in sh: it runs each command it is sent with $N set to the
+// number of the request.
+const char kTestWorker[] =
+    "tmp=$(mktemp) && trap 'rm -f $tmp' EXIT && i=0 && "
+    "while read -r n; do "
+    "  i=$((i+1)); cmd=$(head -c $n); "
+    "  N=$i sh -c \"$cmd\" > $tmp 2>&1; status=$?; "
+    "  printf '%d %d\\n' $status $(wc -c < $tmp); cat $tmp; "
+    "done";
+
+/// Send \a request to \a worker and wait for the response.
+Subprocess* RunRequest(SubprocessSet* subprocs, Worker* worker, const string& request) {
+  Subprocess* subproc = subprocs->AddRequest(worker, request);
+  while (!subproc->Done())
+    subprocs->DoWork();
+  return subproc;
+}
+
+TEST_F(SubprocessTest, Worker) {
+  Worker* worker = subprocs_.StartWorker(kTestWorker);
+  ASSERT_NE((Worker*)0, worker);
+
+  // One worker serves each request in turn.
+  Subprocess* first = RunRequest(&subprocs_, worker, "echo request $N");
+  EXPECT_FALSE(worker->busy());
+  Subprocess* second = RunRequest(&subprocs_, worker, "echo request $N; echo oops >&2; exit 3");
+  EXPECT_EQ(ExitSuccess, first->Finish());
+  EXPECT_EQ("request 1\n", first->GetOutput());
+  EXPECT_EQ(ExitFailure, second->Finish());
+  EXPECT_EQ("request 2\noops\n", second->GetOutput());
+  EXPECT_FALSE(worker->broken());
+
+  // An empty response, and one that takes several reads.
+  Subprocess* third = RunRequest(&subprocs_, worker, "true");
+  Subprocess* fourth = RunRequest(&subprocs_, worker, "seq 20000");
+  EXPECT_EQ(ExitSuccess, third->Finish());
+  EXPECT_EQ("", third->GetOutput());
+  EXPECT_EQ(ExitSuccess, fourth->Finish());
+  EXPECT_EQ(108894u, fourth->GetOutput().size());
+  EXPECT_EQ(4u, subprocs_.finished_.size());
+
+  delete first;
+  delete second;
+  delete third;
+  delete fourth;
+  delete worker;
+}
+
+TEST_F(SubprocessTest, WorkerExits) {
+  Worker* worker = subprocs_.StartWorker("read -r n; exit 0");
+  ASSERT_NE((Worker*)0, worker);
+  Subprocess* subproc = RunRequest(&subprocs_, worker, "true");
+  EXPECT_EQ(ExitFailure, subproc->Finish());
+  EXPECT_NE(string::npos, subproc->GetOutput().find("exited without a response"));
+  EXPECT_TRUE(worker->broken());
+  delete subproc;
+  delete worker;
+}
+
+TEST_F(SubprocessTest, WorkerBadResponse) {
+  Worker* worker = subprocs_.StartWorker("read -r n; echo hello; sleep 10");
+  ASSERT_NE((Worker*)0, worker);
+  Subprocess* subproc = RunRequest(&subprocs_, worker, "true");
+  EXPECT_EQ(ExitFailure, subproc->Finish());
+  EXPECT_NE(string::npos, subproc->GetOutput().find("bad response"));
+  EXPECT_TRUE(worker->broken());
+  delete subproc;
+  delete worker;
+}
+
+TEST_F(SubprocessTest, WorkerIgnoresSigterm) {
+  // Neither the end of its stdin nor SIGTERM stops this worker; it must be
+  // killed rather than waited on forever.
+  Worker* worker = subprocs_.StartWorker("trap '' TERM; while :; do sleep 1; done");
+  ASSERT_NE((Worker*)0, worker);
+  usleep(100 * 1000);  // Let the shell install its trap.
+  int64_t start = GetTimeMillis();
+  delete worker;
+  EXPECT_LT(GetTimeMillis() - start, 5000);
+}
+#endif  // !_WIN32
@@ -114,12 +114,13 @@ void VerifyGraph(const State& state) {
     // All edges need at least one output.
     EXPECT_FALSE((*e)->outputs_.empty());
     // Check that the edge's inputs have the edge as out-edge.
-    for (vector<Node*>::const_iterator in_node = (*e)->inputs_.begin(); in_node != (*e)->inputs_.end(); ++in_node) {
-      const vector<Edge*>& out_edges = (*in_node)->out_edges();
+    for (ArenaVector<Node*>::const_iterator in_node = (*e)->inputs_.begin(); in_node != (*e)->inputs_.end();
+         ++in_node) {
+      const ArenaVector<Edge*>& out_edges = (*in_node)->out_edges();
       EXPECT_NE(find(out_edges.begin(), out_edges.end(), *e), out_edges.end());
     }
     // Check that the edge's outputs have the edge as in-edge.
-    for (vector<Node*>::const_iterator out_node = (*e)->outputs_.begin(); out_node != (*e)->outputs_.end();
+    for (ArenaVector<Node*>::const_iterator out_node = (*e)->outputs_.begin(); out_node != (*e)->outputs_.end();
          ++out_node) {
       EXPECT_EQ((*out_node)->in_edge(), *e);
     }
@@ -163,7 +164,10 @@ bool VirtualFileSystem::MakeDir(const string& path) {
 }
 
 FileReader::Status VirtualFileSystem::ReadFile(const string& path, string* contents, string* err) {
-  files_read_.push_back(path);
+  {
+    std::lock_guard<std::mutex> lock(files_read_mutex_);
+    files_read_.push_back(path);
+  }
   FileMap::iterator i = files_.find(path);
   if (i != files_.end()) {
     *contents = i->second.contents;
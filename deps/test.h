@@ -15,6 +15,8 @@
 #ifndef NINJA_TEST_H_
 #define NINJA_TEST_H_
 
+#include <mutex>
+
 #include <gtest/gtest.h>
 
 #include "disk_interface.h"
@@ -80,6 +82,9 @@ struct VirtualFileSystem : public DiskInterface {
 
   /// A simple fake timestamp for file operations.
   int now_;
+
+  /// Guards files_read_, as ReadFile() may be called from parser threads.
+  std::mutex files_read_mutex_;
 };
 
 struct ScopedTempDir {
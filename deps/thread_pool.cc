@@ -0,0 +1,54 @@
+// Copyright (c) 2024 Aniket Ray
+//
+// Licensed under the MIT License; see LICENSE.txt.
+
+#include "thread_pool.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool(int threads) {
+  workers_.reserve(threads);
+  for (int i = 0; i < threads; ++i)
+    workers_.emplace_back(&ThreadPool::Work, this);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    unique_lock<mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  work_available_.notify_all();
+  for (vector<thread>::iterator i = workers_.begin(); i != workers_.end(); ++i)
+    i->join();
+}
+
+void ThreadPool::Post(function<void()> task) {
+  {
+    unique_lock<mutex> lock(mutex_);
+    tasks_.push_back(std::move(task));
+  }
+  work_available_.notify_one();
+}
+
+void ThreadPool::Wait() {
+  unique_lock<mutex> lock(mutex_);
+  idle_.wait(lock, [this] { return tasks_.empty() && busy_ == 0; });
+}
+
+void ThreadPool::Work() {
+  unique_lock<mutex> lock(mutex_);
+  for (;;) {
+    work_available_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+    if (tasks_.empty())
+      return;  // Stopping, and nothing left to run.
+    function<void()> task = std::move(tasks_.front());
+    tasks_.pop_front();
+    ++busy_;
+    lock.unlock();
+    task();
+    lock.lock();
+    --busy_;
+    if (tasks_.empty() && busy_ == 0)
+      idle_.notify_all();
+  }
+}
@@ -0,0 +1,40 @@
+// Copyright (c) 2024 Aniket Ray
+//
+// Licensed under the MIT License; see LICENSE.txt.
+
+#ifndef NINJA_THREAD_POOL_H_
+#define NINJA_THREAD_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// A fixed set of worker threads running posted tasks in FIFO order.
+/// Tasks may post further tasks but must not wait on each other.
+struct ThreadPool {
+  explicit ThreadPool(int threads);
+
+  /// Runs every task already posted, then joins the workers.
+  ~ThreadPool();
+
+  void Post(std::function<void()> task);
+
+  /// Block until every posted task, including tasks they posted, has run.
+  void Wait();
+
+ private:
+  void Work();
+
+  std::mutex mutex_;
+  std::condition_variable work_available_;
+  std::condition_variable idle_;
+  std::deque<std::function<void()>> tasks_;
+  int busy_ = 0;
+  bool stopping_ = false;
+  std::vector<std::thread> workers_;
+};
+
+#endif  // NINJA_THREAD_POOL_H_
@@ -21,11 +21,13 @@
 #include <io.h>
 #include <share.h>
 #include <windows.h>
+#include <psapi.h>
 #endif
 
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <math.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -34,6 +36,8 @@
 #include <sys/types.h>
 
 #ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/time.h>
 #include <unistd.h>
 #endif
@@ -335,7 +339,7 @@ static inline bool IsKnownWin32SafeCharacter(char ch) {
   }
 }
 
-static inline bool StringNeedsShellEscaping(const string& input) {
+static inline bool StringNeedsShellEscaping(StringPiece input) {
   for (size_t i = 0; i < input.size(); ++i) {
     if (!IsKnownShellSafeCharacter(input[i]))
       return true;
@@ -343,7 +347,7 @@ static inline bool StringNeedsShellEscaping(const string& input) {
   return false;
 }
 
-static inline bool StringNeedsWin32Escaping(const string& input) {
+static inline bool StringNeedsWin32Escaping(StringPiece input) {
   for (size_t i = 0; i < input.size(); ++i) {
     if (!IsKnownWin32SafeCharacter(input[i]))
       return true;
@@ -351,11 +355,11 @@ static inline bool StringNeedsWin32Escaping(const string& input) {
   return false;
 }
 
-void GetShellEscapedString(const string& input, string* result) {
+void GetShellEscapedString(StringPiece input, string* result) {
   assert(result);
 
   if (!StringNeedsShellEscaping(input)) {
-    result->append(input);
+    result->append(input.str_, input.len_);
     return;
   }
 
@@ -364,8 +368,8 @@ void GetShellEscapedString(const string& input, string* result) {
 
   result->push_back(kQuote);
 
-  string::const_iterator span_begin = input.begin();
-  for (string::const_iterator it = input.begin(), end = input.end(); it != end; ++it) {
+  StringPiece::const_iterator span_begin = input.begin();
+  for (StringPiece::const_iterator it = input.begin(), end = input.end(); it != end; ++it) {
     if (*it == kQuote) {
       result->append(span_begin, it);
       result->append(kEscapeSequence);
@@ -376,10 +380,10 @@ void GetShellEscapedString(const string& input, string* result) {
   result->push_back(kQuote);
 }
 
-void GetWin32EscapedString(const string& input, string* result) {
+void GetWin32EscapedString(StringPiece input, string* result) {
   assert(result);
   if (!StringNeedsWin32Escaping(input)) {
-    result->append(input);
+    result->append(input.str_, input.len_);
     return;
   }
 
@@ -388,8 +392,8 @@ void GetWin32EscapedString(const string& input, string* result) {
 
   result->push_back(kQuote);
   size_t consecutive_backslash_count = 0;
-  string::const_iterator span_begin = input.begin();
-  for (string::const_iterator it = input.begin(), end = input.end(); it != end; ++it) {
+  StringPiece::const_iterator span_begin = input.begin();
+  for (StringPiece::const_iterator it = input.begin(), end = input.end(); it != end; ++it) {
     switch (*it) {
       case kBackslash:
         ++consecutive_backslash_count;
@@ -475,6 +479,60 @@ int ReadFile(const string& path, string* contents, string* err) {
 #endif
 }
 
+int MappedFile::Open(const string& path, string* err) {
+  Close();
+#ifdef _WIN32
+  int ret = ReadFile(path, &buffer_, err);
+  if (ret < 0)
+    return ret;
+  data_ = buffer_.data();
+  size_ = buffer_.size();
+  return 0;
+#else
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    err->assign(strerror(errno));
+    return -errno;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    int ret = -errno;
+    err->assign(strerror(errno));
+    close(fd);
+    return ret;
+  }
+  size_ = st.st_size;
+  if (size_ == 0) {
+    close(fd);
+    data_ = buffer_.data();
+    return 0;
+  }
+  void* addr = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  int ret = addr == MAP_FAILED ? -errno : 0;
+  if (ret < 0)
+    err->assign(strerror(errno));
+  close(fd);
+  if (ret < 0) {
+    size_ = 0;
+    return ret;
+  }
+  data_ = static_cast<const char*>(addr);
+  mapped_ = true;
+  return 0;
+#endif
+}
+
+void MappedFile::Close() {
+#ifndef _WIN32
+  if (mapped_)
+    munmap(const_cast<char*>(data_), size_);
+#endif
+  mapped_ = false;
+  data_ = nullptr;
+  size_ = 0;
+  buffer_.clear();
+}
+
 void SetCloseOnExec(int fd) {
 #ifndef _WIN32
   int flags = fcntl(fd, F_GETFD);
@@ -897,6 +955,66 @@ double GetLoadAverage() {
 }
 #endif  // _WIN32
 
+#ifdef _WIN32
+uint64_t GetPeakRSS() {
+  PROCESS_MEMORY_COUNTERS counters;
+  if (!K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    return 0;
+  return counters.PeakWorkingSetSize;
+}
+#else
+uint64_t GetPeakRSS() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+#ifdef __APPLE__
+  return usage.ru_maxrss;  // Already in bytes.
+#else
+  return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+}
+#endif  // _WIN32
+
+bool ParseMemorySize(const string& size, int64_t* kb) {
+  const char* start = size.c_str();
+  char* end;
+  double value = strtod(start, &end);
+  if (end == start || !isfinite(value) || value < 0)
+    return false;
+  double scale;
+  switch (*end) {
+    case '\0':
+      scale = 1024;  // A bare number is in MiB.
+      break;
+    case 'k':
+    case 'K':
+      scale = 1;
+      break;
+    case 'm':
+    case 'M':
+      scale = 1024;
+      break;
+    case 'g':
+    case 'G':
+      scale = 1024 * 1024;
+      break;
+    default:
+      return false;
+  }
+  if (*end != '\0') {
+    ++end;
+    if (*end == 'B' || *end == 'b')
+      ++end;
+    if (*end != '\0')
+      return false;
+  }
+  // INT64_MAX rounds up to 2^63 as a double, the first value out of range.
+  if (value * scale >= (double)INT64_MAX)
+    return false;
+  *kb = (int64_t)(value * scale);
+  return true;
+}
+
 string ElideMiddle(const string& str, size_t width) {
   switch (width) {
     case 0:
@@ -933,3 +1051,18 @@ bool Truncate(const string& path, size_t size, string* err) {
   }
   return true;
 }
+
+bool RenameFile(const string& from, const string& to, string* err) {
+#ifdef _WIN32
+  if (!MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+    *err = GetLastErrorString();
+    return false;
+  }
+#else
+  if (rename(from.c_str(), to.c_str()) < 0) {
+    *err = strerror(errno);
+    return false;
+  }
+#endif
+  return true;
+}
@@ -26,6 +26,8 @@
 #include <string>
 #include <vector>
 
+#include "string_piece.h"
+
 #if !defined(__has_cpp_attribute)
 #define __has_cpp_attribute(x) 0
 #endif
@@ -70,14 +72,36 @@ void CanonicalizePath(char* path, size_t* len, uint64_t* slash_bits);
 /// Bash, or Win32's CommandLineToArgvW().
 /// Appends the string directly to |result| without modification if we can
 /// determine that it contains no problematic characters.
-void GetShellEscapedString(const std::string& input, std::string* result);
-void GetWin32EscapedString(const std::string& input, std::string* result);
+void GetShellEscapedString(StringPiece input, std::string* result);
+void GetWin32EscapedString(StringPiece input, std::string* result);
 
 /// Read a file to a string (in text mode: with CRLF conversion
 /// on Windows).
 /// Returns -errno and fills in \a err on error.
 int ReadFile(const std::string& path, std::string* contents, std::string* err);
 
+/// A read-only view of a whole file: mmap()ed where available, read into
+/// memory otherwise.
+struct MappedFile {
+  MappedFile() = default;
+  ~MappedFile() { Close(); }
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  /// Returns -errno and fills in \a err on error.
+  int Open(const std::string& path, std::string* err);
+  void Close();
+
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+  bool mapped_ = false;
+  std::string buffer_;
+};
+
 /// Mark a file descriptor to not be inherited on exec()s.
 void SetCloseOnExec(int fd);
 
@@ -101,6 +125,15 @@ int GetProcessorCount();
 /// on error.
 double GetLoadAverage();
 
+/// @return the peak resident set size of this process in bytes, or 0 if
+/// it is unknown.
+uint64_t GetPeakRSS();
+
+/// Parse a memory size such as "512", "512M", "1.5G" or "800K" into KiB in
+/// @a kb.  A bare number is in MiB; a unit other than K, M or G, with or
+/// without a trailing B, is an error.  @return false if @a size is not one.
+bool ParseMemorySize(const std::string& size, int64_t* kb);
+
 /// Elide the given string @a str with '...' in the middle if the length
 /// exceeds @a width.
 std::string ElideMiddle(const std::string& str, size_t width);
@@ -108,6 +141,10 @@ std::string ElideMiddle(const std::string& str, size_t width);
 /// Truncates a file to the given size.
 bool Truncate(const std::string& path, size_t size, std::string* err);
 
+/// Moves the file \a from to \a to, replacing any file there in one step:
+/// whoever opens \a to, even after a crash, finds one or the other whole.
+bool RenameFile(const std::string& from, const std::string& to, std::string* err);
+
 #ifdef _MSC_VER
 #define snprintf _snprintf
 #define fileno _fileno
@@ -505,6 +505,44 @@ TEST(StripAnsiEscapeCodes, StripColors) {
   EXPECT_EQ("affixmgr.cxx:286:15: warning: using the result... [-Wparentheses]", stripped);
 }
 
+TEST(ParseMemorySize, Units) {
+  int64_t kb = -1;
+  EXPECT_TRUE(ParseMemorySize("512", &kb));
+  EXPECT_EQ(512 * 1024, kb);
+  EXPECT_TRUE(ParseMemorySize("800K", &kb));
+  EXPECT_EQ(800, kb);
+  EXPECT_TRUE(ParseMemorySize("2m", &kb));
+  EXPECT_EQ(2 * 1024, kb);
+  EXPECT_TRUE(ParseMemorySize("1.5GB", &kb));
+  EXPECT_EQ(1536 * 1024, kb);
+  EXPECT_TRUE(ParseMemorySize("0", &kb));
+  EXPECT_EQ(0, kb);
+  // A bare number is in MiB.
+  EXPECT_TRUE(ParseMemorySize("100", &kb));
+  EXPECT_EQ(100 * 1024, kb);
+  EXPECT_TRUE(ParseMemorySize("0.5", &kb));
+  EXPECT_EQ(512, kb);
+}
+
+TEST(ParseMemorySize, Invalid) {
+  int64_t kb = 7;
+  EXPECT_FALSE(ParseMemorySize("", &kb));
+  EXPECT_FALSE(ParseMemorySize("G", &kb));
+  EXPECT_FALSE(ParseMemorySize("-1G", &kb));
+  EXPECT_FALSE(ParseMemorySize("4T", &kb));
+  EXPECT_FALSE(ParseMemorySize("4 G", &kb));
+  EXPECT_FALSE(ParseMemorySize("100b", &kb));
+  EXPECT_FALSE(ParseMemorySize("100B", &kb));
+  EXPECT_FALSE(ParseMemorySize("100x", &kb));
+  EXPECT_FALSE(ParseMemorySize("1GiB", &kb));
+  EXPECT_FALSE(ParseMemorySize("inf", &kb));
+  EXPECT_FALSE(ParseMemorySize("infG", &kb));
+  EXPECT_FALSE(ParseMemorySize("nan", &kb));
+  EXPECT_FALSE(ParseMemorySize("1e300G", &kb));
+  EXPECT_FALSE(ParseMemorySize("9e12G", &kb));
+  EXPECT_EQ(7, kb);
+}
+
 TEST(ElideMiddle, NothingToElide) {
   string input = "Nothing to elide in this short string.";
   EXPECT_EQ(input, ElideMiddle(input, 80));
@@ -1,47 +1,192 @@
 #include "cppcmake_backend.hpp"
 
-std::string CppCmake::Make::getVar(const std::string& key) {
-  auto it = std::find_if(mappings_.begin(), mappings_.end(),
-                         [&key](const std::pair<std::string, std::string>& p) { return p.first == key; });
-  return it != mappings_.end() ? it->second : "";
+namespace {
+
+bool IsVarnameChar(char c, bool simple) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-' ||
+         (!simple && c == '.');
+}
+
+/// Skip spaces and $-newline continuations, like Lexer::EatWhitespace.
+void EatWhitespace(StringPiece in, size_t* pos) {
+  size_t p = *pos;
+  for (;;) {
+    if (p < in.size() && in[p] == ' ') {
+      ++p;
+    } else if (p + 1 < in.size() && in[p] == '$' && in[p + 1] == '\n') {
+      p += 2;
+    } else if (p + 2 < in.size() && in[p] == '$' && in[p + 1] == '\r' && in[p + 2] == '\n') {
+      p += 3;
+    } else {
+      break;
+    }
+  }
+  *pos = p;
+}
+
+/// Read a $-escaped string from \a in at \a *pos, with the same escapes as
+/// Lexer::ReadEvalString.  In \a path mode the string ends at an unescaped
+/// ' ', ':', '|' or newline and trailing whitespace is skipped.
+bool ReadEvalString(StringPiece in, size_t* pos, bool path, EvalString* eval, std::string* err) {
+  size_t p = *pos;
+  while (p < in.size()) {
+    size_t start = p;
+    while (p < in.size() && in[p] != '$' && in[p] != ' ' && in[p] != ':' && in[p] != '|' && in[p] != '\r' &&
+           in[p] != '\n')
+      ++p;
+    if (p != start)
+      eval->AddText(StringPiece(in.str_ + start, p - start));
+    if (p == in.size())
+      break;
+
+    char c = in[p];
+    if (c == '\r' || c == '\n') {
+      if (path)
+        break;
+      *err = "unexpected newline";
+      return false;
+    }
+    if (c != '$') {
+      if (path)
+        break;
+      eval->AddText(StringPiece(in.str_ + p, 1));
+      ++p;
+      continue;
+    }
+
+    // A $-escape.
+    char next = p + 1 < in.size() ? in[p + 1] : '\0';
+    if (next == '$' || next == ' ' || next == ':') {
+      eval->AddText(StringPiece(in.str_ + p + 1, 1));
+      p += 2;
+    } else if (next == '\n' || (next == '\r' && p + 2 < in.size() && in[p + 2] == '\n')) {
+      p += next == '\n' ? 2 : 3;
+      while (p < in.size() && in[p] == ' ')
+        ++p;
+    } else if (next == '{') {
+      size_t name_end = p + 2;
+      while (name_end < in.size() && IsVarnameChar(in[name_end], false))
+        ++name_end;
+      if (name_end == p + 2 || name_end == in.size() || in[name_end] != '}') {
+        *err = "bad $-escape (literal $ must be written as $$)";
+        return false;
+      }
+      eval->AddSpecial(StringPiece(in.str_ + p + 2, name_end - p - 2));
+      p = name_end + 1;
+    } else if (IsVarnameChar(next, true)) {
+      size_t name_end = p + 1;
+      while (name_end < in.size() && IsVarnameChar(in[name_end], true))
+        ++name_end;
+      eval->AddSpecial(StringPiece(in.str_ + p + 1, name_end - p - 1));
+      p = name_end;
+    } else {
+      *err = "bad $-escape (literal $ must be written as $$)";
+      return false;
+    }
+  }
+  *pos = p;
+  if (path)
+    EatWhitespace(in, pos);
+  return true;
 }
 
-CppCmake::Rule CppCmake::Make::getRule(const std::string& name) {
-  auto it = std::find_if(rules_.begin(), rules_.end(), [&name](const Rule& r) { return r.name == name; });
-  if (it != rules_.end()) {
-    return *it;
-  } else {
-    return Rule{};  // Return an empty Rule if not found
+/// Read paths from \a in until a separator or the end of input.
+bool ReadPaths(StringPiece in, size_t* pos, std::vector<EvalString>* paths, std::string* err) {
+  for (;;) {
+    EvalString path;
+    if (!ReadEvalString(in, pos, true, &path, err))
+      return false;
+    if (path.empty())
+      return true;
+    paths->push_back(path);
   }
 }
 
-CppCmake::BuildTarget CppCmake::Make::getBuildTarget(const std::string& src) {
-  auto it = std::find_if(builds_.begin(), builds_.end(), [&src](const BuildTarget& b) { return b.src == src; });
-  if (it != builds_.end()) {
-    return *it;
-  } else {
-    return BuildTarget{};  // Return an empty BuildTarget if not found
+/// Consume the separator \a sep ("|", "||" or "|@") at \a *pos, if present.
+bool ReadSeparator(StringPiece in, size_t* pos, StringPiece sep) {
+  size_t p = *pos;
+  if (in.size() - p < sep.size() || memcmp(in.str_ + p, sep.str_, sep.size()) != 0)
+    return false;
+  // A lone '|' must not match the start of "||" or "|@".
+  if (sep.size() == 1 && p + 1 < in.size() && (in[p + 1] == '|' || in[p + 1] == '@'))
+    return false;
+  *pos = p + sep.size();
+  EatWhitespace(in, pos);
+  return true;
+}
+
+void HashCombine(uint64_t* hash, uint64_t value) {
+  *hash = (*hash ^ value) * 0x9e3779b97f4a7c15ULL + (*hash >> 29);
+}
+
+/// Mix the length of \a s in ahead of its contents, so that neighbouring
+/// strings cannot run together.
+void HashCombine(uint64_t* hash, StringPiece s) {
+  HashCombine(hash, s.size());
+  HashCombine(hash, BuildLog::LogEntry::HashCommand(s));
+}
+
+/// Read the value \a text of a variable binding, skipping the whitespace
+/// that the lexer skips after the '=' of "name = value".
+bool ReadValue(StringPiece text, EvalString* eval, std::string* err) {
+  size_t pos = 0;
+  EatWhitespace(text, &pos);
+  return ReadEvalString(text, &pos, false, eval, err);
+}
+
+bool EvaluateValue(const std::string& text, Env* env, std::string* value, std::string* err) {
+  if (text.find_first_of("$\r\n") == std::string::npos) {
+    *value = text.substr(std::min(text.find_first_not_of(' '), text.size()));
+    return true;
   }
+  EvalString eval;
+  if (!ReadValue(text, &eval, err))
+    return false;
+  *value = eval.Evaluate(env);
+  return true;
 }
 
-std::string CppCmake::Make::getDefault() {
+}  // namespace
+
+const std::string& CppCmake::Make::getVar(const std::string& key) const {
+  static const std::string kEmpty;
+  auto it = var_index_.find(key);
+  return it != var_index_.end() ? *it->second : kEmpty;
+}
+
+const CppCmake::Rule& CppCmake::Make::getRule(const std::string& name) const {
+  static const Rule kEmpty{};  // Returned if not found
+  auto it = rule_index_.find(name);
+  return it != rule_index_.end() ? *it->second : kEmpty;
+}
+
+const CppCmake::BuildTarget& CppCmake::Make::getBuildTarget(const std::string& src) const {
+  static const BuildTarget kEmpty{};  // Returned if not found
+  auto it = build_index_.find(src);
+  return it != build_index_.end() ? *it->second : kEmpty;
+}
+
+const std::string& CppCmake::Make::getDefault() const {
   return default_;
 }
 
 void CppCmake::Make::setVar(std::string&& key, std::string&& val) {
-  mappings_.emplace_back(key, val);
+  auto& m = mappings_.emplace_back(std::move(key), std::move(val));
+  var_index_.emplace(m.first, &m.second);
 }
 
 void CppCmake::Make::setDefault(std::string&& def) {
-  this->default_ = def;
+  this->default_ = std::move(def);
 }
 
 void CppCmake::Make::addRule(Rule&& rule) {
-  this->rules_.emplace_back(rule);
+  const Rule& r = this->rules_.emplace_back(std::move(rule));
+  rule_index_.emplace(r.name, &r);
 }
 
 void CppCmake::Make::addBuildTarget(BuildTarget&& build) {
-  this->builds_.emplace_back(build);
+  const BuildTarget& b = this->builds_.emplace_back(std::move(build));
+  build_index_.emplace(b.src, &b);
 }
 
 std::string CppCmake::Make::generate_string_() {
@@ -54,15 +199,18 @@ std::string CppCmake::Make::generate_string_() {
   }
 
   // rule
-  for (auto r : this->rules_) {
+  for (const auto& r : this->rules_) {
     out += "rule " + r.name + "\n";
     out += "  ";
     out += "command = " + r.command + "\n";
     out += "  ";
-    out += "description = " + r.description + "\n\n";
+    out += "description = " + r.description + "\n";
+    for (const auto& b : r.bindings)
+      out += "  " + b.first + " = " + b.second + "\n";
+    out += "\n";
   }
 
-  for (auto b : this->builds_) {
+  for (const auto& b : this->builds_) {
     out += "build ";
     out += b.src + ": " + b.target + "\n";
     out += "\n";
@@ -73,6 +221,278 @@ std::string CppCmake::Make::generate_string_() {
   return out;
 }
 
+std::string CppCmake::Make::getManifest() {
+  return generate_string_();
+}
+
+uint64_t CppCmake::Make::contentHash(const ManifestParserOptions& options) const {
+  uint64_t hash = 0;
+  HashCombine(&hash, kCppCmakeVersion);
+  HashCombine(&hash, std::to_string(options.phony_cycle_action_));
+  HashCombine(&hash, cxx_);
+  HashCombine(&hash, cflags_);
+  // Count each section, so that entries cannot move from one to another.
+  HashCombine(&hash, mappings_.size());
+  for (const auto& m : mappings_) {
+    HashCombine(&hash, m.first);
+    HashCombine(&hash, m.second);
+  }
+  HashCombine(&hash, rules_.size());
+  for (const auto& r : rules_) {
+    HashCombine(&hash, r.name);
+    HashCombine(&hash, r.command);
+    HashCombine(&hash, r.description);
+    HashCombine(&hash, r.bindings.size());
+    for (const auto& b : r.bindings) {
+      HashCombine(&hash, b.first);
+      HashCombine(&hash, b.second);
+    }
+  }
+  HashCombine(&hash, builds_.size());
+  for (const auto& b : builds_) {
+    HashCombine(&hash, b.src);
+    HashCombine(&hash, b.target);
+  }
+  HashCombine(&hash, default_);
+  return hash;
+}
+
+bool CppCmake::Make::load(State* state, std::string* err, const ManifestParserOptions& options) {
+  METRIC_RECORD("make load");
+  BindingEnv* env = &state->bindings_;
+
+  // Same binding order as generate_string_(): later values may refer to
+  // earlier ones, so evaluate each as it is bound.
+  std::vector<std::pair<std::string, std::string>> bindings;
+  bindings.reserve(mappings_.size() + 2);
+  bindings.emplace_back("cxx", cxx_);
+  bindings.emplace_back("cflags", cflags_);
+  bindings.insert(bindings.end(), mappings_.begin(), mappings_.end());
+  for (const auto& b : bindings) {
+    std::string value;
+    if (!EvaluateValue(b.second, env, &value, err)) {
+      *err = "variable '" + b.first + "': " + *err;
+      return false;
+    }
+    if (b.first == "ninja_required_version")
+      CheckNinjaVersion(value);
+    env->AddBinding(b.first, value);
+  }
+
+  for (const auto& r : rules_) {
+    if (r.name.empty()) {
+      *err = "expected rule name";
+      return false;
+    }
+    if (env->LookupRuleCurrentScope(r.name) != NULL) {
+      *err = "duplicate rule '" + r.name + "'";
+      return false;
+    }
+    EvalString command, description;
+    if (!ReadValue(r.command, &command, err) || !ReadValue(r.description, &description, err))
+      return false;
+    std::unique_ptr<::Rule> rule(new ::Rule(r.name));
+    rule->AddBinding("command", command);
+    rule->AddBinding("description", description);
+    for (const auto& b : r.bindings) {
+      if (!::Rule::IsReservedBinding(b.first)) {
+        *err = "rule '" + r.name + "': unexpected variable '" + b.first + "'";
+        return false;
+      }
+      EvalString value;
+      if (!ReadValue(b.second, &value, err))
+        return false;
+      rule->AddBinding(b.first, value);
+    }
+    auto bound = [&rule](const char* key) {
+      const EvalString* value = rule->GetBinding(key);
+      return value && !value->empty();
+    };
+    if (bound("rspfile") != bound("rspfile_content")) {
+      *err = "rule '" + r.name + "': rspfile and rspfile_content need to be both specified";
+      return false;
+    }
+    if (!bound("command")) {
+      *err = "rule '" + r.name + "': expected 'command =' line";
+      return false;
+    }
+    env->AddRule(rule.release());
+  }
+
+  // Every build statement has at least one output node, so size the
+  // tables up front instead of rehashing as the graph grows.
+  state->edges_.reserve(state->edges_.size() + builds_.size());
+  state->paths_.reserve(2 * builds_.size());
+  for (const auto& b : builds_) {
+    if (!load_edge_(state, b, options, err))
+      return false;
+  }
+
+  if (!default_.empty()) {
+    std::vector<EvalString> defaults;
+    size_t pos = 0;
+    EatWhitespace(default_, &pos);
+    if (!ReadPaths(default_, &pos, &defaults, err))
+      return false;
+    if (pos != default_.size()) {
+      *err = "default " + default_ + ": unexpected '" + default_[pos] + "'";
+      return false;
+    }
+    for (const auto& d : defaults) {
+      std::string path = d.Evaluate(env);
+      if (path.empty()) {
+        *err = "default: empty path";
+        return false;
+      }
+      uint64_t slash_bits;  // Unused because this only does lookup.
+      CanonicalizePath(&path, &slash_bits);
+      if (!state->AddDefault(path, err))
+        return false;
+    }
+  }
+  return true;
+}
+
+bool CppCmake::Make::load_edge_(State* state, const BuildTarget& build, const ManifestParserOptions& options,
+                                std::string* err) {
+  auto fail = [&build, err](const std::string& message) {
+    *err = "build " + build.src + ": " + message;
+    return false;
+  };
+
+  std::vector<EvalString> outs, ins, validations;
+  StringPiece outs_text(build.src);
+  size_t pos = 0;
+  EatWhitespace(outs_text, &pos);
+  if (!ReadPaths(outs_text, &pos, &outs, err))
+    return fail(*err);
+  int implicit_outs = 0;
+  if (ReadSeparator(outs_text, &pos, "|")) {
+    size_t explicit_outs = outs.size();
+    if (!ReadPaths(outs_text, &pos, &outs, err))
+      return fail(*err);
+    implicit_outs = outs.size() - explicit_outs;
+  }
+  if (pos != outs_text.size())
+    return fail(std::string("unexpected '") + outs_text[pos] + "'");
+  if (outs.empty())
+    return fail("expected path");
+
+  StringPiece ins_text(build.target);
+  pos = 0;
+  EatWhitespace(ins_text, &pos);
+  size_t rule_end = pos;
+  while (rule_end < ins_text.size() && IsVarnameChar(ins_text[rule_end], false))
+    ++rule_end;
+  if (rule_end == pos)
+    return fail("expected build command name");
+  std::string rule_name(ins_text.str_ + pos, rule_end - pos);
+  pos = rule_end;
+  EatWhitespace(ins_text, &pos);
+
+  const ::Rule* rule = state->bindings_.LookupRule(rule_name);
+  if (!rule)
+    return fail("unknown build rule '" + rule_name + "'");
+
+  if (!ReadPaths(ins_text, &pos, &ins, err))
+    return fail(*err);
+  int implicit = 0, order_only = 0;
+  if (ReadSeparator(ins_text, &pos, "|")) {
+    size_t before = ins.size();
+    if (!ReadPaths(ins_text, &pos, &ins, err))
+      return fail(*err);
+    implicit = ins.size() - before;
+  }
+  if (ReadSeparator(ins_text, &pos, "||")) {
+    size_t before = ins.size();
+    if (!ReadPaths(ins_text, &pos, &ins, err))
+      return fail(*err);
+    order_only = ins.size() - before;
+  }
+  if (ReadSeparator(ins_text, &pos, "|@")) {
+    if (!ReadPaths(ins_text, &pos, &validations, err))
+      return fail(*err);
+  }
+  if (pos != ins_text.size())
+    return fail(std::string("unexpected '") + ins_text[pos] + "'");
+
+  // Make never attaches bindings to a build statement, so every edge
+  // evaluates in the top-level scope.
+  BindingEnv* env = &state->bindings_;
+  Edge* edge = state->AddEdge(rule);
+
+  std::string memory = edge->GetBinding("memory");
+  int64_t memory_kb;
+  if (!memory.empty() && !ParseMemorySize(memory, &memory_kb))
+    return fail("invalid memory size '" + memory + "'");
+
+  std::string pool_name = edge->GetBinding("pool");
+  if (!pool_name.empty()) {
+    Pool* pool = state->LookupPool(pool_name);
+    if (pool == NULL)
+      return fail("unknown pool name '" + pool_name + "'");
+    edge->pool_ = pool;
+  }
+
+  edge->outputs_.reserve(outs.size());
+  for (const auto& o : outs) {
+    std::string path = o.Evaluate(env);
+    if (path.empty())
+      return fail("empty path");
+    uint64_t slash_bits;
+    CanonicalizePath(&path, &slash_bits);
+    if (!state->AddOut(edge, path, slash_bits, err))
+      return fail(*err);
+  }
+  edge->implicit_outs_ = implicit_outs;
+
+  edge->inputs_.reserve(ins.size());
+  for (const auto& i : ins) {
+    std::string path = i.Evaluate(env);
+    if (path.empty())
+      return fail("empty path");
+    uint64_t slash_bits;
+    CanonicalizePath(&path, &slash_bits);
+    state->AddIn(edge, path, slash_bits);
+  }
+  edge->implicit_deps_ = implicit;
+  edge->order_only_deps_ = order_only;
+
+  edge->validations_.reserve(validations.size());
+  for (const auto& v : validations) {
+    std::string path = v.Evaluate(env);
+    if (path.empty())
+      return fail("empty path");
+    uint64_t slash_bits;
+    CanonicalizePath(&path, &slash_bits);
+    state->AddValidation(edge, path, slash_bits);
+  }
+
+  if (options.phony_cycle_action_ == kPhonyCycleActionWarn && edge->maybe_phonycycle_diagnostic()) {
+    // See ManifestParser::ParseEdge.
+    Node* out = edge->outputs_[0];
+    ArenaVector<Node*>::iterator new_end = std::remove(edge->inputs_.begin(), edge->inputs_.end(), out);
+    if (new_end != edge->inputs_.end()) {
+      edge->inputs_.erase(new_end, edge->inputs_.end());
+      Warning(
+          "phony target '%s' names itself as an input; "
+          "ignoring [-w phonycycle=warn]",
+          out->path().str_);
+    }
+  }
+
+  std::string dyndep = edge->GetUnescapedDyndep();
+  if (!dyndep.empty()) {
+    uint64_t slash_bits;
+    CanonicalizePath(&dyndep, &slash_bits);
+    edge->dyndep_ = state->GetNode(dyndep, slash_bits);
+    edge->dyndep_->set_dyndep_pending(true);
+    if (std::find(edge->inputs_.begin(), edge->inputs_.end(), edge->dyndep_) == edge->inputs_.end())
+      return fail("dyndep '" + dyndep + "' is not an input");
+  }
+  return true;
+}
+
 //"cxx = g++\ncflags = -Wall -std=c++11\nsrc_dir = .\nbuild_dir = build\n\nrule ensure_dir\n  command = mkdir -p $out\n  description = Ensure directory $out exists\n\nbuild ${build_dir}: ensure_dir\n\nrule compile\n  command = $cxx $cflags -c $in -o $out\n  description = Compile $out\n\nrule link\n  command = $cxx $in -o $out\n  description = Link $out\n\nbuild ${build_dir}/my_lib.o: compile ${src_dir}/lib/my_lib.cpp\nbuild ${build_dir}/main.o: compile ${src_dir}/main.cpp | ${build_dir}\n\nbuild my_app: link ${build_dir}/main.o ${build_dir}/my_lib.o\n\ndefault my_app\n"
 
 void CppCmake::Make::build(int argc, char** argv) {
@@ -113,6 +533,7 @@ void CppCmake::Make::build(int argc, char** argv) {
 
   // Limit number of rebuilds, to prevent infinite loops.
   const int kCycleLimit = 100;
+  const char kStateCachePath[] = ".cppcmake_state";
   for (int cycle = 1; cycle <= kCycleLimit; ++cycle) {
     CppCmake::CppCmakeMain cppcmake(cppcmake_command, config);
 
@@ -120,11 +541,23 @@ void CppCmake::Make::build(int argc, char** argv) {
     if (options.phony_cycle_should_err) {
       parser_opts.phony_cycle_action_ = kPhonyCycleActionError;
     }
-    ManifestParser parser(&cppcmake.state_, &cppcmake.disk_interface_, parser_opts);
     std::string err;
-    if (!parser.Load(this->generate_string_(), &err)) {
-      status->Error("%s", err.c_str());
-      exit(1);
+    const uint64_t cache_key = contentHash(parser_opts);
+    LoadStatus cache_status = StateCache::Load(kStateCachePath, cache_key, &cppcmake.state_, &err);
+    if (cache_status == LOAD_ERROR) {
+      // The State may be half populated; drop the cache and start over
+      // with a fresh one.
+      status->Warning("loading %s: %s; ignoring", kStateCachePath, err.c_str());
+      unlink(kStateCachePath);
+      continue;
+    }
+    if (cache_status == LOAD_NOT_FOUND) {
+      if (!load(&cppcmake.state_, &err, parser_opts)) {
+        status->Error("%s", err.c_str());
+        exit(1);
+      }
+      if (!config.dry_run && !StateCache::Save(kStateCachePath, cache_key, cppcmake.state_, &err))
+        status->Warning("writing %s: %s", kStateCachePath, err.c_str());
     }
     options.input_file = "build.nija";
 
@@ -156,6 +589,11 @@ void CppCmake::Make::build(int argc, char** argv) {
     cppcmake.ParsePreviousElapsedTimes();
 
     int result = cppcmake.RunBuild(argc, argv, status);
+    // Recompact what the logs hold after the build rather than before it, so
+    // that the build does not wait on it.  Not when interrupted, though: the
+    // user wants to get out.
+    if (result != CppCmake::kInterruptedExitCode && !config.dry_run)
+      cppcmake.RecompactLogs();
     if (g_metrics)
       cppcmake.DumpMetrics();
     exit(result);
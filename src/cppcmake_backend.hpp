@@ -1,10 +1,14 @@
 #ifndef CPPCMAKE_CPPCMAKE_BACKEND_HPP
 #define CPPCMAKE_CPPCMAKE_BACKEND_HPP
 
+#include <deque>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "cppcmake_utils.hpp"
+#include "../deps/hash_map.h"
+#include "../deps/state_cache.h"
 
 namespace CppCmake {
 
@@ -12,6 +16,9 @@ namespace CppCmake {
         std::string name;
         std::string command;
         std::string description;
+        /// The rule's other bindings, such as "worker", "memory", "pool" or
+        /// "depfile", in the order they are bound.
+        std::vector<std::pair<std::string, std::string>> bindings;
     };
 
     struct BuildTarget {
@@ -21,6 +28,14 @@ namespace CppCmake {
 
     class Make {
     public:
+        Make() = default;
+
+        /// The indexes point into this object's own storage, so a copy
+        /// would dangle; a move hands the storage over intact.
+        Make(const Make &) = delete;
+        Make &operator=(const Make &) = delete;
+        Make(Make &&) = default;
+        Make &operator=(Make &&) = default;
 
         void setVar(std::string &&key, std::string &&val);
 
@@ -31,10 +46,27 @@ namespace CppCmake {
 
         void addBuildTarget(CppCmake::BuildTarget &&build);
 
-        std::string getVar(const std::string& key);
-        Rule getRule(const std::string& name);
-        BuildTarget getBuildTarget(const std::string& src);
-        std::string getDefault();
+        /// Lookups are hashed and return references that stay valid as
+        /// more variables, rules and targets are added.  A missing entry
+        /// yields an empty value.  When a name is added more than once the
+        /// first entry is returned.
+        const std::string &getVar(const std::string &key) const;
+        const Rule &getRule(const std::string &name) const;
+        const BuildTarget &getBuildTarget(const std::string &src) const;
+        const std::string &getDefault() const;
+
+        /// Populate \a state directly from the variables, rules and build
+        /// targets, without rendering and re-parsing manifest text.
+        /// @return false and fill \a err on error.
+        bool load(State *state, std::string *err,
+                  const ManifestParserOptions &options = ManifestParserOptions());
+
+        /// The manifest text equivalent of this Make.
+        std::string getManifest();
+
+        /// A hash of everything load() reads, so that a StateCache written
+        /// for an identical Make can stand in for load().
+        uint64_t contentHash(const ManifestParserOptions &options = ManifestParserOptions()) const;
 
         NORETURN void build(int argc, char **argv);
 
@@ -46,11 +78,21 @@ namespace CppCmake {
         std::string default_;
         std::string build_dir_;
 
-        std::vector<std::pair<std::string, std::string>> mappings_;
-        std::vector<CppCmake::Rule> rules_;
-        std::vector<CppCmake::BuildTarget> builds_;
+        // Kept in insertion order for emission.  std::deque so that the
+        // indexes below, which key on the stored strings, and references
+        // handed out by the getters survive later additions.
+        std::deque<std::pair<std::string, std::string>> mappings_;
+        std::deque<CppCmake::Rule> rules_;
+        std::deque<CppCmake::BuildTarget> builds_;
+
+        ExternalStringHashMap<const std::string *>::Type var_index_;
+        ExternalStringHashMap<const CppCmake::Rule *>::Type rule_index_;
+        ExternalStringHashMap<const CppCmake::BuildTarget *>::Type build_index_;
 
         std::string generate_string_();
+
+        bool load_edge_(State *state, const BuildTarget &build, const ManifestParserOptions &options,
+                        std::string *err);
     };
 
 
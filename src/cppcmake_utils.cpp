@@ -18,6 +18,13 @@ void CppCmake::Usage(const BuildConfig& config) {
           "  -j N     run N jobs in parallel (0 means infinity) [default=%d on this system]\n"
           "  -k N     keep going until N jobs fail (0 means infinity) [default=1]\n"
           "  -l N     do not start new jobs if the load average is greater than N\n"
+          "  --jobserver  share the -j N job slots with nested builds through a\n"
+          "               GNU make jobserver, unless one was passed down already\n"
+          "  --memory-budget=SIZE  do not start new jobs if the memory the running\n"
+          "               ones used last time would exceed SIZE (e.g. 16G)\n"
+          "  --output-limit=SIZE  keep up to SIZE of each running job's output in\n"
+          "               memory and the rest in a temporary file [default=1M]\n"
+          "    a SIZE is a number of MiB, or ends in K, M or G\n"
           "  -n       dry run (don't run commands but act like they succeeded)\n"
           "\n"
           "  -d MODE  enable debugging (use '-d list' to list modes)\n"
@@ -79,10 +86,11 @@ bool CppCmake::CppCmakeMain::RebuildManifest(const char* input_file, std::string
 void CppCmake::CppCmakeMain::ParsePreviousElapsedTimes() {
   for (Edge* edge : state_.edges_) {
     for (Node* out : edge->outputs_) {
-      BuildLog::LogEntry* log_entry = build_log_.LookupByOutput(out->path());
+      BuildLog::LogEntry* log_entry = build_log_.LookupByOutput(out);
       if (!log_entry)
         continue;  // Maybe we'll have log entry for next output of this edge?
       edge->prev_elapsed_time_millis = log_entry->end_time - log_entry->start_time;
+      edge->prev_peak_rss_kb = log_entry->usage.peak_rss_kb;
       break;  // Onto next edge.
     }
   }
@@ -133,7 +141,7 @@ Node* CppCmake::CppCmakeMain::CollectTarget(const char* cpath, std::string* err)
     } else {
       Node* suggestion = state_.SpellcheckNode(path);
       if (suggestion) {
-        *err += ", did you mean '" + suggestion->path() + "'?";
+        *err += ", did you mean '" + suggestion->path().AsString() + "'?";
       }
     }
     return NULL;
@@ -189,7 +197,7 @@ int CppCmake::CppCmakeMain::ToolQuery(const Options* options, int argc, char* ar
       return 1;
     }
 
-    printf("%s:\n", node->path().c_str());
+    printf("%s:\n", node->path().str_);
     if (Edge* edge = node->in_edge()) {
       if (edge->dyndep_ && edge->dyndep_->dyndep_pending()) {
         if (!dyndep_loader.LoadDyndeps(edge->dyndep_, &err)) {
@@ -203,28 +211,28 @@ int CppCmake::CppCmakeMain::ToolQuery(const Options* options, int argc, char* ar
           label = "| ";
         else if (edge->is_order_only(in))
           label = "|| ";
-        printf("    %s%s\n", label, edge->inputs_[in]->path().c_str());
+        printf("    %s%s\n", label, edge->inputs_[in]->path().str_);
       }
       if (!edge->validations_.empty()) {
         printf("  validations:\n");
-        for (std::vector<Node*>::iterator validation = edge->validations_.begin();
+        for (ArenaVector<Node*>::iterator validation = edge->validations_.begin();
              validation != edge->validations_.end(); ++validation) {
-          printf("    %s\n", (*validation)->path().c_str());
+          printf("    %s\n", (*validation)->path().str_);
         }
       }
     }
     printf("  outputs:\n");
-    for (std::vector<Edge*>::const_iterator edge = node->out_edges().begin(); edge != node->out_edges().end(); ++edge) {
-      for (std::vector<Node*>::iterator out = (*edge)->outputs_.begin(); out != (*edge)->outputs_.end(); ++out) {
-        printf("    %s\n", (*out)->path().c_str());
+    for (ArenaVector<Edge*>::const_iterator edge = node->out_edges().begin(); edge != node->out_edges().end(); ++edge) {
+      for (ArenaVector<Node*>::iterator out = (*edge)->outputs_.begin(); out != (*edge)->outputs_.end(); ++out) {
+        printf("    %s\n", (*out)->path().str_);
       }
     }
-    const std::vector<Edge*> validation_edges = node->validation_out_edges();
+    const ArenaVector<Edge*>& validation_edges = node->validation_out_edges();
     if (!validation_edges.empty()) {
       printf("  validation for:\n");
-      for (std::vector<Edge*>::const_iterator edge = validation_edges.begin(); edge != validation_edges.end(); ++edge) {
-        for (std::vector<Node*>::iterator out = (*edge)->outputs_.begin(); out != (*edge)->outputs_.end(); ++out) {
-          printf("    %s\n", (*out)->path().c_str());
+      for (ArenaVector<Edge*>::const_iterator edge = validation_edges.begin(); edge != validation_edges.end(); ++edge) {
+        for (ArenaVector<Node*>::iterator out = (*edge)->outputs_.begin(); out != (*edge)->outputs_.end(); ++out) {
+          printf("    %s\n", (*out)->path().str_);
         }
       }
     }
@@ -251,11 +259,12 @@ int CppCmake::ToolTargetsList(const std::vector<Node*>& nodes, int depth, int in
   for (std::vector<Node*>::const_iterator n = nodes.begin(); n != nodes.end(); ++n) {
     for (int i = 0; i < indent; ++i)
       printf("  ");
-    const char* target = (*n)->path().c_str();
+    const char* target = (*n)->path().str_;
     if ((*n)->in_edge()) {
       printf("%s: %s\n", target, (*n)->in_edge()->rule_->name().c_str());
       if (depth > 1 || depth <= 0)
-        ToolTargetsList((*n)->in_edge()->inputs_, depth - 1, indent + 1);
+        ToolTargetsList(std::vector<Node*>((*n)->in_edge()->inputs_.begin(), (*n)->in_edge()->inputs_.end()),
+                        depth - 1, indent + 1);
     } else {
       printf("%s\n", target);
     }
@@ -265,9 +274,9 @@ int CppCmake::ToolTargetsList(const std::vector<Node*>& nodes, int depth, int in
 
 int CppCmake::ToolTargetsSourceList(State* state) {
   for (std::vector<Edge*>::iterator e = state->edges_.begin(); e != state->edges_.end(); ++e) {
-    for (std::vector<Node*>::iterator inps = (*e)->inputs_.begin(); inps != (*e)->inputs_.end(); ++inps) {
+    for (ArenaVector<Node*>::iterator inps = (*e)->inputs_.begin(); inps != (*e)->inputs_.end(); ++inps) {
       if (!(*inps)->in_edge())
-        printf("%s\n", (*inps)->path().c_str());
+        printf("%s\n", (*inps)->path().str_);
     }
   }
   return 0;
@@ -279,9 +288,9 @@ int CppCmake::ToolTargetsList(State* state, const std::string& rule_name) {
   // Gather the outputs.
   for (std::vector<Edge*>::iterator e = state->edges_.begin(); e != state->edges_.end(); ++e) {
     if ((*e)->rule_->name() == rule_name) {
-      for (std::vector<Node*>::iterator out_node = (*e)->outputs_.begin(); out_node != (*e)->outputs_.end();
+      for (ArenaVector<Node*>::iterator out_node = (*e)->outputs_.begin(); out_node != (*e)->outputs_.end();
            ++out_node) {
-        rules.insert((*out_node)->path());
+        rules.insert((*out_node)->path().AsString());
       }
     }
   }
@@ -296,8 +305,8 @@ int CppCmake::ToolTargetsList(State* state, const std::string& rule_name) {
 
 int CppCmake::ToolTargetsList(State* state) {
   for (std::vector<Edge*>::iterator e = state->edges_.begin(); e != state->edges_.end(); ++e) {
-    for (std::vector<Node*>::iterator out_node = (*e)->outputs_.begin(); out_node != (*e)->outputs_.end(); ++out_node) {
-      printf("%s: %s\n", (*out_node)->path().c_str(), (*e)->rule_->name().c_str());
+    for (ArenaVector<Node*>::iterator out_node = (*e)->outputs_.begin(); out_node != (*e)->outputs_.end(); ++out_node) {
+      printf("%s: %s\n", (*out_node)->path().str_, (*e)->rule_->name().c_str());
     }
   }
   return 0;
@@ -322,18 +331,18 @@ int CppCmake::CppCmakeMain::ToolDeps(const Options* options, int argc, char** ar
   for (std::vector<Node*>::iterator it = nodes.begin(), end = nodes.end(); it != end; ++it) {
     DepsLog::Deps* deps = deps_log_.GetDeps(*it);
     if (!deps) {
-      printf("%s: deps not found\n", (*it)->path().c_str());
+      printf("%s: deps not found\n", (*it)->path().str_);
       continue;
     }
 
     std::string err;
-    TimeStamp mtime = disk_interface.Stat((*it)->path(), &err);
+    TimeStamp mtime = disk_interface.Stat((*it)->path().AsString(), &err);
     if (mtime == -1)
       Error("%s", err.c_str());  // Log and ignore Stat() errors;
-    printf("%s: #deps %d, deps mtime %" PRId64 " (%s)\n", (*it)->path().c_str(), deps->node_count, deps->mtime,
+    printf("%s: #deps %d, deps mtime %" PRId64 " (%s)\n", (*it)->path().str_, deps->node_count, deps->mtime,
            (!mtime || mtime > deps->mtime ? "STALE" : "VALID"));
     for (int i = 0; i < deps->node_count; ++i)
-      printf("    %s\n", deps->nodes[i]->path().c_str());
+      printf("    %s\n", deps->nodes[i]->path().str_);
     printf("\n");
   }
 
@@ -447,6 +456,131 @@ int CppCmake::CppCmakeMain::ToolRules(const Options* options, int argc, char* ar
   return 0;
 }
 
+namespace {
+
+/// What the last run of one edge, or of all edges of one rule, cost.
+struct Cost {
+  std::string name;
+  int count;
+  int64_t wall_millis;
+  int64_t cpu_millis;
+  int64_t peak_rss_kb;  // The largest, for a rule.
+  int64_t io_blocks;
+};
+
+void PrintCosts(std::vector<Cost>* costs, int64_t Cost::*key, int top, const char* what, const char* by) {
+  std::sort(costs->begin(), costs->end(), [key](const Cost& a, const Cost& b) { return a.*key > b.*key; });
+  if ((int)costs->size() > top)
+    costs->resize(top);
+  printf("%ss by %s:\n", what, by);
+  printf("%10s %10s %10s %10s %6s  %s\n", "cpu s", "wall s", "RSS MiB", "I/O MiB", "count", what);
+  for (std::vector<Cost>::const_iterator c = costs->begin(); c != costs->end(); ++c) {
+    printf("%10.1f %10.1f %10.1f %10.1f %6d  %s\n", c->cpu_millis / 1e3, c->wall_millis / 1e3, c->peak_rss_kb / 1024.,
+           c->io_blocks / 2048., c->count, c->name.c_str());
+  }
+}
+
+}  // anonymous namespace
+
+int CppCmake::CppCmakeMain::ToolCosts(const Options* options, int argc, char* argv[]) {
+  // The costs tool uses getopt, and expects argv[0] to contain the name of
+  // the tool, i.e. "costs".
+  argc++;
+  argv--;
+
+  int top = 10;
+  std::string by = "cpu";
+  optind = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, const_cast<char*>("hn:s:"))) != -1) {
+    switch (opt) {
+      case 'n': {
+        char* end;
+        long value = strtol(optarg, &end, 10);
+        if (*end != '\0' || end == optarg || value <= 0 || value > INT_MAX) {
+          Error("invalid -n parameter '%s'; expected a positive count", optarg);
+          return 1;
+        }
+        top = (int)value;
+        break;
+      }
+      case 's':
+        by = optarg;
+        break;
+      case 'h':
+      default:
+        printf(
+            "usage: cppcmake -t costs [options]\n"
+            "\n"
+            "rank rules and outputs by what their commands cost when they last ran,\n"
+            "as recorded in the build log.\n"
+            "\n"
+            "options:\n"
+            "  -n N   show the N most expensive of each [default=10]\n"
+            "  -s KEY rank by cpu, wall, rss or io [default=cpu]\n"
+            "  -h     print this message\n");
+        return 1;
+    }
+  }
+
+  int64_t Cost::*key;
+  if (by == "cpu") {
+    key = &Cost::cpu_millis;
+  } else if (by == "wall") {
+    key = &Cost::wall_millis;
+  } else if (by == "rss") {
+    key = &Cost::peak_rss_kb;
+  } else if (by == "io") {
+    key = &Cost::io_blocks;
+  } else {
+    Error("unknown cost '%s'; use cpu, wall, rss or io", by.c_str());
+    return 1;
+  }
+
+  // An edge logs the same entry under each output; take the first found.
+  std::map<const Rule*, Cost> rules;
+  std::vector<Cost> outputs;
+  for (std::vector<Edge*>::const_iterator e = state_.edges_.begin(); e != state_.edges_.end(); ++e) {
+    if ((*e)->is_phony())
+      continue;
+    BuildLog::LogEntry* entry = NULL;
+    for (ArenaVector<Node*>::const_iterator o = (*e)->outputs_.begin(); o != (*e)->outputs_.end() && !entry; ++o)
+      entry = build_log_.LookupByOutput(*o);
+    if (!entry)
+      continue;
+
+    const ResourceUsage& usage = entry->usage;
+    Cost cost;
+    cost.name = entry->output;
+    cost.count = 1;
+    cost.wall_millis = entry->end_time - entry->start_time;
+    cost.cpu_millis = usage.user_time_millis + usage.system_time_millis;
+    cost.peak_rss_kb = usage.peak_rss_kb;
+    cost.io_blocks = usage.read_blocks + usage.written_blocks;
+    outputs.push_back(cost);
+
+    std::map<const Rule*, Cost>::iterator rule = rules.find(&(*e)->rule());
+    if (rule == rules.end()) {
+      cost.name = (*e)->rule().name();
+      rules.insert(std::make_pair(&(*e)->rule(), cost));
+      continue;
+    }
+    ++rule->second.count;
+    rule->second.wall_millis += cost.wall_millis;
+    rule->second.cpu_millis += cost.cpu_millis;
+    rule->second.peak_rss_kb = std::max(rule->second.peak_rss_kb, cost.peak_rss_kb);
+    rule->second.io_blocks += cost.io_blocks;
+  }
+
+  std::vector<Cost> rule_costs;
+  for (std::map<const Rule*, Cost>::const_iterator r = rules.begin(); r != rules.end(); ++r)
+    rule_costs.push_back(r->second);
+  PrintCosts(&rule_costs, key, top, "rule", by.c_str());
+  printf("\n");
+  PrintCosts(&outputs, key, top, "output", by.c_str());
+  return 0;
+}
+
 void CppCmake::PrintCommands(Edge* edge, EdgeSet* seen, CppCmake::PrintCommandMode mode) {
   if (!edge)
     return;
@@ -454,7 +588,7 @@ void CppCmake::PrintCommands(Edge* edge, EdgeSet* seen, CppCmake::PrintCommandMo
     return;
 
   if (mode == CppCmake::PCM_All) {
-    for (std::vector<Node*>::iterator in = edge->inputs_.begin(); in != edge->inputs_.end(); ++in)
+    for (ArenaVector<Node*>::iterator in = edge->inputs_.begin(); in != edge->inputs_.end(); ++in)
       CppCmake::PrintCommands((*in)->in_edge(), seen, mode);
   }
 
@@ -510,7 +644,7 @@ void CppCmake::CollectInputs(Edge* edge, std::set<Edge*>* seen, std::vector<std:
   if (!seen->insert(edge).second)
     return;
 
-  for (std::vector<Node*>::iterator in = edge->inputs_.begin(); in != edge->inputs_.end(); ++in)
+  for (ArenaVector<Node*>::iterator in = edge->inputs_.begin(); in != edge->inputs_.end(); ++in)
     CollectInputs((*in)->in_edge(), seen, result);
 
   if (!edge->is_phony()) {
@@ -657,9 +791,9 @@ void CppCmake::printCompdb(const char* const directory, const Edge* const edge,
   printf("\",\n    \"command\": \"");
   PrintJSONString(EvaluateCommandWithRspfile(edge, eval_mode));
   printf("\",\n    \"file\": \"");
-  PrintJSONString(edge->inputs_[0]->path());
+  PrintJSONString(edge->inputs_[0]->path().AsString());
   printf("\",\n    \"output\": \"");
-  PrintJSONString(edge->outputs_[0]->path());
+  PrintJSONString(edge->outputs_[0]->path().AsString());
   printf("\"\n  }");
 }
 
@@ -853,6 +987,8 @@ const CppCmake::Tool* CppCmake::ChooseTool(const std::string& tool_name) {
        &CppCmake::CppCmakeMain::ToolRecompact},
       {"restat", "restats all outputs in the build log", Tool::RUN_AFTER_FLAGS, &CppCmake::CppCmakeMain::ToolRestat},
       {"rules", "list all rules", Tool::RUN_AFTER_LOAD, &CppCmake::CppCmakeMain::ToolRules},
+      {"costs", "rank rules and outputs by what their last run cost", Tool::RUN_AFTER_LOGS,
+       &CppCmake::CppCmakeMain::ToolCosts},
       {"cleandead", "clean built files that are no longer produced by the manifest", Tool::RUN_AFTER_LOGS,
        &CppCmake::CppCmakeMain::ToolCleanDead},
       {"urtle", NULL, Tool::RUN_AFTER_FLAGS, &CppCmake::CppCmakeMain::ToolUrtle},
@@ -1034,13 +1170,37 @@ bool CppCmake::CppCmakeMain::OpenDepsLog(bool recompact_only) {
   return true;
 }
 
+void CppCmake::CppCmakeMain::RecompactLogs() {
+  std::string log_path = ".cppcmake_log";
+  std::string deps_path = ".cppcmake_deps";
+  if (!build_dir_.empty()) {
+    log_path = build_dir_ + "/" + log_path;
+    deps_path = build_dir_ + "/" + deps_path;
+  }
+
+  // Each log is rewritten to a temporary file that replaces it in one step,
+  // so a crash along the way leaves the old log, appends and all.
+  std::string err;
+  if (build_log_.needs_recompaction() && !build_log_.Recompact(log_path, *this, &err)) {
+    Warning("recompacting build log: %s", err.c_str());
+    err.clear();
+  }
+  if (deps_log_.needs_recompaction() && !deps_log_.Recompact(deps_path, &err))
+    Warning("recompacting deps log: %s", err.c_str());
+}
+
 void CppCmake::CppCmakeMain::DumpMetrics() {
   g_metrics->Report();
 
   printf("\n");
-  int count = (int)state_.paths_.size();
-  int buckets = (int)state_.paths_.bucket_count();
-  printf("path->node hash load %.2f (%d entries / %d buckets)\n", count / (double)buckets, count, buckets);
+  const PathTable& paths = PathTable::Global();
+  int count = (int)paths.size();
+  int slots = (int)paths.capacity();
+  printf("path table load %.2f (%d paths / %d slots, %.1f MB of paths, %d nodes)\n", count / (double)slots, count,
+         slots, paths.bytes() / 1048576.0, (int)state_.paths_.size());
+  printf("node/edge arena %.1f MB used / %.1f MB in %d blocks (%d edges)\n", state_.arena_.used() / 1048576.0,
+         state_.arena_.reserved() / 1048576.0, (int)state_.arena_.blocks(), (int)state_.edges_.size());
+  printf("peak RSS %.1f MB\n", GetPeakRSS() / 1048576.0);
 }
 
 bool CppCmake::CppCmakeMain::EnsureBuildDirExists() {
@@ -1090,7 +1250,7 @@ int CppCmake::CppCmakeMain::RunBuild(int argc, char** argv, Status* status) {
   if (!builder.Build(&err)) {
     status->Info("build stopped: %s.", err.c_str());
     if (err.find("interrupted by user") != std::string::npos) {
-      return 130;
+      return kInterruptedExitCode;
     }
     return 1;
   }
@@ -1102,13 +1262,18 @@ int CppCmake::CppCmakeMain::RunBuild(int argc, char** argv, Status* status) {
 /// Returns an exit code, or -1 if CppCmake should continue.
 int CppCmake::ReadFlags(int* argc, char*** argv, Options* options, BuildConfig* config) {
   DeferGuessParallelism deferGuessParallelism(config);
+  config->batch_stat = true;
+  config->jobserver_client = true;
 
-  enum { OPT_VERSION = 1, OPT_QUIET = 2 };
+  enum { OPT_VERSION = 1, OPT_QUIET = 2, OPT_JOBSERVER = 3, OPT_MEMORY_BUDGET = 4, OPT_OUTPUT_LIMIT = 5 };
 
   const option kLongOptions[] = {{"help", no_argument, NULL, 'h'},
                                  {"version", no_argument, NULL, OPT_VERSION},
                                  {"verbose", no_argument, NULL, 'v'},
                                  {"quiet", no_argument, NULL, OPT_QUIET},
+                                 {"jobserver", no_argument, NULL, OPT_JOBSERVER},
+                                 {"memory-budget", required_argument, NULL, OPT_MEMORY_BUDGET},
+                                 {"output-limit", required_argument, NULL, OPT_OUTPUT_LIMIT},
                                  {NULL, 0, NULL, 0}};
 
   int opt;
@@ -1167,6 +1332,17 @@ int CppCmake::ReadFlags(int* argc, char*** argv, Options* options, BuildConfig*
       case OPT_QUIET:
         config->verbosity = BuildConfig::NO_STATUS_UPDATE;
         break;
+      case OPT_JOBSERVER:
+        config->jobserver_server = true;
+        break;
+      case OPT_MEMORY_BUDGET:
+        if (!ParseMemorySize(optarg, &config->memory_budget_kb))
+          Fatal("invalid --memory-budget parameter");
+        break;
+      case OPT_OUTPUT_LIMIT:
+        if (!ParseMemorySize(optarg, &config->output_limit_kb))
+          Fatal("invalid --output-limit parameter");
+        break;
       case 'w':
         if (!WarningEnable(optarg, options))
           return 1;
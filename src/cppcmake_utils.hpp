@@ -39,6 +39,10 @@ namespace CppCmake {
 
     struct Tool;
 
+    /// The exit code of a build interrupted by the user, as a shell reports
+    /// a command killed by SIGINT.
+    const int kInterruptedExitCode = 130;
+
     struct Options {
         const char *input_file;
         const char *working_dir;
@@ -49,7 +53,11 @@ namespace CppCmake {
     struct CppCmakeMain : public BuildLogUser {
         CppCmakeMain(const char *cppcmake_command, const BuildConfig &config) :
                 cppcmake_command_(cppcmake_command), config_(config),
-                start_time_millis_(GetTimeMillis()) {}
+                start_time_millis_(GetTimeMillis()) {
+            // Without io_uring, batched stats go to threads that mostly wait
+            // on the filesystem, so this is not tied to the processor count.
+            disk_interface_.set_stat_threads(16);
+        }
 
         /// Command line used to run CppCmake.
         const char *cppcmake_command_;
@@ -113,6 +121,8 @@ namespace CppCmake {
 
         int ToolRules(const Options *options, int argc, char *argv[]);
 
+        int ToolCosts(const Options *options, int argc, char *argv[]);
+
         int ToolWinCodePage(const Options *options, int argc, char *argv[]);
 
         /// Open the build log.
@@ -123,6 +133,11 @@ namespace CppCmake {
         /// @return false on error.
         bool OpenDepsLog(bool recompact_only = false);
 
+        /// Recompact whichever of the logs grew enough dead entries, once the
+        /// build that appended to them is done.  Failing only warns: the logs
+        /// are still whole, just larger than they need to be.
+        void RecompactLogs();
+
         /// Ensure the build directory exists, creating it if necessary.
         /// @return false on error.
         bool EnsureBuildDirExists();
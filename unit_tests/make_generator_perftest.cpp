@@ -0,0 +1,58 @@
+// Times a generator that queries CppCmake::Make while it adds targets, at
+// doubling target counts, so that the per-target cost should stay flat.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "../src/cppcmake_backend.hpp"
+
+namespace {
+
+/// Add \a num_targets compile targets, each of which looks up its rule, a
+/// variable and the previously added target first, the way a generator
+/// checks for existing entries before adding its own.
+int Generate(int num_targets) {
+  CppCmake::Make make;
+  make.setVar("cxx", "g++");
+  make.setVar("obj", "build/obj");
+  make.addRule({.name = "compile", .command = "$cxx -c $in -o $out", .description = "Compiling $in"});
+
+  int found = 0;
+  std::string prev;
+  for (int i = 0; i < num_targets; ++i) {
+    std::string obj = "$obj/file" + std::to_string(i) + ".o";
+    if (!make.getRule("compile").command.empty())
+      ++found;
+    if (!make.getVar("obj").empty())
+      ++found;
+    if (!prev.empty() && !make.getBuildTarget(prev).target.empty())
+      ++found;
+    make.addBuildTarget({.src = obj, .target = "compile src/file" + std::to_string(i) + ".cpp"});
+    prev = obj;
+  }
+  return found;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int max_targets = argc > 1 ? atoi(argv[1]) : 100000;
+  if (max_targets <= 0) {
+    fprintf(stderr, "usage: make_generator_perftest [max_targets]\n");
+    return 1;
+  }
+
+  for (int n = std::max(1, max_targets / 8); n <= max_targets; n *= 2) {
+    int64_t start = GetTimeMillis();
+    int found = Generate(n);
+    int64_t delta = GetTimeMillis() - start;
+    if (found != 3 * n - 1) {
+      fprintf(stderr, "lookup failed: %d of %d\n", found, 3 * n - 1);
+      return 1;
+    }
+    printf("%7d targets: %5dms  (%.2fus/target)\n", n, (int)delta, delta * 1000.0 / n);
+  }
+  return 0;
+}
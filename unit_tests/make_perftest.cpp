@@ -0,0 +1,131 @@
+// Compares loading a CppCmake::Make into State directly against rendering
+// it to manifest text and running that through ManifestParser, and against
+// reading back a StateCache written for it.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "../src/cppcmake_backend.hpp"
+
+namespace {
+
+void AddTargets(CppCmake::Make* make, int num_targets) {
+  make->setVar("cxx", "g++");
+  make->setVar("cflags", "-I./include -O2 -Wall");
+  make->setVar("obj", "build/obj");
+  make->addRule({.name = "compile", .command = "$cxx -c $cflags -o $out $in", .description = "Compiling $in"});
+  make->addRule({.name = "link", .command = "$cxx $in -o $out", .description = "Linking $out"});
+
+  const int kObjectsPerLink = 100;
+  std::string link_inputs;
+  int links = 0;
+  for (int i = 0; i < num_targets; ++i) {
+    char obj[64], src[64];
+    snprintf(obj, sizeof(obj), "$obj/dir%d/file%d.o", i / kObjectsPerLink, i);
+    snprintf(src, sizeof(src), "src/dir%d/file%d.cpp", i / kObjectsPerLink, i);
+    make->addBuildTarget({.src = obj, .target = std::string("compile ") + src + " | include/common.h"});
+    link_inputs += ' ';
+    link_inputs += obj;
+    if ((i + 1) % kObjectsPerLink == 0 || i + 1 == num_targets) {
+      char bin[64];
+      snprintf(bin, sizeof(bin), "bin/app%d", links++);
+      make->addBuildTarget({.src = bin, .target = "link" + link_inputs});
+      link_inputs.clear();
+    }
+  }
+  make->setDefault("bin/app0");
+}
+
+int LoadDirect(CppCmake::Make* make) {
+  State state;
+  std::string err;
+  if (!make->load(&state, &err)) {
+    fprintf(stderr, "direct load failed: %s\n", err.c_str());
+    exit(1);
+  }
+  return (int)state.edges_.size();
+}
+
+int LoadText(CppCmake::Make* make) {
+  State state;
+  std::string err;
+  ManifestParser parser(&state, NULL);
+  if (!parser.ParseTest(make->getManifest(), &err)) {
+    fprintf(stderr, "manifest parse failed: %s\n", err.c_str());
+    exit(1);
+  }
+  return (int)state.edges_.size();
+}
+
+const char kCachePath[] = "make_perftest.state";
+
+int LoadCached(CppCmake::Make* make) {
+  State state;
+  std::string err;
+  if (StateCache::Load(kCachePath, make->contentHash(), &state, &err) != LOAD_SUCCESS) {
+    fprintf(stderr, "state cache load failed: %s\n", err.c_str());
+    exit(1);
+  }
+  return (int)state.edges_.size();
+}
+
+void Report(const char* name, const std::vector<int>& times) {
+  int min = *std::min_element(times.begin(), times.end());
+  int max = *std::max_element(times.begin(), times.end());
+  float total = std::accumulate(times.begin(), times.end(), 0.0f);
+  printf("%-8s min %dms  max %dms  avg %.1fms\n", name, min, max, total / times.size());
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int num_targets = argc > 1 ? atoi(argv[1]) : 200000;
+  if (num_targets <= 0) {
+    fprintf(stderr, "usage: make_perftest [num_targets]\n");
+    return 1;
+  }
+
+  CppCmake::Make make;
+  AddTargets(&make, num_targets);
+  printf("%d build targets\n", num_targets);
+
+  {
+    State state;
+    std::string err;
+    if (!make.load(&state, &err) || !StateCache::Save(kCachePath, make.contentHash(), state, &err)) {
+      fprintf(stderr, "writing state cache failed: %s\n", err.c_str());
+      return 1;
+    }
+  }
+
+  const int kNumRepetitions = 5;
+  std::vector<int> text_times, direct_times, cached_times;
+  for (int i = 0; i < kNumRepetitions; ++i) {
+    int64_t start = GetTimeMillis();
+    int text_edges = LoadText(&make);
+    text_times.push_back((int)(GetTimeMillis() - start));
+
+    start = GetTimeMillis();
+    int direct_edges = LoadDirect(&make);
+    direct_times.push_back((int)(GetTimeMillis() - start));
+
+    start = GetTimeMillis();
+    int cached_edges = LoadCached(&make);
+    cached_times.push_back((int)(GetTimeMillis() - start));
+
+    if (text_edges != direct_edges || text_edges != cached_edges) {
+      fprintf(stderr, "edge count mismatch: %d vs %d vs %d\n", text_edges, direct_edges, cached_edges);
+      return 1;
+    }
+  }
+  unlink(kCachePath);
+
+  Report("text", text_times);
+  Report("direct", direct_times);
+  Report("cached", cached_times);
+  return 0;
+}
@@ -41,6 +41,194 @@ class TestMake {
     assert(make.getDefault() == "hello");
     std::cout << "testSetDefault passed.\n";
   }
+
+  static void testLoad() {
+    CppCmake::Make make;
+    make.setVar("cxx", "g++");
+    make.setVar("cflags", "-I./include -O2");
+    make.setVar("obj", "build/obj");
+    // The manifest text drops the spaces after '=', so loading must too.
+    make.setVar("ld", "  g++ ");
+    make.setVar("ldflags", " $cflags");
+    make.addRule({.name = "compile", .command = "$cxx -c $cflags -o $out $in", .description = "Compiling $in"});
+    make.addRule({.name = "link", .command = "  $ld $ldflags $in -o $out", .description = " Linking $out"});
+    make.addBuildTarget({.src = "$obj/hello.o", .target = "compile src/hello.cpp | include/hello.h"});
+    make.addBuildTarget({.src = "${obj}/main.o", .target = "compile src/main.cpp || $obj"});
+    make.addBuildTarget({.src = "$obj", .target = "phony"});
+    make.addBuildTarget({.src = "hello", .target = "link $obj/hello.o $obj/main.o"});
+    make.setDefault("hello");
+
+    // Loading directly must produce the same graph as parsing the manifest.
+    State direct;
+    std::string err;
+    bool loaded = make.load(&direct, &err);
+    assert(loaded);
+    assert(err.empty());
+
+    State parsed;
+    ManifestParser parser(&parsed, NULL);
+    bool parsed_ok = parser.ParseTest(make.getManifest(), &err);
+    assert(parsed_ok);
+
+    assert(direct.edges_.size() == parsed.edges_.size());
+    for (size_t i = 0; i < direct.edges_.size(); ++i) {
+      Edge* a = direct.edges_[i];
+      Edge* b = parsed.edges_[i];
+      assert(a->rule().name() == b->rule().name());
+      assert(a->EvaluateCommand() == b->EvaluateCommand());
+      assert(a->GetBinding("description") == b->GetBinding("description"));
+      assert(a->inputs_.size() == b->inputs_.size());
+      assert(a->implicit_deps_ == b->implicit_deps_);
+      assert(a->order_only_deps_ == b->order_only_deps_);
+      assert(a->outputs_.size() == b->outputs_.size());
+    }
+    assert(direct.paths_.size() == parsed.paths_.size());
+    assert(direct.bindings_.LookupVariable("ld") == parsed.bindings_.LookupVariable("ld"));
+    assert(direct.bindings_.LookupVariable("ldflags") == parsed.bindings_.LookupVariable("ldflags"));
+    assert(direct.LookupNode("hello")->in_edge()->EvaluateCommand() ==
+           "g++  -I./include -O2 build/obj/hello.o build/obj/main.o -o hello");
+    assert(direct.defaults_.size() == 1 && direct.defaults_[0]->path() == "hello");
+    assert(direct.LookupNode("build/obj/hello.o")->in_edge()->EvaluateCommand() ==
+           "g++ -c -I./include -O2 -o build/obj/hello.o src/hello.cpp");
+
+    CppCmake::Make bad;
+    bad.addBuildTarget({.src = "out", .target = "nosuchrule in"});
+    State state;
+    bool bad_loaded = bad.load(&state, &err);
+    assert(!bad_loaded);
+    assert(err == "build out: unknown build rule 'nosuchrule'");
+    std::cout << "testLoad passed.\n";
+  }
+
+  static void testLookup() {
+    CppCmake::Make make;
+    make.addRule({.name = "compile", .command = "$cxx -c $in -o $out", .description = ""});
+    make.addBuildTarget({.src = "a.o", .target = "compile a.cpp"});
+    const CppCmake::Rule& rule = make.getRule("compile");
+    const CppCmake::BuildTarget& target = make.getBuildTarget("a.o");
+    for (int i = 0; i < 1000; ++i) {
+      make.addRule({.name = "r" + std::to_string(i), .command = "true", .description = ""});
+      make.addBuildTarget({.src = std::to_string(i) + ".o", .target = "compile " + std::to_string(i) + ".cpp"});
+    }
+    // References stay valid as more entries are added.
+    assert(&make.getRule("compile") == &rule);
+    assert(rule.command == "$cxx -c $in -o $out");
+    assert(&make.getBuildTarget("a.o") == &target);
+    assert(make.getBuildTarget("999.o").target == "compile 999.cpp");
+
+    assert(make.getVar("missing").empty());
+    assert(make.getRule("missing").name.empty());
+    assert(make.getBuildTarget("missing").target.empty());
+
+    // The first binding of a name is the one returned.
+    make.setVar("cflags", "-O2");
+    make.setVar("cflags", "-O0");
+    assert(make.getVar("cflags") == "-O2");
+    std::cout << "testLookup passed.\n";
+  }
+
+  static void testContentHash() {
+    // The same six strings, as three variables or as two rules.
+    CppCmake::Make vars;
+    vars.setVar("a", "b");
+    vars.setVar("c", "d");
+    vars.setVar("e", "f");
+    CppCmake::Make rules;
+    rules.addRule({.name = "a", .command = "b", .description = "c"});
+    rules.addRule({.name = "d", .command = "e", .description = "f"});
+    assert(vars.contentHash() != rules.contentHash());
+
+    // The same characters, split differently between two fields.
+    CppCmake::Make left;
+    left.addBuildTarget({.src = "ab", .target = "c"});
+    CppCmake::Make right;
+    right.addBuildTarget({.src = "a", .target = "bc"});
+    assert(left.contentHash() != right.contentHash());
+
+    CppCmake::Make same;
+    same.addBuildTarget({.src = "ab", .target = "c"});
+    assert(left.contentHash() == same.contentHash());
+    std::cout << "testContentHash passed.\n";
+  }
+
+  static void testRuleBindings() {
+    CppCmake::Make make;
+    make.addRule({.name = "compile",
+                  .command = "$cxx -c $in -o $out",
+                  .description = "",
+                  .bindings = {{"worker", "compile-worker --persistent"}, {"memory", " 2G"}, {"pool", "console"}}});
+    make.addBuildTarget({.src = "a.o", .target = "compile a.cpp"});
+    make.setDefault("a.o");
+
+    State direct;
+    std::string err;
+    bool loaded = make.load(&direct, &err);
+    assert(loaded);
+    State parsed;
+    ManifestParser parser(&parsed, NULL);
+    bool parsed_ok = parser.ParseTest(make.getManifest(), &err);
+    assert(parsed_ok);
+    Edge* a = direct.edges_[0];
+    Edge* b = parsed.edges_[0];
+    assert(a->GetBinding("worker") == "compile-worker --persistent");
+    assert(a->GetBinding("worker") == b->GetBinding("worker"));
+    assert(a->GetBinding("memory") == "2G");
+    assert(b->GetBinding("memory") == "2G");
+    assert(a->pool()->name() == "console");
+    assert(b->pool()->name() == "console");
+
+    CppCmake::Make plain;
+    plain.addRule({.name = "compile", .command = "$cxx -c $in -o $out", .description = ""});
+    plain.addBuildTarget({.src = "a.o", .target = "compile a.cpp"});
+    plain.setDefault("a.o");
+    assert(plain.contentHash() != make.contentHash());
+
+    // Only the bindings a rule may have are accepted, as by the parser.
+    CppCmake::Make unexpected;
+    unexpected.addRule({.name = "r", .command = "true", .description = "", .bindings = {{"flags", "-O2"}}});
+    State state1;
+    bool unexpected_loaded = unexpected.load(&state1, &err);
+    assert(!unexpected_loaded);
+    assert(err == "rule 'r': unexpected variable 'flags'");
+
+    CppCmake::Make bad_memory;
+    bad_memory.addRule({.name = "r", .command = "true", .description = "", .bindings = {{"memory", "100b"}}});
+    bad_memory.addBuildTarget({.src = "out", .target = "r"});
+    State state2;
+    bool bad_memory_loaded = bad_memory.load(&state2, &err);
+    assert(!bad_memory_loaded);
+    assert(err == "build out: invalid memory size '100b'");
+    std::cout << "testRuleBindings passed.\n";
+  }
+
+  static void testToolCosts() {
+    CppCmake::Make make;
+    make.addRule({.name = "compile", .command = "$cxx -c $in -o $out", .description = ""});
+    make.addBuildTarget({.src = "a.o", .target = "compile a.cpp"});
+    BuildConfig config;
+    CppCmake::CppCmakeMain main("cppcmake", config);
+    std::string err;
+    bool loaded = make.load(&main.state_, &err);
+    assert(loaded);
+    ResourceUsage usage;
+    usage.user_time_millis = 1500;
+    bool recorded = main.build_log_.RecordCommand(main.state_.edges_[0], 0, 2000, 0, usage);
+    assert(recorded);
+
+    // getopt takes argv[-1] to be the tool's name.
+    auto run = [&main](const char* n) {
+      char* argv[] = {const_cast<char*>("costs"), const_cast<char*>("-n"), const_cast<char*>(n), NULL};
+      return main.ToolCosts(NULL, 2, argv + 1);
+    };
+    int ok = run("1");
+    int zero = run("0");
+    int negative = run("-3");
+    int word = run("ten");
+    int trailing = run("5x");
+    assert(ok == 0);
+    assert(zero == 1 && negative == 1 && word == 1 && trailing == 1);
+    std::cout << "testToolCosts passed.\n";
+  }
 };
 
 int main() {
@@ -48,6 +236,11 @@ int main() {
   TestMake::testAddRule();
   TestMake::testAddBuildTarget();
   TestMake::testSetDefault();
+  TestMake::testLoad();
+  TestMake::testLookup();
+  TestMake::testContentHash();
+  TestMake::testRuleBindings();
+  TestMake::testToolCosts();
 
   return 0;
 }